@@ -0,0 +1,6 @@
+#version 330 core
+
+// Light pass: only the depth is kept, there is no color attachment
+void main()
+{
+}
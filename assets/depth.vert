@@ -0,0 +1,13 @@
+#version 330 core
+
+uniform mat4 ciModelViewProjection;
+
+in vec4 ciPosition;
+
+// Center and radius of the atom; the surface is a single instance of radius 0.5 at the origin
+in vec4 iInstance;
+
+void main()
+{
+	gl_Position = ciModelViewProjection * vec4(iInstance.xyz + 2.0f * iInstance.w * ciPosition.xyz, 1.0f);
+}
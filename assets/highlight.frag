@@ -0,0 +1,10 @@
+#version 330 core
+
+uniform vec4 uColor;
+
+out vec4 oColor;
+
+void main()
+{
+	oColor = uColor;
+}
@@ -0,0 +1,14 @@
+#version 330 core
+
+uniform mat4 ciModelViewProjection;
+
+in vec4 ciPosition;
+
+// Center and radius of the selected atom
+in vec4 iInstance;
+
+void main()
+{
+	// The cube spans [-0.5, 0.5]^3
+	gl_Position = ciModelViewProjection * vec4(iInstance.xyz + 2.0f * iInstance.w * ciPosition.xyz, 1.0f);
+}
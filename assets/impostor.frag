@@ -0,0 +1,43 @@
+#version 330 core
+
+uniform mat4 ciProjectionMatrix;
+uniform mat4 ciViewMatrixInverse;
+
+in vec4 vColor;
+in vec3 vViewPos;
+flat in vec3 vCenter;
+flat in float vRadius;
+
+// The light pass only needs the depth of the sphere
+#ifndef DEPTH_ONLY
+#include "common/lighting.glsl"
+
+out vec4 fragColor;
+#endif
+
+void main()
+{
+	// Ray through the fragment, from the eye or, orthographic, straight along -z
+	bool perspective = ciProjectionMatrix[2][3] != 0.0f;
+	vec3 origin = perspective ? vec3(0.0f) : vec3(vViewPos.xy, 0.0f);
+	vec3 direction = perspective ? normalize(vViewPos) : vec3(0.0f, 0.0f, -1.0f);
+
+	// Nearest intersection with the sphere; the corners of the quad miss it
+	vec3 offset = origin - vCenter;
+	float b = dot(offset, direction);
+	float c = dot(offset, offset) - vRadius * vRadius;
+	float discriminant = b * b - c;
+	if (discriminant < 0.0f) discard;
+	vec3 hit = origin + (-b - sqrt(discriminant)) * direction;
+
+	// Depth of the sphere, not of the quad
+	vec4 clip = ciProjectionMatrix * vec4(hit, 1.0f);
+	gl_FragDepth = 0.5f * (gl_DepthRange.diff * clip.z / clip.w + gl_DepthRange.near + gl_DepthRange.far);
+
+#ifndef DEPTH_ONLY
+	// Lighting works in world space; the model matrix is the identity while shading (main pass)
+	vec3 fragPos = vec3(ciViewMatrixInverse * vec4(hit, 1.0f));
+	vec3 fragNormal = mat3(ciViewMatrixInverse) * ((hit - vCenter) / vRadius);
+	fragColor = shade(fragPos, fragNormal, uLightViewProjMatrix * vec4(fragPos, 1.0f), vColor.rgb);
+#endif
+}
@@ -0,0 +1,48 @@
+#version 330 core
+
+uniform mat4 ciModelView;
+uniform mat4 ciProjectionMatrix;
+
+// Corner of the quad, [-1, 1]^2
+in vec4 ciPosition;
+
+// Same instances as the sphere mesh: center and radius, RGBA8 color
+in vec4 iInstance;
+in int iColor;
+
+// Fragment
+out vec4 vColor;
+out vec3 vViewPos;		// on the quad, view space
+flat out vec3 vCenter;		// of the sphere, view space
+flat out float vRadius;
+
+vec4 unpackColor(int color)
+{
+	return vec4((uvec4(uint(color)) >> uvec4(0u, 8u, 16u, 24u)) & 0xFFu) / 255.0f;
+}
+
+void main()
+{
+	vColor = vec4(unpackColor(iColor).rgb, 0.0f);
+
+	// The model view matrix scales uniformly (the depth pass enlarges the atoms)
+	vCenter = vec3(ciModelView * vec4(iInstance.xyz, 1.0f));
+	vRadius = iInstance.w * length(ciModelView[0].xyz);
+
+	// The quad faces the eye through the center and covers the silhouette: with a perspective projection
+	// the rays touching the sphere form a cone, wider than the sphere where it crosses the quad; with an
+	// orthographic one (the light) they are parallel
+	vec3 axis = vec3(0.0f, 0.0f, -1.0f);
+	float halfSize = vRadius;
+	if (ciProjectionMatrix[2][3] != 0.0f)
+	{
+		float d = length(vCenter);
+		axis = vCenter / d;
+		halfSize = vRadius * d / sqrt(max(d * d - vRadius * vRadius, 1e-4f));
+	}
+	vec3 right = normalize(cross(axis, abs(axis.y) < 0.99f ? vec3(0.0f, 1.0f, 0.0f) : vec3(1.0f, 0.0f, 0.0f)));
+	vec3 up = cross(right, axis);
+
+	vViewPos = vCenter + halfSize * (ciPosition.x * right + ciPosition.y * up);
+	gl_Position = ciProjectionMatrix * vec4(vViewPos, 1.0f);
+}
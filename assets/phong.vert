@@ -8,8 +8,9 @@ in vec4 ciPosition;
 in vec3 ciNormal;
 in vec4 ciColor;
 
-in mat4 iModelMatrix;
-in vec3 iColor;
+// Center and radius of the atom, its color as RGBA8
+in vec4 iInstance;
+in int iColor;
 
 // Fragment 
 out vec4 vColor;
@@ -20,17 +21,23 @@ out vec3 vFragNormal;
 out vec4 vDepthMapCoord;
 uniform mat4 uLightViewProjMatrix;
 
+vec4 unpackColor(int color)
+{
+	return vec4((uvec4(uint(color)) >> uvec4(0u, 8u, 16u, 24u)) & 0xFFu) / 255.0f;
+}
+
 void main()
 {
 	// kLightPosition position in eye space (relative to camera)
-	vColor = vec4(iColor, 0.0f);
+	vColor = vec4(unpackColor(iColor).rgb, 0.0f);
 
-	// Fragment postion world space
-	vFragPos = vec3(iModelMatrix * ciPosition);
-	vFragNormal = mat3(transpose(inverse(iModelMatrix))) * ciNormal;
+	// Fragment postion world space; the mesh has a radius of 0.5 and only scales uniformly, so the normal
+	// needs no transform
+	vFragPos = iInstance.xyz + 2.0f * iInstance.w * ciPosition.xyz;
+	vFragNormal = ciNormal;
 
 	// lightViewMatrix Frag
-	vDepthMapCoord = (uLightViewProjMatrix * iModelMatrix) * ciPosition;
+	vDepthMapCoord = uLightViewProjMatrix * vec4(vFragPos, 1.0f);
 
 	gl_Position = ciProjectionMatrix * ciModelView * vec4(vFragPos, 1.0f);
 }
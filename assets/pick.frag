@@ -0,0 +1,11 @@
+#version 330 core
+
+flat in uint vId;
+
+// R32UI attachment
+out uint oId;
+
+void main()
+{
+	oId = vId;
+}
@@ -0,0 +1,17 @@
+#version 330 core
+
+uniform mat4 ciModelViewProjection;
+
+in vec4 ciPosition;
+
+// Center and radius of the atom
+in vec4 iInstance;
+
+// Index of the atom + 1; the id buffer is cleared to 0
+flat out uint vId;
+
+void main()
+{
+	vId = uint(gl_InstanceID) + 1u;
+	gl_Position = ciModelViewProjection * vec4(iInstance.xyz + 2.0f * iInstance.w * ciPosition.xyz, 1.0f);
+}
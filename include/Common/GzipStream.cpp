@@ -0,0 +1,114 @@
+#include "GzipStream.h"
+#include <zlib.h>
+#include <limits>
+
+namespace utils
+{
+
+static z_stream* zstream(void *stream)
+{
+	return static_cast<z_stream*>(stream);
+}
+
+GzipStream::GzipStream(std::string_view compressed)
+	: mCompressed(compressed), mStream(nullptr), mFinished(false), mConsumed(0)
+{
+	z_stream *stream = new z_stream();
+	stream->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(compressed.data()));
+	stream->avail_in = 0;
+
+	// 15 + 32: largest window, detect gzip or zlib header
+	if (inflateInit2(stream, 15 + 32) != Z_OK)
+	{
+		delete stream;
+		throw GzipStreamExc();
+	}
+	mStream = stream;
+}
+
+GzipStream::~GzipStream()
+{
+	if (mStream)
+	{
+		inflateEnd(zstream(mStream));
+		delete zstream(mStream);
+	}
+}
+
+bool GzipStream::isGzip(std::string_view data)
+{
+	return data.size() >= 2 && (unsigned char)data[0] == 0x1f && (unsigned char)data[1] == 0x8b;
+}
+
+size_t GzipStream::read(char *buffer, size_t size)
+{
+	z_stream *stream = zstream(mStream);
+	size_t produced = 0;
+
+	while (produced < size && !mFinished)
+	{
+		// avail_in is 32 bit; feed large inputs in slices
+		if (stream->avail_in == 0)
+		{
+			size_t remaining = mCompressed.size() - mConsumed;
+			if (remaining == 0) throw GzipStreamExc();
+			stream->avail_in = (uInt)std::min<size_t>(remaining, std::numeric_limits<uInt>::max());
+		}
+
+		stream->next_out = reinterpret_cast<Bytef*>(buffer + produced);
+		stream->avail_out = (uInt)std::min<size_t>(size - produced, std::numeric_limits<uInt>::max());
+
+		uInt availableIn = stream->avail_in;
+		uInt availableOut = stream->avail_out;
+		int result = inflate(stream, Z_NO_FLUSH);
+		mConsumed += availableIn - stream->avail_in;
+		produced += availableOut - stream->avail_out;
+
+		if (result == Z_STREAM_END)
+		{
+			// Another member may follow; trailing zero padding is ignored
+			size_t offset = mConsumed;
+			while (offset < mCompressed.size() && mCompressed[offset] == 0) ++offset;
+			if (offset < mCompressed.size() && isGzip(mCompressed.substr(offset)))
+			{
+				mConsumed = offset;
+				stream->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(mCompressed.data() + offset));
+				stream->avail_in = 0;
+				if (inflateReset(stream) != Z_OK) throw GzipStreamExc();
+			}
+			else
+			{
+				mConsumed = mCompressed.size();
+				mFinished = true;
+			}
+		}
+		else if (result != Z_OK && result != Z_BUF_ERROR)
+		{
+			throw GzipStreamExc();
+		}
+		else if (result == Z_BUF_ERROR && stream->avail_in != 0 && stream->avail_out != 0)
+		{
+			throw GzipStreamExc();
+		}
+	}
+
+	return produced;
+}
+
+std::string GzipStream::readAll()
+{
+	std::string text;
+	size_t size = 0;
+	do
+	{
+		// Compressed text usually inflates to a few times its size
+		text.resize(std::max<size_t>(text.size() * 2, mCompressed.size() * 4 + 4096));
+		size += read(&text[size], text.size() - size);
+	}
+	while (size == text.size());
+
+	text.resize(size);
+	return text;
+}
+
+} // namespace utils
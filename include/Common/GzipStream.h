@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <atomic>
+#include <memory>
+
+namespace utils
+{
+
+typedef std::shared_ptr<class GzipStream> GzipStreamRef;
+
+/*
+	Incremental inflate of gzip (or zlib) data held in memory, e.g. a MappedFile.
+	Concatenated gzip members are decoded one after another, like gunzip does.
+*/
+class GzipStream
+{
+public:
+	explicit GzipStream(std::string_view compressed);
+	~GzipStream();
+
+	GzipStream(const GzipStream&) = delete;
+	GzipStream& operator=(const GzipStream&) = delete;
+
+	// True if data starts with the gzip magic bytes
+	static bool isGzip(std::string_view data);
+
+	// Decompresses up to size bytes into buffer; returns 0 at the end of the stream
+	size_t read(char *buffer, size_t size);
+	// Decompresses the rest of the stream
+	std::string readAll();
+protected:
+	std::string_view	mCompressed;
+	void*			mStream;	// z_stream
+	bool			mFinished;
+	std::atomic<size_t>	mConsumed;
+public: // Mutators
+	// Compressed bytes consumed so far; safe to poll from other threads
+	size_t			getConsumed() const		{ return mConsumed; }
+	size_t			getCompressedSize() const	{ return mCompressed.size(); }
+};
+
+class GzipStreamExc : public std::exception {
+public:
+	virtual const char* what() const throw() { return "GzipStream exception: corrupt or truncated compressed data"; }
+};
+
+} // namespace utils
@@ -0,0 +1,138 @@
+#include "InstanceBuffer.h"
+#include <algorithm>
+
+namespace utils
+{
+
+static const size_t kMinCapacity = 256;
+// Clean gaps up to this size are sent along with the ranges around them; one call costs more than the bytes
+static const size_t kMergeGapBytes = 4096;
+// Beyond this many ranges they collapse into their hull
+static const size_t kMaxDirtyRanges = 64;
+
+// ---------------------------------------------------------------------
+
+InstanceBufferRef InstanceBuffer::create(size_t elementSize, GLenum usage)
+{
+	return InstanceBufferRef(new InstanceBuffer(elementSize, usage));
+}
+
+InstanceBuffer::InstanceBuffer(size_t elementSize, GLenum usage)
+	: mUsage(usage), mElementSize(elementSize), mCount(0), mCapacity(kMinCapacity), mUploadedBytes(0)
+{
+	mVbo = ci::gl::Vbo::create(GL_ARRAY_BUFFER, mCapacity * mElementSize, nullptr, mUsage);
+}
+
+void InstanceBuffer::reserve(size_t count)
+{
+	if (count <= mCapacity) return;
+
+	// Same buffer object, new storage: whatever references the object keeps working
+	mCapacity = std::max(count, mCapacity * 2);
+	mVbo->bufferData(mCapacity * mElementSize, nullptr, mUsage);
+}
+
+void InstanceBuffer::resize(size_t count)
+{
+	const size_t capacity = mCapacity, previous = mCount;
+	reserve(count);
+	mData.resize(count * mElementSize);
+	mCount = count;
+
+	// Ranges past the end are gone
+	while (!mDirty.empty() && mDirty.back().first >= count) mDirty.pop_back();
+	if (!mDirty.empty()) mDirty.back().second = std::min(mDirty.back().second, count);
+
+	if (mCapacity != capacity) markAllDirty();
+	else if (count > previous) markDirty(previous, count - previous);
+}
+
+void InstanceBuffer::write(size_t first, size_t count, const void *data)
+{
+	count = std::min(count, mCount - std::min(first, mCount));
+	if (count == 0) return;
+
+	std::copy_n(static_cast<const uint8_t*>(data), count * mElementSize, mData.begin() + first * mElementSize);
+	markDirty(first, count);
+}
+
+void InstanceBuffer::markDirty(size_t first, size_t count)
+{
+	size_t last = first + std::min(count, mCount - std::min(first, mCount));
+	if (last <= first) return;
+
+	const size_t gap = std::max<size_t>(kMergeGapBytes / mElementSize, 1);
+
+	// Writes in increasing order (a pass over the atoms) extend the last range
+	if (!mDirty.empty() && first >= mDirty.back().first)
+	{
+		std::pair<size_t, size_t> &back = mDirty.back();
+		if (first <= back.second + gap)
+		{
+			back.second = std::max(back.second, last);
+			return;
+		}
+		mDirty.emplace_back(first, last);
+	}
+	else
+	{
+		// Merge with every range overlapping [first - gap, last + gap)
+		auto begin = std::lower_bound(mDirty.begin(), mDirty.end(), first, [gap](const std::pair<size_t, size_t> &range, size_t value) { return range.second + gap < value; });
+		auto end = begin;
+		while (end != mDirty.end() && end->first <= last + gap)
+		{
+			first = std::min(first, end->first);
+			last = std::max(last, end->second);
+			++end;
+		}
+		begin = mDirty.erase(begin, end);
+		mDirty.emplace(begin, first, last);
+	}
+
+	if (mDirty.size() > kMaxDirtyRanges)
+	{
+		const std::pair<size_t, size_t> hull(mDirty.front().first, mDirty.back().second);
+		mDirty.assign(1, hull);
+	}
+}
+
+size_t InstanceBuffer::getDirtyBytes() const
+{
+	size_t count = 0;
+	for (const std::pair<size_t, size_t> &range : mDirty) count += range.second - range.first;
+	return count * mElementSize;
+}
+
+size_t InstanceBuffer::upload(size_t maxBytes)
+{
+	if (mDirty.empty()) return 0;
+
+	// Most of the buffer changed and all of it fits: orphan the storage and send everything in one call
+	const size_t bytes = mCount * mElementSize;
+	if (bytes <= maxBytes && getDirtyBytes() * 2 >= bytes)
+	{
+		mVbo->bufferData(mCapacity * mElementSize, nullptr, mUsage);
+		mVbo->bufferSubData(0, bytes, mData.data());
+		mDirty.clear();
+		mUploadedBytes += bytes;
+		return bytes;
+	}
+
+	// Otherwise the ranges, front to back; whole elements only
+	const size_t maxCount = maxBytes / mElementSize;
+	size_t sent = 0;
+	while (!mDirty.empty() && sent < maxCount)
+	{
+		std::pair<size_t, size_t> &range = mDirty.front();
+		const size_t count = std::min(range.second - range.first, maxCount - sent);
+		mVbo->bufferSubData(range.first * mElementSize, count * mElementSize, mData.data() + range.first * mElementSize);
+		sent += count;
+
+		range.first += count;
+		if (range.first == range.second) mDirty.erase(mDirty.begin());
+	}
+	mUploadedBytes += sent * mElementSize;
+	return sent * mElementSize;
+}
+
+} // namespace utils
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "cinder/gl/Vbo.h"
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+namespace utils
+{
+
+typedef std::shared_ptr<class InstanceBuffer> InstanceBufferRef;
+
+/*
+	Array of per instance attributes on the GPU, with the CPU copy it is written through.
+	The buffer object is created once and lives as long as the InstanceBuffer, so meshes and batches built on
+	it stay valid: storage grows geometrically inside the same object, and writes only mark element ranges
+	dirty. upload() sends the dirty ranges; when most of the buffer changed it orphans the storage instead, so
+	the driver hands out fresh memory rather than waiting for draws still reading the old contents.
+*/
+class InstanceBuffer
+{
+public:
+	static InstanceBufferRef create(size_t elementSize, GLenum usage = GL_DYNAMIC_DRAW);
+
+	InstanceBuffer(const InstanceBuffer&) = delete;
+	InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+
+	// Number of elements; new elements are dirty. Capacity never shrinks.
+	void resize(size_t count);
+	void clear()						{ resize(0); }
+
+	// Copies count elements to [first, first + count) and marks them dirty
+	void write(size_t first, size_t count, const void *data);
+	template<typename T>
+	void set(size_t index, const T &value)			{ write(index, 1, &value); }
+
+	// After writing through getData(), mark what changed
+	void markDirty(size_t first, size_t count);
+	void markAllDirty()					{ markDirty(0, mCount); }
+
+	// Sends at most maxBytes of the dirty ranges, front to back; returns the number of bytes sent.
+	// The buffer is complete on the GPU once isDirty() is false.
+	size_t upload(size_t maxBytes = SIZE_MAX);
+protected:
+	InstanceBuffer(size_t elementSize, GLenum usage);
+
+	void reserve(size_t count);
+
+	ci::gl::VboRef			mVbo;
+	GLenum				mUsage;
+	size_t				mElementSize;
+	size_t				mCount;
+	size_t				mCapacity;		// elements allocated on the GPU
+	std::vector<uint8_t>		mData;
+
+	// Disjoint, sorted element ranges [first, second) not yet on the GPU
+	std::vector<std::pair<size_t, size_t>>	mDirty;
+	size_t				mUploadedBytes;		// since creation
+public: // Mutators
+	const ci::gl::VboRef		&getVbo() const			{ return mVbo; }
+	size_t				getElementSize() const		{ return mElementSize; }
+	size_t				getCount() const		{ return mCount; }
+	size_t				getCapacity() const		{ return mCapacity; }
+	bool				empty() const			{ return mCount == 0; }
+	bool				isDirty() const			{ return !mDirty.empty(); }
+	size_t				getDirtyBytes() const;
+	size_t				getUploadedBytes() const	{ return mUploadedBytes; }
+
+	void				*getData()			{ return mData.data(); }
+	const void			*getData() const		{ return mData.data(); }
+	template<typename T> T		*getData()			{ return reinterpret_cast<T*>(mData.data()); }
+	template<typename T> const T	*getData() const		{ return reinterpret_cast<const T*>(mData.data()); }
+};
+
+} // namespace utils
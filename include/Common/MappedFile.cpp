@@ -0,0 +1,127 @@
+#include "MappedFile.h"
+
+#if defined( _WIN32 )
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <windows.h>
+#else
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+namespace utils
+{
+
+MappedFile::MappedFile()
+	: mData(nullptr), mSize(0), mFileHandle(nullptr), mMappingHandle(nullptr)
+{
+}
+
+MappedFile::~MappedFile()
+{
+	unmap();
+}
+
+MappedFileRef MappedFile::create(const ci::DataSourceRef dataRef)
+{
+	MappedFileRef result(new MappedFile());
+
+	if (dataRef->isFilePath() && !dataRef->getFilePath().empty())
+	{
+		result->map(dataRef->getFilePath());
+	}
+	else
+	{
+		// No file behind the source; keep its buffer alive instead
+		try { result->mBuffer = dataRef->getBuffer(); }
+		catch (...) { throw MappedFileExc(); }
+
+		result->mData = static_cast<const char*>(result->mBuffer->getData());
+		result->mSize = result->mBuffer->getSize();
+	}
+
+	return result;
+}
+
+MappedFileRef MappedFile::create(const ci::fs::path &path)
+{
+	MappedFileRef result(new MappedFile());
+	result->map(path);
+	return result;
+}
+
+#if defined( _WIN32 )
+
+void MappedFile::map(const ci::fs::path &path)
+{
+	HANDLE file = ::CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) throw MappedFileExc();
+	mFileHandle = file;
+
+	LARGE_INTEGER size;
+	if (!::GetFileSizeEx(file, &size)) { unmap(); throw MappedFileExc(); }
+	mSize = (size_t)size.QuadPart;
+
+	// Empty files can not be mapped
+	if (mSize == 0) return;
+
+	HANDLE mapping = ::CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL) { unmap(); throw MappedFileExc(); }
+	mMappingHandle = mapping;
+
+	mData = static_cast<const char*>(::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (mData == nullptr) { unmap(); throw MappedFileExc(); }
+}
+
+void MappedFile::unmap()
+{
+	if (mBuffer) { mBuffer.reset(); mData = nullptr; mSize = 0; return; }
+
+	if (mData)		::UnmapViewOfFile(mData);
+	if (mMappingHandle)	::CloseHandle(mMappingHandle);
+	if (mFileHandle)	::CloseHandle(mFileHandle);
+
+	mData = nullptr;
+	mSize = 0;
+	mMappingHandle = nullptr;
+	mFileHandle = nullptr;
+}
+
+#else
+
+void MappedFile::map(const ci::fs::path &path)
+{
+	int file = ::open(path.c_str(), O_RDONLY);
+	if (file < 0) throw MappedFileExc();
+
+	struct stat info;
+	if (::fstat(file, &info) != 0) { ::close(file); throw MappedFileExc(); }
+	mSize = (size_t)info.st_size;
+
+	// Empty files can not be mapped
+	if (mSize == 0) { ::close(file); return; }
+
+	void *data = ::mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, file, 0);
+	::close(file);
+	if (data == MAP_FAILED) { mSize = 0; throw MappedFileExc(); }
+
+	// The parser walks the file front to back
+	::madvise(data, mSize, MADV_SEQUENTIAL);
+	mData = static_cast<const char*>(data);
+}
+
+void MappedFile::unmap()
+{
+	if (mBuffer) { mBuffer.reset(); mData = nullptr; mSize = 0; return; }
+
+	if (mData) ::munmap(const_cast<char*>(mData), mSize);
+
+	mData = nullptr;
+	mSize = 0;
+}
+
+#endif
+
+} // namespace utils
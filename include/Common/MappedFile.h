@@ -0,0 +1,52 @@
+#pragma once
+
+#include "cinder/DataSource.h"
+#include <string_view>
+#include <memory>
+
+namespace utils
+{
+
+typedef std::shared_ptr<class MappedFile> MappedFileRef;
+
+/*
+	Read-only view of a whole data source.
+	Files on disk are memory-mapped, other sources (resources, urls) fall back to the Buffer of the DataSource.
+*/
+class MappedFile
+{
+public:
+	static MappedFileRef create(const ci::DataSourceRef dataRef);
+	static MappedFileRef create(const ci::fs::path &path);
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+protected:
+	MappedFile();
+
+	void map(const ci::fs::path &path);
+	void unmap();
+
+	const char*		mData;
+	size_t			mSize;
+
+	// Platform handles of the mapping
+	void*			mFileHandle;
+	void*			mMappingHandle;
+
+	// Fallback storage for sources without file path
+	ci::BufferRef		mBuffer;
+public: // Mutators
+	const char		*getData() const		{ return mData; }
+	size_t			getSize() const			{ return mSize; }
+	std::string_view	getView() const			{ return std::string_view(mData, mSize); }
+	bool			isMapped() const		{ return mBuffer == nullptr; }
+};
+
+class MappedFileExc : public std::exception {
+public:
+	virtual const char* what() const throw() { return "MappedFile exception: could not map the specified source"; }
+};
+
+} // namespace utils
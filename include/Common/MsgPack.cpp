@@ -0,0 +1,169 @@
+#include "MsgPack.h"
+#include <cstring>
+
+namespace utils
+{
+namespace msgpack
+{
+
+const Value* Value::find(std::string_view key) const
+{
+	for (const auto &member : map)
+		if (member.first == key) return &member.second;
+	return nullptr;
+}
+
+int64_t Value::asInt() const
+{
+	if (type == INTEGER)	return integer;
+	if (type == REAL)	return (int64_t)real;
+	throw MsgPackExc();
+}
+
+double Value::asReal() const
+{
+	if (type == REAL)	return real;
+	if (type == INTEGER)	return (double)integer;
+	throw MsgPackExc();
+}
+
+/*
+	Decoder; MessagePack stores numbers big-endian
+*/
+
+class Decoder
+{
+public:
+	explicit Decoder(std::string_view data) : mData(data), mOffset(0) {}
+
+	void decode(Value &value, int depth);
+protected:
+	const uint8_t* take(size_t count)
+	{
+		if (mData.size() - mOffset < count) throw MsgPackExc();
+		const uint8_t *bytes = reinterpret_cast<const uint8_t*>(mData.data() + mOffset);
+		mOffset += count;
+		return bytes;
+	}
+
+	uint64_t readBigEndian(size_t count)
+	{
+		const uint8_t *bytes = take(count);
+		uint64_t result = 0;
+		for (size_t i = 0; i < count; ++i) result = (result << 8) | bytes[i];
+		return result;
+	}
+
+	std::string_view readBytes(size_t count)
+	{
+		const uint8_t *bytes = take(count);
+		return std::string_view(reinterpret_cast<const char*>(bytes), count);
+	}
+
+	void readArray(Value &value, size_t count, int depth);
+	void readMap(Value &value, size_t count, int depth);
+
+	std::string_view	mData;
+	size_t			mOffset;
+};
+
+void Decoder::readArray(Value &value, size_t count, int depth)
+{
+	// Every element takes at least one byte
+	if (count > mData.size() - mOffset) throw MsgPackExc();
+
+	value.type = Value::ARRAY;
+	value.array.resize(count);
+	for (size_t i = 0; i < count; ++i) decode(value.array[i], depth + 1);
+}
+
+void Decoder::readMap(Value &value, size_t count, int depth)
+{
+	if (count > mData.size() - mOffset) throw MsgPackExc();
+
+	value.type = Value::MAP;
+	value.map.resize(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		Value key;
+		decode(key, depth + 1);
+		if (key.type != Value::STRING) throw MsgPackExc();
+
+		value.map[i].first = key.bytes;
+		decode(value.map[i].second, depth + 1);
+	}
+}
+
+void Decoder::decode(Value &value, int depth)
+{
+	if (depth > 64) throw MsgPackExc();
+
+	const uint8_t tag = *take(1);
+
+	// Fixed size formats
+	if (tag <= 0x7f)		{ value.type = Value::INTEGER; value.integer = tag; return; }
+	if (tag >= 0xe0)		{ value.type = Value::INTEGER; value.integer = (int8_t)tag; return; }
+	if ((tag & 0xf0) == 0x80)	{ readMap(value, tag & 0x0f, depth); return; }
+	if ((tag & 0xf0) == 0x90)	{ readArray(value, tag & 0x0f, depth); return; }
+	if ((tag & 0xe0) == 0xa0)	{ value.type = Value::STRING; value.bytes = readBytes(tag & 0x1f); return; }
+
+	switch (tag)
+	{
+	case 0xc0: value.type = Value::NIL; return;
+	case 0xc2: value.type = Value::BOOLEAN; value.boolean = false; return;
+	case 0xc3: value.type = Value::BOOLEAN; value.boolean = true; return;
+
+	case 0xc4: value.type = Value::BINARY; value.bytes = readBytes(readBigEndian(1)); return;
+	case 0xc5: value.type = Value::BINARY; value.bytes = readBytes(readBigEndian(2)); return;
+	case 0xc6: value.type = Value::BINARY; value.bytes = readBytes(readBigEndian(4)); return;
+
+	case 0xca:
+	{
+		uint32_t bits = (uint32_t)readBigEndian(4);
+		float real;
+		std::memcpy(&real, &bits, sizeof(real));
+		value.type = Value::REAL; value.real = real;
+		return;
+	}
+	case 0xcb:
+	{
+		uint64_t bits = readBigEndian(8);
+		double real;
+		std::memcpy(&real, &bits, sizeof(real));
+		value.type = Value::REAL; value.real = real;
+		return;
+	}
+
+	case 0xcc: value.type = Value::INTEGER; value.integer = (int64_t)readBigEndian(1); return;
+	case 0xcd: value.type = Value::INTEGER; value.integer = (int64_t)readBigEndian(2); return;
+	case 0xce: value.type = Value::INTEGER; value.integer = (int64_t)readBigEndian(4); return;
+	case 0xcf: value.type = Value::INTEGER; value.integer = (int64_t)readBigEndian(8); return;
+	case 0xd0: value.type = Value::INTEGER; value.integer = (int8_t)readBigEndian(1); return;
+	case 0xd1: value.type = Value::INTEGER; value.integer = (int16_t)readBigEndian(2); return;
+	case 0xd2: value.type = Value::INTEGER; value.integer = (int32_t)readBigEndian(4); return;
+	case 0xd3: value.type = Value::INTEGER; value.integer = (int64_t)readBigEndian(8); return;
+
+	case 0xd9: value.type = Value::STRING; value.bytes = readBytes(readBigEndian(1)); return;
+	case 0xda: value.type = Value::STRING; value.bytes = readBytes(readBigEndian(2)); return;
+	case 0xdb: value.type = Value::STRING; value.bytes = readBytes(readBigEndian(4)); return;
+
+	case 0xdc: readArray(value, readBigEndian(2), depth); return;
+	case 0xdd: readArray(value, readBigEndian(4), depth); return;
+	case 0xde: readMap(value, readBigEndian(2), depth); return;
+	case 0xdf: readMap(value, readBigEndian(4), depth); return;
+	}
+
+	// Extension types are not used by BinaryCIF
+	throw MsgPackExc();
+}
+
+Value parse(std::string_view data)
+{
+	Value root;
+	Decoder decoder(data);
+	decoder.decode(root, 0);
+	return root;
+}
+
+} // namespace msgpack
+} // namespace utils
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string_view>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <exception>
+
+namespace utils
+{
+namespace msgpack
+{
+
+/*
+	Minimal MessagePack document. Strings and binaries are views into the source data.
+*/
+struct Value
+{
+	enum Type { NIL, BOOLEAN, INTEGER, REAL, STRING, BINARY, ARRAY, MAP };
+
+	Type						type = NIL;
+	bool						boolean = false;
+	int64_t						integer = 0;
+	double						real = 0.0;
+	std::string_view				bytes;		// STRING, BINARY
+	std::vector<Value>				array;		// ARRAY
+	std::vector<std::pair<std::string_view, Value>>	map;		// MAP (string keys only)
+
+	// Member of a map, nullptr if missing
+	const Value*	find(std::string_view key) const;
+
+	// Numeric value of INTEGER or REAL
+	int64_t		asInt() const;
+	double		asReal() const;
+};
+
+Value parse(std::string_view data);
+
+class MsgPackExc : public std::exception {
+public:
+	virtual const char* what() const throw() { return "MessagePack exception: malformed data"; }
+};
+
+} // namespace msgpack
+} // namespace utils
@@ -0,0 +1,116 @@
+#include "PickBuffer.h"
+#include "cinder/gl/scoped.h"
+#include <algorithm>
+#include <cstring>
+
+namespace utils
+{
+
+// Readbacks in flight at once; more requests wait for the oldest to finish
+static const size_t kMaxReadbacks = 3;
+
+// ---------------------------------------------------------------------
+
+PickBufferRef PickBuffer::create(const ci::ivec2 &size)
+{
+	return PickBufferRef(new PickBuffer(size));
+}
+
+PickBuffer::PickBuffer(const ci::ivec2 &size)
+{
+	const ci::ivec2 pixels = glm::max(size, ci::ivec2(1));
+	ci::gl::Fbo::Format format;
+	format.disableColor();
+	format.attachment(GL_COLOR_ATTACHMENT0, ci::gl::Renderbuffer::create(pixels.x, pixels.y, GL_R32UI));
+	format.depthBuffer();
+	mFbo = ci::gl::Fbo::create(pixels.x, pixels.y, format);
+}
+
+void PickBuffer::request(const ci::Area &area, int tag)
+{
+	ci::Area clipped = area.canonicalized();
+	clipped.clipBy(mFbo->getBounds());
+	if (clipped.getWidth() <= 0 || clipped.getHeight() <= 0) return;
+
+	for (Request &pending : mPending)
+	{
+		if (pending.tag != tag) continue;
+		pending.area = clipped;
+		return;
+	}
+	mPending.push_back({ clipped, tag });
+}
+
+void PickBuffer::render(const std::function<void()> &draw)
+{
+	if (mPending.empty() || mInFlight.size() >= kMaxReadbacks) return;
+
+	// One pass covers all pending areas
+	ci::Area bounds = mPending.front().area;
+	for (const Request &pending : mPending) bounds.include(pending.area);
+
+	ci::gl::ScopedFramebuffer scopedFbo(mFbo);
+	ci::gl::ScopedViewport scopedViewport(ci::ivec2(0), mFbo->getSize());
+	ci::gl::ScopedScissor scopedScissor(bounds.x1, bounds.y1, bounds.getWidth(), bounds.getHeight());
+
+	const GLuint empty[4] = { 0, 0, 0, 0 };
+	glClearBufferuiv(GL_COLOR, 0, empty);
+	glClear(GL_DEPTH_BUFFER_BIT);
+	draw();
+
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	size_t taken = 0;
+	for (; taken < mPending.size() && mInFlight.size() < kMaxReadbacks; ++taken)
+	{
+		const Request &pending = mPending[taken];
+		const size_t bytes = (size_t)pending.area.calcArea() * sizeof(uint32_t);
+
+		// A free buffer that holds the area, or a new one
+		ci::gl::PboRef pbo;
+		auto fit = std::find_if(mFreePbos.begin(), mFreePbos.end(), [bytes](const ci::gl::PboRef &free) { return free->getSize() >= bytes; });
+		if (fit != mFreePbos.end())
+		{
+			pbo = *fit;
+			mFreePbos.erase(fit);
+		}
+		else
+		{
+			pbo = ci::gl::Pbo::create(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+		}
+
+		// Returns at once: the copy goes into the buffer object, not client memory
+		ci::gl::ScopedBuffer scopedPbo(pbo);
+		glReadPixels(pending.area.x1, pending.area.y1, pending.area.getWidth(), pending.area.getHeight(), GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+		mInFlight.push_back({ pending, pbo, ci::gl::Sync::create() });
+	}
+	mPending.erase(mPending.begin(), mPending.begin() + taken);
+}
+
+bool PickBuffer::poll(Result &result)
+{
+	if (mInFlight.empty()) return false;
+
+	// Readbacks finish in order; the flush bit makes sure the fence gets to the GPU at all
+	Readback &front = mInFlight.front();
+	const GLenum status = front.fence->clientWaitSync(GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) return false;
+
+	const size_t count = (size_t)front.request.area.calcArea();
+	result.area = front.request.area;
+	result.tag = front.request.tag;
+	result.ids.assign(count, 0);
+	if (const void *data = front.pbo->mapBufferRange(0, count * sizeof(uint32_t), GL_MAP_READ_BIT))
+	{
+		std::memcpy(result.ids.data(), data, count * sizeof(uint32_t));
+		front.pbo->unmap();
+	}
+
+	// The pool keeps as many buffers as can be in flight, the largest ones
+	mFreePbos.push_back(front.pbo);
+	if (mFreePbos.size() > kMaxReadbacks)
+		mFreePbos.erase(std::min_element(mFreePbos.begin(), mFreePbos.end(), [](const ci::gl::PboRef &a, const ci::gl::PboRef &b) { return a->getSize() < b->getSize(); }));
+	mInFlight.pop_front();
+	return true;
+}
+
+} // namespace utils
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "cinder/gl/Fbo.h"
+#include "cinder/gl/Pbo.h"
+#include "cinder/gl/Sync.h"
+#include "cinder/Area.h"
+#include <functional>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <cstdint>
+
+namespace utils
+{
+
+typedef std::shared_ptr<class PickBuffer> PickBufferRef;
+
+/*
+	Integer id buffer for picking: the pick pass writes an id per instance (index + 1, 0 where nothing was drawn)
+	into an R32UI attachment. Nothing is rendered unless an area was requested, and the pass is limited to the
+	requested areas by the scissor test. The ids are read back asynchronously: glReadPixels into a pixel buffer
+	object with a fence behind it, mapped once the fence signalled, usually a frame later, so reading never
+	stalls the pipeline.
+*/
+class PickBuffer
+{
+public:
+	struct Result
+	{
+		ci::Area		area;		// pixels of the buffer, origin lower left
+		int			tag;
+		std::vector<uint32_t>	ids;		// row after row, bottom up
+	};
+
+	static PickBufferRef create(const ci::ivec2 &size);
+
+	PickBuffer(const PickBuffer&) = delete;
+	PickBuffer& operator=(const PickBuffer&) = delete;
+
+	// Queues an area, clipped to the buffer; a pending request with the same tag is replaced, so hovering can
+	// ask every frame
+	void request(const ci::Area &area, int tag);
+
+	// Renders the pending areas with draw() while the buffer is bound, cleared and scissored, and starts
+	// their readback. Does nothing without requests or while all readbacks are in flight.
+	void render(const std::function<void()> &draw);
+
+	// Takes the oldest finished readback; never waits
+	bool poll(Result &result);
+protected:
+	explicit PickBuffer(const ci::ivec2 &size);
+
+	struct Request
+	{
+		ci::Area		area;
+		int			tag;
+	};
+	struct Readback
+	{
+		Request			request;
+		ci::gl::PboRef		pbo;
+		ci::gl::SyncRef		fence;
+	};
+
+	ci::gl::FboRef			mFbo;
+	std::vector<Request>		mPending;
+	std::deque<Readback>		mInFlight;
+	std::vector<ci::gl::PboRef>	mFreePbos;
+public: // Mutators
+	ci::ivec2			getSize() const			{ return mFbo->getSize(); }
+	bool				hasRequests() const		{ return !mPending.empty(); }
+	bool				isReading() const		{ return !mInFlight.empty(); }
+};
+
+} // namespace utils
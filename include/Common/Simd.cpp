@@ -0,0 +1,692 @@
+#include "Simd.h"
+#include <atomic>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cstdint>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define UTILS_SIMD_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define UTILS_TARGET_SSE2
+#define UTILS_TARGET_AVX2
+#else
+#include <cpuid.h>
+#define UTILS_TARGET_SSE2	__attribute__((target("sse2")))
+#define UTILS_TARGET_AVX2	__attribute__((target("avx2")))
+#endif
+#endif
+
+namespace utils
+{
+namespace simd
+{
+
+static_assert(sizeof(glm::vec3) == 3 * sizeof(float), "points are read as packed float triples");
+static_assert(sizeof(glm::mat4) == 16 * sizeof(float), "matrices are written as 16 floats, column after column");
+
+namespace
+{
+
+// Sums run in float over blocks of this many elements and are carried in double
+const size_t kBlockSize = 4096;
+
+struct Kernels
+{
+	void (*transform)(const glm::mat4 &matrix, float *x, float *y, float *z, size_t count);
+	void (*transformPoints)(const glm::mat4 &matrix, glm::vec3 *points, size_t count);
+	void (*computeBounds)(const float *x, const float *y, const float *z, size_t count, glm::vec3 &lower, glm::vec3 &upper);
+	glm::dvec3 (*sum)(const float *x, const float *y, const float *z, size_t count);
+	double (*sumSquares)(const float *x, const float *y, const float *z, size_t count, const glm::vec3 &center);
+	void (*instances)(const float *x, const float *y, const float *z, const float *radii, float scale, size_t count, glm::vec4 *instances);
+	size_t (*markInside)(const float *x, const float *y, const float *z, size_t count, const glm::vec3 &center, float radius, uint32_t *inside);
+	void (*covariance)(const float *ax, const float *ay, const float *az, const float *bx, const float *by, const float *bz, size_t count, double *covariance);
+	void (*distances)(const float *x, const float *y, const float *z, size_t count, const glm::vec3 &point, float *distances);
+};
+
+/*
+	Scalar
+*/
+
+void transformScalar(const glm::mat4 &matrix, float *x, float *y, float *z, size_t count)
+{
+	const float m00 = matrix[0][0], m01 = matrix[0][1], m02 = matrix[0][2];
+	const float m10 = matrix[1][0], m11 = matrix[1][1], m12 = matrix[1][2];
+	const float m20 = matrix[2][0], m21 = matrix[2][1], m22 = matrix[2][2];
+	const float m30 = matrix[3][0], m31 = matrix[3][1], m32 = matrix[3][2];
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		const float px = x[i], py = y[i], pz = z[i];
+		x[i] = m00 * px + m10 * py + m20 * pz + m30;
+		y[i] = m01 * px + m11 * py + m21 * pz + m31;
+		z[i] = m02 * px + m12 * py + m22 * pz + m32;
+	}
+}
+
+void transformPointsScalar(const glm::mat4 &matrix, glm::vec3 *points, size_t count)
+{
+	// Locals, as the stores could alias the matrix otherwise
+	const float m00 = matrix[0][0], m01 = matrix[0][1], m02 = matrix[0][2];
+	const float m10 = matrix[1][0], m11 = matrix[1][1], m12 = matrix[1][2];
+	const float m20 = matrix[2][0], m21 = matrix[2][1], m22 = matrix[2][2];
+	const float m30 = matrix[3][0], m31 = matrix[3][1], m32 = matrix[3][2];
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		const glm::vec3 p = points[i];
+		points[i] = glm::vec3(m00 * p.x + m10 * p.y + m20 * p.z + m30, m01 * p.x + m11 * p.y + m21 * p.z + m31, m02 * p.x + m12 * p.y + m22 * p.z + m32);
+	}
+}
+
+void computeBoundsScalar(const float *x, const float *y, const float *z, size_t count, glm::vec3 &lower, glm::vec3 &upper)
+{
+	// std::min(a, b) keeps a if b is NaN
+	for (size_t i = 0; i < count; ++i)
+	{
+		lower.x = std::min(lower.x, x[i]); upper.x = std::max(upper.x, x[i]);
+		lower.y = std::min(lower.y, y[i]); upper.y = std::max(upper.y, y[i]);
+		lower.z = std::min(lower.z, z[i]); upper.z = std::max(upper.z, z[i]);
+	}
+}
+
+glm::dvec3 sumScalar(const float *x, const float *y, const float *z, size_t count)
+{
+	glm::dvec3 total(0.0);
+	for (size_t begin = 0; begin < count; begin += kBlockSize)
+	{
+		float sx = 0.0f, sy = 0.0f, sz = 0.0f;
+		for (size_t i = begin, end = std::min(count, begin + kBlockSize); i < end; ++i)
+		{
+			sx += x[i];
+			sy += y[i];
+			sz += z[i];
+		}
+		total += glm::dvec3(sx, sy, sz);
+	}
+	return total;
+}
+
+double sumSquaresScalar(const float *x, const float *y, const float *z, size_t count, const glm::vec3 &center)
+{
+	double total = 0.0;
+	for (size_t begin = 0; begin < count; begin += kBlockSize)
+	{
+		float sum = 0.0f;
+		for (size_t i = begin, end = std::min(count, begin + kBlockSize); i < end; ++i)
+		{
+			const float dx = x[i] - center.x, dy = y[i] - center.y, dz = z[i] - center.z;
+			sum += dx * dx + dy * dy + dz * dz;
+		}
+		total += sum;
+	}
+	return total;
+}
+
+void instancesScalar(const float *x, const float *y, const float *z, const float *radii, float scale, size_t count, glm::vec4 *instances)
+{
+	for (size_t i = 0; i < count; ++i)
+		instances[i] = glm::vec4(x[i], y[i], z[i], radii[i] * scale);
+}
+
+size_t markInsideScalar(const float *x, const float *y, const float *z, size_t count, const glm::vec3 &center, float radius, uint32_t *inside)
+{
+	const float radius2 = radius * radius;
+	size_t numInside = 0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		const float dx = x[i] - center.x, dy = y[i] - center.y, dz = z[i] - center.z;
+		if (dx * dx + dy * dy + dz * dz < radius2) inside[i] = ~0u;
+		numInside += inside[i] != 0;
+	}
+	return numInside;
+}
+
+void covarianceScalar(const float *ax, const float *ay, const float *az, const float *bx, const float *by, const float *bz, size_t count, double *covariance)
+{
+	for (size_t begin = 0; begin < count; begin += kBlockSize)
+	{
+		float s[9] = {};
+		for (size_t i = begin, end = std::min(count, begin + kBlockSize); i < end; ++i)
+		{
+			s[0] += ax[i] * bx[i]; s[1] += ax[i] * by[i]; s[2] += ax[i] * bz[i];
+			s[3] += ay[i] * bx[i]; s[4] += ay[i] * by[i]; s[5] += ay[i] * bz[i];
+			s[6] += az[i] * bx[i]; s[7] += az[i] * by[i]; s[8] += az[i] * bz[i];
+		}
+		for (int k = 0; k < 9; ++k) covariance[k] += s[k];
+	}
+}
+
+void distancesScalar(const float *x, const float *y, const float *z, size_t count, const glm::vec3 &point, float *distances)
+{
+	for (size_t i = 0; i < count; ++i)
+	{
+		const float dx = x[i] - point.x, dy = y[i] - point.y, dz = z[i] - point.z;
+		distances[i] = std::sqrt(dx * dx + dy * dy + dz * dz);
+	}
+}
+
+const Kernels kScalar = { transformScalar, transformPointsScalar, computeBoundsScalar, sumScalar, sumSquaresScalar, instancesScalar, markInsideScalar, covarianceScalar, distancesScalar };
+
+#if defined(UTILS_SIMD_X86)
+
+/*
+	SSE2, 4 atoms per step
+*/
+
+// Set bits of the 4 bit lane masks
+const uint8_t kBitCount[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+
+UTILS_TARGET_SSE2 inline __m128 affineSse2(__m128 a, __m128 b, __m128 c, __m128 d, __m128 px, __m128 py, __m128 pz)
+{
+	return _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(a, px), _mm_mul_ps(b, py)), _mm_mul_ps(c, pz)), d);
+}
+
+UTILS_TARGET_SSE2 void transformSse2(const glm::mat4 &matrix, float *x, float *y, float *z, size_t count)
+{
+	const __m128 m00 = _mm_set1_ps(matrix[0][0]), m01 = _mm_set1_ps(matrix[0][1]), m02 = _mm_set1_ps(matrix[0][2]);
+	const __m128 m10 = _mm_set1_ps(matrix[1][0]), m11 = _mm_set1_ps(matrix[1][1]), m12 = _mm_set1_ps(matrix[1][2]);
+	const __m128 m20 = _mm_set1_ps(matrix[2][0]), m21 = _mm_set1_ps(matrix[2][1]), m22 = _mm_set1_ps(matrix[2][2]);
+	const __m128 m30 = _mm_set1_ps(matrix[3][0]), m31 = _mm_set1_ps(matrix[3][1]), m32 = _mm_set1_ps(matrix[3][2]);
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		const __m128 px = _mm_loadu_ps(x + i), py = _mm_loadu_ps(y + i), pz = _mm_loadu_ps(z + i);
+		_mm_storeu_ps(x + i, affineSse2(m00, m10, m20, m30, px, py, pz));
+		_mm_storeu_ps(y + i, affineSse2(m01, m11, m21, m31, px, py, pz));
+		_mm_storeu_ps(z + i, affineSse2(m02, m12, m22, m32, px, py, pz));
+	}
+	transformScalar(matrix, x + i, y + i, z + i, count - i);
+}
+
+UTILS_TARGET_SSE2 void transformPointsSse2(const glm::mat4 &matrix, glm::vec3 *points, size_t count)
+{
+	const __m128 m00 = _mm_set1_ps(matrix[0][0]), m01 = _mm_set1_ps(matrix[0][1]), m02 = _mm_set1_ps(matrix[0][2]);
+	const __m128 m10 = _mm_set1_ps(matrix[1][0]), m11 = _mm_set1_ps(matrix[1][1]), m12 = _mm_set1_ps(matrix[1][2]);
+	const __m128 m20 = _mm_set1_ps(matrix[2][0]), m21 = _mm_set1_ps(matrix[2][1]), m22 = _mm_set1_ps(matrix[2][2]);
+	const __m128 m30 = _mm_set1_ps(matrix[3][0]), m31 = _mm_set1_ps(matrix[3][1]), m32 = _mm_set1_ps(matrix[3][2]);
+
+	// 4 points are 3 registers: x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3; shuffle to columns and back
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		float *p = &points[i].x;
+		const __m128 a = _mm_loadu_ps(p), b = _mm_loadu_ps(p + 4), c = _mm_loadu_ps(p + 8);
+
+		const __m128 px = _mm_shuffle_ps(a, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+		const __m128 py = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+		const __m128 pz = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), c, _MM_SHUFFLE(3, 0, 2, 0));
+
+		const __m128 qx = affineSse2(m00, m10, m20, m30, px, py, pz);
+		const __m128 qy = affineSse2(m01, m11, m21, m31, px, py, pz);
+		const __m128 qz = affineSse2(m02, m12, m22, m32, px, py, pz);
+
+		_mm_storeu_ps(p, _mm_shuffle_ps(_mm_shuffle_ps(qx, qy, _MM_SHUFFLE(0, 0, 0, 0)), _mm_shuffle_ps(qz, qx, _MM_SHUFFLE(1, 1, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0)));
+		_mm_storeu_ps(p + 4, _mm_shuffle_ps(_mm_shuffle_ps(qy, qz, _MM_SHUFFLE(1, 1, 1, 1)), _mm_shuffle_ps(qx, qy, _MM_SHUFFLE(2, 2, 2, 2)), _MM_SHUFFLE(2, 0, 2, 0)));
+		_mm_storeu_ps(p + 8, _mm_shuffle_ps(_mm_shuffle_ps(qz, qx, _MM_SHUFFLE(3, 3, 2, 2)), _mm_shuffle_ps(qy, qz, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0)));
+	}
+	transformPointsScalar(matrix, points + i, count - i);
+}
+
+UTILS_TARGET_SSE2 void computeBoundsSse2(const float *x, const float *y, const float *z, size_t count, glm::vec3 &lower, glm::vec3 &upper)
+{
+	// _mm_min_ps returns the second operand if either is NaN, so the accumulators come second
+	__m128 lx = _mm_set1_ps(lower.x), ly = _mm_set1_ps(lower.y), lz = _mm_set1_ps(lower.z);
+	__m128 ux = _mm_set1_ps(upper.x), uy = _mm_set1_ps(upper.y), uz = _mm_set1_ps(upper.z);
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		const __m128 px = _mm_loadu_ps(x + i), py = _mm_loadu_ps(y + i), pz = _mm_loadu_ps(z + i);
+		lx = _mm_min_ps(px, lx); ux = _mm_max_ps(px, ux);
+		ly = _mm_min_ps(py, ly); uy = _mm_max_ps(py, uy);
+		lz = _mm_min_ps(pz, lz); uz = _mm_max_ps(pz, uz);
+	}
+
+	alignas(16) float lanes[6][4];
+	_mm_store_ps(lanes[0], lx); _mm_store_ps(lanes[1], ly); _mm_store_ps(lanes[2], lz);
+	_mm_store_ps(lanes[3], ux); _mm_store_ps(lanes[4], uy); _mm_store_ps(lanes[5], uz);
+	for (int lane = 0; lane < 4; ++lane)
+	{
+		lower = glm::min(lower, glm::vec3(lanes[0][lane], lanes[1][lane], lanes[2][lane]));
+		upper = glm::max(upper, glm::vec3(lanes[3][lane], lanes[4][lane], lanes[5][lane]));
+	}
+	computeBoundsScalar(x + i, y + i, z + i, count - i, lower, upper);
+}
+
+UTILS_TARGET_SSE2 inline double sumLanesSse2(__m128 v)
+{
+	alignas(16) float lanes[4];
+	_mm_store_ps(lanes, v);
+	return (double)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+UTILS_TARGET_SSE2 glm::dvec3 sumSse2(const float *x, const float *y, const float *z, size_t count)
+{
+	glm::dvec3 total(0.0);
+	size_t i = 0;
+	while (i + 4 <= count)
+	{
+		__m128 sx = _mm_setzero_ps(), sy = _mm_setzero_ps(), sz = _mm_setzero_ps();
+		for (const size_t end = std::min(count, i + kBlockSize); i + 4 <= end; i += 4)
+		{
+			sx = _mm_add_ps(sx, _mm_loadu_ps(x + i));
+			sy = _mm_add_ps(sy, _mm_loadu_ps(y + i));
+			sz = _mm_add_ps(sz, _mm_loadu_ps(z + i));
+		}
+		total += glm::dvec3(sumLanesSse2(sx), sumLanesSse2(sy), sumLanesSse2(sz));
+	}
+	return total + sumScalar(x + i, y + i, z + i, count - i);
+}
+
+UTILS_TARGET_SSE2 double sumSquaresSse2(const float *x, const float *y, const float *z, size_t count, const glm::vec3 &center)
+{
+	const __m128 cx = _mm_set1_ps(center.x), cy = _mm_set1_ps(center.y), cz = _mm_set1_ps(center.z);
+
+	double total = 0.0;
+	size_t i = 0;
+	while (i + 4 <= count)
+	{
+		__m128 sum = _mm_setzero_ps();
+		for (const size_t end = std::min(count, i + kBlockSize); i + 4 <= end; i += 4)
+		{
+			const __m128 dx = _mm_sub_ps(_mm_loadu_ps(x + i), cx);
+			const __m128 dy = _mm_sub_ps(_mm_loadu_ps(y + i), cy);
+			const __m128 dz = _mm_sub_ps(_mm_loadu_ps(z + i), cz);
+			sum = _mm_add_ps(sum, _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+		}
+		total += sumLanesSse2(sum);
+	}
+	return total + sumSquaresScalar(x + i, y + i, z + i, count - i, center);
+}
+
+UTILS_TARGET_SSE2 void instancesSse2(const float *x, const float *y, const float *z, const float *radii, float scale, size_t count, glm::vec4 *instances)
+{
+	const __m128 factor = _mm_set1_ps(scale);
+
+	// Large outputs are written once and uploaded later; streaming stores skip reading them into the cache first
+	const bool stream = (reinterpret_cast<uintptr_t>(instances) & 15) == 0;
+	auto store = [stream](float *m, __m128 v) UTILS_TARGET_SSE2 { if (stream) _mm_stream_ps(m, v); else _mm_storeu_ps(m, v); };
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		// 4 atoms to rows: x y z r
+		__m128 t0 = _mm_loadu_ps(x + i), t1 = _mm_loadu_ps(y + i), t2 = _mm_loadu_ps(z + i), t3 = _mm_mul_ps(_mm_loadu_ps(radii + i), factor);
+		_MM_TRANSPOSE4_PS(t0, t1, t2, t3);
+		float *m = &instances[i][0];
+		store(m, t0);
+		store(m + 4, t1);
+		store(m + 8, t2);
+		store(m + 12, t3);
+	}
+	_mm_sfence();
+	instancesScalar(x + i, y + i, z + i, radii + i, scale, count - i, instances + i);
+}
+
+UTILS_TARGET_SSE2 size_t markInsideSse2(const float *x, const float *y, const float *z, size_t count, const glm::vec3 &center, float radius, uint32_t *inside)
+{
+	const __m128 cx = _mm_set1_ps(center.x), cy = _mm_set1_ps(center.y), cz = _mm_set1_ps(center.z);
+	const __m128 radius2 = _mm_set1_ps(radius * radius);
+
+	size_t numInside = 0;
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		const __m128 dx = _mm_sub_ps(_mm_loadu_ps(x + i), cx);
+		const __m128 dy = _mm_sub_ps(_mm_loadu_ps(y + i), cy);
+		const __m128 dz = _mm_sub_ps(_mm_loadu_ps(z + i), cz);
+		const __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+		// All bits set where inside, OR-ed into the flags
+		__m128i *flags = reinterpret_cast<__m128i*>(inside + i);
+		const __m128i marked = _mm_or_si128(_mm_loadu_si128(flags), _mm_castps_si128(_mm_cmplt_ps(distance, radius2)));
+		_mm_storeu_si128(flags, marked);
+		numInside += kBitCount[_mm_movemask_ps(_mm_castsi128_ps(marked))];
+	}
+	return numInside + markInsideScalar(x + i, y + i, z + i, count - i, center, radius, inside + i);
+}
+
+UTILS_TARGET_SSE2 void covarianceSse2(const float *ax, const float *ay, const float *az, const float *bx, const float *by, const float *bz, size_t count, double *covariance)
+{
+	size_t i = 0;
+	while (i + 4 <= count)
+	{
+		__m128 s[9];
+		for (int k = 0; k < 9; ++k) s[k] = _mm_setzero_ps();
+		for (const size_t end = std::min(count, i + kBlockSize); i + 4 <= end; i += 4)
+		{
+			const __m128 a[3] = { _mm_loadu_ps(ax + i), _mm_loadu_ps(ay + i), _mm_loadu_ps(az + i) };
+			const __m128 b[3] = { _mm_loadu_ps(bx + i), _mm_loadu_ps(by + i), _mm_loadu_ps(bz + i) };
+			for (int r = 0; r < 3; ++r)
+			for (int c = 0; c < 3; ++c)
+				s[3 * r + c] = _mm_add_ps(s[3 * r + c], _mm_mul_ps(a[r], b[c]));
+		}
+		for (int k = 0; k < 9; ++k) covariance[k] += sumLanesSse2(s[k]);
+	}
+	covarianceScalar(ax + i, ay + i, az + i, bx + i, by + i, bz + i, count - i, covariance);
+}
+
+UTILS_TARGET_SSE2 void distancesSse2(const float *x, const float *y, const float *z, size_t count, const glm::vec3 &point, float *distances)
+{
+	const __m128 px = _mm_set1_ps(point.x), py = _mm_set1_ps(point.y), pz = _mm_set1_ps(point.z);
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		const __m128 dx = _mm_sub_ps(_mm_loadu_ps(x + i), px);
+		const __m128 dy = _mm_sub_ps(_mm_loadu_ps(y + i), py);
+		const __m128 dz = _mm_sub_ps(_mm_loadu_ps(z + i), pz);
+		_mm_storeu_ps(distances + i, _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz))));
+	}
+	distancesScalar(x + i, y + i, z + i, count - i, point, distances + i);
+}
+
+const Kernels kSse2 = { transformSse2, transformPointsSse2, computeBoundsSse2, sumSse2, sumSquaresSse2, instancesSse2, markInsideSse2, covarianceSse2, distancesSse2 };
+
+/*
+	AVX2, 8 atoms per step
+*/
+
+// The scalar tails are plain SSE code; leaving the upper halves dirty would stall them (and the callers)
+
+UTILS_TARGET_AVX2 inline __m256 affineAvx2(__m256 a, __m256 b, __m256 c, __m256 d, __m256 px, __m256 py, __m256 pz)
+{
+	// No fused multiply add, so the results match the other versions
+	return _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a, px), _mm256_mul_ps(b, py)), _mm256_mul_ps(c, pz)), d);
+}
+
+UTILS_TARGET_AVX2 void transformAvx2(const glm::mat4 &matrix, float *x, float *y, float *z, size_t count)
+{
+	const __m256 m00 = _mm256_set1_ps(matrix[0][0]), m01 = _mm256_set1_ps(matrix[0][1]), m02 = _mm256_set1_ps(matrix[0][2]);
+	const __m256 m10 = _mm256_set1_ps(matrix[1][0]), m11 = _mm256_set1_ps(matrix[1][1]), m12 = _mm256_set1_ps(matrix[1][2]);
+	const __m256 m20 = _mm256_set1_ps(matrix[2][0]), m21 = _mm256_set1_ps(matrix[2][1]), m22 = _mm256_set1_ps(matrix[2][2]);
+	const __m256 m30 = _mm256_set1_ps(matrix[3][0]), m31 = _mm256_set1_ps(matrix[3][1]), m32 = _mm256_set1_ps(matrix[3][2]);
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		const __m256 px = _mm256_loadu_ps(x + i), py = _mm256_loadu_ps(y + i), pz = _mm256_loadu_ps(z + i);
+		_mm256_storeu_ps(x + i, affineAvx2(m00, m10, m20, m30, px, py, pz));
+		_mm256_storeu_ps(y + i, affineAvx2(m01, m11, m21, m31, px, py, pz));
+		_mm256_storeu_ps(z + i, affineAvx2(m02, m12, m22, m32, px, py, pz));
+	}
+	_mm256_zeroupper();
+	transformScalar(matrix, x + i, y + i, z + i, count - i);
+}
+
+UTILS_TARGET_AVX2 void computeBoundsAvx2(const float *x, const float *y, const float *z, size_t count, glm::vec3 &lower, glm::vec3 &upper)
+{
+	__m256 lx = _mm256_set1_ps(lower.x), ly = _mm256_set1_ps(lower.y), lz = _mm256_set1_ps(lower.z);
+	__m256 ux = _mm256_set1_ps(upper.x), uy = _mm256_set1_ps(upper.y), uz = _mm256_set1_ps(upper.z);
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		const __m256 px = _mm256_loadu_ps(x + i), py = _mm256_loadu_ps(y + i), pz = _mm256_loadu_ps(z + i);
+		lx = _mm256_min_ps(px, lx); ux = _mm256_max_ps(px, ux);
+		ly = _mm256_min_ps(py, ly); uy = _mm256_max_ps(py, uy);
+		lz = _mm256_min_ps(pz, lz); uz = _mm256_max_ps(pz, uz);
+	}
+
+	alignas(32) float lanes[6][8];
+	_mm256_store_ps(lanes[0], lx); _mm256_store_ps(lanes[1], ly); _mm256_store_ps(lanes[2], lz);
+	_mm256_store_ps(lanes[3], ux); _mm256_store_ps(lanes[4], uy); _mm256_store_ps(lanes[5], uz);
+	for (int lane = 0; lane < 8; ++lane)
+	{
+		lower = glm::min(lower, glm::vec3(lanes[0][lane], lanes[1][lane], lanes[2][lane]));
+		upper = glm::max(upper, glm::vec3(lanes[3][lane], lanes[4][lane], lanes[5][lane]));
+	}
+	_mm256_zeroupper();
+	computeBoundsScalar(x + i, y + i, z + i, count - i, lower, upper);
+}
+
+UTILS_TARGET_AVX2 inline double sumLanesAvx2(__m256 v)
+{
+	alignas(32) float lanes[8];
+	_mm256_store_ps(lanes, v);
+	return ((double)lanes[0] + lanes[1] + lanes[2] + lanes[3]) + ((double)lanes[4] + lanes[5] + lanes[6] + lanes[7]);
+}
+
+UTILS_TARGET_AVX2 glm::dvec3 sumAvx2(const float *x, const float *y, const float *z, size_t count)
+{
+	glm::dvec3 total(0.0);
+	size_t i = 0;
+	while (i + 8 <= count)
+	{
+		__m256 sx = _mm256_setzero_ps(), sy = _mm256_setzero_ps(), sz = _mm256_setzero_ps();
+		for (const size_t end = std::min(count, i + kBlockSize); i + 8 <= end; i += 8)
+		{
+			sx = _mm256_add_ps(sx, _mm256_loadu_ps(x + i));
+			sy = _mm256_add_ps(sy, _mm256_loadu_ps(y + i));
+			sz = _mm256_add_ps(sz, _mm256_loadu_ps(z + i));
+		}
+		total += glm::dvec3(sumLanesAvx2(sx), sumLanesAvx2(sy), sumLanesAvx2(sz));
+	}
+	_mm256_zeroupper();
+	return total + sumScalar(x + i, y + i, z + i, count - i);
+}
+
+UTILS_TARGET_AVX2 double sumSquaresAvx2(const float *x, const float *y, const float *z, size_t count, const glm::vec3 &center)
+{
+	const __m256 cx = _mm256_set1_ps(center.x), cy = _mm256_set1_ps(center.y), cz = _mm256_set1_ps(center.z);
+
+	double total = 0.0;
+	size_t i = 0;
+	while (i + 8 <= count)
+	{
+		__m256 sum = _mm256_setzero_ps();
+		for (const size_t end = std::min(count, i + kBlockSize); i + 8 <= end; i += 8)
+		{
+			const __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x + i), cx);
+			const __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y + i), cy);
+			const __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(z + i), cz);
+			sum = _mm256_add_ps(sum, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz)));
+		}
+		total += sumLanesAvx2(sum);
+	}
+	_mm256_zeroupper();
+	return total + sumSquaresScalar(x + i, y + i, z + i, count - i, center);
+}
+
+UTILS_TARGET_AVX2 size_t markInsideAvx2(const float *x, const float *y, const float *z, size_t count, const glm::vec3 &center, float radius, uint32_t *inside)
+{
+	const __m256 cx = _mm256_set1_ps(center.x), cy = _mm256_set1_ps(center.y), cz = _mm256_set1_ps(center.z);
+	const __m256 radius2 = _mm256_set1_ps(radius * radius);
+
+	size_t numInside = 0;
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		const __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x + i), cx);
+		const __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y + i), cy);
+		const __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(z + i), cz);
+		const __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+
+		float *flags = reinterpret_cast<float*>(inside + i);
+		const __m256 marked = _mm256_or_ps(_mm256_loadu_ps(flags), _mm256_cmp_ps(distance, radius2, _CMP_LT_OQ));
+		_mm256_storeu_ps(flags, marked);
+		const int mask = _mm256_movemask_ps(marked);
+		numInside += kBitCount[mask & 15] + kBitCount[mask >> 4];
+	}
+	_mm256_zeroupper();
+	return numInside + markInsideScalar(x + i, y + i, z + i, count - i, center, radius, inside + i);
+}
+
+UTILS_TARGET_AVX2 void covarianceAvx2(const float *ax, const float *ay, const float *az, const float *bx, const float *by, const float *bz, size_t count, double *covariance)
+{
+	size_t i = 0;
+	while (i + 8 <= count)
+	{
+		__m256 s[9];
+		for (int k = 0; k < 9; ++k) s[k] = _mm256_setzero_ps();
+		for (const size_t end = std::min(count, i + kBlockSize); i + 8 <= end; i += 8)
+		{
+			const __m256 a[3] = { _mm256_loadu_ps(ax + i), _mm256_loadu_ps(ay + i), _mm256_loadu_ps(az + i) };
+			const __m256 b[3] = { _mm256_loadu_ps(bx + i), _mm256_loadu_ps(by + i), _mm256_loadu_ps(bz + i) };
+			for (int r = 0; r < 3; ++r)
+			for (int c = 0; c < 3; ++c)
+				s[3 * r + c] = _mm256_add_ps(s[3 * r + c], _mm256_mul_ps(a[r], b[c]));
+		}
+		for (int k = 0; k < 9; ++k) covariance[k] += sumLanesAvx2(s[k]);
+	}
+	_mm256_zeroupper();
+	covarianceScalar(ax + i, ay + i, az + i, bx + i, by + i, bz + i, count - i, covariance);
+}
+
+UTILS_TARGET_AVX2 void distancesAvx2(const float *x, const float *y, const float *z, size_t count, const glm::vec3 &point, float *distances)
+{
+	const __m256 px = _mm256_set1_ps(point.x), py = _mm256_set1_ps(point.y), pz = _mm256_set1_ps(point.z);
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		const __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x + i), px);
+		const __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y + i), py);
+		const __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(z + i), pz);
+		_mm256_storeu_ps(distances + i, _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz))));
+	}
+	_mm256_zeroupper();
+	distancesScalar(x + i, y + i, z + i, count - i, point, distances + i);
+}
+
+// Packed triples and quadruples do not split into 8 lanes evenly; the SSE2 shuffles serve both levels
+const Kernels kAvx2 = { transformAvx2, transformPointsSse2, computeBoundsAvx2, sumAvx2, sumSquaresAvx2, instancesSse2, markInsideAvx2, covarianceAvx2, distancesAvx2 };
+
+#endif // UTILS_SIMD_X86
+
+Level detectLevel()
+{
+#if defined(UTILS_SIMD_X86)
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	const int maxLeaf = info[0];
+
+	__cpuid(info, 1);
+	const bool sse2 = (info[3] & (1 << 26)) != 0;
+	const bool osxsave = (info[2] & (1 << 27)) != 0;
+	const bool avx = (info[2] & (1 << 28)) != 0;
+
+	// The operating system must save the ymm registers too
+	bool avx2 = false;
+	if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 6) == 6)
+	{
+		__cpuidex(info, 7, 0);
+		avx2 = (info[1] & (1 << 5)) != 0;
+	}
+#else
+	// Checks the operating system support as well
+	__builtin_cpu_init();
+	const bool sse2 = __builtin_cpu_supports("sse2") != 0;
+	const bool avx2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+	if (avx2) return AVX2;
+	if (sse2) return SSE2;
+#endif
+	return SCALAR;
+}
+
+const Kernels& getKernels(Level level)
+{
+#if defined(UTILS_SIMD_X86)
+	if (level == AVX2) return kAvx2;
+	if (level == SSE2) return kSse2;
+#endif
+	return kScalar;
+}
+
+std::atomic<int> sLevel(-1);
+
+const Kernels& kernels()
+{
+	return getKernels(getLevel());
+}
+
+} // namespace
+
+// ---------------------------------------------------------------------
+
+Level getSupportedLevel()
+{
+	static const Level level = detectLevel();
+	return level;
+}
+
+Level getLevel()
+{
+	const int level = sLevel.load(std::memory_order_relaxed);
+	return level < 0 ? getSupportedLevel() : Level(level);
+}
+
+void setLevel(Level level)
+{
+	sLevel.store(std::min(level, getSupportedLevel()), std::memory_order_relaxed);
+}
+
+const char* getLevelName(Level level)
+{
+	switch (level)
+	{
+	case AVX2:	return "AVX2";
+	case SSE2:	return "SSE2";
+	default:	return "scalar";
+	}
+}
+
+void transform(const glm::mat4 &matrix, float *x, float *y, float *z, size_t count)
+{
+	kernels().transform(matrix, x, y, z, count);
+}
+
+void transform(const glm::mat4 &matrix, glm::vec3 *points, size_t count)
+{
+	kernels().transformPoints(matrix, points, count);
+}
+
+void computeBounds(const float *x, const float *y, const float *z, size_t count, glm::vec3 &lower, glm::vec3 &upper)
+{
+	lower = glm::vec3(std::numeric_limits<float>::max());
+	upper = glm::vec3(std::numeric_limits<float>::lowest());
+	kernels().computeBounds(x, y, z, count, lower, upper);
+}
+
+glm::vec3 computeCentroid(const float *x, const float *y, const float *z, size_t count)
+{
+	if (count == 0) return glm::vec3(0.0f);
+	return glm::vec3(kernels().sum(x, y, z, count) / double(count));
+}
+
+float computeRadiusOfGyration(const float *x, const float *y, const float *z, size_t count)
+{
+	if (count == 0) return 0.0f;
+	const glm::vec3 centroid = computeCentroid(x, y, z, count);
+	return (float)std::sqrt(kernels().sumSquares(x, y, z, count, centroid) / double(count));
+}
+
+void computeInstances(const float *x, const float *y, const float *z, const float *radii, float scale, size_t count, glm::vec4 *instances)
+{
+	kernels().instances(x, y, z, radii, scale, count, instances);
+}
+
+size_t markInside(const float *x, const float *y, const float *z, size_t count, const glm::vec3 &center, float radius, uint32_t *inside)
+{
+	return kernels().markInside(x, y, z, count, center, radius, inside);
+}
+
+void computeCovariance(const float *ax, const float *ay, const float *az, const float *bx, const float *by, const float *bz, size_t count, double covariance[9])
+{
+	std::fill(covariance, covariance + 9, 0.0);
+	kernels().covariance(ax, ay, az, bx, by, bz, count, covariance);
+}
+
+void computeDistances(const float *x, const float *y, const float *z, size_t count, const glm::vec3 &point, float *distances)
+{
+	kernels().distances(x, y, z, count, point, distances);
+}
+
+} // namespace simd
+} // namespace utils
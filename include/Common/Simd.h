@@ -0,0 +1,62 @@
+#pragma once
+
+#include "cinder/CinderGlm.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace utils
+{
+namespace simd
+{
+
+/*
+	Vectorized kernels over contiguous coordinate columns (x[], y[], z[]).
+	Every kernel has a scalar, an SSE2 and an AVX2 version; the best one the processor and the
+	operating system support is chosen on first use. All versions compute the same operations
+	in the same order per element, so transforms, bounds and matrices match the scalar loops bit
+	for bit; sums (centroid, radius of gyration) differ in the last bits only.
+*/
+
+enum Level
+{
+	SCALAR,
+	SSE2,
+	AVX2
+};
+
+// Level used by the kernels; the best supported one unless lowered by setLevel
+Level getLevel();
+// Best level of this processor
+Level getSupportedLevel();
+// Forces a level (clamped to the supported one), e.g. to compare the versions
+void setLevel(Level level);
+const char* getLevelName(Level level);
+
+// p = matrix * vec4(p, 1), in place; the projective row is ignored
+void transform(const glm::mat4 &matrix, float *x, float *y, float *z, size_t count);
+void transform(const glm::mat4 &matrix, glm::vec3 *points, size_t count);
+
+// Axis aligned bounds; lower > upper for count == 0, NaN coordinates are skipped
+void computeBounds(const float *x, const float *y, const float *z, size_t count, glm::vec3 &lower, glm::vec3 &upper);
+
+// Mean position, 0 for count == 0
+glm::vec3 computeCentroid(const float *x, const float *y, const float *z, size_t count);
+// Root mean square distance to the centroid (unweighted)
+float computeRadiusOfGyration(const float *x, const float *y, const float *z, size_t count);
+
+// instances[i] = vec4(p[i], radii[i] * scale), the center and radius of every sphere instance
+void computeInstances(const float *x, const float *y, const float *z, const float *radii, float scale, size_t count, glm::vec4 *instances);
+
+// Point in sphere test: sets inside[i] to ~0 if point i lies strictly inside the sphere, leaves it otherwise;
+// returns the number of non zero flags afterwards
+size_t markInside(const float *x, const float *y, const float *z, size_t count, const glm::vec3 &center, float radius, uint32_t *inside);
+
+// covariance[3 * i + j] = sum over the points of a_i * b_j, i and j in x, y, z; the points are used as given
+// (center them first for a covariance matrix)
+void computeCovariance(const float *ax, const float *ay, const float *az, const float *bx, const float *by, const float *bz, size_t count, double covariance[9]);
+
+// distances[i] = |p[i] - point|; exact at every level (square roots are correctly rounded)
+void computeDistances(const float *x, const float *y, const float *z, size_t count, const glm::vec3 &point, float *distances);
+
+} // namespace simd
+} // namespace utils
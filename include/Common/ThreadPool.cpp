@@ -0,0 +1,116 @@
+#include "ThreadPool.h"
+#include <atomic>
+#include <exception>
+#include <algorithm>
+
+namespace utils
+{
+
+ThreadPool::ThreadPool(size_t numThreads)
+	: mStopping(false)
+{
+	if (numThreads == 0) numThreads = 1;
+
+	mWorkers.reserve(numThreads);
+	for (size_t i = 0; i < numThreads; ++i)
+		mWorkers.emplace_back(&ThreadPool::workerLoop, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStopping = true;
+	}
+	mCondition.notify_all();
+
+	for (auto &worker : mWorkers)
+		worker.join();
+}
+
+ThreadPool& ThreadPool::get()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mTasks.push_back(std::move(task));
+	}
+	mCondition.notify_one();
+}
+
+void ThreadPool::workerLoop()
+{
+	while (true)
+	{
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mCondition.wait(lock, [this] { return mStopping || !mTasks.empty(); });
+			if (mStopping && mTasks.empty()) return;
+
+			task = std::move(mTasks.front());
+			mTasks.pop_front();
+		}
+		task();
+	}
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)> &fn)
+{
+	if (count == 0) return;
+	if (count == 1 || mWorkers.size() <= 1)
+	{
+		for (size_t i = 0; i < count; ++i) fn(i);
+		return;
+	}
+
+	// Shared with the helpers; a helper that starts late finds no index left and never touches fn
+	struct State
+	{
+		std::atomic<size_t>	next{ 0 };
+		std::atomic<size_t>	done{ 0 };
+		std::mutex		mutex;
+		std::condition_variable	finished;
+		std::exception_ptr	error;
+	};
+	auto state = std::make_shared<State>();
+	const std::function<void(size_t)> *body = &fn;
+
+	auto work = [state, body, count]()
+	{
+		size_t index;
+		while ((index = state->next.fetch_add(1)) < count)
+		{
+			try { (*body)(index); }
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(state->mutex);
+				if (!state->error) state->error = std::current_exception();
+			}
+
+			if (state->done.fetch_add(1) + 1 == count)
+			{
+				std::lock_guard<std::mutex> lock(state->mutex);
+				state->finished.notify_all();
+			}
+		}
+	};
+
+	const size_t helpers = std::min(count - 1, mWorkers.size());
+	for (size_t i = 0; i < helpers; ++i)
+		submit(work);
+
+	work();
+
+	std::unique_lock<std::mutex> lock(state->mutex);
+	state->finished.wait(lock, [&] { return state->done.load() == count; });
+
+	if (state->error) std::rethrow_exception(state->error);
+}
+
+} // namespace utils
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+#include <deque>
+#include <memory>
+
+namespace utils
+{
+
+typedef std::shared_ptr<class ThreadPool> ThreadPoolRef;
+
+/*
+	Fixed set of worker threads shared by the loaders and analysis passes.
+*/
+class ThreadPool
+{
+public:
+	explicit ThreadPool(size_t numThreads = std::thread::hardware_concurrency());
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// Process wide pool sized to the number of cores
+	static ThreadPool& get();
+
+	// Queue a task; it runs on one of the workers
+	void submit(std::function<void()> task);
+
+	// Calls fn(index) for every index in [0, count) and blocks until all calls returned.
+	// The calling thread takes part in the work, so nested calls can not dead-lock.
+	// The first exception thrown by fn is rethrown here.
+	void parallelFor(size_t count, const std::function<void(size_t)> &fn);
+protected:
+	void workerLoop();
+
+	std::vector<std::thread>		mWorkers;
+	std::deque<std::function<void()>>	mTasks;
+	std::mutex				mMutex;
+	std::condition_variable			mCondition;
+	bool					mStopping;
+public: // Mutators
+	size_t					getNumThreads() const		{ return mWorkers.size(); }
+};
+
+} // namespace utils
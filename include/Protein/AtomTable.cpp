@@ -0,0 +1,121 @@
+#include "AtomTable.h"
+#include "Common/Simd.h"
+#include <limits>
+#include <algorithm>
+
+namespace pdb
+{
+
+glm::vec3 AtomTable::getPaletteColor(uint8_t index)
+{
+	// Chain colors, distinguishable next to each other
+	static const float kChains[kNumChainColors][3] =
+	{
+		{ 0.56f, 0.75f, 0.98f }, { 0.98f, 0.67f, 0.34f }, { 0.55f, 0.86f, 0.45f }, { 0.96f, 0.46f, 0.50f },
+		{ 0.74f, 0.60f, 0.93f }, { 0.93f, 0.86f, 0.40f }, { 0.40f, 0.85f, 0.84f }, { 0.95f, 0.60f, 0.85f },
+		{ 0.70f, 0.55f, 0.40f }, { 0.62f, 0.62f, 0.62f }, { 0.30f, 0.55f, 0.85f }, { 0.85f, 0.35f, 0.25f }
+	};
+
+	if (index < kChainColors) return pdb::getColor(Element(index));
+	if (index < kRampColors)
+	{
+		const float *color = kChains[index - kChainColors];
+		return glm::vec3(color[0], color[1], color[2]);
+	}
+
+	// Ramp: blue (low) over white to red (high)
+	const float t = std::min(1.0f, float(index - kRampColors) / (kNumRampColors - 1));
+	const glm::vec3 low(0.23f, 0.30f, 0.75f), middle(0.87f, 0.87f, 0.87f), high(0.71f, 0.02f, 0.15f);
+	return t < 0.5f ? low + (middle - low) * (t * 2.0f) : middle + (high - middle) * (t * 2.0f - 1.0f);
+}
+
+uint32_t AtomTable::packColor(const glm::vec3 &color)
+{
+	uint32_t packed = 0xFF000000u;
+	for (int k = 0; k < 3; ++k)
+		packed |= uint32_t(std::min(1.0f, std::max(0.0f, color[k])) * 255.0f + 0.5f) << (8 * k);
+	return packed;
+}
+
+void AtomTable::resize(size_t count)
+{
+	mX.resize(count, 0.0f);
+	mY.resize(count, 0.0f);
+	mZ.resize(count, 0.0f);
+	mRadius.resize(count, getRadius(Element::Unknown));
+	mSerial.resize(count, 0);
+	mName.resize(count, 0);
+	mElement.resize(count, Element::Unknown);
+	mColorIndex.resize(count, uint8_t(Element::Unknown));
+	mResidue.resize(count, 0);
+	mChain.resize(count, 0);
+}
+
+void AtomTable::clear()
+{
+	mX.clear();
+	mY.clear();
+	mZ.clear();
+	mRadius.clear();
+	mSerial.clear();
+	mName.clear();
+	mElement.clear();
+	mColorIndex.clear();
+	mResidue.clear();
+	mChain.clear();
+}
+
+void AtomTable::setElement(size_t index, Element element)
+{
+	mElement[index] = element;
+	mRadius[index] = getRadius(element);
+	mColorIndex[index] = uint8_t(element);
+}
+
+void AtomTable::setColorIndex(size_t begin, size_t end, uint8_t colorIndex)
+{
+	std::fill(mColorIndex.begin() + begin, mColorIndex.begin() + end, colorIndex);
+}
+
+void AtomTable::resetColors()
+{
+	for (size_t i = 0; i < mElement.size(); ++i)
+		mColorIndex[i] = uint8_t(mElement[i]);
+}
+
+void AtomTable::setPositions(const glm::vec3 *positions)
+{
+	float *x = mX.data();
+	float *y = mY.data();
+	float *z = mZ.data();
+	const size_t count = size();
+	for (size_t i = 0; i < count; ++i)
+	{
+		x[i] = positions[i].x;
+		y[i] = positions[i].y;
+		z[i] = positions[i].z;
+	}
+}
+
+void AtomTable::transform(const glm::mat4 &matrix)
+{
+	// Affine part only, as for points with w = 1
+	utils::simd::transform(matrix, mX.data(), mY.data(), mZ.data(), size());
+}
+
+void AtomTable::computeBounds(size_t begin, size_t end, glm::vec3 &lower, glm::vec3 &upper) const
+{
+	utils::simd::computeBounds(mX.data() + begin, mY.data() + begin, mZ.data() + begin, end - begin, lower, upper);
+}
+
+glm::vec3 AtomTable::computeCentroid(size_t begin, size_t end) const
+{
+	return utils::simd::computeCentroid(mX.data() + begin, mY.data() + begin, mZ.data() + begin, end - begin);
+}
+
+float AtomTable::computeRadiusOfGyration(size_t begin, size_t end) const
+{
+	return utils::simd::computeRadiusOfGyration(mX.data() + begin, mY.data() + begin, mZ.data() + begin, end - begin);
+}
+
+} // namespace pdb
@@ -0,0 +1,130 @@
+#pragma once
+
+#include "cinder/CinderGlm.h"
+#include "Element.h"
+#include "Hierarchy.h"
+#include <vector>
+#include <cstdint>
+
+namespace pdb
+{
+
+class AtomTable;
+
+/*
+	Read-only handle to one atom of an AtomTable; two words, pass by value.
+*/
+class AtomView
+{
+public:
+	AtomView(const AtomTable &table, size_t index) : mTable(&table), mIndex(index) {}
+
+	glm::vec3	getPosition() const;
+	float		getRadius() const;
+	Element		getElement() const;
+	glm::vec3	getColor() const;
+	int32_t		getSerial() const;
+	PackedName	getName() const;
+	uint32_t	getResidue() const;
+	uint32_t	getChain() const;
+protected:
+	const AtomTable		*mTable;
+	size_t			mIndex;
+public: // Mutators
+	size_t			getIndex() const		{ return mIndex; }
+};
+
+/*
+	Atoms of a structure as parallel columns (structure of arrays).
+	Row i of every column belongs to atom i; rows follow the order of the source file.
+	Bulk passes walk one or a few contiguous columns, which keeps them cache friendly and lets the compiler vectorize them.
+*/
+class AtomTable
+{
+public:
+	// Color indices [0, Element::Count) are the element colors, the chain colors and a blue - white - red ramp follow
+	static const uint8_t	kChainColors = uint8_t(Element::Count);
+	static const uint8_t	kNumChainColors = 12;
+	static const uint8_t	kRampColors = kChainColors + kNumChainColors;
+	static const uint8_t	kNumRampColors = 64;
+	static glm::vec3	getPaletteColor(uint8_t index);
+	// RGBA8 with red in the lowest byte and an opaque alpha, the layout of the instance buffers
+	static uint32_t		packColor(const glm::vec3 &color);
+
+	void resize(size_t count);
+	void clear();
+
+	AtomView operator[](size_t index) const		{ return AtomView(*this, index); }
+
+	// Sets the element with its radius and color
+	void setElement(size_t index, Element element);
+	void setPosition(size_t index, const glm::vec3 &position)	{ mX[index] = position.x; mY[index] = position.y; mZ[index] = position.z; }
+	// Fills the color index of the rows [begin, end)
+	void setColorIndex(size_t begin, size_t end, uint8_t colorIndex);
+	// Color indices back to the element colors
+	void resetColors();
+
+	// Bulk passes; the arithmetic ones run on the vectorized kernels of Common/Simd.h
+	void setPositions(const glm::vec3 *positions);
+	void transform(const glm::mat4 &matrix);
+	// Bounds of the rows [begin, end); lower > upper for an empty range
+	void computeBounds(size_t begin, size_t end, glm::vec3 &lower, glm::vec3 &upper) const;
+	// Mean position and radius of gyration (unweighted) of the rows [begin, end)
+	glm::vec3 computeCentroid(size_t begin, size_t end) const;
+	float computeRadiusOfGyration(size_t begin, size_t end) const;
+protected:
+	// Positions
+	std::vector<float>	mX;
+	std::vector<float>	mY;
+	std::vector<float>	mZ;
+
+	// Properties
+	std::vector<float>	mRadius;	// Van der Waals radius
+	std::vector<int32_t>	mSerial;	// serial number of the source file
+	std::vector<PackedName>	mName;		// atom name, e.g. "CA"
+	std::vector<Element>	mElement;
+	std::vector<uint8_t>	mColorIndex;	// into the palette, see getPaletteColor()
+
+	// Hierarchy; residue and chain index of every row (see Hierarchy)
+	std::vector<uint32_t>	mResidue;
+	std::vector<uint32_t>	mChain;
+public: // Mutators
+	size_t			size() const			{ return mX.size(); }
+	bool			empty() const			{ return mX.empty(); }
+
+	// Columns, size() elements each
+	float			*getX()				{ return mX.data(); }
+	float			*getY()				{ return mY.data(); }
+	float			*getZ()				{ return mZ.data(); }
+	float			*getRadii()			{ return mRadius.data(); }
+	int32_t			*getSerials()			{ return mSerial.data(); }
+	PackedName		*getNames()			{ return mName.data(); }
+	uint8_t			*getColorIndices()		{ return mColorIndex.data(); }
+	uint32_t		*getResidues()			{ return mResidue.data(); }
+	uint32_t		*getChains()			{ return mChain.data(); }
+	const float		*getX() const			{ return mX.data(); }
+	const float		*getY() const			{ return mY.data(); }
+	const float		*getZ() const			{ return mZ.data(); }
+	const float		*getRadii() const		{ return mRadius.data(); }
+	const int32_t		*getSerials() const		{ return mSerial.data(); }
+	const PackedName	*getNames() const		{ return mName.data(); }
+	const Element		*getElements() const		{ return mElement.data(); }
+	const uint8_t		*getColorIndices() const	{ return mColorIndex.data(); }
+	const uint32_t		*getResidues() const		{ return mResidue.data(); }
+	const uint32_t		*getChains() const		{ return mChain.data(); }
+
+	glm::vec3		getPosition(size_t index) const	{ return glm::vec3(mX[index], mY[index], mZ[index]); }
+	glm::vec3		getColor(size_t index) const	{ return getPaletteColor(mColorIndex[index]); }
+	uint32_t		getPackedColor(size_t index) const	{ return packColor(getColor(index)); }
+};
+
+inline glm::vec3 AtomView::getPosition() const	{ return mTable->getPosition(mIndex); }
+inline float AtomView::getRadius() const	{ return mTable->getRadii()[mIndex]; }
+inline Element AtomView::getElement() const	{ return mTable->getElements()[mIndex]; }
+inline glm::vec3 AtomView::getColor() const	{ return mTable->getColor(mIndex); }
+inline int32_t AtomView::getSerial() const	{ return mTable->getSerials()[mIndex]; }
+inline PackedName AtomView::getName() const	{ return mTable->getNames()[mIndex]; }
+inline uint32_t AtomView::getResidue() const	{ return mTable->getResidues()[mIndex]; }
+inline uint32_t AtomView::getChain() const	{ return mTable->getChains()[mIndex]; }
+
+} // namespace pdb
@@ -0,0 +1,363 @@
+#include "BinaryCifReader.h"
+#include "Common/ThreadPool.h"
+#include <cstring>
+#include <algorithm>
+
+namespace pdb
+{
+namespace parser
+{
+
+using utils::msgpack::Value;
+
+// ByteArray data types
+enum DataType { INT8 = 1, INT16 = 2, INT32 = 3, UINT8 = 4, UINT16 = 5, UINT32 = 6, FLOAT32 = 32, FLOAT64 = 33 };
+
+static const Value& member(const Value &map, std::string_view key)
+{
+	const Value *value = map.find(key);
+	if (value == nullptr) throw BinaryCifExc();
+	return *value;
+}
+
+/*
+	Column encodings; the loops are written over plain arrays so the compiler can vectorize them
+*/
+
+template<typename T, typename U>
+static void widen(std::string_view raw, std::vector<U> &output)
+{
+	const size_t count = raw.size() / sizeof(T);
+	output.resize(count);
+
+	const char *bytes = raw.data();
+	U *out = output.data();
+	for (size_t i = 0; i < count; ++i)
+	{
+		T value;
+		std::memcpy(&value, bytes + i * sizeof(T), sizeof(T));
+		out[i] = (U)value;
+	}
+}
+
+static void decodeByteArray(std::string_view raw, int type, BinaryCifReader::Column &column)
+{
+	column.isReal = type == FLOAT32 || type == FLOAT64;
+	switch (type)
+	{
+	case INT8:	widen<int8_t>(raw, column.ints); break;
+	case INT16:	widen<int16_t>(raw, column.ints); break;
+	case INT32:	widen<int32_t>(raw, column.ints); break;
+	case UINT8:	widen<uint8_t>(raw, column.ints); break;
+	case UINT16:	widen<uint16_t>(raw, column.ints); break;
+	case UINT32:	widen<uint32_t>(raw, column.ints); break;
+	case FLOAT32:	widen<float>(raw, column.reals); break;
+	case FLOAT64:	widen<double>(raw, column.reals); break;
+	default:	throw BinaryCifExc();
+	}
+}
+
+static void decodeIntegerPacking(BinaryCifReader::Column &column, int byteCount, bool isUnsigned, size_t srcSize)
+{
+	const int32_t upper = isUnsigned ? (byteCount == 1 ? 0xFF : 0xFFFF) : (byteCount == 1 ? 0x7F : 0x7FFF);
+	const int32_t lower = isUnsigned ? -1 : -upper - 1;
+
+	const std::vector<int32_t> &input = column.ints;
+	const size_t count = input.size();
+
+	// Values that fit in one packed number are the common case
+	bool saturated = false;
+	for (size_t i = 0; i < count; ++i)
+		saturated |= (input[i] == upper) | (input[i] == lower);
+	if (!saturated && count == srcSize) return;
+
+	std::vector<int32_t> output(srcSize);
+	size_t j = 0;
+	for (size_t i = 0; i < count && j < srcSize; ++j)
+	{
+		int32_t value = 0;
+		int32_t part = input[i];
+		while (part == upper || part == lower)
+		{
+			value += part;
+			if (++i == count) throw BinaryCifExc();
+			part = input[i];
+		}
+		output[j] = value + part;
+		++i;
+	}
+	if (j != srcSize) throw BinaryCifExc();
+
+	column.ints.swap(output);
+}
+
+static void decodeDelta(BinaryCifReader::Column &column, int32_t origin)
+{
+	int32_t *data = column.ints.data();
+	const size_t count = column.ints.size();
+	if (count == 0) return;
+
+	data[0] += origin;
+	for (size_t i = 1; i < count; ++i) data[i] += data[i - 1];
+}
+
+static void decodeRunLength(BinaryCifReader::Column &column, size_t srcSize)
+{
+	const std::vector<int32_t> &input = column.ints;
+	if (input.size() % 2 != 0) throw BinaryCifExc();
+
+	std::vector<int32_t> output(srcSize);
+	size_t offset = 0;
+	for (size_t i = 0; i < input.size(); i += 2)
+	{
+		const int32_t value = input[i];
+		const size_t repeat = (size_t)std::max(input[i + 1], 0);
+		if (offset + repeat > srcSize) throw BinaryCifExc();
+
+		std::fill_n(output.data() + offset, repeat, value);
+		offset += repeat;
+	}
+	if (offset != srcSize) throw BinaryCifExc();
+
+	column.ints.swap(output);
+}
+
+static void decodeFixedPoint(BinaryCifReader::Column &column, double factor)
+{
+	const size_t count = column.ints.size();
+	column.reals.resize(count);
+
+	const double scale = 1.0 / factor;
+	const int32_t *in = column.ints.data();
+	double *out = column.reals.data();
+	for (size_t i = 0; i < count; ++i) out[i] = in[i] * scale;
+
+	column.ints.clear();
+	column.isReal = true;
+}
+
+static void decodeIntervalQuantization(BinaryCifReader::Column &column, double min, double max, int numSteps)
+{
+	const size_t count = column.ints.size();
+	column.reals.resize(count);
+
+	const double delta = numSteps > 1 ? (max - min) / (numSteps - 1) : 0.0;
+	const int32_t *in = column.ints.data();
+	double *out = column.reals.data();
+	for (size_t i = 0; i < count; ++i) out[i] = min + delta * in[i];
+
+	column.ints.clear();
+	column.isReal = true;
+}
+
+static void decodeStringArray(std::string_view raw, const Value &encoding, BinaryCifReader::Column &column)
+{
+	// Offsets and indices are encoded columns of their own
+	Value offsetsData;
+	offsetsData.type = Value::MAP;
+	offsetsData.map.emplace_back("data", member(encoding, "offsets"));
+	offsetsData.map.emplace_back("encoding", member(encoding, "offsetEncoding"));
+
+	Value indicesData;
+	indicesData.type = Value::MAP;
+	indicesData.map.emplace_back("data", Value());
+	indicesData.map.back().second.type = Value::BINARY;
+	indicesData.map.back().second.bytes = raw;
+	indicesData.map.emplace_back("encoding", member(encoding, "dataEncoding"));
+
+	BinaryCifReader::Column offsets = BinaryCifReader::decode(offsetsData);
+	BinaryCifReader::Column indices = BinaryCifReader::decode(indicesData);
+	if (offsets.isString || offsets.isReal || indices.isString || indices.isReal) throw BinaryCifExc();
+
+	std::string_view stringData = member(encoding, "stringData").bytes;
+
+	// Distinct strings, then one view per row
+	const size_t numStrings = offsets.ints.empty() ? 0 : offsets.ints.size() - 1;
+	std::vector<std::string_view> strings(numStrings);
+	for (size_t i = 0; i < numStrings; ++i)
+	{
+		size_t begin = (size_t)offsets.ints[i];
+		size_t end = (size_t)offsets.ints[i + 1];
+		if (begin > end || end > stringData.size()) throw BinaryCifExc();
+		strings[i] = stringData.substr(begin, end - begin);
+	}
+
+	column.strings.resize(indices.ints.size());
+	for (size_t i = 0; i < indices.ints.size(); ++i)
+	{
+		int32_t index = indices.ints[i];
+		if (index >= (int32_t)numStrings) throw BinaryCifExc();
+		column.strings[i] = index >= 0 ? strings[index] : std::string_view();
+	}
+
+	column.isString = true;
+	column.isReal = false;
+	column.ints.clear();
+}
+
+BinaryCifReader::Column BinaryCifReader::decode(const Value &encodedData)
+{
+	std::string_view raw = member(encodedData, "data").bytes;
+	const Value &encodings = member(encodedData, "encoding");
+	if (encodings.type != Value::ARRAY) throw BinaryCifExc();
+
+	Column column;
+	bool isRaw = true;
+
+	// Encodings were applied front to back
+	for (auto it = encodings.array.rbegin(); it != encodings.array.rend(); ++it)
+	{
+		const Value &encoding = *it;
+		std::string_view kind = member(encoding, "kind").bytes;
+
+		if (kind == "ByteArray")
+		{
+			if (!isRaw) throw BinaryCifExc();
+			decodeByteArray(raw, (int)member(encoding, "type").asInt(), column);
+			isRaw = false;
+		}
+		else if (kind == "StringArray")
+		{
+			if (!isRaw) throw BinaryCifExc();
+			decodeStringArray(raw, encoding, column);
+			isRaw = false;
+		}
+		else
+		{
+			// Integer transforms
+			if (isRaw || column.isString) throw BinaryCifExc();
+			if (column.isReal) throw BinaryCifExc();
+
+			if (kind == "IntegerPacking")
+				decodeIntegerPacking(column, (int)member(encoding, "byteCount").asInt(), member(encoding, "isUnsigned").boolean, (size_t)member(encoding, "srcSize").asInt());
+			else if (kind == "Delta")
+				decodeDelta(column, (int32_t)member(encoding, "origin").asInt());
+			else if (kind == "RunLength")
+				decodeRunLength(column, (size_t)member(encoding, "srcSize").asInt());
+			else if (kind == "FixedPoint")
+				decodeFixedPoint(column, member(encoding, "factor").asReal());
+			else if (kind == "IntervalQuantization")
+				decodeIntervalQuantization(column, member(encoding, "min").asReal(), member(encoding, "max").asReal(), (int)member(encoding, "numSteps").asInt());
+			else
+				throw BinaryCifExc();
+		}
+	}
+	if (isRaw) throw BinaryCifExc();
+
+	return column;
+}
+
+/*
+	Reader
+*/
+
+void BinaryCifReader::read(std::string_view data)
+{
+	mChunks.clear();
+
+	Value root = utils::msgpack::parse(data);
+
+	// First data block
+	const Value &blocks = member(root, "dataBlocks");
+	if (blocks.type != Value::ARRAY || blocks.array.empty()) throw BinaryCifExc();
+
+	const Value *atomSite = nullptr;
+	for (const Value &category : member(blocks.array[0], "categories").array)
+		if (member(category, "name").bytes == "_atom_site") { atomSite = &category; break; }
+	if (atomSite == nullptr) throw BinaryCifExc();
+
+	const size_t rowCount = (size_t)member(*atomSite, "rowCount").asInt();
+
+	// ---------------------------------------------
+	// Decode the used columns in parallel
+	// ---------------------------------------------
+
+	enum Field { GROUP, ID, TYPE_SYMBOL, ATOM_ID, AUTH_ATOM_ID, COMP_ID, AUTH_COMP_ID, ASYM_ID, AUTH_ASYM_ID, SEQ_ID, AUTH_SEQ_ID, INS_CODE, X, Y, Z, MODEL, NUM_FIELDS };
+	const char *names[NUM_FIELDS] = { "group_PDB", "id", "type_symbol", "label_atom_id", "auth_atom_id", "label_comp_id", "auth_comp_id", "label_asym_id", "auth_asym_id",
+					  "label_seq_id", "auth_seq_id", "pdbx_PDB_ins_code", "Cartn_x", "Cartn_y", "Cartn_z", "pdbx_PDB_model_num" };
+
+	const Value *encoded[NUM_FIELDS] = {};
+	for (const Value &column : member(*atomSite, "columns").array)
+	{
+		std::string_view name = member(column, "name").bytes;
+		for (int field = 0; field < NUM_FIELDS; ++field)
+			if (name == names[field]) encoded[field] = &column;
+	}
+	if (!encoded[X] || !encoded[Y] || !encoded[Z]) throw BinaryCifExc();
+
+	Column columns[NUM_FIELDS];
+	std::vector<int32_t> masks[NUM_FIELDS];
+	utils::ThreadPool::get().parallelFor(NUM_FIELDS, [&](size_t field)
+	{
+		if (!encoded[field]) return;
+
+		columns[field] = decode(member(*encoded[field], "data"));
+		if (columns[field].size() != rowCount) throw BinaryCifExc();
+
+		// Masked values ('.' or '?') are treated as empty
+		const Value *mask = encoded[field]->find("mask");
+		if (mask && mask->type == Value::MAP) masks[field] = decode(*mask).ints;
+	});
+
+	const Column *atomId = encoded[ATOM_ID] ? &columns[ATOM_ID] : (encoded[AUTH_ATOM_ID] ? &columns[AUTH_ATOM_ID] : nullptr);
+
+	auto present = [&](int field, size_t row) { return masks[field].empty() || masks[field][row] == 0; };
+	auto real = [&](int field, size_t row) -> float
+	{
+		const Column &column = columns[field];
+		if (column.isString) throw BinaryCifExc();
+		return column.isReal ? (float)column.reals[row] : (float)column.ints[row];
+	};
+	auto text = [&](const Column *column, int field, size_t row)
+	{
+		return column && column->isString && present(field, row) ? column->strings[row] : std::string_view();
+	};
+
+	// Author identifiers as in PDB files, label identifiers otherwise
+	auto preferred = [&](int author, int label) { return encoded[author] ? author : (encoded[label] ? label : -1); };
+	const int residueName = preferred(AUTH_COMP_ID, COMP_ID);
+	const int chainId = preferred(AUTH_ASYM_ID, ASYM_ID);
+	const int residueNumber = preferred(AUTH_SEQ_ID, SEQ_ID);
+	auto identifier = [&](int field, size_t row) { return field >= 0 ? text(&columns[field], field, row) : std::string_view(); };
+
+	// ---------------------------------------------
+	// Rows to records
+	// ---------------------------------------------
+
+	const size_t rowsPerChunk = 64 * 1024;
+	mChunks.resize((rowCount + rowsPerChunk - 1) / rowsPerChunk);
+	utils::ThreadPool::get().parallelFor(mChunks.size(), [&](size_t chunk)
+	{
+		const size_t begin = chunk * rowsPerChunk;
+		const size_t end = std::min(begin + rowsPerChunk, rowCount);
+		mChunks[chunk].records.reserve(end - begin);
+
+		for (size_t row = begin; row < end; ++row)
+		{
+			// Same record types as the PDB loader
+			if (encoded[GROUP])
+			{
+				std::string_view group = text(&columns[GROUP], GROUP, row);
+				if (group != "ATOM" && group != "HETATM") continue;
+			}
+
+			AtomRecord record;
+			record.serial = encoded[ID] && !columns[ID].isString && present(ID, row) ? (int)real(ID, row) : 0;
+			record.position = glm::vec3(real(X, row), real(Y, row), real(Z, row));
+			record.name = text(atomId, atomId == &columns[ATOM_ID] ? ATOM_ID : AUTH_ATOM_ID, row);
+			record.element = encoded[TYPE_SYMBOL] ? parseElement(text(&columns[TYPE_SYMBOL], TYPE_SYMBOL, row)) : Element::Unknown;
+			if (record.element == Element::Unknown && !record.name.empty()) record.element = parseElement(record.name.substr(0, 1));
+			record.residueName = identifier(residueName, row);
+			record.chainId = identifier(chainId, row);
+			record.residueNumber = residueNumber >= 0 && !columns[residueNumber].isString && present(residueNumber, row) ? (int)real(residueNumber, row) : 0;
+			std::string_view insertionCode = identifier(encoded[INS_CODE] ? INS_CODE : -1, row);
+			record.insertionCode = insertionCode.empty() ? ' ' : insertionCode[0];
+			record.model = encoded[MODEL] && !columns[MODEL].isString && present(MODEL, row) ? (int)real(MODEL, row) : -1;
+
+			mChunks[chunk].add(record);
+		}
+	});
+}
+
+} // namespace parser
+} // namespace pdb
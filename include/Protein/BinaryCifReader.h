@@ -0,0 +1,49 @@
+#pragma once
+
+#include "PdbParser.h"
+#include "Common/MsgPack.h"
+#include <string_view>
+#include <vector>
+
+namespace pdb
+{
+namespace parser
+{
+
+/*
+	BinaryCIF reader: MessagePack container with column encodings
+	(ByteArray, FixedPoint, IntervalQuantization, RunLength, Delta, IntegerPacking, StringArray).
+	Reads the _atom_site category of the first data block into atom records.
+*/
+class BinaryCifReader
+{
+public:
+	void read(std::string_view data);
+
+	// Decoded column; exactly one of the arrays is filled
+	struct Column
+	{
+		std::vector<int32_t>		ints;
+		std::vector<double>		reals;
+		std::vector<std::string_view>	strings;
+		bool				isString = false;
+		bool				isReal = false;
+
+		size_t size() const { return isString ? strings.size() : (isReal ? reals.size() : ints.size()); }
+	};
+
+	// Applies the encodings of a { data, encoding } pair in reverse order
+	static Column decode(const utils::msgpack::Value &encodedData);
+protected:
+	std::vector<RecordChunk>	mChunks;
+public: // Mutators
+	std::vector<RecordChunk>	const &getChunks() const	{ return mChunks; }
+};
+
+class BinaryCifExc : public std::exception {
+public:
+	virtual const char* what() const throw() { return "BinaryCIF exception: unsupported or malformed data"; }
+};
+
+} // namespace parser
+} // namespace pdb
@@ -0,0 +1,144 @@
+#include "BondTable.h"
+#include "Common/ThreadPool.h"
+#include <algorithm>
+
+namespace pdb
+{
+
+const float BondTable::kTolerance = 0.45f;
+const float BondTable::kMinDistance = 0.4f;
+
+static const size_t kChunkSize = 16384;
+
+// ---------------------------------------------------------------------
+
+BondTable::BondTable()
+{
+	clear();
+}
+
+void BondTable::clear()
+{
+	mOffsets.assign(1, 0);
+	mNeighbours.clear();
+}
+
+void BondTable::add(size_t numAtoms, const std::vector<Bond> &bonds)
+{
+	std::vector<Bond> copy(bonds);
+	merge(numAtoms, copy);
+}
+
+void BondTable::perceive(const AtomTable &atoms, const SpatialGrid &grid)
+{
+	const size_t numAtoms = atoms.size();
+	if (numAtoms == 0) return;
+
+	// Per atom search radius: its own covalent radius and the largest one present
+	const Element *elements = atoms.getElements();
+	float maxRadius = 0.0f;
+	for (size_t i = 0; i < numAtoms; ++i) maxRadius = std::max(maxRadius, getCovalentRadius(elements[i]));
+
+	const float *x = atoms.getX();
+	const float *y = atoms.getY();
+	const float *z = atoms.getZ();
+	const float minimum = kMinDistance * kMinDistance;
+
+	// Every chunk keeps the bonds to atoms behind its own rows, so each bond is found once
+	const size_t numChunks = (numAtoms + kChunkSize - 1) / kChunkSize;
+	std::vector<std::vector<Bond>> found(numChunks);
+	utils::ThreadPool::get().parallelFor(numChunks, [&](size_t chunk)
+	{
+		std::vector<Bond> &bonds = found[chunk];
+		bonds.reserve(kChunkSize * 2);
+		for (size_t i = chunk * kChunkSize, end = std::min(numAtoms, (chunk + 1) * kChunkSize); i < end; ++i)
+		{
+			const float radius = getCovalentRadius(elements[i]);
+			if (radius <= 0.0f) continue;
+
+			const uint32_t atom = (uint32_t)i;
+			grid.forEachInRadius(glm::vec3(x[i], y[i], z[i]), radius + maxRadius + kTolerance, [&](uint32_t neighbour, float distance)
+			{
+				if (neighbour <= atom || distance < minimum) return;
+
+				const float limit = radius + getCovalentRadius(elements[neighbour]) + kTolerance;
+				if (getCovalentRadius(elements[neighbour]) > 0.0f && distance <= limit * limit) bonds.emplace_back(atom, neighbour);
+			});
+		}
+	});
+
+	size_t count = 0;
+	for (const std::vector<Bond> &bonds : found) count += bonds.size();
+
+	std::vector<Bond> bonds;
+	bonds.reserve(count + getNumBonds());
+	for (std::vector<Bond> &chunk : found)
+	{
+		bonds.insert(bonds.end(), chunk.begin(), chunk.end());
+		std::vector<Bond>().swap(chunk);
+	}
+	merge(numAtoms, bonds);
+}
+
+void BondTable::assign(const uint32_t *offsets, size_t numAtoms, const uint32_t *neighbours)
+{
+	mOffsets.assign(offsets, offsets + numAtoms + 1);
+	mNeighbours.assign(neighbours, neighbours + mOffsets.back());
+}
+
+// ---------------------------------------------------------------------
+
+void BondTable::merge(size_t numAtoms, std::vector<Bond> &bonds)
+{
+	// Bonds already in the table stay
+	if (getNumAtoms() == numAtoms) forEachBond([&bonds](uint32_t first, uint32_t second) { bonds.emplace_back(first, second); });
+
+	auto valid = [numAtoms](const Bond &bond) { return bond.first != bond.second && bond.first < numAtoms && bond.second < numAtoms; };
+
+	// Counting sort into rows, both directions
+	std::vector<uint32_t> offsets(numAtoms + 1, 0);
+	for (const Bond &bond : bonds)
+	{
+		if (!valid(bond)) continue;
+		++offsets[bond.first + 1];
+		++offsets[bond.second + 1];
+	}
+	for (size_t i = 0; i < numAtoms; ++i) offsets[i + 1] += offsets[i];
+
+	std::vector<uint32_t> neighbours(offsets.back());
+	{
+		std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+		for (const Bond &bond : bonds)
+		{
+			if (!valid(bond)) continue;
+			neighbours[cursor[bond.first]++] = bond.second;
+			neighbours[cursor[bond.second]++] = bond.first;
+		}
+	}
+
+	// Rows are short; sort them and drop repeated bonds (CONECT lists bonds from both atoms, double bonds twice)
+	const size_t numChunks = (numAtoms + kChunkSize - 1) / kChunkSize;
+	std::vector<uint32_t> counts(numAtoms + 1, 0);
+	utils::ThreadPool &pool = utils::ThreadPool::get();
+	pool.parallelFor(numChunks, [&](size_t chunk)
+	{
+		for (size_t i = chunk * kChunkSize, end = std::min(numAtoms, (chunk + 1) * kChunkSize); i < end; ++i)
+		{
+			uint32_t *first = neighbours.data() + offsets[i];
+			uint32_t *last = neighbours.data() + offsets[i + 1];
+			std::sort(first, last);
+			counts[i + 1] = (uint32_t)(std::unique(first, last) - first);
+		}
+	});
+	for (size_t i = 0; i < numAtoms; ++i) counts[i + 1] += counts[i];
+
+	mNeighbours.resize(counts.back());
+	pool.parallelFor(numChunks, [&](size_t chunk)
+	{
+		for (size_t i = chunk * kChunkSize, end = std::min(numAtoms, (chunk + 1) * kChunkSize); i < end; ++i)
+			std::copy(neighbours.begin() + offsets[i], neighbours.begin() + offsets[i] + (counts[i + 1] - counts[i]), mNeighbours.begin() + counts[i]);
+	});
+	mOffsets.swap(counts);
+}
+
+} // namespace pdb
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "AtomTable.h"
+#include "SpatialGrid.h"
+#include "Hierarchy.h"
+#include <vector>
+#include <cstdint>
+#include <utility>
+
+namespace pdb
+{
+
+typedef std::pair<uint32_t, uint32_t> Bond;	// rows of the two atoms
+
+/*
+	Covalent bonds as a compressed sparse row adjacency.
+	The bonded atoms of atom i are mNeighbours[mOffsets[i] .. mOffsets[i + 1]), ascending;
+	every bond is stored once for each of its atoms.
+*/
+class BondTable
+{
+public:
+	// Bonded if minDistance <= d <= covalent radius + covalent radius + tolerance (as Jmol and Open Babel do)
+	static const float kTolerance;
+	static const float kMinDistance;
+
+	BondTable();
+
+	void clear();
+
+	// Adds explicit bonds (e.g. CONECT records); self bonds, duplicates and rows >= numAtoms are dropped
+	void add(size_t numAtoms, const std::vector<Bond> &bonds);
+
+	// Adds the bonds implied by the distances of the atoms; the grid must index the same positions
+	void perceive(const AtomTable &atoms, const SpatialGrid &grid);
+
+	// Restores a table from its arrays (see the structure cache)
+	void assign(const uint32_t *offsets, size_t numAtoms, const uint32_t *neighbours);
+
+	// Calls fn(first, second) once per bond, first < second
+	template <typename Fn>
+	void forEachBond(Fn fn) const;
+protected:
+	// Rebuilds the adjacency from bonds, both directions, merged with the current one
+	void merge(size_t numAtoms, std::vector<Bond> &bonds);
+
+	std::vector<uint32_t>		mOffsets;	// numAtoms + 1
+	std::vector<uint32_t>		mNeighbours;
+public: // Mutators
+	size_t				getNumAtoms() const			{ return mOffsets.size() - 1; }
+	size_t				getNumBonds() const			{ return mNeighbours.size() / 2; }
+	IndexRange			getBonds(size_t atom) const		{ return IndexRange{ mOffsets[atom], mOffsets[atom + 1] }; }
+	uint32_t			getNeighbour(size_t slot) const		{ return mNeighbours[slot]; }
+
+	// Arrays, e.g. for the structure cache
+	const uint32_t			*getOffsets() const			{ return mOffsets.data(); }
+	const uint32_t			*getNeighbours() const			{ return mNeighbours.data(); }
+};
+
+// ---------------------------------------------------------------------
+
+template <typename Fn>
+void BondTable::forEachBond(Fn fn) const
+{
+	for (uint32_t atom = 0; atom + 1 < mOffsets.size(); ++atom)
+	{
+		for (uint32_t slot = mOffsets[atom]; slot < mOffsets[atom + 1]; ++slot)
+		{
+			if (atom < mNeighbours[slot]) fn(atom, mNeighbours[slot]);
+		}
+	}
+}
+
+} // namespace pdb
@@ -0,0 +1,458 @@
+#include "Bvh.h"
+#include "Common/ThreadPool.h"
+#include <atomic>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace pdb
+{
+
+const uint32_t Bvh::kLeaf;
+
+static const size_t kChunkSize = 16384;
+
+static size_t numChunks(size_t count)
+{
+	return (count + kChunkSize - 1) / kChunkSize;
+}
+
+// Spreads the low 10 bits of v to every third bit
+static uint32_t expandBits(uint32_t v)
+{
+	v = (v * 0x00010001u) & 0xFF0000FFu;
+	v = (v * 0x00000101u) & 0x0F00F00Fu;
+	v = (v * 0x00000011u) & 0xC30C30C3u;
+	v = (v * 0x00000005u) & 0x49249249u;
+	return v;
+}
+
+static unsigned leadingZeros(uint64_t word)
+{
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanReverse64(&index, word);
+	return 63u - (unsigned)index;
+#else
+	return (unsigned)__builtin_clzll(word);
+#endif
+}
+
+// ---------------------------------------------------------------------
+
+Bvh::Bvh()
+	: mRoot(kLeaf)
+{
+}
+
+void Bvh::clear()
+{
+	mRoot = kLeaf;
+	mNodes.clear();
+	mRanges.clear();
+	mParents.clear();
+	mKeys.clear();
+	mSpheres.clear();
+}
+
+void Bvh::build(const AtomTable &atoms)
+{
+	clear();
+	if (atoms.empty()) return;
+
+	sortAtoms(atoms);
+	buildNodes();
+	copySpheres(atoms);
+	computeBounds();
+}
+
+void Bvh::refit(const AtomTable &atoms)
+{
+	if (atoms.size() != size())
+	{
+		build(atoms);
+		return;
+	}
+
+	copySpheres(atoms);
+	computeBounds();
+}
+
+// ---------------------------------------------------------------------
+
+void Bvh::sortAtoms(const AtomTable &atoms)
+{
+	const size_t numAtoms = atoms.size();
+	const size_t chunks = numChunks(numAtoms);
+	utils::ThreadPool &pool = utils::ThreadPool::get();
+
+	glm::vec3 lower, upper;
+	{
+		std::vector<glm::vec3> lowers(chunks), uppers(chunks);
+		pool.parallelFor(chunks, [&](size_t chunk)
+		{
+			atoms.computeBounds(chunk * kChunkSize, std::min(numAtoms, (chunk + 1) * kChunkSize), lowers[chunk], uppers[chunk]);
+		});
+
+		lower = lowers[0];
+		upper = uppers[0];
+		for (size_t chunk = 1; chunk < chunks; ++chunk)
+		{
+			lower = glm::min(lower, lowers[chunk]);
+			upper = glm::max(upper, uppers[chunk]);
+		}
+	}
+
+	// Morton codes of the centers on a 1024^3 lattice over the bounds
+	const glm::vec3 extent = glm::max(upper - lower, glm::vec3(1e-6f));
+	const glm::vec3 scale = glm::vec3(1023.0f) / extent;
+	const float *x = atoms.getX();
+	const float *y = atoms.getY();
+	const float *z = atoms.getZ();
+
+	std::vector<uint64_t> keys(numAtoms);
+	pool.parallelFor(chunks, [&](size_t chunk)
+	{
+		for (size_t i = chunk * kChunkSize, end = std::min(numAtoms, (chunk + 1) * kChunkSize); i < end; ++i)
+		{
+			// NaN coordinates end up in cell 0
+			const uint32_t cx = (uint32_t)std::min(std::max((x[i] - lower.x) * scale.x, 0.0f), 1023.0f);
+			const uint32_t cy = (uint32_t)std::min(std::max((y[i] - lower.y) * scale.y, 0.0f), 1023.0f);
+			const uint32_t cz = (uint32_t)std::min(std::max((z[i] - lower.z) * scale.z, 0.0f), 1023.0f);
+			const uint32_t code = (expandBits(cx) << 2) | (expandBits(cy) << 1) | expandBits(cz);
+			keys[i] = ((uint64_t)code << 32) | i;
+		}
+	});
+
+	// Stable radix sort on the 30 code bits, 10 bits per pass. Every chunk counts its digits in parallel,
+	// then scatters to its own offsets, which keeps equal codes in row order.
+	const size_t kRadix = 1024;
+	std::vector<uint64_t> sorted(numAtoms);
+	std::vector<uint32_t> counts(chunks * kRadix);
+	for (unsigned shift = 32; shift < 62; shift += 10)
+	{
+		std::fill(counts.begin(), counts.end(), 0);
+		pool.parallelFor(chunks, [&](size_t chunk)
+		{
+			uint32_t *count = counts.data() + chunk * kRadix;
+			for (size_t i = chunk * kChunkSize, end = std::min(numAtoms, (chunk + 1) * kChunkSize); i < end; ++i)
+				++count[(keys[i] >> shift) & (kRadix - 1)];
+		});
+
+		// Offsets digit by digit, chunk by chunk within a digit
+		uint32_t offset = 0;
+		for (size_t digit = 0; digit < kRadix; ++digit)
+		{
+			for (size_t chunk = 0; chunk < chunks; ++chunk)
+			{
+				const uint32_t count = counts[chunk * kRadix + digit];
+				counts[chunk * kRadix + digit] = offset;
+				offset += count;
+			}
+		}
+
+		pool.parallelFor(chunks, [&](size_t chunk)
+		{
+			uint32_t *cursor = counts.data() + chunk * kRadix;
+			for (size_t i = chunk * kChunkSize, end = std::min(numAtoms, (chunk + 1) * kChunkSize); i < end; ++i)
+				sorted[cursor[(keys[i] >> shift) & (kRadix - 1)]++] = keys[i];
+		});
+		keys.swap(sorted);
+	}
+
+	mKeys.swap(keys);
+}
+
+void Bvh::buildNodes()
+{
+	const size_t numAtoms = mKeys.size();
+	mParents.assign(2 * numAtoms - 1, kLeaf);
+	if (numAtoms == 1)
+	{
+		mRoot = kLeaf | 0;
+		return;
+	}
+
+	mRoot = 0;
+	mNodes.resize(numAtoms - 1);
+	mRanges.resize(numAtoms - 1);
+	const int64_t last = (int64_t)numAtoms - 1;
+	const uint64_t *keys = mKeys.data();
+
+	// Length of the common prefix of two keys, -1 outside the array; keys are unique
+	auto delta = [&](int64_t i, int64_t j) -> int
+	{
+		if (j < 0 || j > last) return -1;
+		return (int)leadingZeros(keys[i] ^ keys[j]);
+	};
+
+	const size_t numInternal = numAtoms - 1;
+	utils::ThreadPool::get().parallelFor(numChunks(numInternal), [&](size_t chunk)
+	{
+		for (int64_t i = (int64_t)(chunk * kChunkSize), end = (int64_t)std::min(numInternal, (chunk + 1) * kChunkSize); i < end; ++i)
+		{
+			// Direction of the range and its other end
+			const int64_t d = delta(i, i + 1) > delta(i, i - 1) ? 1 : -1;
+			const int minimum = delta(i, i - d);
+			int64_t maxLength = 2;
+			while (delta(i, i + maxLength * d) > minimum) maxLength *= 2;
+
+			int64_t length = 0;
+			for (int64_t t = maxLength / 2; t >= 1; t /= 2)
+			{
+				if (delta(i, i + (length + t) * d) > minimum) length += t;
+			}
+			const int64_t j = i + length * d;
+
+			// Split where the common prefix with i ends
+			const int prefix = delta(i, j);
+			int64_t split = 0;
+			for (int64_t divider = 2, t = (length + 1) / 2; ; divider *= 2, t = (length + divider - 1) / divider)
+			{
+				if (delta(i, i + (split + t) * d) > prefix) split += t;
+				if (t <= 1) break;
+			}
+			const int64_t gamma = i + split * d + std::min<int64_t>(d, 0);
+
+			const int64_t first = std::min(i, j), lastAtom = std::max(i, j);
+			Node &node = mNodes[i];
+			node.left = first == gamma ? kLeaf | (uint32_t)gamma : (uint32_t)gamma;
+			node.right = lastAtom == gamma + 1 ? kLeaf | (uint32_t)(gamma + 1) : (uint32_t)(gamma + 1);
+			mRanges[i] = std::make_pair((uint32_t)first, (uint32_t)lastAtom);
+
+			// Every child has exactly one parent, so these writes never collide
+			mParents[node.left & kLeaf ? numInternal + (node.left & ~kLeaf) : node.left] = (uint32_t)i;
+			mParents[node.right & kLeaf ? numInternal + (node.right & ~kLeaf) : node.right] = (uint32_t)i;
+		}
+	});
+}
+
+void Bvh::copySpheres(const AtomTable &atoms)
+{
+	const size_t numAtoms = mKeys.size();
+	mSpheres.resize(numAtoms);
+
+	const float *x = atoms.getX();
+	const float *y = atoms.getY();
+	const float *z = atoms.getZ();
+	const float *radii = atoms.getRadii();
+	utils::ThreadPool::get().parallelFor(numChunks(numAtoms), [&](size_t chunk)
+	{
+		for (size_t i = chunk * kChunkSize, end = std::min(numAtoms, (chunk + 1) * kChunkSize); i < end; ++i)
+		{
+			const uint32_t row = (uint32_t)mKeys[i];
+			mSpheres[i] = glm::vec4(x[row], y[row], z[row], radii[row]);
+		}
+	});
+}
+
+void Bvh::computeBounds()
+{
+	if (mNodes.empty()) return;
+
+	// Bottom up from every leaf; the second child to arrive at a node computes its bounds and goes on
+	const size_t numAtoms = mSpheres.size();
+	const size_t numInternal = mNodes.size();
+	std::vector<std::atomic<uint32_t>> visits(numInternal);
+	for (std::atomic<uint32_t> &visit : visits) visit.store(0, std::memory_order_relaxed);
+
+	utils::ThreadPool::get().parallelFor(numChunks(numAtoms), [&](size_t chunk)
+	{
+		for (size_t i = chunk * kChunkSize, end = std::min(numAtoms, (chunk + 1) * kChunkSize); i < end; ++i)
+		{
+			uint32_t node = mParents[numInternal + i];
+			while (node != kLeaf)
+			{
+				if (visits[node].fetch_add(1, std::memory_order_acq_rel) == 0) break;
+
+				glm::vec3 leftLower, leftUpper, rightLower, rightUpper;
+				getBounds(mNodes[node].left, leftLower, leftUpper);
+				getBounds(mNodes[node].right, rightLower, rightUpper);
+				mNodes[node].lower = glm::min(leftLower, rightLower);
+				mNodes[node].upper = glm::max(leftUpper, rightUpper);
+				node = mParents[node];
+			}
+		}
+	});
+}
+
+void Bvh::getBounds(uint32_t child, glm::vec3 &lower, glm::vec3 &upper) const
+{
+	if (child & kLeaf)
+	{
+		const glm::vec4 &sphere = mSpheres[child & ~kLeaf];
+		const glm::vec3 center(sphere);
+		lower = center - glm::vec3(sphere.w);
+		upper = center + glm::vec3(sphere.w);
+	}
+	else
+	{
+		lower = mNodes[child].lower;
+		upper = mNodes[child].upper;
+	}
+}
+
+// ---------------------------------------------------------------------
+
+int Bvh::intersect(const glm::vec3 &origin, const glm::vec3 &direction, float *distance) const
+{
+	if (empty()) return -1;
+
+	const glm::vec3 inverse(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+	const float a = glm::dot(direction, direction);
+
+	// Entry distance of the ray into a box, infinity on a miss
+	auto enter = [&](const glm::vec3 &lower, const glm::vec3 &upper, float limit)
+	{
+		const glm::vec3 t0 = (lower - origin) * inverse;
+		const glm::vec3 t1 = (upper - origin) * inverse;
+		const glm::vec3 near = glm::min(t0, t1), far = glm::max(t0, t1);
+		const float tNear = std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+		const float tFar = std::min(std::min(far.x, far.y), std::min(far.z, limit));
+		return tNear <= tFar ? tNear : std::numeric_limits<float>::infinity();
+	};
+
+	float nearest = std::numeric_limits<float>::infinity();
+	int hit = -1;
+	auto testSphere = [&](uint32_t sorted)
+	{
+		const glm::vec4 &sphere = mSpheres[sorted];
+		const glm::vec3 offset = glm::vec3(sphere) - origin;
+		const float b = glm::dot(offset, direction);
+		const float c = glm::dot(offset, offset) - sphere.w * sphere.w;
+		const float discriminant = b * b - a * c;
+		if (discriminant < 0.0f) return;
+
+		// Nearest root in front of the origin; the far one if the origin is inside the sphere
+		const float root = std::sqrt(discriminant);
+		float t = (b - root) / a;
+		if (t < 0.0f) t = (b + root) / a;
+		if (t >= 0.0f && t < nearest)
+		{
+			nearest = t;
+			hit = (int)getRow(sorted);
+		}
+	};
+
+	if (mRoot & kLeaf)
+	{
+		testSphere(mRoot & ~kLeaf);
+	}
+	else
+	{
+		// Tree depth is bounded by the 64 key bits
+		uint32_t stack[128];
+		size_t top = 0;
+		stack[top++] = mRoot;
+		while (top > 0)
+		{
+			const Node &node = mNodes[stack[--top]];
+			if (enter(node.lower, node.upper, nearest) == std::numeric_limits<float>::infinity()) continue;
+
+			// Leaves are tested right away, internal children are pushed nearer one last so it is visited first
+			const float miss = std::numeric_limits<float>::infinity();
+			float tLeft = miss, tRight = miss;
+			if (node.left & kLeaf)	testSphere(node.left & ~kLeaf);
+			else			tLeft = enter(mNodes[node.left].lower, mNodes[node.left].upper, nearest);
+			if (node.right & kLeaf)	testSphere(node.right & ~kLeaf);
+			else			tRight = enter(mNodes[node.right].lower, mNodes[node.right].upper, nearest);
+
+			const bool leftFirst = tLeft <= tRight;
+			const uint32_t first = leftFirst ? node.left : node.right, second = leftFirst ? node.right : node.left;
+			if (std::max(tLeft, tRight) != miss) stack[top++] = second;
+			if (std::min(tLeft, tRight) != miss) stack[top++] = first;
+		}
+	}
+
+	if (hit >= 0 && distance) *distance = nearest * std::sqrt(a);
+	return hit;
+}
+
+template <typename Classify, typename Test>
+void Bvh::query(Classify classify, Test test, std::vector<uint32_t> &rows) const
+{
+	rows.clear();
+	if (empty()) return;
+
+	auto visitLeaf = [&](uint32_t sorted)
+	{
+		if (test(glm::vec3(mSpheres[sorted]))) rows.push_back(getRow(sorted));
+	};
+
+	if (mRoot & kLeaf)
+	{
+		visitLeaf(mRoot & ~kLeaf);
+		return;
+	}
+
+	uint32_t stack[128];
+	size_t top = 0;
+	stack[top++] = mRoot;
+	while (top > 0)
+	{
+		const uint32_t index = stack[--top];
+		const Node &node = mNodes[index];
+		const int inside = classify(node.lower, node.upper);
+		if (inside < 0) continue;
+		if (inside > 0)
+		{
+			// Whole subtree: its atoms are one run of the sorted order
+			for (uint32_t sorted = mRanges[index].first; sorted <= mRanges[index].second; ++sorted) rows.push_back(getRow(sorted));
+			continue;
+		}
+
+		for (uint32_t child : { node.right, node.left })
+		{
+			if (child & kLeaf)	visitLeaf(child & ~kLeaf);
+			else			stack[top++] = child;
+		}
+	}
+}
+
+void Bvh::queryBox(const glm::vec3 &lower, const glm::vec3 &upper, std::vector<uint32_t> &rows) const
+{
+	auto classify = [&](const glm::vec3 &nodeLower, const glm::vec3 &nodeUpper)
+	{
+		if (nodeUpper.x < lower.x || nodeUpper.y < lower.y || nodeUpper.z < lower.z || nodeLower.x > upper.x || nodeLower.y > upper.y || nodeLower.z > upper.z) return -1;
+		if (nodeLower.x >= lower.x && nodeLower.y >= lower.y && nodeLower.z >= lower.z && nodeUpper.x <= upper.x && nodeUpper.y <= upper.y && nodeUpper.z <= upper.z) return 1;
+		return 0;
+	};
+	auto test = [&](const glm::vec3 &p)
+	{
+		return p.x >= lower.x && p.y >= lower.y && p.z >= lower.z && p.x <= upper.x && p.y <= upper.y && p.z <= upper.z;
+	};
+	query(classify, test, rows);
+}
+
+void Bvh::queryFrustum(const glm::vec4 planes[6], std::vector<uint32_t> &rows) const
+{
+	auto classify = [&](const glm::vec3 &lower, const glm::vec3 &upper)
+	{
+		int inside = 1;
+		for (int i = 0; i < 6; ++i)
+		{
+			const glm::vec4 &plane = planes[i];
+			// Corners furthest along and against the normal
+			const glm::vec3 positive(plane.x >= 0.0f ? upper.x : lower.x, plane.y >= 0.0f ? upper.y : lower.y, plane.z >= 0.0f ? upper.z : lower.z);
+			const glm::vec3 negative(plane.x >= 0.0f ? lower.x : upper.x, plane.y >= 0.0f ? lower.y : upper.y, plane.z >= 0.0f ? lower.z : upper.z);
+			if (glm::dot(glm::vec3(plane), positive) + plane.w < 0.0f) return -1;
+			if (glm::dot(glm::vec3(plane), negative) + plane.w < 0.0f) inside = 0;
+		}
+		return inside;
+	};
+	auto test = [&](const glm::vec3 &p)
+	{
+		for (int i = 0; i < 6; ++i)
+		{
+			if (glm::dot(glm::vec3(planes[i]), p) + planes[i].w < 0.0f) return false;
+		}
+		return true;
+	};
+	query(classify, test, rows);
+}
+
+} // namespace pdb
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "AtomTable.h"
+#include <vector>
+#include <cstdint>
+#include <utility>
+
+namespace pdb
+{
+
+/*
+	Bounding volume hierarchy over the atom spheres (position and radius) for ray picking and marquee selection.
+	Linear BVH: atoms are sorted along a 30 bit Morton curve and internal node i splits its range of the sorted
+	atoms at the highest differing key bit (Karras 2012), so every node is built independently in parallel.
+	Refit keeps the tree and recomputes the bounds bottom up; it stays correct for any motion but the tree gets
+	looser, so structures that changed shape completely should be rebuilt.
+*/
+class Bvh
+{
+public:
+	Bvh();
+
+	void clear();
+	void build(const AtomTable &atoms);
+	void refit(const AtomTable &atoms);	// same atoms at new positions
+
+	// Row of the nearest sphere hit by origin + t * direction with t >= 0, -1 on a miss
+	int intersect(const glm::vec3 &origin, const glm::vec3 &direction, float *distance = nullptr) const;
+
+	// Rows whose centers lie inside the box
+	void queryBox(const glm::vec3 &lower, const glm::vec3 &upper, std::vector<uint32_t> &rows) const;
+	// Rows whose centers lie inside all planes; a point p is inside a plane if dot(plane.xyz, p) + plane.w >= 0
+	void queryFrustum(const glm::vec4 planes[6], std::vector<uint32_t> &rows) const;
+protected:
+	// Children with kLeaf set are indices into the sorted atoms, otherwise internal nodes
+	struct Node
+	{
+		glm::vec3	lower;
+		uint32_t	left;
+		glm::vec3	upper;
+		uint32_t	right;
+	};
+	static const uint32_t kLeaf = 0x80000000u;
+
+	void sortAtoms(const AtomTable &atoms);
+	void buildNodes();
+	void copySpheres(const AtomTable &atoms);
+	void computeBounds();
+
+	void getBounds(uint32_t child, glm::vec3 &lower, glm::vec3 &upper) const;
+
+	// Visits the tree; classify(lower, upper) returns -1 to skip a node, 1 to take all of its atoms, 0 to descend
+	template <typename Classify, typename Test>
+	void query(Classify classify, Test test, std::vector<uint32_t> &rows) const;
+
+	uint32_t				mRoot;
+	std::vector<Node>			mNodes;		// numAtoms - 1 internal nodes
+	std::vector<std::pair<uint32_t, uint32_t>>	mRanges;	// first and last sorted atom of every internal node
+	std::vector<uint32_t>			mParents;	// internal nodes, then the sorted atoms
+
+	// Sorted along the curve
+	std::vector<uint64_t>			mKeys;		// Morton code << 32 | row
+	std::vector<glm::vec4>			mSpheres;	// center and radius
+public: // Mutators
+	bool					empty() const		{ return mSpheres.empty(); }
+	size_t					size() const		{ return mSpheres.size(); }
+	size_t					getNumNodes() const	{ return mNodes.size(); }
+	uint32_t				getRow(size_t sorted) const	{ return (uint32_t)mKeys[sorted]; }
+};
+
+} // namespace pdb
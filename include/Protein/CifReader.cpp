@@ -0,0 +1,428 @@
+#include "CifReader.h"
+#include "Common/ThreadPool.h"
+#include <boost/algorithm/string/predicate.hpp>
+
+namespace pdb
+{
+namespace parser
+{
+
+static bool isSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+/*
+	Tokenizer
+*/
+
+CifTokenizer::TokenType CifTokenizer::next(std::string_view &token)
+{
+	const size_t size = mText.size();
+
+	// Skip blanks and comments
+	while (mOffset < size)
+	{
+		char c = mText[mOffset];
+		if (isSpace(c)) { ++mOffset; continue; }
+		if (c == '#')
+		{
+			while (mOffset < size && mText[mOffset] != '\n' && mText[mOffset] != '\r') ++mOffset;
+			continue;
+		}
+		break;
+	}
+	if (mOffset >= size) return END;
+
+	const size_t begin = mOffset;
+	const char c = mText[begin];
+	const bool lineStart = begin == 0 || mText[begin - 1] == '\n' || mText[begin - 1] == '\r';
+
+	// Text field: from ';' at the start of a line to the next line starting with ';'
+	if (c == ';' && lineStart)
+	{
+		size_t end = begin + 1;
+		while (true)
+		{
+			end = mText.find(';', end);
+			if (end == std::string_view::npos) throw CifExc();
+			if (mText[end - 1] == '\n' || mText[end - 1] == '\r') break;
+			++end;
+		}
+		token = mText.substr(begin + 1, end - begin - 1);
+		mOffset = end + 1;
+		return VALUE;
+	}
+
+	// Quoted value: the quote closes only when followed by a blank
+	if (c == '\'' || c == '"')
+	{
+		size_t end = begin + 1;
+		while (end < size && !(mText[end] == c && (end + 1 == size || isSpace(mText[end + 1])))) ++end;
+		if (end >= size) throw CifExc();
+
+		token = mText.substr(begin + 1, end - begin - 1);
+		mOffset = end + 1;
+		return VALUE;
+	}
+
+	size_t end = begin;
+	while (end < size && !isSpace(mText[end])) ++end;
+	token = mText.substr(begin, end - begin);
+	mOffset = end;
+
+	if (c == '_')							return TAG;
+	if (boost::algorithm::istarts_with(token, "loop_"))		return LOOP;
+	if (boost::algorithm::istarts_with(token, "data_"))		return DATA;
+	return VALUE;
+}
+
+/*
+	Reader
+*/
+
+bool CifReader::addRow(const std::string_view *values, const Columns &columns, RecordChunk &chunk)
+{
+	// Same record types as the PDB loader
+	if (columns.group >= 0 && values[columns.group] != "ATOM" && values[columns.group] != "HETATM") return true;
+
+	AtomRecord record;
+	record.serial = 0;
+	if (columns.id >= 0 && !parseInt(values[columns.id], record.serial)) return false;
+
+	if (!parseReal(values[columns.x], record.position.x))	return false;
+	if (!parseReal(values[columns.y], record.position.y))	return false;
+	if (!parseReal(values[columns.z], record.position.z))	return false;
+
+	record.name = columns.atomId >= 0 ? values[columns.atomId] : std::string_view();
+	record.element = columns.typeSymbol >= 0 ? parseElement(values[columns.typeSymbol]) : Element::Unknown;
+	if (record.element == Element::Unknown && !record.name.empty()) record.element = parseElement(record.name.substr(0, 1));
+
+	// Author identifiers, as in PDB files; '?' and '.' mark missing values
+	auto value = [values](int column)
+	{
+		if (column < 0) return std::string_view();
+		std::string_view field = values[column];
+		return field == "?" || field == "." ? std::string_view() : field;
+	};
+	record.residueName = value(columns.residueName);
+	record.chainId = value(columns.chainId);
+	if (!parseInt(value(columns.residueNumber), record.residueNumber)) record.residueNumber = 0;
+	std::string_view insertionCode = value(columns.insertionCode);
+	record.insertionCode = insertionCode.empty() ? ' ' : insertionCode[0];
+
+	record.model = -1;
+	if (columns.model >= 0 && !parseInt(values[columns.model], record.model)) record.model = -1;
+
+	chunk.add(record);
+	return true;
+}
+
+void CifReader::mapColumns(const std::vector<std::string_view> &tags, Columns &columns)
+{
+	int authAtomId = -1;
+	int labelCompId = -1;
+	int labelAsymId = -1;
+	int labelSeqId = -1;
+	for (size_t i = 0; i < tags.size(); ++i)
+	{
+		std::string_view field = tags[i].substr(sizeof("_atom_site.") - 1);
+		if		(boost::algorithm::iequals(field, "group_PDB"))		columns.group = (int)i;
+		else if (boost::algorithm::iequals(field, "id"))		columns.id = (int)i;
+		else if (boost::algorithm::iequals(field, "type_symbol"))	columns.typeSymbol = (int)i;
+		else if (boost::algorithm::iequals(field, "label_atom_id"))	columns.atomId = (int)i;
+		else if (boost::algorithm::iequals(field, "auth_atom_id"))	authAtomId = (int)i;
+		else if (boost::algorithm::iequals(field, "auth_comp_id"))	columns.residueName = (int)i;
+		else if (boost::algorithm::iequals(field, "label_comp_id"))	labelCompId = (int)i;
+		else if (boost::algorithm::iequals(field, "auth_asym_id"))	columns.chainId = (int)i;
+		else if (boost::algorithm::iequals(field, "label_asym_id"))	labelAsymId = (int)i;
+		else if (boost::algorithm::iequals(field, "auth_seq_id"))	columns.residueNumber = (int)i;
+		else if (boost::algorithm::iequals(field, "label_seq_id"))	labelSeqId = (int)i;
+		else if (boost::algorithm::iequals(field, "pdbx_PDB_ins_code"))	columns.insertionCode = (int)i;
+		else if (boost::algorithm::iequals(field, "Cartn_x"))		columns.x = (int)i;
+		else if (boost::algorithm::iequals(field, "Cartn_y"))		columns.y = (int)i;
+		else if (boost::algorithm::iequals(field, "Cartn_z"))		columns.z = (int)i;
+		else if (boost::algorithm::iequals(field, "pdbx_PDB_model_num"))	columns.model = (int)i;
+	}
+	if (columns.atomId < 0) columns.atomId = authAtomId;
+	if (columns.residueName < 0) columns.residueName = labelCompId;
+	if (columns.chainId < 0) columns.chainId = labelAsymId;
+	if (columns.residueNumber < 0) columns.residueNumber = labelSeqId;
+	if (columns.x < 0 || columns.y < 0 || columns.z < 0) throw CifExc();
+}
+
+CifReader::LinesResult CifReader::readLines(std::string_view body, size_t numColumns, const Columns &columns, RecordChunk &chunk)
+{
+	std::vector<std::string_view> values(numColumns);
+
+	LineReader lines(body);
+	std::string_view line;
+	while (lines.next(line))
+	{
+		// Text fields span lines; let the caller fall back to the streaming path
+		if (!line.empty() && line[0] == ';') return IRREGULAR;
+
+		CifTokenizer tokenizer(line);
+		std::string_view token;
+		size_t count = 0;
+		CifTokenizer::TokenType type;
+		while ((type = tokenizer.next(token)) != CifTokenizer::END)
+		{
+			// The next tag, loop or block ends the body
+			if (type != CifTokenizer::VALUE) return count == 0 ? TERMINATED : IRREGULAR;
+			if (count == numColumns) return IRREGULAR;
+			values[count++] = token;
+		}
+
+		// Blank and comment lines
+		if (count == 0) continue;
+		if (count != numColumns) return IRREGULAR;
+
+		if (!addRow(values.data(), columns, chunk)) throw CifExc();
+	}
+
+	return COMPLETE;
+}
+
+void CifReader::read(std::string_view text)
+{
+	mChunks.clear();
+
+	CifTokenizer tokenizer(text);
+	std::string_view token;
+	CifTokenizer::TokenType type = tokenizer.next(token);
+
+	bool inBlock = false;
+	while (type != CifTokenizer::END)
+	{
+		if (type == CifTokenizer::DATA)
+		{
+			// First data block only
+			if (inBlock) break;
+			inBlock = true;
+			type = tokenizer.next(token);
+			continue;
+		}
+
+		if (type != CifTokenizer::LOOP)
+		{
+			type = tokenizer.next(token);
+			continue;
+		}
+
+		// ---------------------------------------------
+		// Loop header
+		// ---------------------------------------------
+
+		std::vector<std::string_view> tags;
+		size_t bodyBegin = tokenizer.getOffset();
+		while ((type = tokenizer.next(token)) == CifTokenizer::TAG)
+		{
+			tags.push_back(token);
+			bodyBegin = tokenizer.getOffset();
+		}
+
+		bool atomSite = !tags.empty() && boost::algorithm::istarts_with(tags[0], "_atom_site.");
+		if (!atomSite)
+		{
+			// Skip the values of other categories
+			while (type == CifTokenizer::VALUE) type = tokenizer.next(token);
+			continue;
+		}
+
+		Columns columns;
+		mapColumns(tags, columns);
+
+		// ---------------------------------------------
+		// Loop body: ends at the next tag, loop or block
+		// ---------------------------------------------
+
+		size_t bodyEnd = bodyBegin;
+		{
+			LineReader lines(text.substr(bodyBegin));
+			std::string_view line;
+			while (lines.next(line))
+			{
+				std::string_view head = trim(line);
+				if (!head.empty() && (head[0] == '_' ||
+					boost::algorithm::istarts_with(head, "loop_") ||
+					boost::algorithm::istarts_with(head, "data_")))
+					break;
+				bodyEnd = bodyBegin + lines.getOffset();
+			}
+		}
+		std::string_view body = text.substr(bodyBegin, bodyEnd - bodyBegin);
+
+		// One row per line: tokenize chunks of lines in parallel
+		utils::ThreadPool &pool = utils::ThreadPool::get();
+		const size_t chunkSize = 256 * 1024;
+		std::vector<std::string_view> parts = splitLines(body, std::min(body.size() / chunkSize + 1, pool.getNumThreads() * 4));
+
+		std::vector<RecordChunk> chunks(parts.size());
+		std::vector<char> complete(parts.size(), 0);
+		pool.parallelFor(parts.size(), [&](size_t i)
+		{
+			complete[i] = readLines(parts[i], tags.size(), columns, chunks[i]) != IRREGULAR;
+		});
+
+		bool parallel = true;
+		for (char c : complete) parallel = parallel && c;
+
+		if (parallel)
+		{
+			for (auto &chunk : chunks) mChunks.push_back(std::move(chunk));
+			tokenizer.setOffset(bodyEnd);
+		}
+		else
+		{
+			// Rows span lines; stream the tokens instead
+			RecordChunk chunk;
+			std::vector<std::string_view> values(tags.size());
+
+			tokenizer.setOffset(bodyBegin);
+			size_t count = 0;
+			size_t offset = tokenizer.getOffset();
+			while ((type = tokenizer.next(token)) == CifTokenizer::VALUE)
+			{
+				values[count++] = token;
+				if (count == tags.size())
+				{
+					if (!addRow(values.data(), columns, chunk)) throw CifExc();
+					count = 0;
+				}
+				offset = tokenizer.getOffset();
+			}
+			if (count != 0) throw CifExc();
+
+			mChunks.push_back(std::move(chunk));
+			tokenizer.setOffset(offset);
+		}
+
+		type = tokenizer.next(token);
+	}
+}
+
+bool CifReader::read(BlockReader &blocks)
+{
+	mChunks.clear();
+
+	// ---------------------------------------------
+	// Header: find the _atom_site loop line by line
+	// ---------------------------------------------
+
+	enum State { SEARCH, TAGS, BODY };
+	State state = SEARCH;
+	bool inBlock = false;
+	bool inTextField = false;
+
+	// Tags outlive the block they were read from
+	std::vector<std::string> tagNames;
+	Columns columns;
+
+	TextBlockRef block;
+	std::string_view body;
+	while (state != BODY && (block = blocks.next()))
+	{
+		LineReader lines(*block);
+		std::string_view line;
+		size_t lineBegin = 0;
+		while (lines.next(line))
+		{
+			const size_t begin = lineBegin;
+			lineBegin = lines.getOffset();
+
+			if (inTextField)
+			{
+				if (!line.empty() && line[0] == ';') inTextField = false;
+				continue;
+			}
+
+			std::string_view head = trim(line);
+			if (state == TAGS)
+			{
+				if (head.empty() || head[0] == '#') continue;
+				if (head[0] == '_')
+				{
+					// One tag per line, as written by the PDB
+					if (head.find_first_of(" \t") != std::string_view::npos) return false;
+					tagNames.emplace_back(head);
+					continue;
+				}
+
+				if (!tagNames.empty() && boost::algorithm::istarts_with(tagNames[0], "_atom_site."))
+				{
+					std::vector<std::string_view> tags(tagNames.begin(), tagNames.end());
+					mapColumns(tags, columns);
+					body = std::string_view(*block).substr(begin);
+					state = BODY;
+					break;
+				}
+				state = SEARCH;
+			}
+
+			// Values of other categories are skipped
+			if (!line.empty() && line[0] == ';') { inTextField = true; continue; }
+			if (boost::algorithm::istarts_with(head, "data_"))
+			{
+				// First data block only
+				if (inBlock) return true;
+				inBlock = true;
+			}
+			else if (boost::algorithm::istarts_with(head, "loop_"))
+			{
+				if (!trim(head.substr(5)).empty()) return false;
+				tagNames.clear();
+				state = TAGS;
+			}
+		}
+	}
+	if (state != BODY) return true;
+
+	// ---------------------------------------------
+	// Body: batches of blocks are tokenized in parallel while the next ones are decoded
+	// ---------------------------------------------
+
+	utils::ThreadPool &pool = utils::ThreadPool::get();
+	const size_t batchSize = std::max<size_t>(pool.getNumThreads(), 1);
+
+	// Blocks stay alive until their records are detached
+	std::vector<TextBlockRef> batch;
+	std::vector<std::string_view> parts;
+	batch.push_back(block);
+	parts.push_back(body);
+
+	bool finished = false;
+	while (!finished)
+	{
+		while (parts.size() < batchSize && (block = blocks.next()))
+		{
+			batch.push_back(block);
+			parts.push_back(*block);
+		}
+		if (parts.empty()) break;
+		finished = parts.size() < batchSize;
+
+		std::vector<RecordChunk> chunks(parts.size());
+		std::vector<LinesResult> results(parts.size(), COMPLETE);
+		pool.parallelFor(parts.size(), [&](size_t i)
+		{
+			results[i] = readLines(parts[i], tagNames.size(), columns, chunks[i]);
+			chunks[i].detach();
+		});
+
+		for (size_t i = 0; i < parts.size(); ++i)
+		{
+			if (results[i] == IRREGULAR) return false;
+			mChunks.push_back(std::move(chunks[i]));
+			if (results[i] == TERMINATED) return true;
+		}
+
+		batch.clear();
+		parts.clear();
+	}
+
+	return true;
+}
+
+} // namespace parser
+} // namespace pdb
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "PdbParser.h"
+#include <string_view>
+#include <vector>
+
+namespace pdb
+{
+namespace parser
+{
+
+/*
+	Streaming tokenizer for the CIF text syntax (mmCIF).
+	Tokens are slices of the source text; quotes and text field markers are stripped.
+*/
+class CifTokenizer
+{
+public:
+	enum TokenType { END, TAG, LOOP, DATA, VALUE };
+
+	explicit CifTokenizer(std::string_view text) : mText(text), mOffset(0) {}
+
+	TokenType next(std::string_view &token);
+protected:
+	std::string_view	mText;
+	size_t			mOffset;
+public: // Mutators
+	size_t			getOffset() const		{ return mOffset; }
+	void			setOffset(size_t offset)	{ mOffset = offset; }
+};
+
+/*
+	Reads the _atom_site category of the first data block into atom records.
+	Rows that sit on one line each (as written by the PDB) are tokenized in parallel.
+*/
+class CifReader
+{
+public:
+	void read(std::string_view text);
+
+	// Streaming variant for text arriving in blocks (e.g. gzip); rows must sit on one line each.
+	// Returns false for other layouts, the caller then has to read() the whole text.
+	bool read(BlockReader &blocks);
+protected:
+	// Column indices of the _atom_site fields used by Protein
+	struct Columns
+	{
+		int		group = -1;
+		int		id = -1;
+		int		typeSymbol = -1;
+		int		atomId = -1;
+		int		residueName = -1;
+		int		chainId = -1;
+		int		residueNumber = -1;
+		int		insertionCode = -1;
+		int		x = -1;
+		int		y = -1;
+		int		z = -1;
+		int		model = -1;
+	};
+
+	// Outcome of tokenizing a piece of the loop body
+	enum LinesResult { COMPLETE, TERMINATED, IRREGULAR };
+
+	static void mapColumns(const std::vector<std::string_view> &tags, Columns &columns);
+	bool addRow(const std::string_view *values, const Columns &columns, RecordChunk &chunk);
+	LinesResult readLines(std::string_view body, size_t numColumns, const Columns &columns, RecordChunk &chunk);
+
+	std::vector<RecordChunk>	mChunks;
+public: // Mutators
+	std::vector<RecordChunk>	const &getChunks() const	{ return mChunks; }
+};
+
+class CifExc : public std::exception {
+public:
+	virtual const char* what() const throw() { return "CIF parser exception: malformed atom_site category"; }
+};
+
+} // namespace parser
+} // namespace pdb
@@ -0,0 +1,125 @@
+#include "ContactMap.h"
+#include "Common/ThreadPool.h"
+#include "Common/Simd.h"
+#include <algorithm>
+#include <cmath>
+
+namespace pdb
+{
+
+static const size_t kTileRows = 64;
+static const size_t kTileColumns = 1024;	// 12 KB of coordinates and 4 KB of distances
+
+// ---------------------------------------------------------------------
+
+ContactMap::ContactMap()
+	: mCutoff(0.0f)
+{
+}
+
+void ContactMap::clear()
+{
+	mRows.clear();
+	mX.clear();
+	mY.clear();
+	mZ.clear();
+	mCutoff = 0.0f;
+	mDistances.clear();
+	mContacts.clear();
+}
+
+void ContactMap::copyPositions(const AtomTable &atoms, const std::vector<uint32_t> &rows)
+{
+	mRows = rows;
+	mX.resize(rows.size());
+	mY.resize(rows.size());
+	mZ.resize(rows.size());
+	for (size_t i = 0; i < rows.size(); ++i)
+	{
+		mX[i] = atoms.getX()[rows[i]];
+		mY[i] = atoms.getY()[rows[i]];
+		mZ[i] = atoms.getZ()[rows[i]];
+	}
+}
+
+void ContactMap::computeDistances(const AtomTable &atoms, const std::vector<uint32_t> &rows)
+{
+	copyPositions(atoms, rows);
+	const size_t n = rows.size();
+	mDistances.resize(n * n);
+
+	utils::ThreadPool::get().parallelFor((n + kTileRows - 1) / kTileRows, [&](size_t tile)
+	{
+		const size_t firstRow = tile * kTileRows, lastRow = std::min(n, firstRow + kTileRows);
+		for (size_t column = 0; column < n; column += kTileColumns)
+		{
+			const size_t count = std::min(kTileColumns, n - column);
+			for (size_t i = firstRow; i < lastRow; ++i)
+			{
+				const glm::vec3 point(mX[i], mY[i], mZ[i]);
+				utils::simd::computeDistances(&mX[column], &mY[column], &mZ[column], count, point, &mDistances[i * n + column]);
+			}
+		}
+	});
+}
+
+void ContactMap::computeContacts(const AtomTable &atoms, const std::vector<uint32_t> &rows, float cutoff, const SpatialGrid *grid)
+{
+	copyPositions(atoms, rows);
+	mCutoff = cutoff;
+	mContacts.clear();
+	const size_t n = rows.size();
+	const size_t numTiles = (n + kTileRows - 1) / kTileRows;
+	std::vector<std::vector<Contact>> found(numTiles);
+
+	if (grid && grid->size() == atoms.size())
+	{
+		// Index of every atom among the rows, so the neighbours of the grid map back
+		std::vector<int32_t> indices(atoms.size(), -1);
+		for (size_t i = 0; i < n; ++i) indices[rows[i]] = (int32_t)i;
+
+		const float cutoff2 = cutoff * cutoff;
+		utils::ThreadPool::get().parallelFor(numTiles, [&](size_t tile)
+		{
+			std::vector<Contact> &contacts = found[tile];
+			for (size_t i = tile * kTileRows, last = std::min(n, (tile + 1) * kTileRows); i < last; ++i)
+			{
+				const size_t begin = contacts.size();
+				grid->forEachInRadius(glm::vec3(mX[i], mY[i], mZ[i]), cutoff, [&](uint32_t row, float distance2)
+				{
+					const int32_t j = indices[row];
+					if (j > (int32_t)i && distance2 < cutoff2) contacts.push_back({ (uint32_t)i, (uint32_t)j, std::sqrt(distance2) });
+				});
+				// The grid visits cells, not rows, in order
+				std::sort(contacts.begin() + begin, contacts.end(), [](const Contact &a, const Contact &b) { return a.second < b.second; });
+			}
+		});
+	}
+	else
+	{
+		// Tiles of the upper triangle
+		utils::ThreadPool::get().parallelFor(numTiles, [&](size_t tile)
+		{
+			std::vector<Contact> &contacts = found[tile];
+			std::vector<float> distances(kTileColumns);
+			for (size_t i = tile * kTileRows, last = std::min(n, (tile + 1) * kTileRows); i < last; ++i)
+			{
+				const glm::vec3 point(mX[i], mY[i], mZ[i]);
+				for (size_t column = i + 1; column < n; column += kTileColumns)
+				{
+					const size_t count = std::min(kTileColumns, n - column);
+					utils::simd::computeDistances(&mX[column], &mY[column], &mZ[column], count, point, distances.data());
+					for (size_t k = 0; k < count; ++k)
+						if (distances[k] < cutoff) contacts.push_back({ (uint32_t)i, uint32_t(column + k), distances[k] });
+				}
+			}
+		});
+	}
+
+	size_t total = 0;
+	for (const std::vector<Contact> &contacts : found) total += contacts.size();
+	mContacts.reserve(total);
+	for (const std::vector<Contact> &contacts : found) mContacts.insert(mContacts.end(), contacts.begin(), contacts.end());
+}
+
+} // namespace pdb
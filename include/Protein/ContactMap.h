@@ -0,0 +1,60 @@
+#pragma once
+
+#include "AtomTable.h"
+#include "SpatialGrid.h"
+#include <vector>
+#include <cstdint>
+
+namespace pdb
+{
+
+/*
+	Distance matrix and contact map over a list of atoms, e.g. the trace atom of every residue (a residue
+	contact map). The positions of the rows are copied as columns; the dense matrix is filled in tiles of
+	rows x columns small enough to stay in the first level cache, one row against a column tile per call of
+	the vectorized kernel (utils::simd::computeDistances), tiles of rows on the thread pool.
+	Contacts (pairs closer than the cutoff) come from the same tiles, or from the spatial grid when one is
+	given, which only visits the neighbourhood of every row.
+*/
+class ContactMap
+{
+public:
+	struct Contact
+	{
+		uint32_t		first;		// indices into the rows, first < second
+		uint32_t		second;
+		float			distance;
+	};
+
+	ContactMap();
+
+	void clear();
+
+	// Dense numRows x numRows distances, row-major
+	void computeDistances(const AtomTable &atoms, const std::vector<uint32_t> &rows);
+	// Sparse pairs closer than cutoff, ordered by first then second. The grid, if given, must index the
+	// current positions of all atoms.
+	void computeContacts(const AtomTable &atoms, const std::vector<uint32_t> &rows, float cutoff, const SpatialGrid *grid = nullptr);
+protected:
+	void copyPositions(const AtomTable &atoms, const std::vector<uint32_t> &rows);
+
+	std::vector<uint32_t>		mRows;
+	std::vector<float>		mX;
+	std::vector<float>		mY;
+	std::vector<float>		mZ;
+
+	float				mCutoff;
+	std::vector<float>		mDistances;	// empty unless computeDistances
+	std::vector<Contact>		mContacts;	// empty unless computeContacts
+public: // Mutators
+	size_t				getNumRows() const		{ return mRows.size(); }
+	const std::vector<uint32_t>	&getRows() const		{ return mRows; }
+	float				getCutoff() const		{ return mCutoff; }
+
+	bool				hasDistances() const		{ return !mDistances.empty(); }
+	float				getDistance(size_t i, size_t j) const	{ return mDistances[i * mRows.size() + j]; }
+	const float			*getDistances() const		{ return mDistances.data(); }
+	const std::vector<Contact>	&getContacts() const		{ return mContacts; }
+};
+
+} // namespace pdb
@@ -0,0 +1,73 @@
+#include "Element.h"
+#include <array>
+
+namespace pdb
+{
+
+static int letterIndex(char c)
+{
+	if (c >= 'A' && c <= 'Z') return c - 'A';
+	if (c >= 'a' && c <= 'z') return c - 'a';
+	return -1;
+}
+
+// [first letter][second letter + 1, 0 for one letter symbols]
+typedef std::array<std::array<Element, 27>, 26> SymbolTable;
+
+static const SymbolTable& getSymbolTable()
+{
+	static const SymbolTable table = []()
+	{
+		SymbolTable result;
+		for (auto &row : result) row.fill(Element::Unknown);
+
+		for (size_t i = 1; i < size_t(Element::Count); ++i)
+		{
+			const char *symbol = kElements[i].symbol;
+			int second = symbol[1] ? letterIndex(symbol[1]) + 1 : 0;
+			result[letterIndex(symbol[0])][second] = Element(i);
+		}
+
+		// Deuterium (neutron structures)
+		result[letterIndex('D')][0] = Element::H;
+		return result;
+	}();
+	return table;
+}
+
+Element parseElement(std::string_view symbol)
+{
+	// Trim blanks
+	while (!symbol.empty() && symbol.front() == ' ') symbol.remove_prefix(1);
+	while (!symbol.empty() && symbol.back() == ' ') symbol.remove_suffix(1);
+	if (symbol.empty() || symbol.size() > 2) return Element::Unknown;
+
+	int first = letterIndex(symbol[0]);
+	int second = symbol.size() > 1 ? letterIndex(symbol[1]) + 1 : 0;
+	if (first < 0 || second < 0) return Element::Unknown;
+
+	return getSymbolTable()[first][second];
+}
+
+Element elementFromAtomName(std::string_view name)
+{
+	if (name.empty()) return Element::Unknown;
+
+	// Two letter elements start in column 13 ("FE  ", "ZN  ");
+	// hydrogens with four character names ("HG21") start there too
+	if (letterIndex(name[0]) >= 0)
+	{
+		if (name[0] != 'H' && name[0] != 'h' && name.size() > 1 && letterIndex(name[1]) >= 0)
+		{
+			Element element = parseElement(name.substr(0, 2));
+			if (element != Element::Unknown) return element;
+		}
+		return parseElement(name.substr(0, 1));
+	}
+
+	// Blank or digit ("1HG2") in column 13, one letter element in column 14
+	if (name.size() > 1) return parseElement(name.substr(1, 1));
+	return Element::Unknown;
+}
+
+} // namespace pdb
@@ -0,0 +1,168 @@
+#pragma once
+
+#include "cinder/CinderGlm.h"
+#include <string_view>
+#include <cstdint>
+
+namespace pdb
+{
+
+/*
+	Chemical elements, the value is the atomic number
+*/
+enum class Element : uint8_t
+{
+	Unknown = 0,
+	H, He, Li, Be, B, C, N, O, F, Ne,
+	Na, Mg, Al, Si, P, S, Cl, Ar, K, Ca,
+	Sc, Ti, V, Cr, Mn, Fe, Co, Ni, Cu, Zn,
+	Ga, Ge, As, Se, Br, Kr, Rb, Sr, Y, Zr,
+	Nb, Mo, Tc, Ru, Rh, Pd, Ag, Cd, In, Sn,
+	Sb, Te, I, Xe, Cs, Ba, La, Ce, Pr, Nd,
+	Pm, Sm, Eu, Gd, Tb, Dy, Ho, Er, Tm, Yb,
+	Lu, Hf, Ta, W, Re, Os, Ir, Pt, Au, Hg,
+	Tl, Pb, Bi, Po, At, Rn, Fr, Ra, Ac, Th,
+	Pa, U, Np, Pu, Am, Cm, Bk, Cf, Es, Fm,
+	Md, No, Lr, Rf, Db, Sg, Bh, Hs, Mt,
+	Count
+};
+
+struct ElementData
+{
+	const char*	symbol;
+	float		color[3];	// CPK like color scheme
+	float		radius;		// Van der Waals radius in Angstroms
+	float		mass;		// Standard atomic weight in Daltons
+	float		covalentRadius;	// Single bond covalent radius in Angstroms (Cordero et al. 2008; 1.5 behind Cm), 0 never bonds
+};
+
+// Indexed by atomic number; unknown elements keep the defaults the renderer used before
+constexpr ElementData kElements[] =
+{
+	{ "X",	{ 0.0f, 0.0f, 0.0f },	2.00f,	0.0f,	0.00f },
+	{ "H",	{ 0.9f, 0.9f, 0.9f },	1.20f,	1.008f,	0.31f },
+	{ "He",	{ 0.850f, 1.000f, 1.000f },	1.40f,	4.0026f,	0.28f },
+	{ "Li",	{ 0.800f, 0.501f, 1.000f },	1.82f,	6.94f,	1.28f },
+	{ "Be",	{ 0.760784314f, 1.000f, 0.000f },	1.53f,	9.0122f,	0.96f },
+	{ "B",	{ 1.00f, 0.709f, 0.709f },	1.92f,	10.81f,	0.84f },
+	{ "C",	{ 0.2f, 1.0f, 0.2f },	1.70f,	12.011f,	0.76f },
+	{ "N",	{ 0.2f, 0.2f, 1.0f },	1.55f,	14.007f,	0.71f },
+	{ "O",	{ 1.0f, 0.3f, 0.3f },	1.52f,	15.999f,	0.66f },
+	{ "F",	{ 0.7019f, 1.000f, 1.000f },	1.47f,	18.998f,	0.57f },
+	{ "Ne",	{ 0.7019f, 0.890f, 0.960f },	1.54f,	20.180f,	0.58f },
+	{ "Na",	{ 0.6705f, 0.360f, 0.949f },	2.27f,	22.990f,	1.66f },
+	{ "Mg",	{ 0.5411f, 1.000f, 0.000f },	1.73f,	24.305f,	1.41f },
+	{ "Al",	{ 0.7490f, 0.650f, 0.650f },	1.84f,	26.982f,	1.21f },
+	{ "Si",	{ 0.9411f, 0.784f, 0.627f },	2.10f,	28.085f,	1.11f },
+	{ "P",	{ 1.0000f, 0.501f, 0.000f },	1.80f,	30.974f,	1.07f },
+	{ "S",	{ 0.9f, 0.775f, 0.25f },	1.80f,	32.06f,	1.05f },
+	{ "Cl",	{ 0.1215f, 0.941f, 0.121f },	1.75f,	35.45f,	1.02f },
+	{ "Ar",	{ 0.5019f, 0.819f, 0.890f },	1.88f,	39.948f,	1.06f },
+	{ "K",	{ 0.5607f, 0.250f, 0.831f },	2.75f,	39.098f,	2.03f },
+	{ "Ca",	{ 0.2392f, 1.000f, 0.000f },	2.31f,	40.078f,	1.76f },
+	{ "Sc",	{ 0.9019f, 0.901f, 0.901f },	2.11f,	44.956f,	1.70f },
+	{ "Ti",	{ 0.7490f, 0.760f, 0.780f },	2.00f,	47.867f,	1.60f },
+	{ "V",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	50.942f,	1.53f },
+	{ "Cr",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	51.996f,	1.39f },
+	{ "Mn",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	54.938f,	1.39f },
+	{ "Fe",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	55.845f,	1.32f },
+	{ "Co",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	58.933f,	1.26f },
+	{ "Ni",	{ 0.6509f, 0.650f, 0.670f },	1.63f,	58.693f,	1.24f },
+	{ "Cu",	{ 0.6509f, 0.650f, 0.670f },	1.40f,	63.546f,	1.32f },
+	{ "Zn",	{ 0.6509f, 0.650f, 0.670f },	1.39f,	65.38f,	1.22f },
+	{ "Ga",	{ 0.6509f, 0.650f, 0.670f },	1.87f,	69.723f,	1.22f },
+	{ "Ge",	{ 0.6509f, 0.650f, 0.670f },	2.11f,	72.630f,	1.20f },
+	{ "As",	{ 0.6509f, 0.650f, 0.670f },	1.85f,	74.922f,	1.19f },
+	{ "Se",	{ 0.6509f, 0.650f, 0.670f },	1.90f,	78.971f,	1.20f },
+	{ "Br",	{ 0.6509f, 0.650f, 0.670f },	1.85f,	79.904f,	1.20f },
+	{ "Kr",	{ 0.6509f, 0.650f, 0.670f },	2.02f,	83.798f,	1.16f },
+	{ "Rb",	{ 0.6509f, 0.650f, 0.670f },	3.03f,	85.468f,	2.20f },
+	{ "Sr",	{ 0.6509f, 0.650f, 0.670f },	2.49f,	87.62f,	1.95f },
+	{ "Y",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	88.906f,	1.90f },
+	{ "Zr",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	91.224f,	1.75f },
+	{ "Nb",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	92.906f,	1.64f },
+	{ "Mo",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	95.95f,	1.54f },
+	{ "Tc",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	98.0f,	1.47f },
+	{ "Ru",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	101.07f,	1.46f },
+	{ "Rh",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	102.91f,	1.42f },
+	{ "Pd",	{ 0.6509f, 0.650f, 0.670f },	1.63f,	106.42f,	1.39f },
+	{ "Ag",	{ 0.6509f, 0.650f, 0.670f },	1.72f,	107.87f,	1.45f },
+	{ "Cd",	{ 0.6509f, 0.650f, 0.670f },	1.58f,	112.41f,	1.44f },
+	{ "In",	{ 0.6509f, 0.650f, 0.670f },	1.93f,	114.82f,	1.42f },
+	{ "Sn",	{ 0.6509f, 0.650f, 0.670f },	2.17f,	118.71f,	1.39f },
+	{ "Sb",	{ 0.6509f, 0.650f, 0.670f },	2.06f,	121.76f,	1.39f },
+	{ "Te",	{ 0.6509f, 0.650f, 0.670f },	2.06f,	127.60f,	1.38f },
+	{ "I",	{ 0.6509f, 0.650f, 0.670f },	1.98f,	126.90f,	1.39f },
+	{ "Xe",	{ 0.6509f, 0.650f, 0.670f },	2.16f,	131.29f,	1.40f },
+	{ "Cs",	{ 0.6509f, 0.650f, 0.670f },	3.43f,	132.91f,	2.44f },
+	{ "Ba",	{ 0.6509f, 0.650f, 0.670f },	2.68f,	137.33f,	2.15f },
+	{ "La",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	138.91f,	2.07f },
+	{ "Ce",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	140.12f,	2.04f },
+	{ "Pr",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	140.91f,	2.03f },
+	{ "Nd",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	144.24f,	2.01f },
+	{ "Pm",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	145.0f,	1.99f },
+	{ "Sm",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	150.36f,	1.98f },
+	{ "Eu",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	151.96f,	1.98f },
+	{ "Gd",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	157.25f,	1.96f },
+	{ "Tb",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	158.93f,	1.94f },
+	{ "Dy",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	162.50f,	1.92f },
+	{ "Ho",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	164.93f,	1.92f },
+	{ "Er",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	167.26f,	1.89f },
+	{ "Tm",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	168.93f,	1.90f },
+	{ "Yb",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	173.05f,	1.87f },
+	{ "Lu",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	174.97f,	1.87f },
+	{ "Hf",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	178.49f,	1.75f },
+	{ "Ta",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	180.95f,	1.70f },
+	{ "W",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	183.84f,	1.62f },
+	{ "Re",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	186.21f,	1.51f },
+	{ "Os",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	190.23f,	1.44f },
+	{ "Ir",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	192.22f,	1.41f },
+	{ "Pt",	{ 0.6509f, 0.650f, 0.670f },	1.75f,	195.08f,	1.36f },
+	{ "Au",	{ 0.6509f, 0.650f, 0.670f },	1.66f,	196.97f,	1.36f },
+	{ "Hg",	{ 0.6509f, 0.650f, 0.670f },	1.55f,	200.59f,	1.32f },
+	{ "Tl",	{ 0.6509f, 0.650f, 0.670f },	1.96f,	204.38f,	1.45f },
+	{ "Pb",	{ 0.6509f, 0.650f, 0.670f },	2.02f,	207.2f,	1.46f },
+	{ "Bi",	{ 0.6509f, 0.650f, 0.670f },	2.07f,	208.98f,	1.48f },
+	{ "Po",	{ 0.6509f, 0.650f, 0.670f },	1.97f,	209.0f,	1.40f },
+	{ "At",	{ 0.6509f, 0.650f, 0.670f },	2.02f,	210.0f,	1.50f },
+	{ "Rn",	{ 0.6509f, 0.650f, 0.670f },	2.20f,	222.0f,	1.50f },
+	{ "Fr",	{ 0.6509f, 0.650f, 0.670f },	3.48f,	223.0f,	2.60f },
+	{ "Ra",	{ 0.6509f, 0.650f, 0.670f },	2.83f,	226.0f,	2.21f },
+	{ "Ac",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	227.0f,	2.15f },
+	{ "Th",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	232.04f,	2.06f },
+	{ "Pa",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	231.04f,	2.00f },
+	{ "U",	{ 0.6509f, 0.650f, 0.670f },	1.86f,	238.03f,	1.96f },
+	{ "Np",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	237.0f,	1.90f },
+	{ "Pu",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	244.0f,	1.87f },
+	{ "Am",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	243.0f,	1.80f },
+	{ "Cm",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	247.0f,	1.69f },
+	{ "Bk",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	247.0f,	1.50f },
+	{ "Cf",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	251.0f,	1.50f },
+	{ "Es",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	252.0f,	1.50f },
+	{ "Fm",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	257.0f,	1.50f },
+	{ "Md",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	258.0f,	1.50f },
+	{ "No",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	259.0f,	1.50f },
+	{ "Lr",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	262.0f,	1.50f },
+	{ "Rf",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	267.0f,	1.50f },
+	{ "Db",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	268.0f,	1.50f },
+	{ "Sg",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	269.0f,	1.50f },
+	{ "Bh",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	270.0f,	1.50f },
+	{ "Hs",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	277.0f,	1.50f },
+	{ "Mt",	{ 0.6509f, 0.650f, 0.670f },	2.00f,	278.0f,	1.50f }
+};
+static_assert(sizeof(kElements) / sizeof(kElements[0]) == size_t(Element::Count), "one entry per element");
+
+constexpr const ElementData& getElementData(Element element)	{ return kElements[size_t(element) < size_t(Element::Count) ? size_t(element) : 0]; }
+constexpr const char* getSymbol(Element element)		{ return getElementData(element).symbol; }
+constexpr float getRadius(Element element)			{ return getElementData(element).radius; }
+constexpr float getMass(Element element)			{ return getElementData(element).mass; }
+constexpr float getCovalentRadius(Element element)		{ return getElementData(element).covalentRadius; }
+inline glm::vec3 getColor(Element element)			{ const float *c = getElementData(element).color; return glm::vec3(c[0], c[1], c[2]); }
+
+// Element of a symbol like "C", "FE" or "Fe"; deuterium maps to hydrogen
+Element parseElement(std::string_view symbol);
+
+// Element from the PDB atom name field (columns 13 - 16, untrimmed): two letter elements start in column 13
+Element elementFromAtomName(std::string_view name);
+
+} // namespace pdb
@@ -0,0 +1,122 @@
+#include "Hierarchy.h"
+#include <algorithm>
+#include <initializer_list>
+
+namespace pdb
+{
+
+PackedName packName(std::string_view name)
+{
+	size_t begin = 0;
+	size_t end = name.size();
+	while (begin < end && name[begin] == ' ') ++begin;
+	while (end > begin && name[end - 1] == ' ') --end;
+
+	// First character in the highest byte, so packed names sort like the text
+	PackedName packed = 0;
+	for (size_t i = 0; i < 4; ++i)
+	{
+		uint8_t c = begin + i < end ? (uint8_t)name[begin + i] : 0;
+		packed = (packed << 8) | c;
+	}
+	return packed;
+}
+
+std::string unpackName(PackedName name)
+{
+	std::string text;
+	for (int shift = 24; shift >= 0; shift -= 8)
+	{
+		char c = (char)((name >> shift) & 0xff);
+		if (c == 0) break;
+		text.push_back(c);
+	}
+	return text;
+}
+
+ResidueType classifyResidue(PackedName name)
+{
+	// Sorted once, searched per residue
+	auto sorted = [](std::initializer_list<const char*> names)
+	{
+		std::vector<PackedName> packed;
+		for (const char *name : names) packed.push_back(packName(name));
+		std::sort(packed.begin(), packed.end());
+		return packed;
+	};
+	static const std::vector<PackedName> kAminoAcids = sorted({ "ALA", "ARG", "ASN", "ASP", "CYS", "GLN", "GLU", "GLY", "HIS", "ILE", "LEU", "LYS", "MET", "PHE", "PRO", "SER", "THR", "TRP", "TYR", "VAL",
+								     "SEC", "PYL", "MSE", "ASX", "GLX", "UNK", "HID", "HIE", "HIP", "HSD", "HSE", "HSP", "CYX", "CYM", "ASH", "GLH", "LYN" });
+	static const std::vector<PackedName> kNucleotides = sorted({ "A", "C", "G", "U", "I", "T", "N", "DA", "DC", "DG", "DT", "DI", "DU" });
+	static const std::vector<PackedName> kSolvent = sorted({ "HOH", "WAT", "H2O", "DOD", "TIP", "TIP3", "TIP4", "SOL", "SPC" });
+
+	if (std::binary_search(kAminoAcids.begin(), kAminoAcids.end(), name))	return ResidueType::AminoAcid;
+	if (std::binary_search(kNucleotides.begin(), kNucleotides.end(), name))	return ResidueType::Nucleotide;
+	if (std::binary_search(kSolvent.begin(), kSolvent.end(), name))		return ResidueType::Solvent;
+	return ResidueType::Other;
+}
+
+Hierarchy::Hierarchy()
+{
+	clear();
+}
+
+void Hierarchy::clear()
+{
+	mResidueOffsets.assign(1, 0);
+	mResidueNames.clear();
+	mResidueNumbers.clear();
+	mInsertionCodes.clear();
+	mResidueTypes.clear();
+
+	mChainOffsets.assign(1, 0);
+	mChainIds.clear();
+}
+
+void Hierarchy::reserve(size_t numAtoms)
+{
+	// Proteins average about eight atoms per residue
+	mResidueOffsets.reserve(numAtoms / 8 + 2);
+	mResidueNames.reserve(numAtoms / 8 + 1);
+	mResidueNumbers.reserve(numAtoms / 8 + 1);
+	mInsertionCodes.reserve(numAtoms / 8 + 1);
+	mResidueTypes.reserve(numAtoms / 8 + 1);
+}
+
+void Hierarchy::append(PackedName chainId, PackedName residueName, int32_t residueNumber, char insertionCode)
+{
+	const bool newChain = mChainIds.empty() || mChainIds.back() != chainId;
+	const bool newResidue = newChain || mResidueNumbers.back() != residueNumber || mInsertionCodes.back() != insertionCode || mResidueNames.back() != residueName;
+
+	if (newResidue)
+	{
+		if (newChain)
+		{
+			mChainIds.push_back(chainId);
+			mChainOffsets.push_back(mChainOffsets.back());
+		}
+		++mChainOffsets.back();
+
+		mResidueNames.push_back(residueName);
+		mResidueNumbers.push_back(residueNumber);
+		mInsertionCodes.push_back(insertionCode);
+		mResidueTypes.push_back(classifyResidue(residueName));
+		mResidueOffsets.push_back(mResidueOffsets.back());
+	}
+	++mResidueOffsets.back();
+}
+
+void Hierarchy::assign(const uint32_t *residueOffsets, const PackedName *residueNames, const int32_t *residueNumbers, const char *insertionCodes, size_t numResidues,
+		       const uint32_t *chainOffsets, const PackedName *chainIds, size_t numChains)
+{
+	mResidueOffsets.assign(residueOffsets, residueOffsets + numResidues + 1);
+	mResidueNames.assign(residueNames, residueNames + numResidues);
+	mResidueNumbers.assign(residueNumbers, residueNumbers + numResidues);
+	mInsertionCodes.assign(insertionCodes, insertionCodes + numResidues);
+	mResidueTypes.resize(numResidues);
+	for (size_t i = 0; i < numResidues; ++i) mResidueTypes[i] = classifyResidue(residueNames[i]);
+
+	mChainOffsets.assign(chainOffsets, chainOffsets + numChains + 1);
+	mChainIds.assign(chainIds, chainIds + numChains);
+}
+
+} // namespace pdb
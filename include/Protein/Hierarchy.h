@@ -0,0 +1,90 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+namespace pdb
+{
+
+// Identifier of up to four characters (atom, residue and chain names) packed into an integer.
+// Surrounding blanks are dropped; compares like the text it holds.
+typedef uint32_t PackedName;
+
+PackedName packName(std::string_view name);
+std::string unpackName(PackedName name);
+
+// Polymer type of a residue, from its name
+enum class ResidueType : uint8_t { Other, AminoAcid, Nucleotide, Solvent };
+
+ResidueType classifyResidue(PackedName name);
+
+// Half-open range [begin, end) of atom rows or residue indices
+struct IndexRange
+{
+	uint32_t	begin;
+	uint32_t	end;
+
+	uint32_t	size() const			{ return end - begin; }
+	bool		empty() const			{ return begin == end; }
+};
+
+/*
+	Chain > residue > atom hierarchy of a structure, as offset arrays.
+	Residue r owns the atom rows [residueOffsets[r], residueOffsets[r + 1]),
+	chain c owns the residues [chainOffsets[c], chainOffsets[c + 1]).
+	Atoms are appended in file order, so a chain ID that comes back later in the file
+	(e.g. waters after the other chains) opens a new chain range with the same ID.
+*/
+class Hierarchy
+{
+public:
+	Hierarchy();
+
+	void clear();
+	void reserve(size_t numAtoms);
+
+	// Appends the next atom row; a new residue (chain) starts when the identifiers differ from the previous atom's
+	void append(PackedName chainId, PackedName residueName, int32_t residueNumber, char insertionCode);
+
+	// Restores a hierarchy from its arrays (see the structure cache)
+	void assign(const uint32_t *residueOffsets, const PackedName *residueNames, const int32_t *residueNumbers, const char *insertionCodes, size_t numResidues,
+		    const uint32_t *chainOffsets, const PackedName *chainIds, size_t numChains);
+protected:
+	// Residues; mResidueOffsets has one entry more than residues
+	std::vector<uint32_t>		mResidueOffsets;
+	std::vector<PackedName>		mResidueNames;
+	std::vector<int32_t>		mResidueNumbers;
+	std::vector<char>		mInsertionCodes;
+	std::vector<ResidueType>	mResidueTypes;
+
+	// Chains; mChainOffsets has one entry more than chains
+	std::vector<uint32_t>		mChainOffsets;
+	std::vector<PackedName>		mChainIds;
+public: // Mutators
+	size_t				getNumAtoms() const			{ return mResidueOffsets.back(); }
+	size_t				getNumResidues() const			{ return mResidueNames.size(); }
+	size_t				getNumChains() const			{ return mChainIds.size(); }
+
+	IndexRange			getResidueAtoms(size_t residue) const	{ return IndexRange{ mResidueOffsets[residue], mResidueOffsets[residue + 1] }; }
+	IndexRange			getChainResidues(size_t chain) const	{ return IndexRange{ mChainOffsets[chain], mChainOffsets[chain + 1] }; }
+	IndexRange			getChainAtoms(size_t chain) const	{ return IndexRange{ mResidueOffsets[mChainOffsets[chain]], mResidueOffsets[mChainOffsets[chain + 1]] }; }
+
+	PackedName			getResidueName(size_t residue) const	{ return mResidueNames[residue]; }
+	int32_t				getResidueNumber(size_t residue) const	{ return mResidueNumbers[residue]; }
+	char				getInsertionCode(size_t residue) const	{ return mInsertionCodes[residue]; }
+	ResidueType			getResidueType(size_t residue) const	{ return mResidueTypes[residue]; }
+	PackedName			getChainId(size_t chain) const		{ return mChainIds[chain]; }
+
+	// Arrays, e.g. for the structure cache
+	const uint32_t			*getResidueOffsets() const		{ return mResidueOffsets.data(); }
+	const PackedName		*getResidueNames() const		{ return mResidueNames.data(); }
+	const int32_t			*getResidueNumbers() const		{ return mResidueNumbers.data(); }
+	const char			*getInsertionCodes() const		{ return mInsertionCodes.data(); }
+	const ResidueType		*getResidueTypes() const		{ return mResidueTypes.data(); }
+	const uint32_t			*getChainOffsets() const		{ return mChainOffsets.data(); }
+	const PackedName		*getChainIds() const			{ return mChainIds.data(); }
+};
+
+} // namespace pdb
@@ -0,0 +1,373 @@
+#include "PdbParser.h"
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+namespace pdb
+{
+namespace parser
+{
+
+static const float kInversePowersOf10[] = {
+	1.0f, 1e-1f, 1e-2f, 1e-3f, 1e-4f, 1e-5f, 1e-6f, 1e-7f, 1e-8f, 1e-9f
+};
+
+bool parseInt(std::string_view field, int &value)
+{
+	field = trim(field);
+	if (field.empty()) return false;
+
+	size_t i = 0;
+	bool negative = false;
+	if (field[0] == '-' || field[0] == '+')
+	{
+		negative = field[0] == '-';
+		++i;
+	}
+	if (i == field.size()) return false;
+
+	int result = 0;
+	for (; i < field.size(); ++i)
+	{
+		unsigned digit = (unsigned)(field[i] - '0');
+		if (digit > 9) return false;
+		result = result * 10 + (int)digit;
+	}
+
+	value = negative ? -result : result;
+	return true;
+}
+
+bool parseHybrid36(std::string_view field, int &value)
+{
+	if (parseInt(field, value)) return true;
+
+	// Past the decimal range the first digit is a letter; the case selects the range
+	const size_t width = field.size();
+	if (width == 0 || width > 5) return false;
+	const bool upper = field[0] >= 'A' && field[0] <= 'Z';
+	const bool lower = field[0] >= 'a' && field[0] <= 'z';
+	if (!upper && !lower) return false;
+
+	int result = 0;
+	for (char c : field)
+	{
+		int digit;
+		if (c >= '0' && c <= '9')			digit = c - '0';
+		else if (upper && c >= 'A' && c <= 'Z')	digit = c - 'A' + 10;
+		else if (lower && c >= 'a' && c <= 'z')	digit = c - 'a' + 10;
+		else						return false;
+		result = result * 36 + digit;
+	}
+
+	// A000.. follows 10^width - 1, a000.. follows ZZZ..
+	int power = 1, decimal = 10;
+	for (size_t i = 1; i < width; ++i)
+	{
+		power *= 36;
+		decimal *= 10;
+	}
+	value = result - 10 * power + decimal + (lower ? 26 * power : 0);
+	return true;
+}
+
+// Numbers too wide for their columns, written as stars
+static bool isOverflow(std::string_view field)
+{
+	return !field.empty() && field.find_first_not_of('*') == std::string_view::npos;
+}
+
+bool parseReal(std::string_view field, float &value)
+{
+	field = trim(field);
+	if (field.empty()) return false;
+
+	size_t i = 0;
+	bool negative = false;
+	if (field[0] == '-' || field[0] == '+')
+	{
+		negative = field[0] == '-';
+		++i;
+	}
+
+	// Accumulate all digits as one integer mantissa and remember the position of the point
+	int64_t mantissa = 0;
+	int fractionDigits = -1;
+	int digits = 0;
+	for (; i < field.size(); ++i)
+	{
+		const char c = field[i];
+		if (c == '.')
+		{
+			if (fractionDigits >= 0) return false;
+			fractionDigits = 0;
+			continue;
+		}
+
+		unsigned digit = (unsigned)(c - '0');
+		if (digit > 9) return false;
+		if (digits++ < 18) 
+		{
+			mantissa = mantissa * 10 + digit;
+			if (fractionDigits >= 0) ++fractionDigits;
+		}
+	}
+	if (digits == 0) return false;
+
+	float result = (float)mantissa;
+	if (fractionDigits > 0)
+	{
+		if (fractionDigits < 10)	result *= kInversePowersOf10[fractionDigits];
+		else				result = (float)((double)mantissa / std::pow(10.0, fractionDigits));
+	}
+
+	value = negative ? -result : result;
+	return true;
+}
+
+bool LineReader::next(std::string_view &line)
+{
+	if (mOffset >= mText.size()) return false;
+
+	const char *begin = mText.data() + mOffset;
+	const char *end = mText.data() + mText.size();
+	const char *cursor = begin;
+
+	while (cursor != end && *cursor != '\n' && *cursor != '\r') ++cursor;
+
+	line = std::string_view(begin, (size_t)(cursor - begin));
+
+	// Skip the line terminator ("\r\n" counts as one)
+	if (cursor != end)
+	{
+		if (*cursor == '\r' && cursor + 1 != end && cursor[1] == '\n') ++cursor;
+		++cursor;
+	}
+	mOffset = (size_t)(cursor - mText.data());
+
+	return true;
+}
+
+std::vector<std::string_view> splitLines(std::string_view text, size_t count)
+{
+	std::vector<std::string_view> chunks;
+	if (text.empty()) return chunks;
+	if (count == 0) count = 1;
+
+	chunks.reserve(count);
+	const size_t target = text.size() / count + 1;
+
+	size_t begin = 0;
+	while (begin < text.size())
+	{
+		// Move the end of the chunk behind the next line terminator
+		size_t end = std::min(begin + target, text.size());
+		while (end < text.size() && text[end - 1] != '\n' && text[end - 1] != '\r') ++end;
+
+		chunks.push_back(text.substr(begin, end - begin));
+		begin = end;
+	}
+
+	return chunks;
+}
+
+/*
+	BlockReader
+*/
+
+BlockReader::BlockReader(ReadFn read, size_t blockSize, size_t capacity)
+	: mRead(read), mBlockSize(std::max<size_t>(blockSize, 1)), mCapacity(std::max<size_t>(capacity, 1)),
+	  mFinished(false), mStopping(false)
+{
+	mThread = std::thread(&BlockReader::readLoop, this);
+}
+
+BlockReader::~BlockReader()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStopping = true;
+	}
+	mCondition.notify_all();
+	if (mThread.joinable()) mThread.join();
+}
+
+TextBlockRef BlockReader::next()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	mCondition.wait(lock, [this] { return !mBlocks.empty() || mFinished; });
+
+	if (mBlocks.empty())
+	{
+		if (mError) std::rethrow_exception(mError);
+		return nullptr;
+	}
+
+	TextBlockRef block = mBlocks.front();
+	mBlocks.pop_front();
+	mCondition.notify_all();
+	return block;
+}
+
+void BlockReader::readLoop()
+{
+	std::string carry;
+	try
+	{
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mMutex);
+				mCondition.wait(lock, [this] { return mStopping || mBlocks.size() < mCapacity; });
+				if (mStopping) break;
+			}
+
+			// Lines left over from the previous block come first
+			std::shared_ptr<std::string> block = std::make_shared<std::string>();
+			block->swap(carry);
+			const size_t begin = block->size();
+			block->resize(begin + mBlockSize);
+			block->resize(begin + mRead(&(*block)[begin], mBlockSize));
+
+			const bool end = block->size() == begin;
+			if (!end)
+			{
+				// Keep the partial last line for the next block
+				size_t cut = block->find_last_of("\n\r");
+				if (cut == std::string::npos) { carry.swap(*block); continue; }
+				carry.assign(*block, cut + 1, std::string::npos);
+				block->resize(cut + 1);
+			}
+
+			std::lock_guard<std::mutex> lock(mMutex);
+			if (!block->empty()) mBlocks.push_back(block);
+			if (end)
+			{
+				mFinished = true;
+				break;
+			}
+			mCondition.notify_all();
+		}
+	}
+	catch (...)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mError = std::current_exception();
+		mFinished = true;
+	}
+	mCondition.notify_all();
+}
+
+void RecordChunk::detach()
+{
+	size_t size = 0;
+	for (const AtomRecord &record : records) size += record.name.size() + record.residueName.size() + record.chainId.size();
+
+	text.resize(size);
+	char *out = text.data();
+	auto copy = [&out](std::string_view &field)
+	{
+		std::copy(field.begin(), field.end(), out);
+		field = std::string_view(out, field.size());
+		out += field.size();
+	};
+
+	for (AtomRecord &record : records)
+	{
+		copy(record.name);
+		copy(record.residueName);
+		copy(record.chainId);
+	}
+}
+
+bool parseCoordinates(std::string_view line, glm::vec3 &position, size_t &end)
+{
+	// Standard layout: decimal points at columns 35, 43 and 51
+	if (line.size() >= 54 && line[34] == '.' && line[42] == '.' && line[50] == '.')
+	{
+		end = 54;
+		return	parseReal(line.substr(30, 8), position.x) &&
+			parseReal(line.substr(38, 8), position.y) &&
+			parseReal(line.substr(46, 8), position.z);
+	}
+
+	// Shifted layout (e.g. 2ex3.pdb): every coordinate is written as %.3f,
+	// so each value ends three characters after its decimal point
+	size_t begin = 27;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		size_t point = line.find('.', begin);
+		if (point == std::string_view::npos || point + 4 > line.size()) return false;
+
+		if (!parseReal(line.substr(begin, point + 4 - begin), position[axis])) return false;
+		begin = point + 4;
+	}
+	end = begin;
+	return true;
+}
+
+bool parseModelRecord(std::string_view line, int &model)
+{
+	if (!startsWith(line, "MODEL ")) return false;
+	if (!parseInt(column(line, 10, 4), model)) throw ParserExc();
+	return true;
+}
+
+bool parseConectRecord(std::string_view line, std::vector<std::pair<int, int>> &connections)
+{
+	if (!startsWith(line, "CONECT")) return false;
+
+	// Stars name no atom, so the record is skipped
+	int atom;
+	std::string_view serial = column(line, 6, 5);
+	if (!parseHybrid36(serial, atom))
+	{
+		if (isOverflow(serial)) return true;
+		throw ParserExc();
+	}
+
+	// Up to four bonded atoms; blank fields end the list
+	for (size_t first = 11; first < 31; first += 5)
+	{
+		int bonded;
+		std::string_view field = column(line, first, 5);
+		if (isOverflow(field)) continue;
+		if (!parseHybrid36(field, bonded)) break;
+		connections.emplace_back(atom, bonded);
+	}
+	return true;
+}
+
+bool parseAtomRecord(std::string_view line, AtomRecord &record)
+{
+	if (!startsWith(line, "ATOM") && !startsWith(line, "HETATM")) return false;
+
+	// Stars: setAtoms numbers the atom by its row
+	size_t end;
+	std::string_view serial = column(line, 6, 5);
+	if (!parseHybrid36(serial, record.serial))
+	{
+		if (!isOverflow(serial))				throw ParserExc();
+		record.serial = -1;
+	}
+	if (!parseCoordinates(line, record.position, end))		throw ParserExc();
+
+	std::string_view name = column(line, 12, 4);
+	record.name = trim(name);
+
+	// Residue columns keep their place in files with shifted coordinates
+	record.residueName = trim(column(line, 17, 3));
+	record.chainId = trim(column(line, 21, 1));
+	if (!parseHybrid36(column(line, 22, 4), record.residueNumber)) record.residueNumber = 0;
+	std::string_view insertionCode = column(line, 26, 1);
+	record.insertionCode = insertionCode.empty() ? ' ' : insertionCode[0];
+
+	// Element columns 77 - 78 move along with shifted coordinates; older files leave them blank
+	record.element = parseElement(column(line, end + 22, 2));
+	if (record.element == Element::Unknown) record.element = elementFromAtomName(name);
+
+	return true;
+}
+
+} // namespace parser
+} // namespace pdb
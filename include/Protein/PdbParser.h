@@ -0,0 +1,168 @@
+#pragma once
+
+#include "cinder/CinderGlm.h"
+#include "Element.h"
+#include <string_view>
+#include <vector>
+#include <limits>
+#include <functional>
+#include <memory>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+namespace pdb
+{
+namespace parser
+{
+
+/*
+	Zero-copy helpers for fixed-column PDB records.
+	All slices point into the source text, nothing is allocated while scanning.
+*/
+
+// Slice [first, first + count) of a record, clipped to the length of the line
+inline std::string_view column(std::string_view line, size_t first, size_t count)
+{
+	if (first >= line.size()) return std::string_view();
+	return line.substr(first, count);
+}
+
+inline std::string_view trim(std::string_view field)
+{
+	size_t begin = 0;
+	size_t end = field.size();
+	while (begin < end && (field[begin] == ' ' || field[begin] == '\t')) ++begin;
+	while (end > begin && (field[end - 1] == ' ' || field[end - 1] == '\t')) --end;
+	return field.substr(begin, end - begin);
+}
+
+inline bool startsWith(std::string_view line, std::string_view prefix)
+{
+	return line.size() >= prefix.size() && line.compare(0, prefix.size(), prefix) == 0;
+}
+
+// Decimal integer column (surrounding blanks allowed)
+bool parseInt(std::string_view field, int &value);
+
+// Hybrid-36 integer column (e.g. Chimera past 99,999 atoms): decimal up to the width of the field, then
+// A0000 - ZZZZZ and a0000 - zzzzz in base 36; fields of at most 5 characters
+bool parseHybrid36(std::string_view field, int &value);
+
+// Fixed-point decimal column like "-103.733" (surrounding blanks allowed, no exponent)
+bool parseReal(std::string_view field, float &value);
+
+// Coordinate columns 31 - 54; tolerates files whose columns are shifted by a character.
+// end receives the index behind the z coordinate (54 for the standard layout)
+bool parseCoordinates(std::string_view line, glm::vec3 &position, size_t &end);
+
+/*
+	Splits text into lines in place. Accepts "\n", "\r\n" and "\r" line endings.
+*/
+class LineReader
+{
+public:
+	explicit LineReader(std::string_view text) : mText(text), mOffset(0) {}
+
+	bool next(std::string_view &line);
+protected:
+	std::string_view	mText;
+	size_t			mOffset;
+public: // Mutators
+	size_t			getOffset() const		{ return mOffset; }
+};
+
+// Splits text into at most count pieces that start and end on line boundaries
+std::vector<std::string_view> splitLines(std::string_view text, size_t count);
+
+typedef std::shared_ptr<const std::string> TextBlockRef;
+
+/*
+	Cuts a stream of text (e.g. a decompressor) into blocks of whole lines.
+	A background thread keeps up to capacity blocks ready, so the source is read while the caller parses.
+*/
+class BlockReader
+{
+public:
+	// Fills buffer with up to size bytes, returns 0 at the end of the stream
+	typedef std::function<size_t(char*, size_t)> ReadFn;
+
+	BlockReader(ReadFn read, size_t blockSize = 1024 * 1024, size_t capacity = 8);
+	~BlockReader();
+
+	BlockReader(const BlockReader&) = delete;
+	BlockReader& operator=(const BlockReader&) = delete;
+
+	// Next block in stream order, nullptr at the end; rethrows errors of the source
+	TextBlockRef next();
+protected:
+	void readLoop();
+
+	ReadFn				mRead;
+	size_t				mBlockSize;
+	size_t				mCapacity;
+
+	std::deque<TextBlockRef>	mBlocks;
+	bool				mFinished;
+	bool				mStopping;
+	std::exception_ptr		mError;
+	std::mutex			mMutex;
+	std::condition_variable		mCondition;
+	std::thread			mThread;
+};
+
+/*
+	ATOM / HETATM record, columns according to PDB format 3.3
+*/
+struct AtomRecord
+{
+	int			serial;		// 7 - 11, hybrid-36; -1 if the writer filled it with stars (VMD)
+	std::string_view	name;		// 13 - 16
+	std::string_view	residueName;	// 18 - 20
+	std::string_view	chainId;	// 22
+	int			residueNumber;	// 23 - 26
+	char			insertionCode;	// 27, blank if none
+	glm::vec3		position;	// 31 - 38, 39 - 46, 47 - 54
+	Element			element;	// 77 - 78, or derived from the atom name
+	int			model;		// serial of the enclosing MODEL record, -1 if not known (yet)
+};
+
+// Parsed records of one part of a file, with the bounds of their positions
+struct RecordChunk
+{
+	std::vector<AtomRecord>	records;
+	glm::vec3		lowerBound = glm::vec3(std::numeric_limits<float>::max());
+	glm::vec3		upperBound = glm::vec3(std::numeric_limits<float>::lowest());
+	int			model = -1;	// model open at the end of the chunk
+	std::vector<std::pair<int, int>>	connections;	// serials of the CONECT bonds, in file order
+	std::vector<char>	text;		// owned copy of the record slices after detach()
+
+	void add(const AtomRecord &record)
+	{
+		records.push_back(record);
+		lowerBound = glm::min(lowerBound, record.position);
+		upperBound = glm::max(upperBound, record.position);
+	}
+
+	// Copies the names and identifiers of the records into the chunk, so the source text can be released
+	void detach();
+};
+
+// Returns true and the model serial (columns 11 - 14) for MODEL records
+bool parseModelRecord(std::string_view line, int &model);
+
+// Returns false if the line is not an ATOM or HETATM record; throws if the record is malformed
+bool parseAtomRecord(std::string_view line, AtomRecord &record);
+
+// Returns false if the line is not a CONECT record; appends (atom, bonded atom) serial pairs, columns 7 - 11 and 12 - 31
+bool parseConectRecord(std::string_view line, std::vector<std::pair<int, int>> &connections);
+
+class ParserExc : public std::exception {
+public:
+	virtual const char* what() const throw() { return "PDB parser exception: malformed record"; }
+};
+
+} // namespace parser
+} // namespace pdb
@@ -1,14 +1,28 @@
 #include "Protein.h"
 #include <boost/algorithm/string.hpp> 
 #include "Common/Utils.h"
+#include "Common/MappedFile.h"
+#include "Common/GzipStream.h"
+#include "PdbParser.h"
+#include "Common/ThreadPool.h"
+#include "Common/Simd.h"
+#include "StructureCache.h"
+#include "CifReader.h"
+#include "BinaryCifReader.h"
+#include "SelectionQuery.h"
+#include <cstring>
+#include <cmath>
+#include <algorithm>
 #include <iostream>
 #include <fstream>
+#include <atomic>
 #include "cinder/ObjLoader.h"
 
 namespace pdb
 {
 
 Protein::Protein()
+	: mNumModels(1), mCurrentModel(0), mColorScheme(ELEMENT_COLORS)
 {
 
 }
@@ -30,14 +44,13 @@ void Protein::moveTo(glm::vec3 position)
 	// Update bounding Box
 	mBoundingBoxMatrix = translation * mBoundingBoxMatrix;
 
-	std::vector<AtomRef>::iterator begin = mAtoms.begin();
-	std::vector<AtomRef>::iterator end = mAtoms.end();
+	mAtoms.transform(mBoundingBoxMatrix);
+	// The bounding box matrix only translates, so the cells keep their atoms
+	mGrid.translate(glm::vec3(mBoundingBoxMatrix[3]));
+	if (!mBvh.empty()) mBvh.refit(mAtoms);
 
-	while (begin != end)
-	{
-		(*begin)->setPosition(mBoundingBoxMatrix);
-		++begin;
-	}
+	// Other models move along
+	utils::simd::transform(mBoundingBoxMatrix, mModelPositions.data(), mModelPositions.size());
 }
 
 void Protein::setBounds(glm::vec3 position)
@@ -68,153 +81,689 @@ void Protein::setBoundingBox()
 }
 
 /*
-	Color scheme functions
+	Parsing functions
 */
-void Protein::loadColorScheme(const ci::DataSourceRef dataRef)
+
+// Parses the MODEL, ATOM, HETATM and CONECT records of whole lines
+static void parseRecords(std::string_view text, parser::RecordChunk &chunk)
 {
-	// Read the data file
-	std::string data;
-	try { data = loadString(dataRef); }
+	// a record is at least 80 characters long
+	chunk.records.reserve(text.size() / 81 + 1);
+
+	parser::LineReader reader(text);
+	parser::AtomRecord record;
+	std::string_view line;
+	while (reader.next(line))
+	{
+		// Models opened before this chunk are resolved when merging
+		if (parser::parseModelRecord(line, chunk.model)) continue;
+		if (!parser::parseAtomRecord(line, record))
+		{
+			parser::parseConectRecord(line, chunk.connections);
+			continue;
+		}
+
+		record.model = chunk.model;
+		chunk.add(record);
+	}
+}
+
+void Protein::loadPdb(std::string_view data, const ProgressFn &progress)
+{
+	// Parse the file in place
+	try 
+	{
+		if (data.empty()) throw ProteinInvalidSourceExc();
+
+		utils::ThreadPool &pool = utils::ThreadPool::get();
+
+		// ---------------------------------------------
+		// Parse chunks of whole lines in parallel
+		// ---------------------------------------------
+
+		// Small files are not worth the scheduling
+		const size_t chunkSize = 256 * 1024;
+		const size_t numChunks = std::min(data.size() / chunkSize + 1, pool.getNumThreads() * 4);
+		std::vector<std::string_view> chunks = parser::splitLines(data, numChunks);
+
+		std::vector<parser::RecordChunk> parsed(chunks.size());
+		std::atomic<size_t> parsedChunks(0);
+
+		pool.parallelFor(chunks.size(), [&](size_t i)
+		{
+			parseRecords(chunks[i], parsed[i]);
+
+			// Parsing is the bulk of the work
+			if (progress) progress(0.8f * (float)(++parsedChunks) / (float)chunks.size());
+		});
+
+		setAtoms(parsed);
+
+		if (progress) progress(1.0f);
+	}
 	catch (...) { throw ProteinInvalidSourceExc(); }
+}
 
-	// Parse
+void Protein::loadPdb(parser::BlockReader &blocks)
+{
 	try
 	{
-		std::vector<std::string> lines = ci::split(data, "\n\r");
-		for (size_t i = 0; i < lines.size(); ++i)
+		utils::ThreadPool &pool = utils::ThreadPool::get();
+		const size_t batchSize = std::max<size_t>(pool.getNumThreads(), 1);
+
+		// ---------------------------------------------
+		// Blocks are parsed a batch at a time while the reader decodes the next ones
+		// ---------------------------------------------
+
+		std::vector<parser::RecordChunk> parsed;
+		std::vector<parser::TextBlockRef> batch;
+		bool finished = false;
+		while (!finished)
 		{
-			std::vector<std::string> tokens = ci::split(lines[i], ";");
-			if (!tokens.empty() && tokens.size() == 4)
-			{
-				// Name of Atom
-				std::string tmpName = tokens[0];
+			parser::TextBlockRef block;
+			while (batch.size() < batchSize && (block = blocks.next())) batch.push_back(block);
+			finished = batch.size() < batchSize;
 
-				// Color of Atom
-				glm::vec3 tmpColor;
-				tmpColor.r = boost::lexical_cast<float> (tokens[1]);
-				tmpColor.g = boost::lexical_cast<float> (tokens[2]);
-				tmpColor.b = boost::lexical_cast<float> (tokens[3]);
+			const size_t first = parsed.size();
+			parsed.resize(first + batch.size());
+			pool.parallelFor(batch.size(), [&](size_t i)
+			{
+				parseRecords(*batch[i], parsed[first + i]);
 
-				mColorScheme.emplace(tmpName, tmpColor);
-			}
+				// Only the records are kept, not the text
+				parsed[first + i].detach();
+			});
+			batch.clear();
 		}
+		if (parsed.empty()) throw ProteinInvalidSourceExc();
+
+		setAtoms(parsed);
 	}
 	catch (...) { throw ProteinInvalidSourceExc(); }
 }
 
-/*
-	Atom Properties functions
-*/
-void Protein::loadAtomRadii(const ci::DataSourceRef dataRef)
+void Protein::loadCif(std::string_view data, const ProgressFn &progress)
+{
+	try
+	{
+		parser::CifReader reader;
+		reader.read(data);
+		if (progress) progress(0.8f);
+
+		setAtoms(reader.getChunks());
+		if (progress) progress(1.0f);
+	}
+	catch (...) { throw ProteinInvalidSourceExc(); }
+}
+
+void Protein::loadBinaryCif(std::string_view data, const ProgressFn &progress)
 {
-	// Read the data file
-	std::string data;
-	try { data = loadString(dataRef); }
+	try
+	{
+		parser::BinaryCifReader reader;
+		reader.read(data);
+		if (progress) progress(0.8f);
+
+		setAtoms(reader.getChunks());
+		if (progress) progress(1.0f);
+	}
 	catch (...) { throw ProteinInvalidSourceExc(); }
+}
 
-	// Parse
+void Protein::loadCompressed(std::string_view data, const std::string &extension, const ProgressFn &progress)
+{
 	try
 	{
-		std::vector<std::string> lines = ci::split(data, "\n\r");
-		for (size_t i = 0; i < lines.size(); ++i)
+		// MessagePack is not line based; inflate it whole
+		if (extension == ".bcif")
 		{
-			std::vector<std::string> tokens = ci::split(lines[i], ";");
-			if (!tokens.empty() && tokens.size() == 2)
-			{
-				// Name of Atom
-				std::string tmpName = tokens[0];
+			std::string text = utils::GzipStream(data).readAll();
+			loadBinaryCif(text, progress);
+			return;
+		}
 
-				// Radii of Atom
-				float tmpRadii;
-				tmpRadii = boost::lexical_cast<float> (tokens[1]);
-				tmpRadii /= 100.0f;
+		// ---------------------------------------------
+		// Decompression runs on the block reader thread, parsing on the pool
+		// ---------------------------------------------
 
-				mAtomRadii.emplace(tmpName, tmpRadii);
+		bool streamed = true;
+		{
+			utils::GzipStream stream(data);
+			parser::BlockReader blocks([&stream, &progress](char *buffer, size_t size)
+			{
+				size_t produced = stream.read(buffer, size);
+				if (progress) progress(0.8f * (float)stream.getConsumed() / (float)std::max<size_t>(stream.getCompressedSize(), 1));
+				return produced;
+			});
+
+			if (extension == ".cif" || extension == ".mmcif")
+			{
+				parser::CifReader reader;
+				streamed = reader.read(blocks);
+				if (streamed) setAtoms(reader.getChunks());
+			}
+			else
+			{
+				loadPdb(blocks);
 			}
 		}
+
+		// Rows spanning lines need the whole text
+		if (!streamed)
+		{
+			std::string text = utils::GzipStream(data).readAll();
+			loadCif(text, progress);
+			return;
+		}
+
+		if (progress) progress(1.0f);
 	}
 	catch (...) { throw ProteinInvalidSourceExc(); }
 }
 
-void Protein::loadPdb(const ci::DataSourceRef dataRef)
+void Protein::setAtoms(const std::vector<parser::RecordChunk> &chunks)
 {
-	// Read the data file
-	std::string data;
-	try { data = loadString(dataRef); }
-	catch (...) { throw ProteinInvalidSourceExc(); }
+	// ---------------------------------------------
+	// Merge in file order; ID of atom is its position in mAtoms
+	// ---------------------------------------------
 
-	// Parse the file
-	try 
+	std::vector<size_t> offsets(chunks.size() + 1, 0);
+	for (size_t i = 0; i < chunks.size(); ++i)
+	{
+		offsets[i + 1] = offsets[i] + chunks[i].records.size();
+
+		// set new minValues, maxValues for Boudning Box
+		if (!chunks[i].records.empty())
+		{
+			setBounds(chunks[i].lowerBound);
+			setBounds(chunks[i].upperBound);
+		}
+	}
+
+	// ---------------------------------------------
+	// Models: records of a chunk opened before its first MODEL record belong to the model open at the end of the previous chunk
+	// ---------------------------------------------
+
+	auto modelOf = [&](size_t chunk, size_t index, int carried)
 	{
-		// Split the file into the lines
-		std::vector<std::string> lines = ci::split(data, "\n\r");
-		if (lines.size() < 2) throw;
+		int model = chunks[chunk].records[index].model;
+		return model < 0 ? carried : model;
+	};
 
-		// Prepare mAtoms
-		if(!mAtoms.empty()) mAtoms.clear();
-		mAtoms.reserve(lines.size());
+	// The first model is the topology; the others must repeat it atom for atom
+	size_t numAtoms = 0;
+	size_t numModels = 1;
+	{
+		int carried = -1;
+		int firstModel = 0;
+		int currentModel = 0;
+		size_t blockSize = 0;
+		bool consistent = true;
+		bool first = true;
+
+		for (size_t i = 0; i < chunks.size(); ++i)
+		{
+			for (size_t j = 0; j < chunks[i].records.size(); ++j)
+			{
+				int model = modelOf(i, j, carried);
+				if (first) { firstModel = currentModel = model; first = false; }
+
+				if (model != currentModel)
+				{
+					if (numAtoms == 0) numAtoms = blockSize;
+					else if (blockSize != numAtoms) consistent = false;
+					++numModels;
+					currentModel = model;
+					blockSize = 0;
+				}
+				++blockSize;
+			}
+			if (chunks[i].model >= 0) carried = chunks[i].model;
+		}
+		if (numAtoms == 0) numAtoms = blockSize;
+		else if (blockSize != numAtoms) consistent = false;
 
-		// Read all lines
-		for (size_t i = 0; i < lines.size(); ++i)
+		// Models with different atoms can not share a topology; keep the first one only
+		if (!consistent)
 		{
-			if (lines[i].substr(0, 4) == "ATOM")
+			numAtoms = 0;
+			carried = -1;
+			for (size_t i = 0; i < chunks.size(); ++i)
 			{
-				// ---------------------------------------------
-				// Create Atom
-				// ---------------------------------------------
-				
-				// Atom serial number
-				int	tmpId = boost::lexical_cast<int> (boost::trim_copy(lines[i].substr(6, 5)));
-
-				// Position of Atom
-				glm::vec3 tmpPosition;
-				tmpPosition.x = boost::lexical_cast<float> (boost::trim_copy(lines[i].substr(30, 7)));
-				tmpPosition.y = boost::lexical_cast<float> (boost::trim_copy(lines[i].substr(38, 7)));
-				tmpPosition.z = boost::lexical_cast<float> (boost::trim_copy(lines[i].substr(46, 7)));
-
-				// Name of Atom
-				std::string tmpName = lines[i].substr(77, 1);
-
-				mAtoms.emplace_back(new Atom(tmpId, tmpName, tmpPosition));
-
-				// ---------------------------------------------
-				// Set Atom Properties
-				// ---------------------------------------------
-				
-				auto searchColor = mColorScheme.find(tmpName);
-				auto searchRadii = mAtomRadii.find(tmpName);
-
-				// Set Color
-				if (searchColor != mColorScheme.end())
-					mAtoms.back()->setColor(searchColor->second);
-				else
-					mAtoms.back()->setColor(glm::vec3(0.0f));
-				
-				// Set Radii
-				if (searchRadii != mAtomRadii.end())
-					mAtoms.back()->setRadii(searchRadii->second);
-				else
-					mAtoms.back()->setRadii(2.0f);
-
-				// ---------------------------------------------
-				// Extras
-				// ---------------------------------------------
-
-				// set new minValues, maxValues for Boudning Box
-				setBounds(tmpPosition);
+				for (size_t j = 0; j < chunks[i].records.size(); ++j)
+					if (modelOf(i, j, carried) == firstModel) ++numAtoms;
+				if (chunks[i].model >= 0) carried = chunks[i].model;
 			}
+			numModels = 1;
 		}
-		// compute Bouding Box Matrix 
-		setBoundingBox();
 	}
-	catch (...) { throw ProteinInvalidSourceExc(); }
+
+	mAtoms.clear();
+	mAtoms.resize(numAtoms);
+	int32_t *serials = mAtoms.getSerials();
+	PackedName *names = mAtoms.getNames();
+
+	mNumModels = numModels;
+	mCurrentModel = 0;
+	mModelPositions.clear();
+	if (numModels > 1) mModelPositions.resize(numModels * numAtoms);
+
+	utils::ThreadPool::get().parallelFor(chunks.size(), [&](size_t i)
+	{
+		const std::vector<parser::AtomRecord> &records = chunks[i].records;
+		for (size_t j = 0; j < records.size(); ++j)
+		{
+			const parser::AtomRecord &record = records[j];
+			const size_t index = offsets[i] + j;
+
+			// Coordinates of every model
+			if (numModels > 1) mModelPositions[index] = record.position;
+
+			// Topology comes from the first model
+			if (index >= numAtoms) continue;
+
+			// Fill the row; color and radius follow the element
+			// Stars count from the row, like the writer did before it ran out of columns
+			serials[index] = record.serial != -1 ? record.serial : int32_t(index + 1);
+			names[index] = packName(record.name);
+			mAtoms.setPosition(index, record.position);
+			mAtoms.setElement(index, record.element);
+		}
+	});
+
+	// Chains and residues of the topology, in file order
+	mHierarchy.clear();
+	mHierarchy.reserve(numAtoms);
+	for (size_t i = 0; i < chunks.size() && offsets[i] < numAtoms; ++i)
+	{
+		const std::vector<parser::AtomRecord> &records = chunks[i].records;
+		const size_t count = std::min(records.size(), numAtoms - offsets[i]);
+		for (size_t j = 0; j < count; ++j)
+		{
+			const parser::AtomRecord &record = records[j];
+			mHierarchy.append(packName(record.chainId), packName(record.residueName), record.residueNumber, record.insertionCode);
+		}
+	}
+	indexHierarchy();
+	applyColorScheme();
+	mSelection.resize(numAtoms);
+
+	// Explicit bonds (CONECT records); serials resolve to the rows of the topology
+	mBonds.clear();
+	size_t numConnections = 0;
+	for (const parser::RecordChunk &chunk : chunks) numConnections += chunk.connections.size();
+	if (numConnections > 0)
+	{
+		std::vector<std::pair<int32_t, uint32_t>> rows(numAtoms);
+		for (size_t i = 0; i < numAtoms; ++i) rows[i] = std::make_pair(serials[i], (uint32_t)i);
+		std::sort(rows.begin(), rows.end());
+
+		auto rowOf = [&rows](int serial)
+		{
+			auto it = std::lower_bound(rows.begin(), rows.end(), std::make_pair((int32_t)serial, (uint32_t)0));
+			return (it != rows.end() && it->first == serial) ? it->second : std::numeric_limits<uint32_t>::max();
+		};
+
+		// Unknown serials map past the last row and are dropped
+		std::vector<Bond> bonds;
+		bonds.reserve(numConnections);
+		for (const parser::RecordChunk &chunk : chunks)
+			for (const std::pair<int, int> &connection : chunk.connections)
+				bonds.emplace_back(rowOf(connection.first), rowOf(connection.second));
+		mBonds.add(numAtoms, bonds);
+	}
+
+	// compute Bouding Box Matrix 
+	setBoundingBox();
+}
+
+bool Protein::setModel(size_t model)
+{
+	if (model >= mNumModels) return false;
+	if (model == mCurrentModel) return true;
+
+	mAtoms.setPositions(getModelPositions(model));
+	mGrid.update(mAtoms);
+	mBvh.refit(mAtoms);
+	mSasa.clear();
+
+	mCurrentModel = model;
+	return true;
+}
+
+void Protein::setPositions(const glm::vec3 *positions)
+{
+	mAtoms.setPositions(positions);
+	mGrid.update(mAtoms);
+	mBvh.refit(mAtoms);
+	mSasa.clear();
+}
+
+const glm::vec3* Protein::getModelPositions(size_t model) const
+{
+	if (mNumModels <= 1 || model >= mNumModels) return nullptr;
+	return mModelPositions.data() + model * mAtoms.size();
+}
+
+void Protein::alignModels(size_t reference)
+{
+	if (mNumModels <= 1 || reference >= mNumModels) return;
+
+	std::vector<uint32_t> rows;
+	getTraceAtoms(rows);
+	Superposition superposition;
+	for (size_t model = 0; model < mNumModels; ++model)
+		superposition.addFrame(getModelPositions(model), rows);
+
+	std::vector<Superposition::Fit> fits;
+	superposition.fitAll(reference, fits);
+
+	// Transforms compose, so aligning again keeps the way back to the file coordinates
+	mModelTransforms.resize(mNumModels, glm::mat4(1.0f));
+	for (size_t model = 0; model < mNumModels; ++model)
+	{
+		glm::vec3 *positions = mModelPositions.data() + model * mAtoms.size();
+		utils::simd::transform(fits[model].transform, positions, mAtoms.size());
+		mModelTransforms[model] = fits[model].transform * mModelTransforms[model];
+	}
+	setPositions(getModelPositions(mCurrentModel));
+}
+
+void Protein::computeModelRmsds(std::vector<float> &matrix) const
+{
+	matrix.assign(mNumModels * mNumModels, 0.0f);
+	if (mNumModels <= 1) return;
+
+	std::vector<uint32_t> rows;
+	getTraceAtoms(rows);
+	Superposition superposition;
+	for (size_t model = 0; model < mNumModels; ++model)
+		superposition.addFrame(getModelPositions(model), rows);
+	superposition.computeRmsdMatrix(matrix);
+}
+
+/*
+	Hierarchy functions
+*/
+
+void Protein::indexHierarchy()
+{
+	uint32_t *residues = mAtoms.getResidues();
+	uint32_t *chains = mAtoms.getChains();
+
+	for (size_t chain = 0; chain < mHierarchy.getNumChains(); ++chain)
+	{
+		IndexRange range = mHierarchy.getChainResidues(chain);
+		for (uint32_t residue = range.begin; residue < range.end; ++residue)
+		{
+			IndexRange atoms = mHierarchy.getResidueAtoms(residue);
+			std::fill(residues + atoms.begin, residues + atoms.end, residue);
+			std::fill(chains + atoms.begin, chains + atoms.end, (uint32_t)chain);
+		}
+	}
+}
+
+void Protein::applyColorScheme()
+{
+	switch (mColorScheme)
+	{
+	case ELEMENT_COLORS:
+		mAtoms.resetColors();
+		break;
+	case CHAIN_COLORS:
+		for (size_t chain = 0; chain < mHierarchy.getNumChains(); ++chain)
+		{
+			IndexRange atoms = mHierarchy.getChainAtoms(chain);
+			mAtoms.setColorIndex(atoms.begin, atoms.end, uint8_t(AtomTable::kChainColors + chain % AtomTable::kNumChainColors));
+		}
+		break;
+	case SASA_COLORS:
+		// Areas come from updateSasa or setSasa; until there are some atoms keep their colors
+		if (!mSasa.empty()) applySasaColors(mSasa);
+		break;
+	}
+}
+
+void Protein::applySasaColors(const Sasa &sasa)
+{
+	uint8_t *colors = mAtoms.getColorIndices();
+	const float *radii = mAtoms.getRadii();
+	for (size_t i = 0; i < mAtoms.size(); ++i)
+		colors[i] = uint8_t(AtomTable::kRampColors + std::lround(sasa.getExposure(i, radii[i]) * (AtomTable::kNumRampColors - 1)));
+}
+
+const Sasa& Protein::updateSasa()
+{
+	if (mSasa.empty() && !mAtoms.empty()) mSasa.compute(mAtoms, mGrid, mHierarchy);
+	return mSasa;
+}
+
+void Protein::setSasa(Sasa &&sasa, const AtomTable &atoms)
+{
+	const size_t numAtoms = mAtoms.size();
+	if (sasa.empty() || atoms.size() != numAtoms) return;
+
+	if (mColorScheme == SASA_COLORS) applySasaColors(sasa);
+
+	// Bit for bit the same positions
+	const size_t bytes = numAtoms * sizeof(float);
+	if (std::memcmp(atoms.getX(), mAtoms.getX(), bytes) == 0 && std::memcmp(atoms.getY(), mAtoms.getY(), bytes) == 0 && std::memcmp(atoms.getZ(), mAtoms.getZ(), bytes) == 0)
+		mSasa = std::move(sasa);
+}
+
+const Surface& Protein::updateSurface()
+{
+	mSurface.update(mAtoms);
+	return mSurface;
+}
+
+bool Protein::updateSurface(const AtomTable &atoms)
+{
+	return mSurface.update(atoms);
+}
+
+void Protein::setColorScheme(ColorScheme scheme)
+{
+	mColorScheme = scheme;
+	applyColorScheme();
+}
+
+void Protein::getTraceAtoms(std::vector<uint32_t> &atoms) const
+{
+	atoms.clear();
+	std::vector<uint32_t> chainAtoms;
+	for (size_t chain = 0; chain < mHierarchy.getNumChains(); ++chain)
+	{
+		getBackbone(chain, chainAtoms);
+		atoms.insert(atoms.end(), chainAtoms.begin(), chainAtoms.end());
+	}
+	if (atoms.empty())
+	{
+		atoms.resize(mAtoms.size());
+		for (uint32_t row = 0; row < atoms.size(); ++row) atoms[row] = row;
+	}
+}
+
+void Protein::getResidueBounds(size_t residue, glm::vec3 &lower, glm::vec3 &upper) const
+{
+	IndexRange atoms = mHierarchy.getResidueAtoms(residue);
+	mAtoms.computeBounds(atoms.begin, atoms.end, lower, upper);
+}
+
+void Protein::getChainBounds(size_t chain, glm::vec3 &lower, glm::vec3 &upper) const
+{
+	IndexRange atoms = mHierarchy.getChainAtoms(chain);
+	mAtoms.computeBounds(atoms.begin, atoms.end, lower, upper);
+}
+
+void Protein::getBackbone(size_t chain, std::vector<uint32_t> &atoms) const
+{
+	static const PackedName kAlphaCarbon = packName("CA");
+	static const PackedName kPhosphorus = packName("P");
+
+	atoms.clear();
+	const PackedName *names = mAtoms.getNames();
+	const Element *elements = mAtoms.getElements();
+
+	IndexRange residues = mHierarchy.getChainResidues(chain);
+	for (uint32_t residue = residues.begin; residue < residues.end; ++residue)
+	{
+		IndexRange range = mHierarchy.getResidueAtoms(residue);
+		for (uint32_t i = range.begin; i < range.end; ++i)
+		{
+			// Calcium ions are named CA too, they come with an element though
+			if ((names[i] == kAlphaCarbon && elements[i] == Element::C) || names[i] == kPhosphorus)
+			{
+				atoms.push_back(i);
+				break;
+			}
+		}
+	}
+}
+
+/*
+	Structure cache functions
+*/
+
+bool Protein::loadCache(const ci::fs::path &path, uint64_t hash, uint64_t size)
+{
+	utils::MappedFileRef file;
+	try { file = utils::MappedFile::create(path); }
+	catch (...) { return false; }
+
+	// Validate
+	if (file->getSize() < sizeof(cache::Header)) return false;
+
+	cache::Header header;
+	std::memcpy(&header, file->getData(), sizeof(header));
+	if (header.magic != cache::kMagic || header.version != cache::kVersion || header.headerSize != sizeof(cache::Header)) return false;
+	if (header.sourceHash != hash || header.sourceSize != size) return false;
+
+	if (header.numModels == 0) return false;
+	cache::Layout layout = cache::Layout::compute(header);
+	if (file->getSize() < layout.total) return false;
+
+	// Columns are read in place from the mapping
+	const char *data = file->getData();
+	const uint8_t *elements		= reinterpret_cast<const uint8_t*>(data + layout.elements);
+
+	// Coordinates, serials and names match the table columns; copy them as blocks
+	mAtoms.resize(header.numAtoms);
+	std::memcpy(mAtoms.getX(), data + layout.x, header.numAtoms * sizeof(float));
+	std::memcpy(mAtoms.getY(), data + layout.y, header.numAtoms * sizeof(float));
+	std::memcpy(mAtoms.getZ(), data + layout.z, header.numAtoms * sizeof(float));
+	std::memcpy(mAtoms.getSerials(), data + layout.serials, header.numAtoms * sizeof(int32_t));
+	std::memcpy(mAtoms.getNames(), data + layout.names, header.numAtoms * sizeof(PackedName));
+
+	for (size_t i = 0; i < header.numAtoms; ++i)
+		mAtoms.setElement(i, elements[i] < uint8_t(Element::Count) ? Element(elements[i]) : Element::Unknown);
+
+	// Hierarchy
+	const uint32_t *residueOffsets = reinterpret_cast<const uint32_t*>(data + layout.residueOffsets);
+	const uint32_t *chainOffsets = reinterpret_cast<const uint32_t*>(data + layout.chainOffsets);
+	if (residueOffsets[header.numResidues] != header.numAtoms || chainOffsets[header.numChains] != header.numResidues) return false;
+
+	mHierarchy.assign(residueOffsets,
+		reinterpret_cast<const PackedName*>(data + layout.residueNames),
+		reinterpret_cast<const int32_t*>(data + layout.residueNumbers),
+		data + layout.insertionCodes, header.numResidues,
+		chainOffsets, reinterpret_cast<const PackedName*>(data + layout.chainIds), header.numChains);
+	indexHierarchy();
+	applyColorScheme();
+	mSelection.resize(header.numAtoms);
+
+	// Bonds
+	const uint32_t *bondOffsets = reinterpret_cast<const uint32_t*>(data + layout.bondOffsets);
+	if (bondOffsets[header.numAtoms] != 2 * header.numBonds) return false;
+	mBonds.assign(bondOffsets, header.numAtoms, reinterpret_cast<const uint32_t*>(data + layout.bondNeighbours));
+
+	// Ensemble coordinates
+	mNumModels = header.numModels;
+	mCurrentModel = 0;
+	if (mNumModels > 1)
+	{
+		const glm::vec3 *models = reinterpret_cast<const glm::vec3*>(data + layout.models);
+		mModelPositions.assign(models, models + (size_t)mNumModels * header.numAtoms);
+	}
+
+	mLowerBound = header.lowerBound;
+	mUpperBound = header.upperBound;
+	mBoundingBoxMatrix = header.boundingBoxMatrix;
+	mSizeOfStructure = header.sizeOfStructure;
+
+	return true;
+}
+
+void Protein::saveCache(const ci::fs::path &path, uint64_t hash, uint64_t size) const
+{
+	cache::Header header;
+	std::memset((void*)&header, 0, sizeof(header));
+	header.magic = cache::kMagic;
+	header.version = cache::kVersion;
+	header.headerSize = sizeof(cache::Header);
+	header.numAtoms = (uint32_t)mAtoms.size();
+	header.numModels = (uint32_t)mNumModels;
+	header.numResidues = (uint32_t)mHierarchy.getNumResidues();
+	header.numChains = (uint32_t)mHierarchy.getNumChains();
+	header.numBonds = (uint32_t)mBonds.getNumBonds();
+	header.sourceHash = hash;
+	header.sourceSize = size;
+	header.lowerBound = mLowerBound;
+	header.upperBound = mUpperBound;
+	header.boundingBoxMatrix = mBoundingBoxMatrix;
+	header.sizeOfStructure = mSizeOfStructure;
+
+	// Gather columns into one image
+	cache::Layout layout = cache::Layout::compute(header);
+	std::vector<char> image(layout.total, 0);
+	std::memcpy(image.data(), &header, sizeof(header));
+
+	if (mNumModels > 1)
+		std::memcpy(&image[layout.models], mModelPositions.data(), mModelPositions.size() * sizeof(glm::vec3));
+
+	const size_t numAtoms = mAtoms.size();
+	std::memcpy(&image[layout.x], mAtoms.getX(), numAtoms * sizeof(float));
+	std::memcpy(&image[layout.y], mAtoms.getY(), numAtoms * sizeof(float));
+	std::memcpy(&image[layout.z], mAtoms.getZ(), numAtoms * sizeof(float));
+	std::memcpy(&image[layout.serials], mAtoms.getSerials(), numAtoms * sizeof(int32_t));
+	std::memcpy(&image[layout.elements], mAtoms.getElements(), numAtoms * sizeof(Element));
+	std::memcpy(&image[layout.names], mAtoms.getNames(), numAtoms * sizeof(PackedName));
+
+	const size_t numResidues = header.numResidues;
+	const size_t numChains = header.numChains;
+	std::memcpy(&image[layout.residueOffsets], mHierarchy.getResidueOffsets(), (numResidues + 1) * sizeof(uint32_t));
+	std::memcpy(&image[layout.residueNames], mHierarchy.getResidueNames(), numResidues * sizeof(PackedName));
+	std::memcpy(&image[layout.residueNumbers], mHierarchy.getResidueNumbers(), numResidues * sizeof(int32_t));
+	std::memcpy(&image[layout.insertionCodes], mHierarchy.getInsertionCodes(), numResidues * sizeof(char));
+	std::memcpy(&image[layout.chainOffsets], mHierarchy.getChainOffsets(), (numChains + 1) * sizeof(uint32_t));
+	std::memcpy(&image[layout.chainIds], mHierarchy.getChainIds(), numChains * sizeof(PackedName));
+	std::memcpy(&image[layout.bondOffsets], mBonds.getOffsets(), (numAtoms + 1) * sizeof(uint32_t));
+	std::memcpy(&image[layout.bondNeighbours], mBonds.getNeighbours(), mBonds.getNumBonds() * 2 * sizeof(uint32_t));
+
+	// Write aside and rename, so a reader never maps a half written file.
+	// The cache is optional; read-only locations are silently skipped.
+	try
+	{
+		ci::fs::create_directories(path.parent_path());
+
+		ci::fs::path temporary = path;
+		temporary += ".tmp";
+		{
+			std::ofstream stream(temporary.string(), std::ios::binary | std::ios::trunc);
+			if (!stream) return;
+			stream.write(image.data(), (std::streamsize)image.size());
+			if (!stream) return;
+		}
+		ci::fs::rename(temporary, path);
+	}
+	catch (...) {}
 }
 
 /*
    Public function
 */
 
-void Protein::loadProtein(const ci::DataSourceRef colorDataRef, const ci::DataSourceRef radiiDataRef, const ci::DataSourceRef pdbDataRef)
+void Protein::loadProtein(const ci::DataSourceRef pdbDataRef, const ProgressFn &progress)
 {
 	try 
 	{
@@ -228,20 +777,61 @@ void Protein::loadProtein(const ci::DataSourceRef colorDataRef, const ci::DataSo
 			mName.erase(0, last_slash_idx + 1);
 		}
 		
+		// Map the data file
+		utils::MappedFileRef file = utils::MappedFile::create(pdbDataRef);
+		std::string_view data = file->getView();
+
+		// Reuse the binary cache of identical contents
+		const bool cacheable = pdbDataRef->isFilePath() && !pdbDataRef->getFilePath().empty();
+		uint64_t hash = 0;
+		ci::fs::path cachePath;
+		if (cacheable)
+		{
+			hash = cache::hashContents(data);
+			cachePath = cache::getCachePath(pdbDataRef->getFilePath(), hash);
+
+			if (loadCache(cachePath, hash, data.size()))
+			{
+				mGrid.build(mAtoms);
+				mBvh.build(mAtoms);
+				if (mColorScheme == SASA_COLORS) applyColorScheme();
+				if (progress) progress(1.0f);
+				return;
+			}
+		}
+
 		// Load protein data
-		loadColorScheme(colorDataRef);
-		loadAtomRadii(radiiDataRef);
-		loadPdb(pdbDataRef);
+		// Compressed entries are named after their contents, e.g. 1abc.cif.gz
+		const bool compressed = utils::GzipStream::isGzip(data);
+		ci::fs::path sourcePath = pdbDataRef->getFilePath();
+		if (compressed && boost::algorithm::iequals(sourcePath.extension().string(), ".gz")) sourcePath = sourcePath.stem();
+
+		std::string extension = sourcePath.extension().string();
+		boost::algorithm::to_lower(extension);
+		if (compressed)
+			loadCompressed(data, extension, progress);
+		else if (extension == ".cif" || extension == ".mmcif")
+			loadCif(data, progress);
+		else if (extension == ".bcif")
+			loadBinaryCif(data, progress);
+		else
+			loadPdb(data, progress);
 
 		// Center protein structure
 		moveTo(glm::vec3(0.0f));
+		mGrid.build(mAtoms);
+		mBvh.build(mAtoms);
+		mBonds.perceive(mAtoms, mGrid);
+		if (mColorScheme == SASA_COLORS) applyColorScheme();
+
+		if (cacheable) saveCache(cachePath, hash, data.size());
 	}
 	catch (...) { throw ProteinInvalidSourceExc(); }
 }
 
 void Protein::cleanUp()
 {
-	float minValue = std::numeric_limits<float>::min();
+	float minValue = std::numeric_limits<float>::lowest();
 	float maxValue = std::numeric_limits<float>::max();
 
 	mLowerBound = glm::vec3(maxValue);
@@ -249,23 +839,59 @@ void Protein::cleanUp()
 	mBoundingBoxMatrix = glm::mat4();
 	mSizeOfStructure = 0;
 
-	if (!mAtoms.empty())			mAtoms.clear();
-	if (!mColorScheme.empty())		mColorScheme.clear();
-	if (!mAtomRadii.empty())		mAtomRadii.clear();
-	if (!mSelected.empty())			mSelected.clear();
+	mAtoms.clear();
+	mHierarchy.clear();
+	mSelection.resize(0);
+	mGrid.clear();
+	mBvh.clear();
+	mBonds.clear();
+	mSasa.clear();
+	mSurface.clear();
+	if (!mModelPositions.empty())		mModelPositions.clear();
+	mNumModels = 1;
+	mCurrentModel = 0;
+	mModelTransforms.clear();
 }
 
 bool Protein::select(int atomId)
 {
-	if (atomId < 0 || (size_t)atomId > mAtoms.size()) return false;
+	if (atomId < 0 || (size_t)atomId >= mAtoms.size()) return false;
 
-	auto search = mSelected.find(atomId);
-	if (search != mSelected.end())
-		mSelected.erase(atomId);
-	else
-		mSelected.insert(atomId);
-		
+	mSelection.flip(atomId);
+	return true;
+}
+
+void Protein::select(const std::string &query)
+{
+	SelectionQuery(query).evaluate(*this, mSelection);
+}
+
+// Selects the whole range, or deselects it if it is fully selected
+static void toggleRange(Selection &selection, IndexRange atoms)
+{
+	selection.setRange(atoms.begin, atoms.end, !selection.allOf(atoms.begin, atoms.end));
+}
+
+bool Protein::selectResidue(size_t residue)
+{
+	if (residue >= mHierarchy.getNumResidues()) return false;
+	toggleRange(mSelection, mHierarchy.getResidueAtoms(residue));
+	return true;
+}
+
+bool Protein::selectChain(size_t chain)
+{
+	if (chain >= mHierarchy.getNumChains()) return false;
+	toggleRange(mSelection, mHierarchy.getChainAtoms(chain));
 	return true;
 }
 
+void Protein::select(const std::vector<uint32_t> &atoms)
+{
+	for (uint32_t atom : atoms)
+	{
+		if (atom < mSelection.size()) mSelection.set(atom);
+	}
+}
+
 }	// namespace Protein
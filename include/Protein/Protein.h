@@ -4,32 +4,40 @@
 #include "cinder/Utilities.h"
 #include "cinder/app/App.h"
 #include "cinder/gl/gl.h"
-#include <set>
-
-#include "Atom.h"
+#include <functional>
+#include <string_view>
+
+#include "AtomTable.h"
+#include "Selection.h"
+#include "SpatialGrid.h"
+#include "Bvh.h"
+#include "BondTable.h"
+#include "Sasa.h"
+#include "Surface.h"
+#include "Superposition.h"
+#include "PdbParser.h"
 
 namespace pdb 
 {
 
 typedef std::shared_ptr<class Protein> ProteinRef;
 
+// Receives load progress in [0, 1]; may be called from worker threads
+typedef std::function<void(float)> ProgressFn;
+
 class Protein
 {
 public:
+	enum ColorScheme { ELEMENT_COLORS, CHAIN_COLORS, SASA_COLORS };	// SASA: accessible share of every atom, buried blue to exposed red
+
 	Protein();
 	~Protein();
 protected:
 	// Name
 	std::string				mName;
 
-	// Color Scheme
-	std::map<std::string, glm::vec3>	mColorScheme;
-
-	// Atom properties
-	std::map<std::string, float>		mAtomRadii;
-
 	// Atom Containers
-	std::vector<AtomRef>			mAtoms;	    // Order given by pdb; ID of atom is its position in container; Not safe but enough for our Prototype   
+	AtomTable				mAtoms;	    // Order given by pdb; ID of atom is its row in the table
 
 	// Protein structure properties
 	glm::vec3				mUpperBound;
@@ -37,43 +45,116 @@ protected:
 	glm::mat4				mBoundingBoxMatrix;
 
 	// Selection
-	std::set<int>				mSelected;  // Container of selected atoms, for efficient handling (Assuming that selection will be smaller than whole atoms)  
+	Selection				mSelection;  // One bit per atom
 
 	float					mSizeOfStructure;
 
+	// Models (NMR ensembles); mAtoms hold the topology and the positions of the current model
+	std::vector<glm::vec3>			mModelPositions;	// numModels * numAtoms, model after model; empty for single models
+	size_t					mNumModels;
+	size_t					mCurrentModel;
+	std::vector<glm::mat4>			mModelTransforms;	// applied by alignModels, one per model; empty for none
+
+	// Hierarchy (chains > residues > atoms); residue and chain of every atom are columns of mAtoms
+	Hierarchy				mHierarchy;
+	ColorScheme				mColorScheme;
+
+	// Spatial indices over the current positions; the grid answers neighbour and range queries, the bvh rays and frusta
+	SpatialGrid				mGrid;
+	Bvh					mBvh;
+
+	// Covalent bonds of the topology: CONECT records and bonds perceived from the distances of the first model
+	BondTable				mBonds;
+
+	// Solvent accessible surface of the current positions; cleared when they change, computed on demand or handed in
+	Sasa					mSasa;
+	// Gaussian surface for drawing; kept across position changes, update redoes the parts that moved
+	Surface					mSurface;
+
 	// Secondary structures
 
 
 protected:
-	// Color Scheme functions
-	void loadColorScheme(const ci::DataSourceRef dataRef);
-
-	// Atom Properties functions
-	void loadAtomRadii(const ci::DataSourceRef dataRef);
-	void loadPdb(const ci::DataSourceRef dataRef);
+	// Parsing functions; colors and radii come from the element table (Element.h)
+	void loadPdb(std::string_view data, const ProgressFn &progress);
+	void loadPdb(parser::BlockReader &blocks);
+	void loadCif(std::string_view data, const ProgressFn &progress);
+	void loadBinaryCif(std::string_view data, const ProgressFn &progress);
+	void loadCompressed(std::string_view data, const std::string &extension, const ProgressFn &progress);
+	void setAtoms(const std::vector<parser::RecordChunk> &chunks);
 	//void loadSecStructures(const ci::DataSourceRef dataRef);
 
+	// Structure cache functions
+	bool loadCache(const ci::fs::path &path, uint64_t hash, uint64_t size);
+	void saveCache(const ci::fs::path &path, uint64_t hash, uint64_t size) const;
+
+	// Hierarchy functions
+	void indexHierarchy();	// fills the residue and chain columns from the ranges
+	void applyColorScheme();
+	void applySasaColors(const Sasa &sasa);
+
 	// Protein structure functions
 	void setBounds(glm::vec3 position);
 	void setBoundingBox();
 	void moveTo(glm::vec3 position); 
 public: // Functions
-	void loadProtein(const ci::DataSourceRef colorDataRef,
-			 const ci::DataSourceRef radiiDataRef,
-			 const ci::DataSourceRef pdbDataRef);
+	void loadProtein(const ci::DataSourceRef pdbDataRef, const ProgressFn &progress = ProgressFn());
 	// Clean up
 	void cleanUp();
 
 	// Select
 	bool select(int atomId);	// (de)select
+	void select(const std::string &query);	// replaces the selection, see SelectionQuery; throws SelectionQueryExc
+	bool selectResidue(size_t residue);	// (de)selects all atoms of the residue
+	bool selectChain(size_t chain);	// (de)selects all atoms of the chain
+	void select(const std::vector<uint32_t> &atoms);	// adds the atoms to the selection
+
+	// Hierarchy; every function touches the atoms of its range only
+	void setColorScheme(ColorScheme scheme);
+	void getResidueBounds(size_t residue, glm::vec3 &lower, glm::vec3 &upper) const;
+	void getChainBounds(size_t chain, glm::vec3 &lower, glm::vec3 &upper) const;
+	// Rows of the trace atoms (CA, or P for nucleic acids) of the residues of the chain, residues without one are skipped
+	void getBackbone(size_t chain, std::vector<uint32_t> &atoms) const;
+	// Backbones of all chains, or all rows if there are none
+	void getTraceAtoms(std::vector<uint32_t> &atoms) const;
+
+	// Models
+	bool setModel(size_t model);	// copies the coordinates of the model into the atoms
+	void setPositions(const glm::vec3 *positions);	// one per atom, e.g. a trajectory frame; grid and bvh follow
+	const glm::vec3* getModelPositions(size_t model) const;	// nullptr for single model structures
+	// Superposes every model onto the reference over the trace atoms (all atoms if there are none) and moves
+	// its positions there; the transforms are kept, see getModelTransform
+	void alignModels(size_t reference = 0);
+	// RMSD of all pairs of models over the trace atoms, after superposition; see Superposition::computeRmsdMatrix
+	void computeModelRmsds(std::vector<float> &matrix) const;
+
+	// Surface
+	const Sasa& updateSasa();	// computes the areas unless they are current
+	// Areas a worker computed from a copy of the atoms: colors by them while coloring by SASA, and keeps them
+	// as the current areas if the atoms have not moved since the copy was made
+	void setSasa(Sasa &&sasa, const AtomTable &atoms);
+	const Surface& updateSurface();	// builds the mesh, or updates it to the current positions
+	// Same from a copy of the atoms, e.g. on a worker while the positions move on; nothing may read the surface
+	// meanwhile. False if the mesh stayed as it was.
+	bool updateSurface(const AtomTable &atoms);
 public:	// Mutators
 	
-	std::vector<AtomRef>			const &getAtoms()		{ return mAtoms; }
-	std::set<int>				const &getSelected()		{ return mSelected; }
+	AtomTable				const &getAtoms() const		{ return mAtoms; }
+	Hierarchy				const &getHierarchy() const	{ return mHierarchy; }
+	ColorScheme				getColorScheme() const		{ return mColorScheme; }
+	Selection				const &getSelection() const	{ return mSelection; }
+	SpatialGrid				const &getGrid() const		{ return mGrid; }
+	Bvh					const &getBvh() const		{ return mBvh; }
+	BondTable				const &getBonds() const		{ return mBonds; }
+	Sasa					const &getSasa() const		{ return mSasa; }	// empty unless current, see updateSasa
+	Surface					const &getSurface() const	{ return mSurface; }	// may be behind the positions, see updateSurface
 	glm::mat4				const &getBoundingBoxMatrix()   { return mBoundingBoxMatrix; }
 	glm::vec3				const &getBoundUpper()		{ return mLowerBound; }
 	glm::vec3				const &getBoundLower()		{ return mUpperBound; }
 	float					const &getSizeOfStructure()	{ return mSizeOfStructure; }
+	size_t					getNumModels() const		{ return mNumModels; }
+	size_t					getCurrentModel() const		{ return mCurrentModel; }
+	glm::mat4				getModelTransform(size_t model) const	{ return model < mModelTransforms.size() ? mModelTransforms[model] : glm::mat4(1.0f); }
 };
 
 class ProteinExc : public std::exception {
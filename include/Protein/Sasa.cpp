@@ -0,0 +1,106 @@
+#include "Sasa.h"
+#include "Common/ThreadPool.h"
+#include "Common/Simd.h"
+#include <algorithm>
+#include <cmath>
+
+namespace pdb
+{
+
+static const size_t kChunkSize = 256;
+static const float kPi = 3.14159265358979f;
+
+// ---------------------------------------------------------------------
+
+Sasa::Sasa(float probeRadius, size_t numPoints)
+	: mProbeRadius(probeRadius), mTotalArea(0.0)
+{
+	// Golden section spiral: equal area bands in z, turned by the golden angle
+	const float golden = kPi * (3.0f - std::sqrt(5.0f));
+	mPointX.resize(numPoints);
+	mPointY.resize(numPoints);
+	mPointZ.resize(numPoints);
+	for (size_t k = 0; k < numPoints; ++k)
+	{
+		const float z = 1.0f - (2.0f * k + 1.0f) / numPoints;
+		const float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+		mPointX[k] = r * std::cos(golden * k);
+		mPointY[k] = r * std::sin(golden * k);
+		mPointZ[k] = z;
+	}
+}
+
+void Sasa::clear()
+{
+	mAtomAreas.clear();
+	mResidueAreas.clear();
+	mTotalArea = 0.0;
+}
+
+void Sasa::compute(const AtomTable &atoms, const SpatialGrid &grid, const Hierarchy &hierarchy)
+{
+	const size_t numAtoms = atoms.size();
+	mAtomAreas.assign(numAtoms, 0.0f);
+	mResidueAreas.assign(hierarchy.getNumResidues(), 0.0f);
+	mTotalArea = 0.0;
+	if (numAtoms == 0 || mPointX.empty()) return;
+
+	const float *x = atoms.getX();
+	const float *y = atoms.getY();
+	const float *z = atoms.getZ();
+	const float *radii = atoms.getRadii();
+	const float maxRadius = *std::max_element(radii, radii + numAtoms);
+	const size_t numPoints = getNumPoints();
+
+	utils::ThreadPool::get().parallelFor((numAtoms + kChunkSize - 1) / kChunkSize, [&](size_t chunk)
+	{
+		std::vector<uint32_t> buried(numPoints);
+		for (size_t i = chunk * kChunkSize, end = std::min(numAtoms, (chunk + 1) * kChunkSize); i < end; ++i)
+		{
+			const glm::vec3 center(x[i], y[i], z[i]);
+			const float radius = radii[i] + mProbeRadius;
+			const float scale = 1.0f / radius;
+
+			// Every neighbour whose inflated sphere overlaps buries the points inside it; the tests run on the
+			// unit sphere, scaled by 1 / radius. Most atoms of a protein are buried completely long before the
+			// search ends, so it stops there.
+			std::fill(buried.begin(), buried.end(), 0u);
+			size_t numBuried = 0;
+			grid.anyInRadius(center, radius + maxRadius + mProbeRadius, [&](uint32_t neighbour)
+			{
+				const glm::vec3 offset = (glm::vec3(x[neighbour], y[neighbour], z[neighbour]) - center) * scale;
+				const float reach = (radius + radii[neighbour] + mProbeRadius) * scale;
+				if (neighbour == i || glm::dot(offset, offset) >= reach * reach) return false;
+
+				numBuried = utils::simd::markInside(mPointX.data(), mPointY.data(), mPointZ.data(), numPoints, offset, (radii[neighbour] + mProbeRadius) * scale, buried.data());
+				return numBuried == numPoints;
+			});
+
+			mAtomAreas[i] = 4.0f * kPi * radius * radius * (numPoints - numBuried) / numPoints;
+		}
+	});
+
+	// Residues own contiguous rows
+	for (size_t residue = 0; residue < mResidueAreas.size(); ++residue)
+	{
+		const IndexRange range = hierarchy.getResidueAtoms(residue);
+		double area = 0.0;
+		for (uint32_t atom = range.begin; atom < range.end; ++atom) area += mAtomAreas[atom];
+		mResidueAreas[residue] = (float)area;
+		mTotalArea += area;
+	}
+
+	// Atoms outside residues (no hierarchy) still count
+	if (mResidueAreas.empty())
+	{
+		for (float area : mAtomAreas) mTotalArea += area;
+	}
+}
+
+float Sasa::getExposure(size_t atom, float radius) const
+{
+	const float inflated = radius + mProbeRadius;
+	return std::min(1.0f, mAtomAreas[atom] / (4.0f * kPi * inflated * inflated));
+}
+
+} // namespace pdb
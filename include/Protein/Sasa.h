@@ -0,0 +1,54 @@
+#pragma once
+
+#include "AtomTable.h"
+#include "Hierarchy.h"
+#include "SpatialGrid.h"
+#include <vector>
+
+namespace pdb
+{
+
+/*
+	Solvent accessible surface area (Shrake & Rupley 1973).
+	Every atom is inflated by the probe radius and sampled with points spread evenly over its sphere
+	(golden section spiral). A point is accessible if it lies inside no other inflated atom; the area
+	of an atom is its share of accessible points times the area of its inflated sphere.
+	Radii are the van der Waals radii of the atom table.
+*/
+class Sasa
+{
+public:
+	explicit Sasa(float probeRadius = 1.4f, size_t numPoints = 128);
+
+	void clear();
+
+	// Areas of the current positions; the grid must index them
+	void compute(const AtomTable &atoms, const SpatialGrid &grid, const Hierarchy &hierarchy);
+protected:
+	float				mProbeRadius;
+
+	// Points on the unit sphere, as columns
+	std::vector<float>		mPointX;
+	std::vector<float>		mPointY;
+	std::vector<float>		mPointZ;
+
+	// Square Angstroms
+	std::vector<float>		mAtomAreas;
+	std::vector<float>		mResidueAreas;
+	double				mTotalArea;
+public: // Mutators
+	bool				empty() const			{ return mAtomAreas.empty(); }
+	float				getProbeRadius() const		{ return mProbeRadius; }
+	size_t				getNumPoints() const		{ return mPointX.size(); }
+
+	double				getTotalArea() const		{ return mTotalArea; }
+	float				getAtomArea(size_t atom) const	{ return mAtomAreas[atom]; }
+	float				getResidueArea(size_t residue) const	{ return mResidueAreas[residue]; }
+	const float			*getAtomAreas() const		{ return mAtomAreas.data(); }
+	const float			*getResidueAreas() const	{ return mResidueAreas.data(); }
+
+	// Accessible share of the inflated sphere of an atom of the given radius, 0 buried .. 1 free
+	float				getExposure(size_t atom, float radius) const;
+};
+
+} // namespace pdb
@@ -0,0 +1,134 @@
+#include "Selection.h"
+#include <algorithm>
+
+namespace pdb
+{
+
+static inline size_t popCount(uint64_t word)
+{
+#if defined(_MSC_VER)
+	return (size_t)__popcnt64(word);
+#else
+	return (size_t)__builtin_popcountll(word);
+#endif
+}
+
+// Bits [first, last) of one word, 0 <= first < last <= 64
+static inline uint64_t wordMask(size_t first, size_t last)
+{
+	uint64_t upper = last == 64 ? ~uint64_t(0) : (uint64_t(1) << last) - 1;
+	return upper & ~((uint64_t(1) << first) - 1);
+}
+
+void Selection::resize(size_t size)
+{
+	if (size < mSize)
+	{
+		mWords.resize((size + 63) / 64);
+		mSize = size;
+		trim();
+	}
+	else
+	{
+		mWords.resize((size + 63) / 64, 0);
+		mSize = size;
+	}
+}
+
+void Selection::clear()
+{
+	std::fill(mWords.begin(), mWords.end(), 0);
+}
+
+void Selection::fill()
+{
+	std::fill(mWords.begin(), mWords.end(), ~uint64_t(0));
+	trim();
+}
+
+void Selection::trim()
+{
+	if (mSize & 63) mWords.back() &= wordMask(0, mSize & 63);
+}
+
+void Selection::setRange(size_t begin, size_t end, bool value)
+{
+	if (begin >= end) return;
+
+	const size_t first = begin >> 6;
+	const size_t last = (end - 1) >> 6;
+	for (size_t w = first; w <= last; ++w)
+	{
+		uint64_t mask = wordMask(w == first ? begin & 63 : 0, w == last ? ((end - 1) & 63) + 1 : 64);
+		if (value)	mWords[w] |= mask;
+		else		mWords[w] &= ~mask;
+	}
+}
+
+bool Selection::allOf(size_t begin, size_t end) const
+{
+	if (begin >= end) return true;
+
+	const size_t first = begin >> 6;
+	const size_t last = (end - 1) >> 6;
+	for (size_t w = first; w <= last; ++w)
+	{
+		uint64_t mask = wordMask(w == first ? begin & 63 : 0, w == last ? ((end - 1) & 63) + 1 : 64);
+		if ((mWords[w] & mask) != mask) return false;
+	}
+	return true;
+}
+
+bool Selection::anyOf(size_t begin, size_t end) const
+{
+	if (begin >= end) return false;
+
+	const size_t first = begin >> 6;
+	const size_t last = (end - 1) >> 6;
+	for (size_t w = first; w <= last; ++w)
+	{
+		uint64_t mask = wordMask(w == first ? begin & 63 : 0, w == last ? ((end - 1) & 63) + 1 : 64);
+		if (mWords[w] & mask) return true;
+	}
+	return false;
+}
+
+size_t Selection::count() const
+{
+	size_t total = 0;
+	for (uint64_t word : mWords) total += popCount(word);
+	return total;
+}
+
+bool Selection::any() const
+{
+	for (uint64_t word : mWords)
+		if (word) return true;
+	return false;
+}
+
+Selection& Selection::operator&=(const Selection &other)
+{
+	for (size_t w = 0; w < mWords.size(); ++w) mWords[w] &= other.mWords[w];
+	return *this;
+}
+
+Selection& Selection::operator|=(const Selection &other)
+{
+	for (size_t w = 0; w < mWords.size(); ++w) mWords[w] |= other.mWords[w];
+	return *this;
+}
+
+Selection& Selection::operator-=(const Selection &other)
+{
+	for (size_t w = 0; w < mWords.size(); ++w) mWords[w] &= ~other.mWords[w];
+	return *this;
+}
+
+void Selection::invert()
+{
+	for (uint64_t &word : mWords) word = ~word;
+	trim();
+}
+
+} // namespace pdb
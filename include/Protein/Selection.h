@@ -0,0 +1,85 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace pdb
+{
+
+/*
+	Dense set of atom rows, one bit per atom.
+	Set operations work on 64 atoms per step; bits behind size() are always zero.
+*/
+class Selection
+{
+public:
+	Selection() : mSize(0) {}
+	explicit Selection(size_t size) : mSize(0) { resize(size); }
+
+	void resize(size_t size);	// new rows are not selected
+	void clear();			// deselects all rows, keeps the size
+	void fill();			// selects all rows
+
+	bool test(size_t index) const		{ return (mWords[index >> 6] >> (index & 63)) & 1; }
+	void set(size_t index)			{ mWords[index >> 6] |= uint64_t(1) << (index & 63); }
+	void reset(size_t index)		{ mWords[index >> 6] &= ~(uint64_t(1) << (index & 63)); }
+	void flip(size_t index)			{ mWords[index >> 6] ^= uint64_t(1) << (index & 63); }
+
+	// Rows [begin, end)
+	void setRange(size_t begin, size_t end, bool value = true);
+	bool allOf(size_t begin, size_t end) const;
+	bool anyOf(size_t begin, size_t end) const;
+
+	size_t count() const;
+	bool any() const;
+
+	// Operands must have the same size
+	Selection& operator&=(const Selection &other);
+	Selection& operator|=(const Selection &other);
+	Selection& operator-=(const Selection &other);	// and not
+	void invert();
+
+	// Calls fn(row) for every selected row in ascending order
+	template <typename Fn>
+	void forEach(Fn fn) const
+	{
+		for (size_t w = 0; w < mWords.size(); ++w)
+		{
+			uint64_t word = mWords[w];
+			while (word)
+			{
+				fn((w << 6) + lowestBit(word));
+				word &= word - 1;
+			}
+		}
+	}
+
+	static unsigned lowestBit(uint64_t word)
+	{
+#if defined(_MSC_VER)
+		unsigned long index;
+		_BitScanForward64(&index, word);
+		return (unsigned)index;
+#else
+		return (unsigned)__builtin_ctzll(word);
+#endif
+	}
+protected:
+	// Clears the bits behind mSize in the last word
+	void trim();
+
+	std::vector<uint64_t>	mWords;
+	size_t			mSize;
+public: // Mutators
+	size_t			size() const			{ return mSize; }
+	size_t			getNumWords() const		{ return mWords.size(); }
+	uint64_t		*getWords()			{ return mWords.data(); }
+	const uint64_t		*getWords() const		{ return mWords.data(); }
+};
+
+} // namespace pdb
@@ -0,0 +1,461 @@
+#include "SelectionQuery.h"
+#include "Protein.h"
+#include "PdbParser.h"
+#include "Common/ThreadPool.h"
+#include <boost/algorithm/string.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <cctype>
+#include <cstring>
+
+namespace pdb
+{
+
+static bool contains(const std::vector<PackedName> &names, PackedName name)
+{
+	for (PackedName candidate : names)
+		if (candidate == name) return true;
+	return false;
+}
+
+static bool contains(const std::vector<std::pair<int, int>> &ranges, int value)
+{
+	for (const std::pair<int, int> &range : ranges)
+		if (value >= range.first && value <= range.second) return true;
+	return false;
+}
+
+/*
+	Predicate kernels
+*/
+
+// Eight bytes of 0 or 1 to eight bits, byte i to bit i
+static inline uint64_t packBytes(const uint8_t *bytes)
+{
+	uint64_t word;
+	std::memcpy(&word, bytes, 8);
+	return (word * 0x0102040810204080ULL) >> 56;
+}
+
+// Atom level: 64 rows are tested into bytes by a branchless loop the compiler vectorizes, then packed into one word.
+// Matches are added to the selection, so lists of values take one pass per value.
+template <typename Test>
+static void matchAtoms(size_t count, Selection &selection, Test test)
+{
+	uint64_t *words = selection.getWords();
+	const size_t full = count / 64;
+	alignas(16) uint8_t matches[64];
+	for (size_t w = 0; w < full; ++w)
+	{
+		const size_t base = w * 64;
+		for (size_t k = 0; k < 64; ++k)
+			matches[k] = test(base + k) ? 1 : 0;
+
+		uint64_t bits = 0;
+		for (size_t j = 0; j < 8; ++j)
+			bits |= packBytes(matches + j * 8) << (j * 8);
+		words[w] |= bits;
+	}
+
+	uint64_t bits = 0;
+	for (size_t i = full * 64; i < count; ++i)
+		bits |= uint64_t(test(i)) << (i & 63);
+	if (count & 63) words[full] |= bits;
+}
+
+template <typename T>
+static void matchValues(size_t count, const T *column, const std::vector<T> &values, Selection &selection)
+{
+	for (const T value : values)
+		matchAtoms(count, selection, [column, value](size_t i) { return column[i] == value; });
+}
+
+// Residue level: runs of matching residues become one range of rows
+template <typename Test>
+static void matchResidues(const Hierarchy &hierarchy, Selection &selection, Test test)
+{
+	const uint32_t *offsets = hierarchy.getResidueOffsets();
+	const size_t numResidues = hierarchy.getNumResidues();
+
+	size_t residue = 0;
+	while (residue < numResidues)
+	{
+		if (!test(residue)) { ++residue; continue; }
+
+		size_t last = residue + 1;
+		while (last < numResidues && test(last)) ++last;
+		selection.setRange(offsets[residue], offsets[last]);
+		residue = last;
+	}
+}
+
+// Rows within distance of any selected row
+static void selectWithin(const SpatialGrid &grid, const AtomTable &atoms, const Selection &targets, float distance, Selection &result)
+{
+	const size_t numTargets = targets.count();
+	if (numTargets == 0) return;
+
+	// Few targets: gather the neighbours of each
+	if (numTargets * 8 <= atoms.size())
+	{
+		targets.forEach([&](size_t row)
+		{
+			grid.forEachInRadius(atoms.getPosition(row), distance, [&result](uint32_t neighbour, float) { result.set(neighbour); });
+		});
+		return;
+	}
+
+	// Many targets: every atom looks for the nearest target it can find. Chunks cover whole words of result.
+	const size_t chunkSize = 64 * 256;
+	utils::ThreadPool::get().parallelFor((atoms.size() + chunkSize - 1) / chunkSize, [&](size_t chunk)
+	{
+		for (size_t row = chunk * chunkSize, end = std::min(atoms.size(), (chunk + 1) * chunkSize); row < end; ++row)
+		{
+			if (targets.test(row) || grid.anyInRadius(atoms.getPosition(row), distance, [&targets](uint32_t neighbour) { return targets.test(neighbour); }))
+				result.set(row);
+		}
+	});
+}
+
+/*
+	Parser
+*/
+
+static const char *kKeywords[] = { "AND", "OR", "NOT", "WITHIN", "OF", "BYRES", "TO", "ALL", "NONE", "PROTEIN", "NUCLEIC", "WATER", "LIGAND", "BACKBONE", "HYDROGEN",
+				   "INDEX", "SERIAL", "RESID", "NAME", "RESNAME", "CHAIN", "ELEMENT" };
+
+SelectionQuery::SelectionQuery(const std::string &text)
+	: mPosition(0)
+{
+	// Words and parentheses
+	std::string token;
+	for (char c : text)
+	{
+		if (std::isspace((unsigned char)c) || c == '(' || c == ')')
+		{
+			if (!token.empty()) mTokens.push_back(token);
+			token.clear();
+			if (c == '(' || c == ')') mTokens.push_back(std::string(1, c));
+		}
+		else token.push_back(c);
+	}
+	if (!token.empty()) mTokens.push_back(token);
+
+	if (mTokens.empty()) throw SelectionQueryExc("empty query");
+
+	parseQuery();
+	if (!atEnd()) throw SelectionQueryExc("unexpected '" + mTokens[mPosition] + "'");
+}
+
+bool SelectionQuery::accept(const char *keyword)
+{
+	if (atEnd() || !boost::algorithm::iequals(mTokens[mPosition], keyword)) return false;
+	++mPosition;
+	return true;
+}
+
+bool SelectionQuery::isValue() const
+{
+	if (atEnd()) return false;
+
+	const std::string &token = mTokens[mPosition];
+	if (token == "(" || token == ")") return false;
+	for (const char *keyword : kKeywords)
+		if (boost::algorithm::iequals(token, keyword)) return false;
+	return true;
+}
+
+void SelectionQuery::parseQuery()
+{
+	parseTerm();
+	while (accept("or"))
+	{
+		parseTerm();
+		mProgram.push_back(Instruction{ OR });
+	}
+}
+
+void SelectionQuery::parseTerm()
+{
+	parseFactor();
+	while (accept("and"))
+	{
+		parseFactor();
+		mProgram.push_back(Instruction{ AND });
+	}
+}
+
+void SelectionQuery::parseFactor()
+{
+	if (atEnd()) throw SelectionQueryExc("unexpected end of query");
+
+	if (accept("not"))
+	{
+		parseFactor();
+		mProgram.push_back(Instruction{ NOT });
+		return;
+	}
+
+	if (accept("("))
+	{
+		parseQuery();
+		if (!accept(")")) throw SelectionQueryExc("missing ')'");
+		return;
+	}
+
+	if (accept("within"))
+	{
+		Instruction instruction{ WITHIN };
+		char *end = nullptr;
+		if (isValue()) instruction.distance = std::strtof(mTokens[mPosition].c_str(), &end);
+		if (!end || *end != '\0' || !(instruction.distance >= 0.0f)) throw SelectionQueryExc("within expects a distance");
+		++mPosition;
+		if (!accept("of")) throw SelectionQueryExc("within expects 'of'");
+
+		parseFactor();
+		mProgram.push_back(instruction);
+		return;
+	}
+
+	if (accept("byres"))
+	{
+		parseFactor();
+		mProgram.push_back(Instruction{ BYRES });
+		return;
+	}
+
+	// Predicates
+	static const std::pair<const char*, Op> kPredicates[] =
+	{
+		{ "all", ALL }, { "none", NONE }, { "protein", PROTEIN }, { "nucleic", NUCLEIC }, { "water", WATER }, { "ligand", LIGAND }, { "backbone", BACKBONE }, { "hydrogen", HYDROGEN },
+		{ "index", INDEX }, { "serial", SERIAL }, { "resid", RESID }, { "name", NAME }, { "resname", RESNAME }, { "chain", CHAIN }, { "element", ELEMENT }
+	};
+
+	for (const std::pair<const char*, Op> &predicate : kPredicates)
+	{
+		if (!accept(predicate.first)) continue;
+
+		Instruction instruction{ predicate.second };
+		switch (predicate.second)
+		{
+		case INDEX: case SERIAL: case RESID:
+			parseNumbers(instruction);
+			break;
+		case NAME: case RESNAME: case CHAIN:
+			parseIdentifiers(instruction);
+			break;
+		case ELEMENT:
+			if (!isValue()) throw SelectionQueryExc("element expects symbols");
+			while (isValue())
+			{
+				Element element = parseElement(mTokens[mPosition]);
+				if (element == Element::Unknown) throw SelectionQueryExc("unknown element '" + mTokens[mPosition] + "'");
+				instruction.elements.push_back(element);
+				++mPosition;
+			}
+			break;
+		default:
+			break;
+		}
+		mProgram.push_back(instruction);
+		return;
+	}
+
+	throw SelectionQueryExc("unexpected '" + mTokens[mPosition] + "'");
+}
+
+void SelectionQuery::parseNumbers(Instruction &instruction)
+{
+	if (!isValue()) throw SelectionQueryExc("expected numbers");
+
+	while (isValue())
+	{
+		const std::string &token = mTokens[mPosition++];
+
+		// n, n-m or n:m; a leading sign belongs to the first number
+		size_t split = token.find_first_of("-:", 1);
+		int first, last;
+		if (!parser::parseInt(std::string_view(token).substr(0, split), first)) throw SelectionQueryExc("'" + token + "' is not a number");
+		last = first;
+		if (split != std::string::npos && !parser::parseInt(std::string_view(token).substr(split + 1), last)) throw SelectionQueryExc("'" + token + "' is not a range");
+
+		// n to m
+		if (split == std::string::npos && accept("to"))
+		{
+			if (atEnd() || !parser::parseInt(mTokens[mPosition], last)) throw SelectionQueryExc("'to' expects a number");
+			++mPosition;
+		}
+
+		instruction.ranges.push_back(std::make_pair(std::min(first, last), std::max(first, last)));
+	}
+}
+
+void SelectionQuery::parseIdentifiers(Instruction &instruction)
+{
+	if (!isValue()) throw SelectionQueryExc("expected names");
+
+	while (isValue())
+		instruction.names.push_back(packName(mTokens[mPosition++]));
+}
+
+/*
+	Evaluation
+*/
+
+void SelectionQuery::evaluate(const Protein &protein, Selection &selection) const
+{
+	const AtomTable &atoms = protein.getAtoms();
+	const Hierarchy &hierarchy = protein.getHierarchy();
+	const size_t numAtoms = atoms.size();
+
+	// The protein keeps its grid current; a structure assembled without one gets a temporary grid
+	const SpatialGrid *grid = &protein.getGrid();
+	SpatialGrid temporary;
+	if (grid->size() != numAtoms && std::any_of(mProgram.begin(), mProgram.end(), [](const Instruction &instruction) { return instruction.op == WITHIN; }))
+	{
+		temporary.build(atoms);
+		grid = &temporary;
+	}
+
+	const ResidueType *types = hierarchy.getResidueTypes();
+	auto hasType = [&](ResidueType type) { return std::find(types, types + hierarchy.getNumResidues(), type) != types + hierarchy.getNumResidues(); };
+
+	std::vector<Selection> stack;
+	for (const Instruction &instruction : mProgram)
+	{
+		// Operators
+		switch (instruction.op)
+		{
+		case AND:
+		case OR:
+		{
+			Selection right = std::move(stack.back());
+			stack.pop_back();
+			if (instruction.op == AND)	stack.back() &= right;
+			else				stack.back() |= right;
+			continue;
+		}
+		case NOT:
+			stack.back().invert();
+			continue;
+		case WITHIN:
+		{
+			Selection result(numAtoms);
+			selectWithin(*grid, atoms, stack.back(), instruction.distance, result);
+			stack.back() = std::move(result);
+			continue;
+		}
+		case BYRES:
+		{
+			Selection result(numAtoms);
+			const Selection &operand = stack.back();
+			matchResidues(hierarchy, result, [&](size_t residue)
+			{
+				IndexRange range = hierarchy.getResidueAtoms(residue);
+				return operand.anyOf(range.begin, range.end);
+			});
+			stack.back() = std::move(result);
+			continue;
+		}
+		default:
+			break;
+		}
+
+		// Predicates
+		stack.emplace_back(numAtoms);
+		Selection &result = stack.back();
+		switch (instruction.op)
+		{
+		case ALL:
+			result.fill();
+			break;
+		case NONE:
+			break;
+		case PROTEIN:
+			matchResidues(hierarchy, result, [types](size_t residue) { return types[residue] == ResidueType::AminoAcid; });
+			break;
+		case NUCLEIC:
+			matchResidues(hierarchy, result, [types](size_t residue) { return types[residue] == ResidueType::Nucleotide; });
+			break;
+		case WATER:
+			matchResidues(hierarchy, result, [types](size_t residue) { return types[residue] == ResidueType::Solvent; });
+			break;
+		case LIGAND:
+			matchResidues(hierarchy, result, [types](size_t residue) { return types[residue] == ResidueType::Other; });
+			break;
+		case BACKBONE:
+		{
+			static const std::vector<PackedName> kProtein = { packName("N"), packName("CA"), packName("C"), packName("O"), packName("OXT") };
+			static const std::vector<PackedName> kNucleic = { packName("P"), packName("OP1"), packName("OP2"), packName("O1P"), packName("O2P"),
+									  packName("O5'"), packName("C5'"), packName("C4'"), packName("C3'"), packName("O3'") };
+
+			// Backbone names, restricted to the residues of their polymer type
+			for (ResidueType type : { ResidueType::AminoAcid, ResidueType::Nucleotide })
+			{
+				if (!hasType(type)) continue;
+
+				Selection names(numAtoms), residues(numAtoms);
+				matchValues(numAtoms, atoms.getNames(), type == ResidueType::AminoAcid ? kProtein : kNucleic, names);
+				matchResidues(hierarchy, residues, [types, type](size_t residue) { return types[residue] == type; });
+				names &= residues;
+				result |= names;
+			}
+			break;
+		}
+		case HYDROGEN:
+		{
+			const Element *elements = atoms.getElements();
+			matchAtoms(numAtoms, result, [elements](size_t i) { return elements[i] == Element::H; });
+			break;
+		}
+		case INDEX:
+			for (const std::pair<int, int> &range : instruction.ranges)
+			{
+				size_t first = (size_t)std::max(range.first, 0);
+				size_t last = std::min((size_t)std::max(range.second + 1, 0), numAtoms);
+				result.setRange(first, last);
+			}
+			break;
+		case SERIAL:
+		{
+			const int32_t *serials = atoms.getSerials();
+			for (const std::pair<int, int> &range : instruction.ranges)
+			{
+				const int first = range.first, last = range.second;
+				matchAtoms(numAtoms, result, [serials, first, last](size_t i) { return (serials[i] >= first) & (serials[i] <= last); });
+			}
+			break;
+		}
+		case RESID:
+			matchResidues(hierarchy, result, [&](size_t residue) { return contains(instruction.ranges, hierarchy.getResidueNumber(residue)); });
+			break;
+		case NAME:
+		{
+			matchValues(numAtoms, atoms.getNames(), instruction.names, result);
+			break;
+		}
+		case RESNAME:
+			matchResidues(hierarchy, result, [&](size_t residue) { return contains(instruction.names, hierarchy.getResidueName(residue)); });
+			break;
+		case CHAIN:
+			for (size_t chain = 0; chain < hierarchy.getNumChains(); ++chain)
+			{
+				if (!contains(instruction.names, hierarchy.getChainId(chain))) continue;
+				IndexRange range = hierarchy.getChainAtoms(chain);
+				result.setRange(range.begin, range.end);
+			}
+			break;
+		case ELEMENT:
+		{
+			matchValues(numAtoms, atoms.getElements(), instruction.elements, result);
+			break;
+		}
+		default:
+			break;
+		}
+	}
+
+	selection = std::move(stack.back());
+}
+
+} // namespace pdb
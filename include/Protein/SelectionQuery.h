@@ -0,0 +1,79 @@
+#pragma once
+
+#include "Selection.h"
+#include "Hierarchy.h"
+#include "Element.h"
+#include <string>
+#include <vector>
+#include <exception>
+
+namespace pdb
+{
+
+class Protein;
+
+/*
+	Selection language, compiled once into a postfix program over the atom columns.
+
+	query	:= term { "or" term }
+	term	:= factor { "and" factor }
+	factor	:= "not" factor | "(" query ")" | "within" <distance> "of" factor | "byres" factor | predicate
+
+	Predicates
+		all, none, protein, nucleic, water, ligand, backbone, hydrogen
+		index, serial, resid	<number | n-m | n:m | n to m> ...
+		name, resname, chain	<identifier> ...
+		element			<symbol> ...
+
+	Keywords are case insensitive, identifiers are not. Examples:
+		chain A and resname HEM
+		within 5 of ligand
+		element FE ZN or (protein and not backbone)
+*/
+class SelectionQuery
+{
+public:
+	// Throws SelectionQueryExc on syntax errors
+	explicit SelectionQuery(const std::string &text);
+
+	// Rows of the protein matching the query; selection is resized to the atoms of the protein
+	void evaluate(const Protein &protein, Selection &selection) const;
+protected:
+	enum Op { ALL, NONE, PROTEIN, NUCLEIC, WATER, LIGAND, BACKBONE, HYDROGEN, INDEX, SERIAL, RESID, NAME, RESNAME, CHAIN, ELEMENT, WITHIN, BYRES, AND, OR, NOT };
+
+	struct Instruction
+	{
+		Op					op;
+		std::vector<PackedName>			names;		// NAME, RESNAME, CHAIN
+		std::vector<std::pair<int, int>>	ranges;		// INDEX, SERIAL, RESID; inclusive
+		std::vector<Element>			elements;	// ELEMENT
+		float					distance = 0.0f;// WITHIN
+	};
+
+	// Recursive descent over mTokens, appending to mProgram
+	void parseQuery();
+	void parseTerm();
+	void parseFactor();
+	void parseNumbers(Instruction &instruction);
+	void parseIdentifiers(Instruction &instruction);
+
+	bool atEnd() const					{ return mPosition >= mTokens.size(); }
+	bool accept(const char *keyword);
+	bool isValue() const;	// current token is not a keyword or parenthesis
+
+	std::vector<std::string>	mTokens;
+	size_t				mPosition;
+
+	// Operands come before their operators
+	std::vector<Instruction>	mProgram;
+};
+
+class SelectionQueryExc : public std::exception {
+public:
+	explicit SelectionQueryExc(const std::string &message) : mMessage("Selection query exception: " + message) {}
+	virtual const char* what() const throw() { return mMessage.c_str(); }
+protected:
+	std::string	mMessage;
+};
+
+} // namespace pdb
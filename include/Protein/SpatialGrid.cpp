@@ -0,0 +1,282 @@
+#include "SpatialGrid.h"
+#include "Common/ThreadPool.h"
+#include <cmath>
+#include <limits>
+
+namespace pdb
+{
+
+static const size_t kChunkSize = 16384;
+
+// ---------------------------------------------------------------------
+
+SpatialGrid::SpatialGrid(float cellSize)
+	: mRequestedCellSize(cellSize), mCellSize(cellSize), mOrigin(0.0f), mDims(0)
+{
+}
+
+void SpatialGrid::clear()
+{
+	mCellSize = mRequestedCellSize;
+	mOrigin = glm::vec3(0.0f);
+	mDims = glm::ivec3(0);
+	mCellStart.clear();
+	mCell.clear();
+	mSlot.clear();
+	mRows.clear();
+	mX.clear();
+	mY.clear();
+	mZ.clear();
+}
+
+void SpatialGrid::build(const AtomTable &atoms)
+{
+	clear();
+	const size_t numAtoms = atoms.size();
+	if (numAtoms == 0) return;
+
+	// Bounds per chunk
+	const size_t numChunks = (numAtoms + kChunkSize - 1) / kChunkSize;
+	std::vector<glm::vec3> lowers(numChunks), uppers(numChunks);
+	utils::ThreadPool::get().parallelFor(numChunks, [&](size_t chunk)
+	{
+		atoms.computeBounds(chunk * kChunkSize, std::min(numAtoms, (chunk + 1) * kChunkSize), lowers[chunk], uppers[chunk]);
+	});
+
+	glm::vec3 lower = lowers[0], upper = uppers[0];
+	for (size_t chunk = 1; chunk < numChunks; ++chunk)
+	{
+		lower = glm::min(lower, lowers[chunk]);
+		upper = glm::max(upper, uppers[chunk]);
+	}
+
+	// Bounded number of cells, about a few per atom. One cell of margin on every side lets
+	// atoms move a little (models, trajectory frames) before update has to rebuild.
+	const size_t maxCells = std::min<size_t>(std::max<size_t>(numAtoms * 4, 4096), 1 << 22);
+	for (;;)
+	{
+		mDims = glm::ivec3((upper - lower) / mCellSize) + glm::ivec3(3);
+		if ((size_t)mDims.x * mDims.y * mDims.z <= maxCells) break;
+		mCellSize *= 2.0f;
+	}
+	mOrigin = lower - glm::vec3(mCellSize);
+
+	mCellStart.resize((size_t)mDims.x * mDims.y * mDims.z + 1);
+	mCell.resize(numAtoms);
+	mSlot.resize(numAtoms);
+	mRows.resize(numAtoms);
+	mX.resize(numAtoms);
+	mY.resize(numAtoms);
+	mZ.resize(numAtoms);
+
+	bool outside, moved;
+	computeCells(atoms, outside, moved);
+	sortCells();
+	copyPositions(atoms);
+}
+
+void SpatialGrid::update(const AtomTable &atoms)
+{
+	if (atoms.size() != mCell.size() || empty())
+	{
+		build(atoms);
+		return;
+	}
+
+	bool outside, moved;
+	computeCells(atoms, outside, moved);
+	if (outside)
+	{
+		build(atoms);
+		return;
+	}
+
+	if (moved) sortCells();
+	copyPositions(atoms);
+}
+
+void SpatialGrid::translate(const glm::vec3 &offset)
+{
+	mOrigin += offset;
+	for (size_t slot = 0; slot < mRows.size(); ++slot)
+	{
+		mX[slot] += offset.x;
+		mY[slot] += offset.y;
+		mZ[slot] += offset.z;
+	}
+}
+
+// ---------------------------------------------------------------------
+
+void SpatialGrid::computeCells(const AtomTable &atoms, bool &outside, bool &moved)
+{
+	const size_t numAtoms = atoms.size();
+	const size_t numChunks = (numAtoms + kChunkSize - 1) / kChunkSize;
+	const float *x = atoms.getX();
+	const float *y = atoms.getY();
+	const float *z = atoms.getZ();
+	const float scale = 1.0f / mCellSize;
+
+	// Per chunk flags: 1 = an atom changed cells, 2 = an atom left the grid (or is not a number)
+	std::vector<uint8_t> flags(numChunks, 0);
+	utils::ThreadPool::get().parallelFor(numChunks, [&](size_t chunk)
+	{
+		uint8_t flag = 0;
+		for (size_t i = chunk * kChunkSize, end = std::min(numAtoms, (chunk + 1) * kChunkSize); i < end; ++i)
+		{
+			// Truncation toward zero is floor for the non negative range that matters here
+			const float fx = (x[i] - mOrigin.x) * scale, fy = (y[i] - mOrigin.y) * scale, fz = (z[i] - mOrigin.z) * scale;
+			if (!(fx >= 0.0f && fy >= 0.0f && fz >= 0.0f && fx < mDims.x && fy < mDims.y && fz < mDims.z))
+			{
+				flag |= 2;
+				continue;
+			}
+
+			const uint32_t cell = (uint32_t)indexOf((int)fx, (int)fy, (int)fz);
+			if (cell != mCell[i])
+			{
+				mCell[i] = cell;
+				flag |= 1;
+			}
+		}
+		flags[chunk] = flag;
+	});
+
+	outside = moved = false;
+	for (uint8_t flag : flags)
+	{
+		moved |= (flag & 1) != 0;
+		outside |= (flag & 2) != 0;
+	}
+}
+
+void SpatialGrid::sortCells()
+{
+	const size_t numCells = mCellStart.size() - 1;
+	std::fill(mCellStart.begin(), mCellStart.end(), 0);
+	for (uint32_t cell : mCell) ++mCellStart[cell + 1];
+	for (size_t cell = 0; cell < numCells; ++cell) mCellStart[cell + 1] += mCellStart[cell];
+
+	// Stable, so rows stay ascending within a cell
+	std::vector<uint32_t> cursor(mCellStart.begin(), mCellStart.end() - 1);
+	for (size_t row = 0; row < mCell.size(); ++row)
+	{
+		const uint32_t slot = cursor[mCell[row]]++;
+		mSlot[row] = slot;
+		mRows[slot] = (uint32_t)row;
+	}
+}
+
+void SpatialGrid::copyPositions(const AtomTable &atoms)
+{
+	const size_t numAtoms = atoms.size();
+	const float *x = atoms.getX();
+	const float *y = atoms.getY();
+	const float *z = atoms.getZ();
+
+	utils::ThreadPool::get().parallelFor((numAtoms + kChunkSize - 1) / kChunkSize, [&](size_t chunk)
+	{
+		for (size_t i = chunk * kChunkSize, end = std::min(numAtoms, (chunk + 1) * kChunkSize); i < end; ++i)
+		{
+			const uint32_t slot = mSlot[i];
+			mX[slot] = x[i];
+			mY[slot] = y[i];
+			mZ[slot] = z[i];
+		}
+	});
+}
+
+// ---------------------------------------------------------------------
+
+glm::ivec3 SpatialGrid::cellOf(const glm::vec3 &position) const
+{
+	const glm::vec3 cell = glm::floor((position - mOrigin) / mCellSize);
+	return glm::ivec3(glm::clamp(cell, glm::vec3(0.0f), glm::vec3(mDims - glm::ivec3(1))));
+}
+
+bool SpatialGrid::overlaps(const glm::vec3 &lower, const glm::vec3 &upper, CellRange &range) const
+{
+	if (empty()) return false;
+
+	const glm::vec3 extent = mOrigin + glm::vec3(mDims) * mCellSize;
+	if (upper.x < mOrigin.x || upper.y < mOrigin.y || upper.z < mOrigin.z || lower.x > extent.x || lower.y > extent.y || lower.z > extent.z) return false;
+	if (!(lower.x <= upper.x && lower.y <= upper.y && lower.z <= upper.z)) return false;
+
+	range.first = cellOf(lower);
+	range.last = cellOf(upper);
+	return true;
+}
+
+void SpatialGrid::queryRadius(const glm::vec3 &center, float radius, std::vector<uint32_t> &rows) const
+{
+	rows.clear();
+	forEachInRadius(center, radius, [&rows](uint32_t row, float) { rows.push_back(row); });
+}
+
+void SpatialGrid::queryBox(const glm::vec3 &lower, const glm::vec3 &upper, std::vector<uint32_t> &rows) const
+{
+	rows.clear();
+	forEachInBox(lower, upper, [&rows](uint32_t row) { rows.push_back(row); });
+}
+
+void SpatialGrid::queryNearest(const glm::vec3 &center, size_t k, std::vector<uint32_t> &rows) const
+{
+	rows.clear();
+	if (k == 0 || empty()) return;
+
+	// Max heap on the squared distance of the k best so far
+	typedef std::pair<float, uint32_t> Candidate;
+	std::vector<Candidate> heap;
+	heap.reserve(k + 1);
+
+	auto visit = [&](int y, int z, int first, int last)
+	{
+		const uint32_t end = mCellStart[indexOf(last, y, z) + 1];
+		for (uint32_t slot = mCellStart[indexOf(first, y, z)]; slot < end; ++slot)
+		{
+			const float dx = mX[slot] - center.x, dy = mY[slot] - center.y, dz = mZ[slot] - center.z;
+			const float distance = dx * dx + dy * dy + dz * dz;
+			if (heap.size() == k && distance >= heap.front().first) continue;
+
+			heap.emplace_back(distance, mRows[slot]);
+			std::push_heap(heap.begin(), heap.end());
+			if (heap.size() > k)
+			{
+				std::pop_heap(heap.begin(), heap.end());
+				heap.pop_back();
+			}
+		}
+	};
+
+	// Shells of cells at growing Chebyshev distance around the cell of center. Everything beyond
+	// shell r is at least r cells away, which bounds the distance of the unvisited atoms.
+	const glm::ivec3 c = cellOf(center);
+	const int maxShell = std::max(std::max(std::max(c.x, mDims.x - 1 - c.x), std::max(c.y, mDims.y - 1 - c.y)), std::max(c.z, mDims.z - 1 - c.z));
+	for (int r = 0; r <= maxShell; ++r)
+	{
+		const glm::ivec3 first = glm::max(c - glm::ivec3(r), glm::ivec3(0));
+		const glm::ivec3 last = glm::min(c + glm::ivec3(r), mDims - glm::ivec3(1));
+		for (int z = first.z; z <= last.z; ++z)
+		for (int y = first.y; y <= last.y; ++y)
+		{
+			if (std::abs(z - c.z) == r || std::abs(y - c.y) == r)
+			{
+				visit(y, z, first.x, last.x);
+			}
+			else
+			{
+				if (c.x - r >= 0) visit(y, z, c.x - r, c.x - r);
+				if (r > 0 && c.x + r < mDims.x) visit(y, z, c.x + r, c.x + r);
+			}
+		}
+
+		const float bound = r * mCellSize;
+		if (heap.size() == k && heap.front().first <= bound * bound) break;
+	}
+
+	std::sort_heap(heap.begin(), heap.end());
+	rows.reserve(heap.size());
+	for (const Candidate &candidate : heap) rows.push_back(candidate.second);
+}
+
+} // namespace pdb
@@ -0,0 +1,149 @@
+#pragma once
+
+#include "AtomTable.h"
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+namespace pdb
+{
+
+/*
+	Uniform grid (cell list) over the atom positions.
+	Rows are counting-sorted by cell, and their coordinates are copied in cell order, so the cells
+	of one grid row along x form a single contiguous run that queries scan without indirection.
+*/
+class SpatialGrid
+{
+public:
+	explicit SpatialGrid(float cellSize = 4.0f);
+
+	void clear();
+
+	// Sorts the atoms into cells; the cell size grows if the grid would get too many cells
+	void build(const AtomTable &atoms);
+
+	// Same atoms at new positions (models, trajectory frames). Atoms that stay in their cell are
+	// updated in place; the cells are re-sorted if atoms changed cells and rebuilt if atoms left the grid.
+	void update(const AtomTable &atoms);
+
+	// Rigid translation of all atoms; only the origin of the grid moves
+	void translate(const glm::vec3 &offset);
+
+	// Calls fn(row, squaredDistance) for every row within radius of center
+	template <typename Fn>
+	void forEachInRadius(const glm::vec3 &center, float radius, Fn fn) const;
+
+	// True if a row within radius of center passes pred(row); stops at the first one
+	template <typename Pred>
+	bool anyInRadius(const glm::vec3 &center, float radius, Pred pred) const;
+
+	// Calls fn(row) for every row inside the box [lower, upper]
+	template <typename Fn>
+	void forEachInBox(const glm::vec3 &lower, const glm::vec3 &upper, Fn fn) const;
+
+	// Rows in cell order
+	void queryRadius(const glm::vec3 &center, float radius, std::vector<uint32_t> &rows) const;
+	void queryBox(const glm::vec3 &lower, const glm::vec3 &upper, std::vector<uint32_t> &rows) const;
+
+	// The k rows nearest to center, nearest first; fewer if the grid holds fewer atoms
+	void queryNearest(const glm::vec3 &center, size_t k, std::vector<uint32_t> &rows) const;
+protected:
+	struct CellRange
+	{
+		glm::ivec3	first;
+		glm::ivec3	last;
+	};
+
+	void computeCells(const AtomTable &atoms, bool &outside, bool &moved);
+	void sortCells();
+	void copyPositions(const AtomTable &atoms);
+
+	glm::ivec3 cellOf(const glm::vec3 &position) const;
+	bool overlaps(const glm::vec3 &lower, const glm::vec3 &upper, CellRange &range) const;
+	size_t indexOf(int x, int y, int z) const	{ return ((size_t)z * mDims.y + y) * mDims.x + x; }
+
+	float				mRequestedCellSize;
+	float				mCellSize;
+	glm::vec3			mOrigin;	// lower corner of cell (0, 0, 0)
+	glm::ivec3			mDims;
+
+	std::vector<uint32_t>		mCellStart;	// numCells + 1 offsets into the sorted arrays
+	std::vector<uint32_t>		mCell;		// cell of every row
+	std::vector<uint32_t>		mSlot;		// position of every row in the sorted arrays
+
+	// Sorted by cell
+	std::vector<uint32_t>		mRows;
+	std::vector<float>		mX;
+	std::vector<float>		mY;
+	std::vector<float>		mZ;
+public: // Mutators
+	bool				empty() const			{ return mRows.empty(); }
+	size_t				size() const			{ return mRows.size(); }
+	float				getCellSize() const		{ return mCellSize; }
+	const glm::ivec3		&getDims() const		{ return mDims; }
+	const glm::vec3			&getOrigin() const		{ return mOrigin; }
+};
+
+// ---------------------------------------------------------------------
+
+template <typename Fn>
+void SpatialGrid::forEachInRadius(const glm::vec3 &center, float radius, Fn fn) const
+{
+	CellRange range;
+	if (!overlaps(center - glm::vec3(radius), center + glm::vec3(radius), range)) return;
+
+	const float squared = radius * radius;
+	for (int z = range.first.z; z <= range.last.z; ++z)
+	for (int y = range.first.y; y <= range.last.y; ++y)
+	{
+		// One contiguous run per grid row
+		const uint32_t end = mCellStart[indexOf(range.last.x, y, z) + 1];
+		for (uint32_t slot = mCellStart[indexOf(range.first.x, y, z)]; slot < end; ++slot)
+		{
+			const float dx = mX[slot] - center.x, dy = mY[slot] - center.y, dz = mZ[slot] - center.z;
+			const float distance = dx * dx + dy * dy + dz * dz;
+			if (distance <= squared) fn(mRows[slot], distance);
+		}
+	}
+}
+
+template <typename Pred>
+bool SpatialGrid::anyInRadius(const glm::vec3 &center, float radius, Pred pred) const
+{
+	CellRange range;
+	if (!overlaps(center - glm::vec3(radius), center + glm::vec3(radius), range)) return false;
+
+	const float squared = radius * radius;
+	for (int z = range.first.z; z <= range.last.z; ++z)
+	for (int y = range.first.y; y <= range.last.y; ++y)
+	{
+		const uint32_t end = mCellStart[indexOf(range.last.x, y, z) + 1];
+		for (uint32_t slot = mCellStart[indexOf(range.first.x, y, z)]; slot < end; ++slot)
+		{
+			const float dx = mX[slot] - center.x, dy = mY[slot] - center.y, dz = mZ[slot] - center.z;
+			if (dx * dx + dy * dy + dz * dz <= squared && pred(mRows[slot])) return true;
+		}
+	}
+	return false;
+}
+
+template <typename Fn>
+void SpatialGrid::forEachInBox(const glm::vec3 &lower, const glm::vec3 &upper, Fn fn) const
+{
+	CellRange range;
+	if (!overlaps(lower, upper, range)) return;
+
+	for (int z = range.first.z; z <= range.last.z; ++z)
+	for (int y = range.first.y; y <= range.last.y; ++y)
+	{
+		const uint32_t end = mCellStart[indexOf(range.last.x, y, z) + 1];
+		for (uint32_t slot = mCellStart[indexOf(range.first.x, y, z)]; slot < end; ++slot)
+		{
+			if (mX[slot] >= lower.x && mX[slot] <= upper.x && mY[slot] >= lower.y && mY[slot] <= upper.y && mZ[slot] >= lower.z && mZ[slot] <= upper.z)
+				fn(mRows[slot]);
+		}
+	}
+}
+
+} // namespace pdb
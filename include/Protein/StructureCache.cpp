@@ -0,0 +1,75 @@
+#include "StructureCache.h"
+#include <cstring>
+#include <cstdio>
+
+namespace pdb
+{
+namespace cache
+{
+
+static size_t align16(size_t offset)
+{
+	return (offset + 15) & ~(size_t)15;
+}
+
+Layout Layout::compute(const Header &header)
+{
+	const size_t numAtoms = header.numAtoms;
+	const size_t numResidues = header.numResidues;
+	const size_t numChains = header.numChains;
+
+	Layout layout;
+	layout.x		= align16(sizeof(Header));
+	layout.y		= align16(layout.x + numAtoms * sizeof(float));
+	layout.z		= align16(layout.y + numAtoms * sizeof(float));
+	layout.serials		= align16(layout.z + numAtoms * sizeof(float));
+	layout.elements		= align16(layout.serials + numAtoms * sizeof(int32_t));
+	layout.names		= align16(layout.elements + numAtoms * sizeof(uint8_t));
+	layout.residueOffsets	= align16(layout.names + numAtoms * sizeof(uint32_t));
+	layout.residueNames	= align16(layout.residueOffsets + (numResidues + 1) * sizeof(uint32_t));
+	layout.residueNumbers	= align16(layout.residueNames + numResidues * sizeof(uint32_t));
+	layout.insertionCodes	= align16(layout.residueNumbers + numResidues * sizeof(int32_t));
+	layout.chainOffsets	= align16(layout.insertionCodes + numResidues * sizeof(char));
+	layout.chainIds		= align16(layout.chainOffsets + (numChains + 1) * sizeof(uint32_t));
+	layout.bondOffsets	= align16(layout.chainIds + numChains * sizeof(uint32_t));
+	layout.bondNeighbours	= align16(layout.bondOffsets + (numAtoms + 1) * sizeof(uint32_t));
+	layout.models		= align16(layout.bondNeighbours + (size_t)header.numBonds * 2 * sizeof(uint32_t));
+	layout.total		= layout.models + (header.numModels > 1 ? (size_t)header.numModels * numAtoms * sizeof(glm::vec3) : 0);
+	return layout;
+}
+
+uint64_t hashContents(std::string_view data)
+{
+	// FNV-1a over 64 bit words, with a final avalanche
+	const uint64_t prime = 0x100000001b3ULL;
+	uint64_t hash = 0xcbf29ce484222325ULL ^ (uint64_t)data.size();
+
+	const char *cursor = data.data();
+	size_t words = data.size() / 8;
+	for (size_t i = 0; i < words; ++i, cursor += 8)
+	{
+		uint64_t word;
+		std::memcpy(&word, cursor, 8);
+		hash = (hash ^ word) * prime;
+		hash ^= hash >> 29;
+	}
+
+	for (size_t i = words * 8; i < data.size(); ++i)
+		hash = (hash ^ (uint8_t)data[i]) * prime;
+
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdULL;
+	hash ^= hash >> 33;
+	return hash;
+}
+
+ci::fs::path getCachePath(const ci::fs::path &source, uint64_t hash)
+{
+	char name[32];
+	std::snprintf(name, sizeof(name), "-%016llx.pdbc", (unsigned long long)hash);
+
+	return source.parent_path() / ".proteincache" / (source.stem().string() + name);
+}
+
+} // namespace cache
+} // namespace pdb
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "cinder/CinderGlm.h"
+#include "cinder/Filesystem.h"
+#include <string_view>
+#include <cstdint>
+
+namespace pdb
+{
+namespace cache
+{
+
+/*
+	Binary structure cache.
+	One file per source contents, stored in ".proteincache" next to the source:
+
+	Header
+	x, y, z		float[numAtoms] each	(centered, as after Protein::loadProtein; AtomTable columns)
+	serials		int32_t[numAtoms]
+	elements	uint8_t[numAtoms]	(pdb::Element; radii and colors come from the element table)
+	names		uint32_t[numAtoms]	(pdb::PackedName)
+	residues	uint32_t[numResidues + 1] offsets, uint32_t[numResidues] names, int32_t[numResidues] numbers, char[numResidues] insertion codes
+	chains		uint32_t[numChains + 1] offsets, uint32_t[numChains] IDs
+	bonds		uint32_t[numAtoms + 1] offsets, uint32_t[2 * numBonds] bonded atoms	(pdb::BondTable)
+	models		glm::vec3[numModels * numAtoms]	(only for ensembles)
+
+	Every column starts at a 16 byte boundary, so it can be read in place from the mapping
+	and copied into the matching AtomTable column as one block.
+*/
+
+const uint32_t kMagic	= 0x43424450;	// "PDBC"
+const uint32_t kVersion	= 6;
+
+struct Header
+{
+	uint32_t	magic;
+	uint32_t	version;
+	uint32_t	headerSize;	// guards against layout changes
+	uint32_t	numAtoms;
+	uint32_t	numModels;
+	uint32_t	numResidues;
+	uint32_t	numChains;
+	uint32_t	numBonds;
+	uint64_t	sourceHash;
+	uint64_t	sourceSize;
+
+	glm::vec3	lowerBound;
+	glm::vec3	upperBound;
+	glm::mat4	boundingBoxMatrix;
+	float		sizeOfStructure;
+};
+
+// Byte offsets of the columns
+struct Layout
+{
+	size_t		x;
+	size_t		y;
+	size_t		z;
+	size_t		serials;
+	size_t		elements;
+	size_t		names;
+	size_t		residueOffsets;
+	size_t		residueNames;
+	size_t		residueNumbers;
+	size_t		insertionCodes;
+	size_t		chainOffsets;
+	size_t		chainIds;
+	size_t		bondOffsets;
+	size_t		bondNeighbours;
+	size_t		models;
+	size_t		total;
+
+	static Layout compute(const Header &header);
+};
+
+// 64 bit hash of the source contents
+uint64_t hashContents(std::string_view data);
+
+// <source dir>/.proteincache/<source name>-<hash>.pdbc
+ci::fs::path getCachePath(const ci::fs::path &source, uint64_t hash);
+
+} // namespace cache
+} // namespace pdb
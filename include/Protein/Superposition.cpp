@@ -0,0 +1,264 @@
+#include "Superposition.h"
+#include "Common/ThreadPool.h"
+#include "Common/Simd.h"
+#include <algorithm>
+#include <cmath>
+
+namespace pdb
+{
+
+static const int kMaxNewtonSteps = 50;
+static const int kMaxJacobiSweeps = 32;
+
+// ---------------------------------------------------------------------
+// Key matrix
+
+/*
+	Horn's key matrix of the covariance S = sum mobile * target^T. Its largest eigenvalue is the largest
+	sum of mobile . (R * target) over rotations R, the eigenvector the quaternion of that rotation.
+*/
+static void buildKeyMatrix(const double s[9], double key[4][4])
+{
+	const double xx = s[0], xy = s[1], xz = s[2], yx = s[3], yy = s[4], yz = s[5], zx = s[6], zy = s[7], zz = s[8];
+	const double rows[4][4] =
+	{
+		{ xx + yy + zz,	yz - zy,	zx - xz,	xy - yx },
+		{ yz - zy,	xx - yy - zz,	xy + yx,	zx + xz },
+		{ zx - xz,	xy + yx,	-xx + yy - zz,	yz + zy },
+		{ xy - yx,	zx + xz,	yz + zy,	-xx - yy + zz }
+	};
+	std::copy(&rows[0][0], &rows[0][0] + 16, &key[0][0]);
+}
+
+static double determinant3(double a, double b, double c, double d, double e, double f, double g, double h, double i)
+{
+	return a * (e * i - f * h) - b * (d * i - f * g) + c * (d * h - e * g);
+}
+
+static double determinant4(const double m[4][4])
+{
+	double total = 0.0;
+	for (int column = 0; column < 4; ++column)
+	{
+		int c[3], k = 0;
+		for (int j = 0; j < 4; ++j) if (j != column) c[k++] = j;
+		const double minor = determinant3(m[1][c[0]], m[1][c[1]], m[1][c[2]], m[2][c[0]], m[2][c[1]], m[2][c[2]], m[3][c[0]], m[3][c[1]], m[3][c[2]]);
+		total += (column & 1 ? -1.0 : 1.0) * m[0][column] * minor;
+	}
+	return total;
+}
+
+/*
+	Largest eigenvalue of the key matrix. The matrix has no trace, so its characteristic polynomial is
+	x^4 + c2 x^2 + c1 x + c0; Newton's method from the upper bound (inner products of both frames) / 2
+	converges onto the largest root from above.
+*/
+static double getLargestEigenvalue(const double s[9], double upperBound)
+{
+	double key[4][4];
+	buildKeyMatrix(s, key);
+
+	double squares = 0.0;
+	for (int k = 0; k < 9; ++k) squares += s[k] * s[k];
+	const double c2 = -2.0 * squares;
+	const double c1 = -8.0 * determinant3(s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7], s[8]);
+	const double c0 = determinant4(key);
+
+	double lambda = upperBound;
+	for (int step = 0; step < kMaxNewtonSteps; ++step)
+	{
+		const double lambda2 = lambda * lambda;
+		const double value = (lambda2 + c2) * lambda2 + c1 * lambda + c0;
+		const double slope = 4.0 * lambda2 * lambda + 2.0 * c2 * lambda + c1;
+		if (slope == 0.0) break;
+
+		const double delta = value / slope;
+		lambda -= delta;
+		if (std::abs(delta) <= 1e-11 * std::abs(lambda)) break;
+	}
+	return lambda;
+}
+
+// Cyclic Jacobi rotations; the eigenvectors end up in the columns of vectors
+static void solveEigen(double m[4][4], double vectors[4][4])
+{
+	for (int i = 0; i < 4; ++i)
+	for (int j = 0; j < 4; ++j)
+		vectors[i][j] = i == j ? 1.0 : 0.0;
+
+	for (int sweep = 0; sweep < kMaxJacobiSweeps; ++sweep)
+	{
+		double off = 0.0, diagonal = 0.0;
+		for (int i = 0; i < 4; ++i)
+		{
+			diagonal += m[i][i] * m[i][i];
+			for (int j = i + 1; j < 4; ++j) off += m[i][j] * m[i][j];
+		}
+		if (off <= 1e-30 * diagonal) break;
+
+		for (int p = 0; p < 3; ++p)
+		for (int q = p + 1; q < 4; ++q)
+		{
+			if (m[p][q] == 0.0) continue;
+
+			// Zeroes m[p][q]; t = tan of the rotation angle, the smaller root
+			const double theta = (m[q][q] - m[p][p]) / (2.0 * m[p][q]);
+			const double t = (theta >= 0.0 ? 1.0 : -1.0) / (std::abs(theta) + std::sqrt(theta * theta + 1.0));
+			const double c = 1.0 / std::sqrt(t * t + 1.0), s = t * c;
+			for (int k = 0; k < 4; ++k)
+			{
+				const double kp = m[k][p], kq = m[k][q];
+				m[k][p] = c * kp - s * kq;
+				m[k][q] = s * kp + c * kq;
+			}
+			for (int k = 0; k < 4; ++k)
+			{
+				const double pk = m[p][k], qk = m[q][k];
+				m[p][k] = c * pk - s * qk;
+				m[q][k] = s * pk + c * qk;
+			}
+			for (int k = 0; k < 4; ++k)
+			{
+				const double kp = vectors[k][p], kq = vectors[k][q];
+				vectors[k][p] = c * kp - s * kq;
+				vectors[k][q] = s * kp + c * kq;
+			}
+		}
+	}
+}
+
+static float toRmsd(double innerProducts, double lambda, size_t numAtoms)
+{
+	if (numAtoms == 0) return 0.0f;
+	return (float)std::sqrt(std::max(0.0, (innerProducts - 2.0 * lambda) / numAtoms));
+}
+
+// ---------------------------------------------------------------------
+
+Superposition::Superposition()
+	: mNumAtoms(0)
+{
+}
+
+void Superposition::clear()
+{
+	mNumAtoms = 0;
+	mX.clear();
+	mY.clear();
+	mZ.clear();
+	mCentroids.clear();
+	mInnerProducts.clear();
+}
+
+size_t Superposition::addFrame(const glm::vec3 *positions, const std::vector<uint32_t> &rows)
+{
+	if (getNumFrames() == 0) mNumAtoms = rows.size();
+	else if (rows.size() != mNumAtoms) throw SuperpositionExc("frame has " + std::to_string(rows.size()) + " atoms, expected " + std::to_string(mNumAtoms));
+
+	glm::dvec3 centroid(0.0);
+	for (uint32_t row : rows) centroid += glm::dvec3(positions[row]);
+	if (!rows.empty()) centroid /= double(rows.size());
+
+	const size_t first = mX.size();
+	mX.resize(first + mNumAtoms);
+	mY.resize(first + mNumAtoms);
+	mZ.resize(first + mNumAtoms);
+	double innerProducts = 0.0;
+	for (size_t i = 0; i < mNumAtoms; ++i)
+	{
+		const glm::dvec3 p = glm::dvec3(positions[rows[i]]) - centroid;
+		mX[first + i] = (float)p.x;
+		mY[first + i] = (float)p.y;
+		mZ[first + i] = (float)p.z;
+		innerProducts += glm::dot(p, p);
+	}
+
+	mCentroids.push_back(centroid);
+	mInnerProducts.push_back(innerProducts);
+	return mCentroids.size() - 1;
+}
+
+size_t Superposition::addFrame(const AtomTable &atoms, const std::vector<uint32_t> &rows)
+{
+	std::vector<glm::vec3> positions(atoms.size());
+	for (size_t row = 0; row < atoms.size(); ++row)
+		positions[row] = glm::vec3(atoms.getX()[row], atoms.getY()[row], atoms.getZ()[row]);
+	return addFrame(positions.data(), rows);
+}
+
+void Superposition::computeCovariance(size_t mobile, size_t target, double covariance[9]) const
+{
+	const size_t a = mobile * mNumAtoms, b = target * mNumAtoms;
+	utils::simd::computeCovariance(&mX[a], &mY[a], &mZ[a], &mX[b], &mY[b], &mZ[b], mNumAtoms, covariance);
+}
+
+float Superposition::computeRmsd(size_t mobile, size_t target) const
+{
+	if (mobile == target || mNumAtoms == 0) return 0.0f;
+
+	double covariance[9];
+	computeCovariance(mobile, target, covariance);
+	const double innerProducts = mInnerProducts[mobile] + mInnerProducts[target];
+	return toRmsd(innerProducts, getLargestEigenvalue(covariance, 0.5 * innerProducts), mNumAtoms);
+}
+
+Superposition::Fit Superposition::fit(size_t mobile, size_t target) const
+{
+	Fit result;
+	result.transform = glm::mat4(1.0f);
+	result.rmsd = 0.0f;
+	if (mNumAtoms == 0) return result;
+
+	double covariance[9], key[4][4], vectors[4][4];
+	computeCovariance(mobile, target, covariance);
+	buildKeyMatrix(covariance, key);
+	solveEigen(key, vectors);
+
+	int largest = 0;
+	for (int k = 1; k < 4; ++k) if (key[k][k] > key[largest][largest]) largest = k;
+	const double w = vectors[0][largest], x = vectors[1][largest], y = vectors[2][largest], z = vectors[3][largest];
+	result.rmsd = toRmsd(mInnerProducts[mobile] + mInnerProducts[target], key[largest][largest], mNumAtoms);
+
+	// Rotation of the unit quaternion, column after column; then target = R * (mobile - centroid) + centroid
+	const double rotation[3][3] =
+	{
+		{ w * w + x * x - y * y - z * z,	2.0 * (x * y + w * z),		2.0 * (x * z - w * y) },
+		{ 2.0 * (x * y - w * z),		w * w - x * x + y * y - z * z,	2.0 * (y * z + w * x) },
+		{ 2.0 * (x * z + w * y),		2.0 * (y * z - w * x),		w * w - x * x - y * y + z * z }
+	};
+	const glm::dvec3 &from = mCentroids[mobile], &to = mCentroids[target];
+	for (int column = 0; column < 3; ++column)
+		result.transform[column] = glm::vec4((float)rotation[column][0], (float)rotation[column][1], (float)rotation[column][2], 0.0f);
+	glm::dvec3 translation = to;
+	for (int column = 0; column < 3; ++column)
+		translation -= glm::dvec3(rotation[column][0], rotation[column][1], rotation[column][2]) * from[column];
+	result.transform[3] = glm::vec4(glm::vec3(translation), 1.0f);
+	return result;
+}
+
+void Superposition::fitAll(size_t reference, std::vector<Fit> &fits) const
+{
+	fits.resize(getNumFrames());
+	utils::ThreadPool::get().parallelFor(fits.size(), [&](size_t frame) { fits[frame] = fit(frame, reference); });
+}
+
+void Superposition::computeRmsdMatrix(std::vector<float> &matrix) const
+{
+	const size_t numFrames = getNumFrames();
+	matrix.assign(numFrames * numFrames, 0.0f);
+
+	// Row i has numFrames - 1 - i pairs; a task takes row i and row numFrames - 1 - i, so all tasks are equal.
+	// The frame of the row stays in cache while the others stream by.
+	utils::ThreadPool::get().parallelFor((numFrames + 1) / 2, [&](size_t task)
+	{
+		const size_t rows[2] = { task, numFrames - 1 - task };
+		for (size_t k = 0; k < (rows[0] == rows[1] ? 1u : 2u); ++k)
+		{
+			const size_t i = rows[k];
+			for (size_t j = i + 1; j < numFrames; ++j)
+				matrix[i * numFrames + j] = matrix[j * numFrames + i] = computeRmsd(i, j);
+		}
+	});
+}
+
+} // namespace pdb
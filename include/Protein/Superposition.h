@@ -0,0 +1,69 @@
+#pragma once
+
+#include "AtomTable.h"
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <exception>
+
+namespace pdb
+{
+
+/*
+	Least squares superposition of frames over corresponding atoms: the models of an NMR ensemble, trajectory
+	frames, or the trace atoms of two crystal forms. Every frame keeps a centered copy of its atoms as columns,
+	so a pair costs one vectorized pass over both for the 3x3 covariance (utils::simd::computeCovariance).
+	The RMSD is the largest eigenvalue of Horn's 4x4 key matrix, found by Newton's method on its characteristic
+	polynomial (QCP, Theobald 2005) without building a rotation; fit() takes the rotation from the eigenvector.
+*/
+class Superposition
+{
+public:
+	struct Fit
+	{
+		glm::mat4		transform;	// moves the mobile frame onto the target
+		float			rmsd;
+	};
+
+	Superposition();
+
+	void clear();
+
+	// Copies positions[rows[i]], centered; every frame must give as many rows as the first, corresponding
+	// in order. Returns the index of the frame. Throws SuperpositionExc otherwise.
+	size_t addFrame(const glm::vec3 *positions, const std::vector<uint32_t> &rows);
+	size_t addFrame(const AtomTable &atoms, const std::vector<uint32_t> &rows);
+
+	float computeRmsd(size_t mobile, size_t target) const;
+	Fit fit(size_t mobile, size_t target) const;
+
+	// Fit of every frame onto the reference, on the thread pool
+	void fitAll(size_t reference, std::vector<Fit> &fits) const;
+	// RMSD of all pairs on the thread pool; matrix[i * numFrames + j], symmetric, 0 on the diagonal
+	void computeRmsdMatrix(std::vector<float> &matrix) const;
+protected:
+	// Sums of mobile_i * target_j over the centered atoms
+	void computeCovariance(size_t mobile, size_t target, double covariance[9]) const;
+
+	size_t				mNumAtoms;	// per frame
+
+	// Centered atoms, frame after frame
+	std::vector<float>		mX;
+	std::vector<float>		mY;
+	std::vector<float>		mZ;
+	std::vector<glm::dvec3>		mCentroids;
+	std::vector<double>		mInnerProducts;	// sum of the squared centered coordinates
+public: // Mutators
+	size_t				getNumFrames() const		{ return mCentroids.size(); }
+	size_t				getNumAtoms() const		{ return mNumAtoms; }
+};
+
+class SuperpositionExc : public std::exception {
+public:
+	explicit SuperpositionExc(const std::string &message) : mMessage("Superposition exception: " + message) {}
+	virtual const char* what() const throw() { return mMessage.c_str(); }
+protected:
+	std::string	mMessage;
+};
+
+} // namespace pdb
@@ -0,0 +1,624 @@
+#include "Surface.h"
+#include "Common/ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace pdb
+{
+
+static const int kBlockSize = 8;		// cells per side
+static const int kBlockSamples = kBlockSize + 1;
+static const float kIsoValue = 1.0f;
+static const float kCutoff = 1e-3f;		// Gaussians end where they fall below kCutoff * kIsoValue
+static const size_t kMaxBlocks = 1 << 22;	// directory entries; the spacing grows beyond
+static const size_t kBlocksPerTask = 16;
+
+// ---------------------------------------------------------------------
+// Marching cubes cases
+
+/*
+	Corner c of a cell sits at (c & 1, c >> 1 & 1, c >> 2). Edge e runs along axis e / 4 from the corner
+	kEdgeCorner[e]. The triangles of the 256 cases are traced from the cube faces instead of a fixed table:
+	every face cuts its crossing edges into segments, the segments close into loops, the loops are fanned.
+	Faces with two inside corners on a diagonal always keep the inside corners apart, which only depends
+	on the face, so neighbouring cells agree and the surface has no cracks.
+*/
+static const int kEdgeCorner[12] = { 0, 2, 4, 6, 0, 1, 4, 5, 0, 1, 2, 3 };
+
+struct CaseTable
+{
+	static const int	kMaxCorners = 15;	// 5 triangles at most, as in the classic table
+
+	uint8_t			numCorners[256];
+	uint8_t			edges[256][kMaxCorners];
+};
+
+static int edgeOf(int corner, int axis)
+{
+	const int x = corner & 1, y = corner >> 1 & 1, z = corner >> 2;
+	switch (axis)
+	{
+	case 0:		return y + 2 * z;
+	case 1:		return 4 + x + 2 * z;
+	default:	return 8 + x + 2 * y;
+	}
+}
+
+static glm::vec3 cornerOffset(int corner)
+{
+	return glm::vec3(float(corner & 1), float(corner >> 1 & 1), float(corner >> 2));
+}
+
+static CaseTable buildCases()
+{
+	CaseTable table;
+	for (int mask = 0; mask < 256; ++mask)
+	{
+		// Two links per crossing edge, one from each face it borders
+		int links[12][2];
+		int numLinks[12] = {};
+		auto connect = [&](int first, int second)
+		{
+			links[first][numLinks[first]++] = second;
+			links[second][numLinks[second]++] = first;
+		};
+
+		for (int face = 0; face < 6; ++face)
+		{
+			const int axis = face >> 1, u = (axis + 1) % 3, v = (axis + 2) % 3;
+			int corners[4], edges[4];
+			bool inside[4];
+			for (int k = 0; k < 4; ++k)
+			{
+				corners[k] = (face & 1) << axis | int(k == 1 || k == 2) << u | int(k >= 2) << v;
+				inside[k] = (mask >> corners[k] & 1) != 0;
+			}
+			for (int k = 0; k < 4; ++k)
+			{
+				const int first = corners[k], second = corners[(k + 1) % 4];
+				const int along = (first ^ second) == 1 ? 0 : ((first ^ second) == 2 ? 1 : 2);
+				edges[k] = edgeOf(std::min(first, second), along);
+			}
+
+			int crossing[4], numCrossing = 0;
+			for (int k = 0; k < 4; ++k)
+				if (inside[k] != inside[(k + 1) % 4]) crossing[numCrossing++] = edges[k];
+
+			if (numCrossing == 2)
+				connect(crossing[0], crossing[1]);
+			else if (numCrossing == 4)
+			{
+				for (int k = 0; k < 4; ++k)
+					if (inside[k]) connect(edges[(k + 3) % 4], edges[k]);
+			}
+		}
+
+		int numCorners = 0;
+		bool visited[12] = {};
+		for (int start = 0; start < 12; ++start)
+		{
+			if (numLinks[start] == 0 || visited[start]) continue;
+
+			int loop[12], length = 0;
+			for (int previous = -1, edge = start; length == 0 || edge != start;)
+			{
+				visited[edge] = true;
+				loop[length++] = edge;
+				const int next = links[edge][0] == previous ? links[edge][1] : links[edge][0];
+				previous = edge;
+				edge = next;
+			}
+
+			// Newell normal of the loop through the edge midpoints, turned to point outside (to lower density)
+			glm::vec3 points[12], normal(0.0f), outward(0.0f);
+			for (int k = 0; k < length; ++k)
+			{
+				const int axis = loop[k] / 4, corner = kEdgeCorner[loop[k]];
+				glm::vec3 direction(0.0f);
+				direction[axis] = 1.0f;
+				points[k] = cornerOffset(corner) + 0.5f * direction;
+				outward += (mask >> corner & 1) ? direction : -direction;
+			}
+			for (int k = 0; k < length; ++k)
+			{
+				const glm::vec3 &a = points[k], &b = points[(k + 1) % length];
+				normal += glm::vec3((a.y - b.y) * (a.z + b.z), (a.z - b.z) * (a.x + b.x), (a.x - b.x) * (a.y + b.y));
+			}
+			if (glm::dot(normal, outward) < 0.0f) std::reverse(loop, loop + length);
+
+			for (int k = 1; k + 1 < length; ++k)
+			{
+				table.edges[mask][numCorners++] = uint8_t(loop[0]);
+				table.edges[mask][numCorners++] = uint8_t(loop[k]);
+				table.edges[mask][numCorners++] = uint8_t(loop[k + 1]);
+			}
+		}
+		table.numCorners[mask] = uint8_t(numCorners);
+	}
+	return table;
+}
+
+static const CaseTable& getCases()
+{
+	static const CaseTable table = buildCases();
+	return table;
+}
+
+// ---------------------------------------------------------------------
+
+// Edge key: lower sample (block local, [0, kBlockSize)) and axis
+static inline uint32_t keyOf(int x, int y, int z, int axis)
+{
+	return (((uint32_t)z * kBlockSize + y) * kBlockSize + x) * 3 + axis;
+}
+
+// Block b samples [b * kBlockSize, (b + 1) * kBlockSize]; the blocks sampling a box of samples
+static inline void getBlockRange(const glm::ivec3 &lower, const glm::ivec3 &upper, glm::ivec3 &first, glm::ivec3 &last)
+{
+	first = glm::ivec3(std::max(lower.x - 1, 0) / kBlockSize, std::max(lower.y - 1, 0) / kBlockSize, std::max(lower.z - 1, 0) / kBlockSize);
+	last = glm::ivec3(upper.x / kBlockSize, upper.y / kBlockSize, upper.z / kBlockSize);
+}
+
+// ---------------------------------------------------------------------
+
+Surface::Surface(float spacing, float sharpness)
+	: mRequestedSpacing(spacing), mSpacing(spacing), mSharpness(sharpness), mOrigin(0.0f), mDims(0)
+{
+	mReach = std::sqrt(1.0f + std::log(1.0f / kCutoff) / mSharpness);
+}
+
+void Surface::clear()
+{
+	mSpacing = mRequestedSpacing;
+	mOrigin = glm::vec3(0.0f);
+	mDims = glm::ivec3(0);
+	mBlockIndex.clear();
+	mBlocks.clear();
+	mX.clear();
+	mY.clear();
+	mZ.clear();
+	mRadii.clear();
+	mPositions.clear();
+	mNormals.clear();
+	mVertexAtoms.clear();
+	mIndices.clear();
+}
+
+void Surface::build(const AtomTable &atoms)
+{
+	clear();
+	if (atoms.empty()) return;
+
+	const size_t numAtoms = atoms.size();
+	mX.assign(atoms.getX(), atoms.getX() + numAtoms);
+	mY.assign(atoms.getY(), atoms.getY() + numAtoms);
+	mZ.assign(atoms.getZ(), atoms.getZ() + numAtoms);
+	mRadii.assign(atoms.getRadii(), atoms.getRadii() + numAtoms);
+	setupGrid();
+
+	// Two passes, so the atom lists are allocated once and stay ascending
+	glm::ivec3 lower, upper;
+	std::vector<uint32_t> counts(mBlockIndex.size(), 0);
+	for (uint32_t row = 0; row < numAtoms; ++row)
+	{
+		if (!getSampleBox(row, lower, upper)) continue;	// NaN positions
+		glm::ivec3 first, last;
+		getBlockRange(lower, upper, first, last);
+		for (int z = first.z; z <= last.z; ++z)
+		for (int y = first.y; y <= last.y; ++y)
+		for (int x = first.x; x <= last.x; ++x)
+			++counts[indexOf(glm::ivec3(x, y, z))];
+	}
+	for (size_t index = 0; index < counts.size(); ++index)
+	{
+		if (counts[index] == 0) continue;
+		const int x = int(index % mDims.x), y = int(index / mDims.x % mDims.y), z = int(index / mDims.x / mDims.y);
+		mBlockIndex[index] = (int32_t)mBlocks.size();
+		mBlocks.emplace_back();
+		mBlocks.back().coord = glm::ivec3(x, y, z);
+		mBlocks.back().atoms.reserve(counts[index]);
+		mBlocks.back().dirty = true;
+	}
+	for (uint32_t row = 0; row < numAtoms; ++row)
+		if (getSampleBox(row, lower, upper)) addAtom(row, lower, upper);
+
+	polygonizeDirty();
+	assemble();
+}
+
+bool Surface::update(const AtomTable &atoms)
+{
+	const size_t numAtoms = atoms.size();
+	if (numAtoms == 0)
+	{
+		const bool built = !mX.empty();
+		clear();
+		return built;
+	}
+	if (numAtoms != mX.size() || mBlockIndex.empty())
+	{
+		build(atoms);
+		return true;
+	}
+
+	// NaN coordinates that stay NaN did not move
+	auto changed = [](float a, float b) { return a != b && !(std::isnan(a) && std::isnan(b)); };
+	const float *x = atoms.getX(), *y = atoms.getY(), *z = atoms.getZ();
+	std::vector<uint32_t> moved;
+	for (uint32_t row = 0; row < numAtoms; ++row)
+		if (changed(x[row], mX[row]) || changed(y[row], mY[row]) || changed(z[row], mZ[row])) moved.push_back(row);
+	if (moved.empty()) return false;
+
+	// Moving most atoms costs more in list edits than a build does
+	if (moved.size() > numAtoms / 4)
+	{
+		build(atoms);
+		return true;
+	}
+
+	// Old boxes first, then the new ones; atoms leaving the margin of the grid need a new grid
+	std::vector<glm::ivec3> boxes(moved.size() * 2);
+	std::vector<char> listed(moved.size());
+	for (size_t i = 0; i < moved.size(); ++i)
+		listed[i] = getSampleBox(moved[i], boxes[2 * i], boxes[2 * i + 1]);
+	for (size_t i = 0; i < moved.size(); ++i)
+	{
+		const uint32_t row = moved[i];
+		mX[row] = x[row];
+		mY[row] = y[row];
+		mZ[row] = z[row];
+	}
+	for (size_t i = 0; i < moved.size(); ++i)
+	{
+		glm::ivec3 lower, upper;
+		if (!getSampleBox(moved[i], lower, upper))
+		{
+			build(atoms);
+			return true;
+		}
+		if (listed[i]) removeAtom(moved[i], boxes[2 * i], boxes[2 * i + 1]);
+		boxes[2 * i] = lower;
+		boxes[2 * i + 1] = upper;
+	}
+	for (size_t i = 0; i < moved.size(); ++i)
+		addAtom(moved[i], boxes[2 * i], boxes[2 * i + 1]);
+
+	polygonizeDirty();
+	assemble();
+	return true;
+}
+
+// ---------------------------------------------------------------------
+
+void Surface::setupGrid()
+{
+	glm::vec3 lower(std::numeric_limits<float>::max()), upper(-std::numeric_limits<float>::max());
+	float maxRadius = 0.0f;
+	for (size_t row = 0; row < mX.size(); ++row)
+	{
+		if (std::isnan(mX[row] + mY[row] + mZ[row])) continue;
+		const glm::vec3 position(mX[row], mY[row], mZ[row]);
+		lower = glm::min(lower, position);
+		upper = glm::max(upper, position);
+		maxRadius = std::max(maxRadius, mRadii[row]);
+	}
+	if (lower.x > upper.x) lower = upper = glm::vec3(0.0f);
+
+	// Gaussians stay a sample away from the border, plus a block of margin for atoms that move
+	for (;;)
+	{
+		const float margin = maxRadius * mReach + (kBlockSize + 1) * mSpacing;
+		mOrigin = lower - glm::vec3(margin);
+		const glm::vec3 extent = (upper - lower + glm::vec3(2.0f * margin)) / (kBlockSize * mSpacing);
+		mDims = glm::ivec3(int(std::ceil(extent.x)), int(std::ceil(extent.y)), int(std::ceil(extent.z)));
+		if ((size_t)mDims.x * mDims.y * mDims.z <= kMaxBlocks) break;
+		mSpacing *= 2.0f;
+	}
+	mBlockIndex.assign((size_t)mDims.x * mDims.y * mDims.z, -1);
+}
+
+bool Surface::getSampleBox(uint32_t row, glm::ivec3 &lower, glm::ivec3 &upper) const
+{
+	const glm::vec3 position(mX[row], mY[row], mZ[row]);
+	const glm::vec3 reach(mRadii[row] * mReach);
+	const glm::vec3 low = (position - reach - mOrigin) / mSpacing, high = (position + reach - mOrigin) / mSpacing;
+	const glm::vec3 first(std::ceil(low.x), std::ceil(low.y), std::ceil(low.z));
+	const glm::vec3 last(std::floor(high.x), std::floor(high.y), std::floor(high.z));
+
+	// Compared as floats, far away positions do not fit an int
+	const glm::vec3 border(float(mDims.x * kBlockSize - 1), float(mDims.y * kBlockSize - 1), float(mDims.z * kBlockSize - 1));
+	if (!(first.x >= 1.0f && first.y >= 1.0f && first.z >= 1.0f && last.x <= border.x && last.y <= border.y && last.z <= border.z))
+		return false;
+
+	lower = glm::ivec3(first);
+	upper = glm::ivec3(last);
+	return true;
+}
+
+void Surface::addAtom(uint32_t row, const glm::ivec3 &lower, const glm::ivec3 &upper)
+{
+	glm::ivec3 first, last;
+	getBlockRange(lower, upper, first, last);
+	for (int z = first.z; z <= last.z; ++z)
+	for (int y = first.y; y <= last.y; ++y)
+	for (int x = first.x; x <= last.x; ++x)
+	{
+		const glm::ivec3 coord(x, y, z);
+		int32_t &index = mBlockIndex[indexOf(coord)];
+		if (index < 0)
+		{
+			index = (int32_t)mBlocks.size();
+			mBlocks.emplace_back();
+			mBlocks.back().coord = coord;
+		}
+
+		Block &block = mBlocks[index];
+		block.atoms.insert(std::lower_bound(block.atoms.begin(), block.atoms.end(), row), row);
+		block.dirty = true;
+	}
+}
+
+void Surface::removeAtom(uint32_t row, const glm::ivec3 &lower, const glm::ivec3 &upper)
+{
+	glm::ivec3 first, last;
+	getBlockRange(lower, upper, first, last);
+	for (int z = first.z; z <= last.z; ++z)
+	for (int y = first.y; y <= last.y; ++y)
+	for (int x = first.x; x <= last.x; ++x)
+	{
+		// Emptied blocks stay; they produce no triangles
+		Block &block = mBlocks[mBlockIndex[indexOf(glm::ivec3(x, y, z))]];
+		auto it = std::lower_bound(block.atoms.begin(), block.atoms.end(), row);
+		if (it != block.atoms.end() && *it == row) block.atoms.erase(it);
+		block.dirty = true;
+	}
+}
+
+// ---------------------------------------------------------------------
+
+/*
+	Splats the atoms of the block into its samples and runs marching cubes over its cells.
+	A sample shared by two blocks sums the same atoms in the same (ascending) order in both, so both
+	blocks see exactly the same values and agree on every crossing.
+	Triangle corners on an edge of this block store the index of its vertex; corners on an edge owned by a
+	neighbour (lower sample on the far side of the block) store which neighbour in bits 16.. and the key.
+*/
+void Surface::polygonize(Block &block) const
+{
+	const int n = kBlockSamples;
+	const glm::ivec3 base = block.coord * kBlockSize;
+
+	block.positions.clear();
+	block.vertexAtoms.clear();
+	block.keys.clear();
+	block.corners.clear();
+
+	// Gaussians are separable into one factor per axis. Along an axis the factors follow a recurrence,
+	// w(d + h) = w(d) * r(d), r(d + h) = r(d) * exp(2 f h^2), started at the lower end of the box of the
+	// atom (not of the block) so that every block gets the same factors. They are kept, atoms side by
+	// side, for the vertex atoms below; factors outside the box of an atom are 0.
+	const size_t numAtoms = block.atoms.size();
+	std::vector<float> factors(3 * n * numAtoms, 0.0f);
+	float density[n * n * n] = {};
+	for (size_t atom = 0; atom < numAtoms; ++atom)
+	{
+		const uint32_t row = block.atoms[atom];
+		glm::ivec3 lower, upper;
+		getSampleBox(row, lower, upper);
+
+		const float falloff = -mSharpness / (mRadii[row] * mRadii[row]);
+		const float step = std::exp(2.0f * falloff * mSpacing * mSpacing);
+		const float center[3] = { mX[row], mY[row], mZ[row] };
+		float weights[3][n] = {};
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			const float d = mOrigin[axis] + lower[axis] * mSpacing - center[axis];
+			float value = std::exp(falloff * d * d + (axis == 0 ? mSharpness : 0.0f));
+			float ratio = std::exp(falloff * mSpacing * (2.0f * d + mSpacing));
+			const int last = std::min(upper[axis], base[axis] + kBlockSize);
+			for (int i = lower[axis]; i <= last; ++i)
+			{
+				if (i >= base[axis])
+				{
+					weights[axis][i - base[axis]] = value;
+					factors[(axis * n + i - base[axis]) * numAtoms + atom] = value;
+				}
+				value *= ratio;
+				ratio *= step;
+			}
+		}
+		lower = glm::max(lower - base, glm::ivec3(0));
+		upper = glm::min(upper - base, glm::ivec3(kBlockSize));
+
+		for (int z = lower.z; z <= upper.z; ++z)
+		for (int y = lower.y; y <= upper.y; ++y)
+		{
+			const float weight = weights[2][z] * weights[1][y];
+			float *line = density + (z * n + y) * n;
+			for (int x = lower.x; x <= upper.x; ++x)
+				line[x] += weight * weights[0][x];
+		}
+	}
+
+	uint8_t inside[n * n * n];
+	int numInside = 0;
+	for (int sample = 0; sample < n * n * n; ++sample)
+	{
+		inside[sample] = density[sample] >= kIsoValue;
+		numInside += inside[sample];
+	}
+	if (numInside == 0 || numInside == n * n * n) return;
+
+	// Vertices on the owned edges, keys ascending
+	const int strides[3] = { 1, n, n * n };
+	uint16_t vertexOf[kBlockSize * kBlockSize * kBlockSize * 3];
+	std::vector<uint16_t> insideSamples;
+	for (int z = 0; z < kBlockSize; ++z)
+	for (int y = 0; y < kBlockSize; ++y)
+	for (int x = 0; x < kBlockSize; ++x)
+	{
+		const int sample = (z * n + y) * n + x;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			const int next = sample + strides[axis];
+			if (inside[next] == inside[sample]) continue;
+
+			const float t = (kIsoValue - density[sample]) / (density[next] - density[sample]);
+			glm::vec3 position(float(base.x + x), float(base.y + y), float(base.z + z));
+			position[axis] += t;
+
+			const uint32_t key = keyOf(x, y, z, axis);
+			vertexOf[key] = (uint16_t)block.positions.size();
+			block.positions.push_back(mOrigin + position * mSpacing);
+			block.keys.push_back((uint16_t)key);
+
+			const int end = inside[sample] ? sample : next;
+			insideSamples.push_back((uint16_t)end);
+		}
+	}
+
+	// Vertex atoms: largest share of the density at the inside end of the edge, once per sample
+	const uint32_t kNone = ~0u;
+	uint32_t owner[n * n * n];
+	for (uint16_t end : insideSamples) owner[end] = kNone;
+	block.vertexAtoms.resize(insideSamples.size());
+	for (size_t vertex = 0; vertex < insideSamples.size(); ++vertex)
+	{
+		const int end = insideSamples[vertex];
+		if (owner[end] == kNone)
+		{
+			const float *factorX = factors.data() + (end % n) * numAtoms;
+			const float *factorY = factors.data() + (n + end / n % n) * numAtoms;
+			const float *factorZ = factors.data() + (2 * n + end / (n * n)) * numAtoms;
+			float largest = -1.0f;
+			for (size_t atom = 0; atom < numAtoms; ++atom)
+			{
+				const float value = factorZ[atom] * factorY[atom] * factorX[atom];
+				if (value > largest)
+				{
+					largest = value;
+					owner[end] = block.atoms[atom];
+				}
+			}
+		}
+		block.vertexAtoms[vertex] = owner[end];
+	}
+
+	// Cells; their triangles may use only vertices of neighbours. The corners with x = 0 of the cells
+	// of a line are the corners with x = 1 of the previous cell.
+	const CaseTable &cases = getCases();
+	for (int z = 0; z < kBlockSize; ++z)
+	for (int y = 0; y < kBlockSize; ++y)
+	{
+		const uint8_t *line = inside + (z * n + y) * n;
+		auto cornersAt = [&](int x) { return line[x] | line[x + n] << 2 | line[x + n * n] << 4 | line[x + n * n + n] << 6; };
+
+		int previous = cornersAt(0);
+		for (int x = 0; x < kBlockSize; ++x)
+		{
+			const int next = cornersAt(x + 1);
+			const int mask = previous | next << 1;
+			previous = next;
+
+			for (int k = 0; k < cases.numCorners[mask]; ++k)
+			{
+				const int edge = cases.edges[mask][k], corner = kEdgeCorner[edge];
+				int sx = x + (corner & 1), sy = y + (corner >> 1 & 1), sz = z + (corner >> 2);
+				const uint32_t neighbour = uint32_t(sx == kBlockSize) | uint32_t(sy == kBlockSize) << 1 | uint32_t(sz == kBlockSize) << 2;
+				if (neighbour == 0)
+				{
+					block.corners.push_back(vertexOf[keyOf(sx, sy, sz, edge / 4)]);
+					continue;
+				}
+
+				if (sx == kBlockSize) sx = 0;
+				if (sy == kBlockSize) sy = 0;
+				if (sz == kBlockSize) sz = 0;
+				block.corners.push_back(neighbour << 16 | keyOf(sx, sy, sz, edge / 4));
+			}
+		}
+	}
+}
+
+void Surface::polygonizeDirty()
+{
+	std::vector<uint32_t> dirty;
+	for (uint32_t index = 0; index < mBlocks.size(); ++index)
+		if (mBlocks[index].dirty) dirty.push_back(index);
+
+	utils::ThreadPool::get().parallelFor((dirty.size() + kBlocksPerTask - 1) / kBlocksPerTask, [&](size_t task)
+	{
+		for (size_t i = task * kBlocksPerTask, end = std::min(dirty.size(), (task + 1) * kBlocksPerTask); i < end; ++i)
+		{
+			Block &block = mBlocks[dirty[i]];
+			polygonize(block);
+			block.dirty = false;
+		}
+	});
+}
+
+/*
+	Concatenates the vertices of the blocks and resolves the triangle corners to them.
+	An edge crossing the surface has a sample inside it, which an atom reaches, so the block owning the
+	edge exists and made the vertex.
+*/
+void Surface::assemble()
+{
+	const size_t numBlocks = mBlocks.size();
+	std::vector<uint32_t> firstVertex(numBlocks + 1, 0), firstIndex(numBlocks + 1, 0);
+	for (size_t index = 0; index < numBlocks; ++index)
+	{
+		firstVertex[index + 1] = firstVertex[index] + (uint32_t)mBlocks[index].positions.size();
+		firstIndex[index + 1] = firstIndex[index] + (uint32_t)mBlocks[index].corners.size();
+	}
+
+	mPositions.resize(firstVertex.back());
+	mVertexAtoms.resize(firstVertex.back());
+	mIndices.resize(firstIndex.back());
+
+	utils::ThreadPool::get().parallelFor((numBlocks + kBlocksPerTask - 1) / kBlocksPerTask, [&](size_t task)
+	{
+		for (size_t index = task * kBlocksPerTask, end = std::min(numBlocks, (task + 1) * kBlocksPerTask); index < end; ++index)
+		{
+			const Block &block = mBlocks[index];
+			std::copy(block.positions.begin(), block.positions.end(), mPositions.begin() + firstVertex[index]);
+			std::copy(block.vertexAtoms.begin(), block.vertexAtoms.end(), mVertexAtoms.begin() + firstVertex[index]);
+
+			uint32_t *indices = mIndices.data() + firstIndex[index];
+			for (uint32_t corner : block.corners)
+			{
+				const uint32_t neighbour = corner >> 16;
+				if (neighbour == 0)
+				{
+					*indices++ = firstVertex[index] + corner;
+					continue;
+				}
+
+				const glm::ivec3 coord = block.coord + glm::ivec3(neighbour & 1, neighbour >> 1 & 1, neighbour >> 2);
+				const int32_t owner = mBlockIndex[indexOf(coord)];
+				const std::vector<uint16_t> &keys = mBlocks[owner].keys;
+				const size_t vertex = std::lower_bound(keys.begin(), keys.end(), uint16_t(corner & 0xffff)) - keys.begin();
+				*indices++ = firstVertex[owner] + (uint32_t)vertex;
+			}
+		}
+	});
+
+	// Area weighted face normals; triangles of neighbouring blocks share vertices, so this pass is serial
+	mNormals.assign(mPositions.size(), glm::vec3(0.0f));
+	for (size_t i = 0; i < mIndices.size(); i += 3)
+	{
+		const uint32_t a = mIndices[i], b = mIndices[i + 1], c = mIndices[i + 2];
+		const glm::vec3 normal = glm::cross(mPositions[b] - mPositions[a], mPositions[c] - mPositions[a]);
+		mNormals[a] += normal;
+		mNormals[b] += normal;
+		mNormals[c] += normal;
+	}
+	for (glm::vec3 &normal : mNormals)
+	{
+		const float length = glm::length(normal);
+		if (length > 0.0f) normal /= length;
+	}
+}
+
+} // namespace pdb
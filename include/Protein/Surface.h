@@ -0,0 +1,96 @@
+#pragma once
+
+#include "AtomTable.h"
+#include <vector>
+#include <cstdint>
+
+namespace pdb
+{
+
+/*
+	Gaussian molecular surface: the isosurface density = 1 of a sum of one Gaussian per atom,
+	exp(-sharpness * (d^2 / r^2 - 1)) with r the van der Waals radius. A lone atom gets its van der Waals
+	sphere, crevices between atoms fill smoothly.
+	The density lives in a sparse grid of blocks of 8^3 cells, allocated where atoms reach. Every block
+	samples its own 9^3 corners, so blocks are splatted and polygonized (marching cubes) independently on
+	the thread pool; a vertex belongs to the block holding the lower end of its edge, which welds the
+	mesh across blocks. update() only redoes the blocks around atoms that moved.
+*/
+class Surface
+{
+public:
+	// spacing: grid step in Angstrom; sharpness: higher values hug the spheres, lower ones blur the surface
+	explicit Surface(float spacing = 1.0f, float sharpness = 2.0f);
+
+	void clear();
+
+	// Full rebuild from the current positions
+	void build(const AtomTable &atoms);
+	// Redoes the blocks reached by atoms that moved since the last build or update; builds if there was none
+	// or the atoms changed. False if the mesh stayed as it was.
+	bool update(const AtomTable &atoms);
+protected:
+	struct Block
+	{
+		glm::ivec3			coord;
+		std::vector<uint32_t>		atoms;		// rows whose Gaussian reaches the samples of the block, ascending
+
+		// Vertices on the edges the block owns; keys encode the lower sample and the axis of the edge, ascending
+		std::vector<glm::vec3>		positions;
+		std::vector<uint32_t>		vertexAtoms;
+		std::vector<uint16_t>		keys;
+
+		// Three per triangle: a vertex of this block, or the key of a vertex of a neighbour (see polygonize)
+		std::vector<uint32_t>		corners;
+		bool				dirty;
+	};
+
+	void setupGrid();
+	// Samples reached by the Gaussian of the row; false if they reach the border of the grid
+	bool getSampleBox(uint32_t row, glm::ivec3 &lower, glm::ivec3 &upper) const;
+	void addAtom(uint32_t row, const glm::ivec3 &lower, const glm::ivec3 &upper);
+	void removeAtom(uint32_t row, const glm::ivec3 &lower, const glm::ivec3 &upper);
+
+	void polygonize(Block &block) const;
+	void polygonizeDirty();
+	void assemble();
+
+	size_t indexOf(const glm::ivec3 &coord) const	{ return ((size_t)coord.z * mDims.y + coord.y) * mDims.x + coord.x; }
+
+	float				mRequestedSpacing;
+	float				mSpacing;	// grows for huge bounds, see setupGrid
+	float				mSharpness;
+	float				mReach;		// Gaussians are cut off at mReach * radius
+
+	// Block directory over the bounds of the atoms, with one block of margin for atoms that move
+	glm::vec3			mOrigin;	// sample (0, 0, 0)
+	glm::ivec3			mDims;
+	std::vector<int32_t>		mBlockIndex;	// into mBlocks, -1 where no atom reaches
+	std::vector<Block>		mBlocks;
+
+	// Positions and radii the blocks were built from
+	std::vector<float>		mX;
+	std::vector<float>		mY;
+	std::vector<float>		mZ;
+	std::vector<float>		mRadii;
+
+	// Welded mesh
+	std::vector<glm::vec3>		mPositions;
+	std::vector<glm::vec3>		mNormals;
+	std::vector<uint32_t>		mVertexAtoms;	// atom with the largest share of the density, e.g. for colors
+	std::vector<uint32_t>		mIndices;
+public: // Mutators
+	bool				empty() const			{ return mIndices.empty(); }
+	float				getSpacing() const		{ return mSpacing; }
+	float				getSharpness() const		{ return mSharpness; }
+	size_t				getNumBlocks() const		{ return mBlocks.size(); }
+
+	size_t				getNumVertices() const		{ return mPositions.size(); }
+	size_t				getNumIndices() const		{ return mIndices.size(); }
+	const glm::vec3			*getPositions() const		{ return mPositions.data(); }
+	const glm::vec3			*getNormals() const		{ return mNormals.data(); }
+	const uint32_t			*getVertexAtoms() const		{ return mVertexAtoms.data(); }
+	const uint32_t			*getIndices() const		{ return mIndices.data(); }
+};
+
+} // namespace pdb
@@ -0,0 +1,531 @@
+#include "Trajectory.h"
+#include "cinder/Timer.h"
+#include <boost/algorithm/string/case_conv.hpp>
+#include <cstring>
+
+namespace pdb
+{
+
+/*
+	XDR helpers
+*/
+
+static int32_t readXdrInt(const char *bytes)
+{
+	const uint8_t *b = reinterpret_cast<const uint8_t*>(bytes);
+	return int32_t((uint32_t(b[0]) << 24) | (uint32_t(b[1]) << 16) | (uint32_t(b[2]) << 8) | uint32_t(b[3]));
+}
+
+static float readXdrFloat(const char *bytes)
+{
+	int32_t bits = readXdrInt(bytes);
+	float value;
+	std::memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+static uint32_t swapBytes(uint32_t value)
+{
+	return (value >> 24) | ((value >> 8) & 0xff00) | ((value << 8) & 0xff0000) | (value << 24);
+}
+
+/*
+	XTC coordinate decompression (xdr3dfcoord)
+*/
+
+static const int kMagicInts[] =
+{
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 8, 10, 12, 16, 20, 25, 32, 40, 50, 64,
+	80, 101, 128, 161, 203, 256, 322, 406, 512, 645, 812, 1024, 1290,
+	1625, 2048, 2580, 3250, 4096, 5060, 6501, 8192, 10321, 13003,
+	16384, 20642, 26007, 32768, 41285, 52015, 65536, 82570, 104031,
+	131072, 165140, 208063, 262144, 330280, 416127, 524287, 660561,
+	832255, 1048576, 1321122, 1664510, 2097152, 2642245, 3329021,
+	4194304, 5284491, 6658042, 8388607, 10568983, 13316085, 16777216
+};
+static const int kFirstIdx = 9;
+static const int kLastIdx = int(sizeof(kMagicInts) / sizeof(kMagicInts[0]));
+
+class BitReader
+{
+public:
+	BitReader(const uint8_t *data, size_t size) : mData(data), mSize(size), mCount(0), mLastBits(0), mLastByte(0) {}
+
+	int bits(int numBits)
+	{
+		const int mask = numBits < 32 ? (1 << numBits) - 1 : -1;
+		int num = 0;
+		while (numBits >= 8)
+		{
+			mLastByte = (mLastByte << 8) | nextByte();
+			num |= (mLastByte >> mLastBits) << (numBits - 8);
+			numBits -= 8;
+		}
+		if (numBits > 0)
+		{
+			if (int(mLastBits) < numBits)
+			{
+				mLastBits += 8;
+				mLastByte = (mLastByte << 8) | nextByte();
+			}
+			mLastBits -= numBits;
+			num |= (mLastByte >> mLastBits) & ((1 << numBits) - 1);
+		}
+		return num & mask;
+	}
+
+	// Unpacks three integers that were packed as one mixed radix number
+	void ints(int numBits, const unsigned int sizes[3], int nums[3])
+	{
+		int bytes[32];
+		int numBytes = 0;
+		bytes[1] = bytes[2] = bytes[3] = 0;
+		while (numBits > 8)
+		{
+			bytes[numBytes++] = bits(8);
+			numBits -= 8;
+		}
+		if (numBits > 0)
+		{
+			bytes[numBytes++] = bits(numBits);
+		}
+		for (int i = 2; i > 0; --i)
+		{
+			unsigned int num = 0;
+			for (int j = numBytes - 1; j >= 0; --j)
+			{
+				num = (num << 8) | unsigned(bytes[j]);
+				unsigned int p = num / sizes[i];
+				bytes[j] = int(p);
+				num = num - p * sizes[i];
+			}
+			nums[i] = int(num);
+		}
+		nums[0] = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (bytes[3] << 24);
+	}
+protected:
+	unsigned int nextByte()
+	{
+		if (mCount >= mSize) throw TrajectoryExc();
+		return mData[mCount++];
+	}
+
+	const uint8_t	*mData;
+	size_t		mSize;
+	size_t		mCount;
+	unsigned int	mLastBits;
+	unsigned int	mLastByte;
+};
+
+static int sizeOfInt(unsigned int size)
+{
+	unsigned int num = 1;
+	int numBits = 0;
+	while (size >= num && numBits < 32)
+	{
+		numBits++;
+		num <<= 1;
+	}
+	return numBits;
+}
+
+static int sizeOfInts(const unsigned int sizes[3])
+{
+	unsigned int bytes[32];
+	unsigned int numBytes = 1;
+	bytes[0] = 1;
+	for (int i = 0; i < 3; ++i)
+	{
+		unsigned int tmp = 0;
+		unsigned int byteCount = 0;
+		for (; byteCount < numBytes; ++byteCount)
+		{
+			tmp = bytes[byteCount] * sizes[i] + tmp;
+			bytes[byteCount] = tmp & 0xff;
+			tmp >>= 8;
+		}
+		while (tmp != 0)
+		{
+			bytes[byteCount++] = tmp & 0xff;
+			tmp >>= 8;
+		}
+		numBytes = byteCount;
+	}
+	unsigned int num = 1;
+	int numBits = 0;
+	numBytes--;
+	while (bytes[numBytes] >= num)
+	{
+		numBits++;
+		num *= 2;
+	}
+	return numBits + int(numBytes) * 8;
+}
+
+/*
+	TrajectoryReader
+*/
+
+TrajectoryReaderRef TrajectoryReader::create(const ci::fs::path &path)
+{
+	const std::string extension = boost::algorithm::to_lower_copy(path.extension().string());
+	if (extension == ".xtc") return std::make_shared<XtcReader>(path);
+	if (extension == ".dcd") return std::make_shared<DcdReader>(path);
+	throw TrajectoryExc();
+}
+
+/*
+	XtcReader
+*/
+
+static const int32_t kXtcMagic = 1995;
+
+XtcReader::XtcReader(const ci::fs::path &path)
+	: mOffset(0)
+{
+	mFile = utils::MappedFile::create(path);
+	if (mFile->getSize() < 8 || readXdrInt(mFile->getData()) != kXtcMagic) throw TrajectoryExc();
+	mNumAtoms = size_t(readXdrInt(mFile->getData() + 4));
+}
+
+bool XtcReader::readFrame(std::vector<glm::vec3> &positions)
+{
+	// magic, natoms, step, time, box[3][3], natoms
+	const size_t headerSize = 4 * 4 + 9 * 4 + 4;
+	if (mOffset + headerSize > mFile->getSize()) return false;
+
+	const char *header = mFile->getData() + mOffset;
+	if (readXdrInt(header) != kXtcMagic || size_t(readXdrInt(header + 4)) != mNumAtoms) throw TrajectoryExc();
+	mOffset += headerSize;
+
+	positions.resize(mNumAtoms);
+	decompress(positions);
+	return true;
+}
+
+void XtcReader::decompress(std::vector<glm::vec3> &positions)
+{
+	const char *data = mFile->getData();
+	const size_t size = mFile->getSize();
+	auto require = [&](size_t bytes) { if (mOffset + bytes > size) throw TrajectoryExc(); };
+	auto nextInt = [&]() { require(4); int32_t value = readXdrInt(data + mOffset); mOffset += 4; return value; };
+	auto nextFloat = [&]() { require(4); float value = readXdrFloat(data + mOffset); mOffset += 4; return value; };
+
+	// nm to Angstroms
+	const float unit = 10.0f;
+
+	// Small systems are stored uncompressed
+	if (mNumAtoms <= 9)
+	{
+		for (auto &position : positions)
+		{
+			position.x = nextFloat() * unit;
+			position.y = nextFloat() * unit;
+			position.z = nextFloat() * unit;
+		}
+		return;
+	}
+
+	const float precision = nextFloat();
+	int minInt[3], maxInt[3];
+	for (int i = 0; i < 3; ++i) minInt[i] = nextInt();
+	for (int i = 0; i < 3; ++i) maxInt[i] = nextInt();
+
+	unsigned int sizeInt[3];
+	int bitSizeInt[3] = { 0, 0, 0 };
+	int bitSize = 0;
+	for (int i = 0; i < 3; ++i) sizeInt[i] = unsigned(maxInt[i] - minInt[i] + 1);
+	if ((sizeInt[0] | sizeInt[1] | sizeInt[2]) > 0xffffff)
+	{
+		// Too large to multiply, each coordinate is stored on its own
+		for (int i = 0; i < 3; ++i) bitSizeInt[i] = sizeOfInt(sizeInt[i]);
+	}
+	else
+	{
+		bitSize = sizeOfInts(sizeInt);
+	}
+
+	int smallIdx = nextInt();
+	if (smallIdx < kFirstIdx || smallIdx >= kLastIdx) throw TrajectoryExc();
+	int smaller = kMagicInts[std::max(kFirstIdx, smallIdx - 1)] / 2;
+	int smallNum = kMagicInts[smallIdx] / 2;
+	unsigned int sizeSmall[3];
+	sizeSmall[0] = sizeSmall[1] = sizeSmall[2] = unsigned(kMagicInts[smallIdx]);
+
+	const size_t byteCount = size_t(nextInt());
+	require(byteCount);
+	BitReader reader(reinterpret_cast<const uint8_t*>(data + mOffset), byteCount);
+	mOffset += (byteCount + 3) & ~size_t(3);
+
+	// Integer coordinates; runs of small deltas follow a full coordinate
+	mIntegers.resize(mNumAtoms * 3);
+	const float invPrecision = unit / precision;
+	size_t written = 0;
+	auto emit = [&](const int *coord)
+	{
+		if (written >= mNumAtoms) throw TrajectoryExc();
+		positions[written++] = glm::vec3(coord[0], coord[1], coord[2]) * invPrecision;
+	};
+
+	int run = 0;
+	size_t i = 0;
+	while (i < mNumAtoms)
+	{
+		int *thisCoord = mIntegers.data() + i * 3;
+		if (bitSize == 0)
+		{
+			for (int k = 0; k < 3; ++k) thisCoord[k] = reader.bits(bitSizeInt[k]);
+		}
+		else
+		{
+			reader.ints(bitSize, sizeInt, thisCoord);
+		}
+		i++;
+		int prevCoord[3];
+		for (int k = 0; k < 3; ++k)
+		{
+			thisCoord[k] += minInt[k];
+			prevCoord[k] = thisCoord[k];
+		}
+
+		int isSmaller = 0;
+		if (reader.bits(1) == 1)
+		{
+			run = reader.bits(5);
+			isSmaller = run % 3;
+			run -= isSmaller;
+			isSmaller--;
+		}
+		if (run > 0)
+		{
+			if (i + size_t(run / 3) > mNumAtoms) throw TrajectoryExc();
+			for (int k = 0; k < run; k += 3)
+			{
+				thisCoord += 3;
+				reader.ints(smallIdx, sizeSmall, thisCoord);
+				i++;
+				for (int c = 0; c < 3; ++c) thisCoord[c] += prevCoord[c] - smallNum;
+				if (k == 0)
+				{
+					// The first two atoms of a run are swapped for better compression of water
+					for (int c = 0; c < 3; ++c) std::swap(thisCoord[c], prevCoord[c]);
+					emit(prevCoord);
+				}
+				else
+				{
+					for (int c = 0; c < 3; ++c) prevCoord[c] = thisCoord[c];
+				}
+				emit(thisCoord);
+			}
+		}
+		else
+		{
+			emit(thisCoord);
+		}
+
+		smallIdx += isSmaller;
+		if (smallIdx < kFirstIdx || smallIdx >= kLastIdx) throw TrajectoryExc();
+		if (isSmaller < 0)
+		{
+			smallNum = smaller;
+			smaller = smallIdx > kFirstIdx ? kMagicInts[smallIdx - 1] / 2 : 0;
+		}
+		else if (isSmaller > 0)
+		{
+			smaller = smallNum;
+			smallNum = kMagicInts[smallIdx] / 2;
+		}
+		sizeSmall[0] = sizeSmall[1] = sizeSmall[2] = unsigned(kMagicInts[smallIdx]);
+	}
+	if (written != mNumAtoms) throw TrajectoryExc();
+}
+
+/*
+	DcdReader
+*/
+
+DcdReader::DcdReader(const ci::fs::path &path)
+	: mOffset(0), mFirstFrame(0), mSwapped(false), mUnitCell(false), mFourDims(false)
+{
+	mFile = utils::MappedFile::create(path);
+	if (mFile->getSize() < 4) throw TrajectoryExc();
+
+	// The first record is always 84 bytes, which also gives away the byte order
+	uint32_t marker;
+	std::memcpy(&marker, mFile->getData(), sizeof(marker));
+	if (marker != 84)
+	{
+		if (swapBytes(marker) != 84) throw TrajectoryExc();
+		mSwapped = true;
+	}
+
+	// "CORD" and the control block
+	std::string_view record;
+	if (!readRecord(record) || record.size() != 84 || record.substr(0, 4) != "CORD") throw TrajectoryExc();
+	int32_t control[20];
+	for (int i = 0; i < 20; ++i) control[i] = readInt(record.data() + 4 + i * 4);
+
+	// Fixed atoms store a different first frame, not supported
+	if (control[8] != 0) throw TrajectoryExc();
+	const bool charmm = control[19] != 0;
+	mUnitCell = charmm && control[10] != 0;
+	mFourDims = charmm && control[11] != 0;
+
+	// Title and number of atoms
+	if (!readRecord(record)) throw TrajectoryExc();
+	if (!readRecord(record) || record.size() != 4) throw TrajectoryExc();
+	const int32_t numAtoms = readInt(record.data());
+	if (numAtoms <= 0) throw TrajectoryExc();
+	mNumAtoms = size_t(numAtoms);
+
+	mFirstFrame = mOffset;
+}
+
+bool DcdReader::readFrame(std::vector<glm::vec3> &positions)
+{
+	if (mOffset >= mFile->getSize()) return false;
+
+	std::string_view record;
+	if (mUnitCell && !readRecord(record)) return false;
+
+	positions.resize(mNumAtoms);
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		if (!readRecord(record)) return false;
+		if (record.size() != mNumAtoms * 4) throw TrajectoryExc();
+		const char *values = record.data();
+		for (size_t i = 0; i < mNumAtoms; ++i)
+		{
+			positions[i][axis] = readFloat(values + i * 4);
+		}
+	}
+	if (mFourDims && !readRecord(record)) return false;
+	return true;
+}
+
+bool DcdReader::readRecord(std::string_view &record)
+{
+	const char *data = mFile->getData();
+	const size_t size = mFile->getSize();
+	if (mOffset + 4 > size) return false;
+
+	const size_t length = size_t(uint32_t(readInt(data + mOffset)));
+	// A truncated last frame is treated as the end of the file
+	if (mOffset + 8 + length > size) return false;
+	if (size_t(uint32_t(readInt(data + mOffset + 4 + length))) != length) throw TrajectoryExc();
+
+	record = std::string_view(data + mOffset + 4, length);
+	mOffset += 8 + length;
+	return true;
+}
+
+int32_t DcdReader::readInt(const char *bytes) const
+{
+	uint32_t value;
+	std::memcpy(&value, bytes, sizeof(value));
+	return int32_t(mSwapped ? swapBytes(value) : value);
+}
+
+float DcdReader::readFloat(const char *bytes) const
+{
+	int32_t bits = readInt(bytes);
+	float value;
+	std::memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+/*
+	TrajectoryPlayer
+*/
+
+TrajectoryPlayer::TrajectoryPlayer(TrajectoryReaderRef reader, const glm::mat4 &transform, size_t capacity)
+	: mReader(reader), mTransform(transform), mFrames(std::max<size_t>(capacity, 2)), mHead(0), mCount(0),
+	  mStopping(false), mFailed(false), mDecodeFps(0.0f), mFrameIndex(0)
+{
+	mThread = std::thread(&TrajectoryPlayer::decodeLoop, this);
+}
+
+TrajectoryPlayer::~TrajectoryPlayer()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStopping = true;
+	}
+	mSpaceAvailable.notify_all();
+	if (mThread.joinable()) mThread.join();
+}
+
+const std::vector<glm::vec3>* TrajectoryPlayer::front()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mCount > 0 ? &mFrames[mHead] : nullptr;
+}
+
+void TrajectoryPlayer::pop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (mCount == 0) return;
+		mHead = (mHead + 1) % mFrames.size();
+		mCount--;
+	}
+	mFrameIndex++;
+	mSpaceAvailable.notify_one();
+}
+
+void TrajectoryPlayer::decodeLoop()
+{
+	ci::Timer timer;
+	double decodeSeconds = 0.0;
+	size_t decodedFrames = 0;
+	size_t emptyPasses = 0;
+
+	while (true)
+	{
+		size_t slot;
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mSpaceAvailable.wait(lock, [this] { return mStopping || mCount < mFrames.size(); });
+			if (mStopping) return;
+			slot = (mHead + mCount) % mFrames.size();
+		}
+
+		// The slot is outside [head, head + count), the consumer does not touch it
+		std::vector<glm::vec3> &frame = mFrames[slot];
+		timer.start();
+		bool decoded;
+		try
+		{
+			decoded = mReader->readFrame(frame);
+			if (!decoded)
+			{
+				// Loop the trajectory; give up if it has no frames at all
+				if (++emptyPasses > 1) return;
+				mReader->rewind();
+				continue;
+			}
+		}
+		catch (std::exception&)
+		{
+			mFailed = true;
+			return;
+		}
+		emptyPasses = 0;
+		for (auto &position : frame)
+		{
+			position = glm::vec3(mTransform * glm::vec4(position, 1.0f));
+		}
+		timer.stop();
+
+		decodeSeconds += timer.getSeconds();
+		decodedFrames++;
+		if (decodeSeconds > 0.0) mDecodeFps = float(decodedFrames / decodeSeconds);
+
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mCount++;
+		}
+	}
+}
+
+} // namespace pdb
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "cinder/CinderGlm.h"
+#include "cinder/Filesystem.h"
+#include "Common/MappedFile.h"
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+namespace pdb
+{
+
+typedef std::shared_ptr<class TrajectoryReader> TrajectoryReaderRef;
+typedef std::shared_ptr<class TrajectoryPlayer> TrajectoryPlayerRef;
+
+/*
+	Sequential reader of trajectory frames; positions are returned in Angstroms.
+*/
+class TrajectoryReader
+{
+public:
+	// Picks the reader by extension (.xtc, .dcd)
+	static TrajectoryReaderRef create(const ci::fs::path &path);
+
+	virtual ~TrajectoryReader() {}
+
+	// Reads the next frame; false at the end of the file
+	virtual bool readFrame(std::vector<glm::vec3> &positions) = 0;
+	virtual void rewind() = 0;
+protected:
+	TrajectoryReader() : mNumAtoms(0) {}
+
+	utils::MappedFileRef	mFile;
+	size_t			mNumAtoms;
+public: // Mutators
+	size_t			getNumAtoms() const		{ return mNumAtoms; }
+};
+
+/*
+	GROMACS XTC: XDR (big-endian) frames with compressed coordinates
+*/
+class XtcReader : public TrajectoryReader
+{
+public:
+	explicit XtcReader(const ci::fs::path &path);
+
+	bool readFrame(std::vector<glm::vec3> &positions) override;
+	void rewind() override				{ mOffset = 0; }
+protected:
+	void decompress(std::vector<glm::vec3> &positions);
+
+	size_t			mOffset;
+	std::vector<int>	mIntegers;	// scratch for the decoded integer coordinates
+};
+
+/*
+	CHARMM / NAMD DCD: Fortran unformatted records, native or swapped byte order
+*/
+class DcdReader : public TrajectoryReader
+{
+public:
+	explicit DcdReader(const ci::fs::path &path);
+
+	bool readFrame(std::vector<glm::vec3> &positions) override;
+	void rewind() override				{ mOffset = mFirstFrame; }
+protected:
+	bool readRecord(std::string_view &record);
+	int32_t readInt(const char *bytes) const;
+	float readFloat(const char *bytes) const;
+
+	size_t			mOffset;
+	size_t			mFirstFrame;
+	bool			mSwapped;
+	bool			mUnitCell;
+	bool			mFourDims;
+};
+
+/*
+	Decodes frames ahead on a background thread into a ring buffer.
+	Frames are transformed (e.g. centered like the topology) before they are queued.
+*/
+class TrajectoryPlayer
+{
+public:
+	TrajectoryPlayer(TrajectoryReaderRef reader, const glm::mat4 &transform, size_t capacity = 8);
+	~TrajectoryPlayer();
+
+	// Oldest decoded frame, nullptr if the decoder has not caught up
+	const std::vector<glm::vec3>* front();
+	// Releases the frame returned by front()
+	void pop();
+protected:
+	void decodeLoop();
+
+	TrajectoryReaderRef			mReader;
+	glm::mat4				mTransform;
+
+	// Ring buffer
+	std::vector<std::vector<glm::vec3>>	mFrames;
+	size_t					mHead;		// next frame to consume
+	size_t					mCount;		// decoded frames waiting
+	std::mutex				mMutex;
+	std::condition_variable			mSpaceAvailable;
+
+	std::thread				mThread;
+	bool					mStopping;
+	std::atomic<bool>			mFailed;	// decoding stopped on a malformed frame
+	std::atomic<float>			mDecodeFps;
+	std::atomic<size_t>			mFrameIndex;
+public: // Mutators
+	bool					hasFailed() const		{ return mFailed; }
+	float					getDecodeFps() const		{ return mDecodeFps; }
+	size_t					getFrameIndex() const		{ return mFrameIndex; }
+	size_t					getNumAtoms() const		{ return mReader->getNumAtoms(); }
+};
+
+class TrajectoryExc : public std::exception {
+public:
+	virtual const char* what() const throw() { return "Trajectory exception: unsupported or malformed trajectory"; }
+};
+
+} // namespace pdb
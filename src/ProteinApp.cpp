@@ -9,12 +9,24 @@
 #include "boost/algorithm/string.hpp"
 #include "cinder/params/Params.h"
 #include <boost/algorithm/string.hpp> 
-
-#include "ProteinLoader/PDBloader.h"
-#include "ProteinLoader/Utils.h"
+#include <thread>
+#include <atomic>
+
+#include "Protein/Protein.h"
+#include "Protein/Trajectory.h"
+#include "Protein/ContactMap.h"
+#include "Common/Utils.h"
+#include "Common/Simd.h"
+#include "Common/InstanceBuffer.h"
+#include "Common/ThreadPool.h"
+#include "Common/PickBuffer.h"
 
 #define DEBUG
 
+// Contact map: dense distances up to this many rows (16 MB), and at most this many texels a side
+static const size_t kMaxDenseContactRows = 2048;
+static const size_t kMaxContactMapSize = 2048;
+
 using namespace ci;
 using namespace ci::app;
 using namespace std;
@@ -36,6 +48,66 @@ struct ShaderData
 	float   irradianceFix;
 };
 
+// Background structure loading: parse -> build instance data -> staged upload
+struct LoadJob
+{
+	enum Stage { PARSING, BUILDING, UPLOADING, FAILED };
+
+	fs::path				file;
+	std::atomic<int>		stage;
+	std::atomic<float>		progress;
+	std::string				error;
+
+	// Stage 1 (worker): parsed structure
+	pdb::ProteinRef			protein;
+
+	// Stage 2 (worker): instance data
+	std::vector< vec4 >		instances;	// center, radius
+	std::vector< uint32_t >	colors;		// RGBA8
+
+	// Stage 3 (main thread): the staging instance buffers of the app filled a slice per frame
+	bool					staged;
+	size_t					uploadedBytes;
+};
+typedef std::shared_ptr<LoadJob> LoadJobRef;
+
+// Instance buffers of one structure with the meshes and batches drawing them
+struct InstanceSet
+{
+	// Center and radius of every instance (16 bytes); the CPU copy is kept for picking
+	utils::InstanceBufferRef	instances;
+	// RGBA8 color of every instance (4 bytes)
+	utils::InstanceBufferRef	colors;
+
+	gl::BatchRef				batch;			// sphere mesh
+	gl::BatchRef				impostorBatch;	// one quad per atom
+	gl::BatchRef				pickBatch;
+	gl::BatchRef				depthBatch;
+	gl::BatchRef				depthImpostorBatch;
+};
+
+// Surface update on the thread pool over a copy of the atoms; the app swaps the mesh in when it is done
+struct SurfaceJob
+{
+	pdb::ProteinRef			protein;	// the worker updates its surface, which nothing else reads meanwhile
+	pdb::AtomTable			atoms;		// positions when the job started
+	bool					changed;
+	std::string				error;
+	std::atomic<bool>		done;
+};
+typedef std::shared_ptr<SurfaceJob> SurfaceJobRef;
+
+// SASA pass on the thread pool over a copy of the atoms; the app colors by it when it is done
+struct SasaJob
+{
+	pdb::ProteinRef			protein;	// only its hierarchy is read, which never changes
+	pdb::AtomTable			atoms;		// positions when the job started
+	pdb::Sasa				sasa;
+	std::string				error;
+	std::atomic<bool>		done;
+};
+typedef std::shared_ptr<SasaJob> SasaJobRef;
+
 struct LightData
 {
 	vec3		position;
@@ -55,6 +127,13 @@ struct LightData
 
 class ProteinApp : public App {
 public:
+	enum Representation
+	{
+		SPHERES,
+		IMPOSTORS,
+		SURFACE
+	};
+
 	static void prepare(Settings *settings);
 
 	void setup() override;
@@ -72,28 +151,72 @@ public:
 	void keyUp(KeyEvent event) override;
 
 	void fileDrop(FileDropEvent event) override;
+	void cleanup() override;
 private:
 	// GUI
 	void initializeGUI();
 
-	// Perform Picking
+	// Perform Picking; rays and marquee frusta are answered by the bvh of the structure
 	bool performPicking(float mouseX , float mouseY);
+	size_t selectMarquee(const Rectf &area);	// adds the atoms whose centers project into the window area
 
 	// Load an object mesh into a VBO using ObjLoader
 	void loadMesh();
-
-	// Creates a VAO containing a transform matrix for each instance
-	void initializeBuffer();
-
-	// Depth Map
+	// Instance buffers and the meshes and batches drawing them, created once
+	void initializeInstanceBuffers();
+	void initializeInstanceSet(InstanceSet &set);
+	void uploadInstanceBuffers(size_t maxBytes = SIZE_MAX);
+	bool hasInstances() const;	// loaded and complete on the GPU
+
+	// Background loading
+	void startLoading(const fs::path &file);
+	void buildInstanceData(LoadJob &job);
+	bool uploadInstanceData(LoadJob &job);
+	void updateLoading();
+
+	// Colors: writes the colors of the current scheme into the instance buffer, changed atoms only
+	void applyColorScheme();
+	void uploadColors();	// after the protein recolored itself, e.g. SASA of a new model
+	void updateSasaColors();	// recomputes stale areas on the thread pool while coloring by SASA, at most once a second during playback
+
+	// Surface representation; the mesh is built on the thread pool, the shown one stays until the next is done
+	void updateSurface();	// remeshes after the positions changed, drops the mesh while spheres are shown
+	void updateSurfaceJob();	// swaps a finished mesh in, starts the next job if the positions moved on
+	void createSurfaceMesh(const pdb::Surface &surface);
+	void resetSurfaceMesh();
+
+	// Residue contact map overlay: distances of the trace atoms as a texture, clicks select residue pairs
+	void updateContactMap();
+	Rectf getContactMapArea() const;	// window points, lower left corner
+	bool pickContact(const vec2 &position);
+	void drawContactMap();
+
+	// Selection: evaluates mSelectionQuery; the highlight gathers the instances of the selected atoms
+	void applySelection();
+	void updateHighlight();
+
+	// Ensembles: uploads the positions of one model into the instance buffer
+	void showModel(int model);
+	void updateModels();
+	void alignModels();	// superposes all models onto the shown one, reports their RMSD
+
+	// Trajectories: decoded frames are written into the instance buffer, whose upload orphans the storage
+	void startTrajectory(const fs::path &file);
+	void updateTrajectory();
+	void stopTrajectory();
+
+	// Swaps in a loaded structure together with its instances, once they are complete on the GPU
+	void initializeBuffer(LoadJob &job);
+
+	// Depth Map: depth only light pass, rendered again only when the light or the geometry moved
+	void createDepthMap();
 	void renderToFBO();
-private:
-	gl::FboRef					mFboTest;
-	gl::FboRef					mFboTestPicking;
-	gl::BatchRef				mBatchTest;
-	gl::GlslProgRef				mShaderTest;
-	void renderToTestFbo();
-	bool pickByColor(const ivec2 &position);
+
+	// Id buffer picking: areas are requested from input, rendered on the next frame and read back a frame later
+	enum PickTag { PICK_HOVER, PICK_CLICK, PICK_AREA };
+	void requestPick(const Rectf &area, int tag);	// window points
+	void renderPickBuffer();
+	void applyPicks();
 private:
 	// GUI
 	params::InterfaceGlRef		mParams;
@@ -103,7 +226,22 @@ private:
 	// Pick
 	TriMeshRef					mTriMesh;
 	AxisAlignedBox				mObjectBounds;
-	std::map<int,bool>			mPicked;
+	bool						mMarqueeActive;	// shift or alt + drag
+	bool						mMarqueeVisible;	// alt: only atoms drawn in the id buffer
+	vec2						mMarqueeStart;
+	vec2						mMarqueeEnd;
+
+	// Selection (kept by mPDB) and its highlight: one wire cube per selected atom, drawn instanced
+	gl::GlslProgRef				mHighlightShader;
+	utils::InstanceBufferRef	mHighlightBuffer;
+	gl::BatchRef				mHighlightBatch;
+	bool						mHighlightDirty;	// selection or positions changed
+	std::string					mSelectionQuery;
+	std::string					mSelectionStatus;
+	utils::PickBufferRef		mPickBuffer;
+	gl::GlslProgRef				mPickShader;
+	int							mHoverAtom;		// -1 over the background
+	std::string					mHoverStatus;
 
 	// Controlable camera
 	CameraPersp					mCamera;
@@ -111,29 +249,77 @@ private:
 
 	// Shader instanced rendering support
 	gl::GlslProgRef				mShader;
-	// VBO containing one object(sphere) mesh
-	gl::VboMeshRef				mVboMesh;
-	// Batch combining mesh and shader
-	gl::BatchRef				mBatch;
+
+	// Sphere impostors: one quad per atom over the same instance buffers, ray cast in the fragment shader
+	gl::GlslProgRef				mImpostorShader;
 
 	// Wire meshes
 	gl::BatchRef				mWirePlane;
-	gl::BatchRef				mWireBoundingCube;
-	std::vector< mat4 >			mModelMatrices;
 
 	// PDB file
-	pdb::PDBloaderRef			mPDB;
+	pdb::ProteinRef				mPDB;
 	float						mSizeOfStructure;
 	float						mSizeOfAtoms;
-
-	// VBO containing a list of matrices, one for every instance
-	gl::VboRef					mInstanceDataVbo;
-	// VBO containing a list of colors, one for every instance
-	gl::VboRef					mInstanceColorVbo;
+	int							mColorScheme;	// pdb::Protein::ColorScheme
+	std::string					mSasaStatus;	// total area while coloring by SASA
+	double						mSasaTime;		// last pass, see updateSasaColors
+	SasaJobRef					mSasaJob;
+
+	// Instances of mPDB, and those of a loading structure until it is complete on the GPU and swapped in
+	InstanceSet					mInstances;
+	InstanceSet					mStagedInstances;
+
+	// Gaussian surface, drawn with the sphere shader as a single instance that keeps the vertices in place;
+	// colors are per vertex, from the atom owning it
+	int							mRepresentation;	// Representation
+	gl::VboMeshRef				mSurfaceMesh;
+	gl::VboRef					mSurfaceColorVbo;
+	gl::BatchRef				mSurfaceBatch;
+	std::vector<uint32_t>		mSurfaceVertexAtoms;	// of the mesh drawn, for its colors
+	SurfaceJobRef				mSurfaceJob;
+	bool						mSurfaceDirty;	// positions changed since the job started
+	std::string					mSurfaceStatus;
+
+	// Contact map of the trace atoms; texel (i, j) shows the distance of rows i and j, contacts white. Larger
+	// maps bin rows and show the contacts only. Follows model steps and trajectory frames.
+	bool						mShowContactMap;
+	float						mContactCutoff;
+	pdb::ContactMap				mContactMap;
+	gl::Texture2dRef			mContactTexture;
+	std::string					mContactStatus;
+
+	// Structure being loaded in the background; mPDB keeps rendering until it is swapped
+	LoadJobRef					mLoadJob;
+	std::thread					mLoadThread;
+	float						mLoadProgress;
+	std::string					mLoadStatus;
+
+	// Ensemble (MODEL/ENDMDL) playback
+	int							mModel;
+	bool						mModelAnimated;
+	float						mModelsPerSecond;
+	double						mModelTime;
+	std::string					mModelRmsdStatus;	// mean and largest RMSD of all pairs after alignModels
+
+	// Trajectory (XTC/DCD) playback; every frame rewrites all centers, so the instance buffer is orphaned
+	pdb::TrajectoryPlayerRef	mTrajectory;
+	bool						mTrajectoryPlaying;
+	float						mFramesPerSecond;
+	double						mFrameTime;
+	float						mDecodeFps;
+	int							mTrajectoryFrame;
 
 	// Depth Map
 	LightData					mLight;
 	gl::FboRef					mFboDepthMap;
+	int							mDepthMapResolution;	// 512 << resolution texels a side
+	gl::GlslProgRef				mDepthShader;
+	gl::GlslProgRef				mDepthImpostorShader;
+	gl::BatchRef				mDepthSurfaceBatch;
+	bool						mDepthMapDirty;		// resolution or representation changed
+	mat4						mDepthMapViewProjection;	// of the light at the last pass
+	size_t						mDepthMapUploads;	// bytes the instance buffer had sent at the last pass
+	int							mDepthMapPasses;
 
 	// Subsurface Scattering Shader Data
 	ShaderData					mShaderData;
@@ -151,8 +337,12 @@ void ProteinApp::setup()
 	// Load shaders
 	try
 	{
-		mShader = gl::GlslProg::create(loadAsset("program.vert"), loadAsset("program.frag"));
-		mShaderTest = gl::GlslProg::create(loadAsset("picker.vert"), loadAsset("picker.frag"));
+		mShader = gl::GlslProg::create(loadAsset("phong.vert"), loadAsset("phong.frag"));
+		mDepthShader = gl::GlslProg::create(loadAsset("depth.vert"), loadAsset("depth.frag"));
+		mDepthImpostorShader = gl::GlslProg::create(gl::GlslProg::Format().vertex(loadAsset("impostor.vert")).fragment(loadAsset("impostor.frag")).define("DEPTH_ONLY"));
+		mPickShader = gl::GlslProg::create(loadAsset("pick.vert"), loadAsset("pick.frag"));
+		mHighlightShader = gl::GlslProg::create(loadAsset("highlight.vert"), loadAsset("highlight.frag"));
+		mImpostorShader = gl::GlslProg::create(loadAsset("impostor.vert"), loadAsset("impostor.frag"));
 	}
 	catch (const std::exception &e)
 	{
@@ -170,6 +360,42 @@ void ProteinApp::setup()
 
 	// Structure options
 	mSizeOfAtoms = 2.0f;
+	mColorScheme = pdb::Protein::ELEMENT_COLORS;
+	mSasaStatus = "-";
+	mSasaTime = 0.0;
+	mRepresentation = SPHERES;
+	mSurfaceDirty = false;
+	mSurfaceStatus = "-";
+	mShowContactMap = false;
+	mContactCutoff = 8.0f;
+	mContactStatus = "-";
+
+	// Selection
+	mHighlightDirty = false;
+	mSelectionQuery = "";
+	mSelectionStatus = "none";
+	mMarqueeActive = false;
+	mMarqueeVisible = false;
+	mHoverAtom = -1;
+	mHoverStatus = "-";
+
+	// Loading
+	mLoadProgress = 0.0f;
+	mLoadStatus = "idle";
+
+	// Ensembles
+	mModel = 0;
+	mModelAnimated = false;
+	mModelsPerSecond = 10.0f;
+	mModelTime = 0.0;
+	mModelRmsdStatus = "-";
+
+	// Trajectories
+	mTrajectoryPlaying = true;
+	mFramesPerSecond = 30.0f;
+	mFrameTime = 0.0;
+	mDecodeFps = 0.0f;
+	mTrajectoryFrame = 0;
 
 	// Shader Data
 	mShaderData.strength = 1.0f;
@@ -199,24 +425,20 @@ void ProteinApp::setup()
 	mCamera.lookAt(vec3(90.0f, 90.0f, 90.0f), vec3(0.0f));
 	mCameraUi.setCamera(&mCamera);
 	mShader->uniform("uNearFarPlane", vec2(mCamera.getNearClip(), mCamera.getFarClip()));
+	if (mImpostorShader) mImpostorShader->uniform("uNearFarPlane", vec2(mCamera.getNearClip(), mCamera.getFarClip()));
 
 	// Depth Map
-	{
-		const GLsizei size_of_map = 2048;
-		gl::Fbo::Format format;
-		mFboDepthMap = gl::Fbo::create(size_of_map, size_of_map, format.depthTexture());
-		const gl::ScopedFramebuffer scopedFramebuffer(mFboDepthMap);
-		const gl::ScopedViewport scopedViewport(ivec2(0), mFboDepthMap->getSize());
-		gl::clear();
-		//mFboDepthMap->getDepthTexture()->setCompareMode(GL_COMPARE_REF_TO_TEXTURE);
-	}
+	mDepthMapResolution = 2;
+	mDepthMapPasses = 0;
+	mDepthMapUploads = 0;
+	createDepthMap();
 
 	// Wire meshes
 	mWirePlane = gl::Batch::create(geom::WirePlane().size(vec2(10)).subdivisions(ivec2(10)), colorShader);
-	mWireBoundingCube = gl::Batch::create(geom::WireCube(), colorShader);
 
 	// Load object mesh
 	loadMesh();
+	initializeInstanceBuffers();
 	
 	// SetGUI
 	initializeGUI();
@@ -225,7 +447,7 @@ void ProteinApp::setup()
 	mSizeOfStructure = 250.0f;
 
 	// Load radii
-	mPDB = pdb::PDBloaderRef (new pdb::PDBloader());
+	mPDB = pdb::ProteinRef (new pdb::Protein());
 
 	// Set render States
 	//gl::enableFaceCulling();
@@ -238,8 +460,22 @@ void ProteinApp::update()
 {
 	// Measure
 	mAvgFrameRate = getAverageFps();
-	// Camera Data
-	mShader->uniform("uEyePos", vec3(mCamera.getEyePoint()));
+
+	// Background loading
+	updateLoading();
+
+	// Ensemble and trajectory playback
+	updateModels();
+	updateTrajectory();
+	updateSasaColors();
+	updateSurfaceJob();
+
+	// Finished id buffer readbacks, then the selection highlight follows the atoms
+	applyPicks();
+	if (mHighlightDirty) updateHighlight();
+
+	// Changed ranges go to the GPU before drawing; a loading structure sends its own slices
+	uploadInstanceBuffers();
 
 	// Update position of Light
 	if(mLight.animated)
@@ -249,25 +485,34 @@ void ProteinApp::update()
 		mLight.cam.lookAt(mLight.position, vec3(0.0f), vec3(0.0f, -1.0f, 0.0f));
 	}	
 
-	// Update Light Data Uniforms
-	mShader->uniform("uLightPos", mLight.position);
-	mShader->uniform("uLightColor", mLight.color);
-
-	// Update Light Attenuation
-	mShader->uniform("uConstant", mLight.constant);
-	mShader->uniform("uLinear", mLight.linear);
-	mShader->uniform("uQuadratic", mLight.quadratic);
-
-	// Update Shader Data Uniforms
-	mShader->uniform("uStrength", mShaderData.strength);
-	mShader->uniform("uEnable", mShaderData.enable);
-	mShader->uniform("uThickTechnique", mShaderData.thickTechnique);
-	mShader->uniform("uLightingModel", mShaderData.lightingModel);
-	mShader->uniform("uThicknessEnable", mShaderData.thicknessEnable);
-	mShader->uniform("uTransmitanceEnable", mShaderData.transmitanceEnable);
-	mShader->uniform("uExtintionCoef", mShaderData.extintionCoef);
-	mShader->uniform("uIrradianceEnable", mShaderData.irradianceEnable);
-	mShader->uniform("uIrradianceFix", mShaderData.irradianceFix);
+	// Mesh and impostor programs share the lighting (common/lighting.glsl)
+	for (const gl::GlslProgRef &program : { mShader, mImpostorShader })
+	{
+		if (!program) continue;
+
+		// Camera Data
+		program->uniform("uEyePos", vec3(mCamera.getEyePoint()));
+
+		// Update Light Data Uniforms
+		program->uniform("uLightPos", mLight.position);
+		program->uniform("uLightColor", mLight.color);
+
+		// Update Light Attenuation
+		program->uniform("uConstant", mLight.constant);
+		program->uniform("uLinear", mLight.linear);
+		program->uniform("uQuadratic", mLight.quadratic);
+
+		// Update Shader Data Uniforms
+		program->uniform("uStrength", mShaderData.strength);
+		program->uniform("uEnable", mShaderData.enable);
+		program->uniform("uThickTechnique", mShaderData.thickTechnique);
+		program->uniform("uLightingModel", mShaderData.lightingModel);
+		program->uniform("uThicknessEnable", mShaderData.thicknessEnable);
+		program->uniform("uTransmitanceEnable", mShaderData.transmitanceEnable);
+		program->uniform("uExtintionCoef", mShaderData.extintionCoef);
+		program->uniform("uIrradianceEnable", mShaderData.irradianceEnable);
+		program->uniform("uIrradianceFix", mShaderData.irradianceFix);
+	}
 }
 
 void ProteinApp::draw()
@@ -277,23 +522,12 @@ void ProteinApp::draw()
 
 	// Render to FBO
 	renderToFBO();
-	renderToTestFbo();
+	renderPickBuffer();
 	// Activate our camera
 	gl::setMatrices(mCamera);
 
 #ifdef DEBUG
 	// Draw the grid & Light.
-	{
-		if (!mPicked.empty())
-		for (auto const &ent1 : mPicked)
-			if (ent1.second)
-			{
-				gl::pushModelMatrix();
-				gl::multModelMatrix(mModelMatrices[ent1.first]);
-				mWireBoundingCube->draw();
-				gl::popModelMatrix();
-			}
-	}
 	{
 		gl::ScopedColor color(Color::gray(0.2f));
 		mWirePlane->draw();
@@ -305,34 +539,44 @@ void ProteinApp::draw()
 	}
 
 	// Draw Instances
-	if (mVboMesh && mShader && mInstanceDataVbo)
+	if (mInstances.batch && hasInstances())
 	{
 		gl::pushMatrices();
 		// Number of Instances = number of atoms in pdb
-		unsigned int numOfAtoms = mPDB->getAtoms().size();
+		unsigned int numOfAtoms = (unsigned int)mInstances.instances->getCount();
 
-		gl::ScopedGlslProg shader(mShader);
-		mShader->uniform("uDepthMap", 0); //Depth map from FBO
+		const bool impostors = mRepresentation == IMPOSTORS && mInstances.impostorBatch;
+		const gl::GlslProgRef &program = impostors ? mImpostorShader : mShader;
+		gl::ScopedGlslProg shader(program);
+		program->uniform("uDepthMap", 0); //Depth map from FBO
 		gl::ScopedTextureBind uDepthMap(mFboDepthMap->getDepthTexture(), (uint8_t)0);
-		mShader->uniform("uLightViewProjMatrix", mLight.cam.getProjectionMatrix() * mLight.cam.getViewMatrix());
-		mBatch->drawInstanced(numOfAtoms);
+		program->uniform("uLightViewProjMatrix", mLight.cam.getProjectionMatrix() * mLight.cam.getViewMatrix());
+		if (mSurfaceBatch)	mSurfaceBatch->drawInstanced(1);
+		else if (impostors)	mInstances.impostorBatch->drawInstanced(numOfAtoms);
+		else				mInstances.batch->drawInstanced(numOfAtoms);
 		gl::popMatrices();
 	}
+
+	// Highlight selected atoms, one draw for the whole selection
+	if (mHighlightBatch && !mHighlightBuffer->empty() && !mHighlightBuffer->isDirty())
+	{
+		mHighlightShader->uniform("uColor", vec4(1.0f, 0.85f, 0.2f, 1.0f));
+		mHighlightBatch->drawInstanced((GLsizei)mHighlightBuffer->getCount());
+	}
 #ifdef DEBUG
 	// restore 2D drawing
 	//gl::setMatricesWindow(toPixels(getWindowSize()));
 	//gl::draw(mFboDepthMap->getDepthTexture() , Rectf(getWindowWidth() - 256, 256, getWindowWidth(), 0));
 #endif
 	
-	// show the FBO color texture in the upper left corner
 	gl::setMatricesWindow(toPixels(getWindowSize()));
-	gl::draw(mFboTest->getColorTexture(), Rectf(0, 0, (float)getWindowWidth()/5, (float)getWindowHeight()/5));
+	drawContactMap();
 
-	// draw picking buffer
-	if (mFboTestPicking) {
-		Rectf rct = (Rectf)mFboTestPicking->getBounds() * 5.0f;
-		rct.offset(vec2((float)getWindowWidth() - rct.getWidth(), 0));
-		gl::draw(mFboTestPicking->getColorTexture(), rct);
+	// Marquee being dragged
+	if (mMarqueeActive)
+	{
+		gl::ScopedColor color(Color(1.0f, 0.85f, 0.2f));
+		gl::drawStrokedRect(toPixels(Rectf(mMarqueeStart, mMarqueeEnd).canonicalized()));
 	}
 
 	// GUi
@@ -344,10 +588,8 @@ void ProteinApp::resize()
 	// Adjust the camera aspect ratio	
 	mCamera.setAspectRatio(getWindowAspectRatio());
 
-	// Test FBO
-	gl::Fbo::Format format;
-	format.setSamples( 0 ); // uncomment this to enable 4x antialiasing
-	mFboTest = gl::Fbo::create(getWindowWidth(), getWindowHeight(), format.colorTexture());
+	// Id buffer in pixels, like the default framebuffer
+	mPickBuffer = utils::PickBuffer::create(toPixels(getWindowSize()));
 
 }
 
@@ -358,21 +600,41 @@ void ProteinApp::fileDrop( FileDropEvent event )
 	{
 		fs::path file = event.getFile(0);
 
-		if( file.extension() == ".pdb" )
+		std::string extension = file.extension().string();
+		boost::algorithm::to_lower(extension);
+
+		// Compressed archive entries (.pdb.gz, .cif.gz) are streamed by the loader
+		if( extension == ".gz" )
 		{
-			try
-			{
-				mPDB->loadProtein(loadFile(file));
-				initializeBuffer();
-			}
-			catch (const std::exception &e)
+			extension = file.stem().extension().string();
+			boost::algorithm::to_lower(extension);
+		}
+
+		if( extension == ".pdb" || extension == ".cif" || extension == ".mmcif" || extension == ".bcif" )
+		{
+			// One structure at a time
+			if (mLoadJob)
 			{
-				console() << e.what() << std::endl;
+				console() << "Still loading " << mLoadJob->file.filename() << ", ignoring " << file.filename() << std::endl;
+				return;
 			}
+
+			startLoading(file);
+		}
+		else if( extension == ".xtc" || extension == ".dcd" )
+		{
+			// Frames are applied to the structure on screen
+			startTrajectory(file);
 		}
 	}
 }
 
+void ProteinApp::cleanup()
+{
+	mTrajectory.reset();
+	if (mLoadThread.joinable()) mLoadThread.join();
+}
+
 void ProteinApp::initializeGUI()
 {
 	mParams = params::InterfaceGl::create("Settings", toPixels(ivec2(200, 300)));
@@ -380,9 +642,17 @@ void ProteinApp::initializeGUI()
 	mParams->addParam("FPS", &mAvgFrameRate, "", true);
 	mParams->addParam("Backgroun Color", &mBackGroundColor).min(0.0f).max(1.0f).step(0.1);
 
+	mParams->addSeparator();
+	mParams->addText("Loading");
+	mParams->addParam("Status", &mLoadStatus, "", true);
+	mParams->addParam("Progress %", &mLoadProgress, "", true);
+
 	mParams->addSeparator();
 	mParams->addText("Light control");
 	mParams->addButton("Stop/Start", [&]() {mLight.animated = !mLight.animated; }, "key=l");
+	std::vector<std::string> depthMapSizes = { "512", "1024", "2048", "4096" };
+	mParams->addParam("Depth map", depthMapSizes, &mDepthMapResolution).updateFn([this]() { createDepthMap(); });
+	mParams->addParam("Light passes", &mDepthMapPasses, "", true);
 
 	// Depth map properties
 	mParams->addSeparator();
@@ -411,60 +681,109 @@ void ProteinApp::initializeGUI()
 	// Structure properties
 	mParams->addSeparator();
 	mParams->addText("Structure options");
-	mParams->addParam("Diameter of Atoms", &mSizeOfAtoms).min(2.0f).max(10.0f).step(0.5f);
+	mParams->addParam("Diameter of Atoms", &mSizeOfAtoms).min(2.0f).max(10.0f).step(0.5f);
+	std::vector<std::string> representations = { "Spheres", "Impostors", "Surface" };
+	mParams->addParam("Show as", representations, &mRepresentation).updateFn([this]() { updateSurface(); });
+	mParams->addParam("Surface", &mSurfaceStatus, "", true);
+	mParams->addParam("Contact map", &mShowContactMap).updateFn([this]() { updateContactMap(); });
+	mParams->addParam("Contact cutoff", &mContactCutoff).min(4.0f).max(20.0f).step(0.5f).updateFn([this]() { updateContactMap(); });
+	mParams->addParam("Contacts", &mContactStatus, "", true);
+	std::vector<std::string> colorSchemes = { "Element", "Chain", "SASA" };
+	mParams->addParam("Color by", colorSchemes, &mColorScheme).updateFn([this]() { applyColorScheme(); });
+	mParams->addParam("SASA", &mSasaStatus, "", true);
+
+	// Selection
+	mParams->addSeparator();
+	mParams->addText("Selection");
+	mParams->addParam("Query", &mSelectionQuery);
+	mParams->addButton("Select", [&]() { applySelection(); });
+	mParams->addButton("Clear selection", [&]() { mSelectionQuery.clear(); applySelection(); });
+	mParams->addParam("Selected", &mSelectionStatus, "", true);
+	mParams->addParam("Hover", &mHoverStatus, "", true);
+
+	// Ensembles
+	mParams->addSeparator();
+	mParams->addText("Models");
+	mParams->addParam("Model", &mModel).min(0).max(0);
+	mParams->addParam("Animate models", &mModelAnimated, "key=m");
+	mParams->addParam("Models per second", &mModelsPerSecond).min(1.0f).max(120.0f).step(1.0f);
+	mParams->addButton("Align models", [&]() { alignModels(); });
+	mParams->addParam("RMSD", &mModelRmsdStatus, "", true);
+
+	// Trajectory
+	mParams->addSeparator();
+	mParams->addText("Trajectory");
+	mParams->addParam("Play", &mTrajectoryPlaying, "key=p");
+	mParams->addParam("Frames per second", &mFramesPerSecond).min(1.0f).max(240.0f).step(1.0f);
+	mParams->addParam("Frame", &mTrajectoryFrame, "", true);
+	mParams->addParam("Decode FPS", &mDecodeFps, "", true);
+	mParams->addButton("Stop trajectory", [&]() { stopTrajectory(); });
 }
 
 bool ProteinApp::performPicking(float mouseX, float mouseY)
 {
-	if(!mVboMesh || !mShader || !mInstanceDataVbo) return false;
+	if(!mInstances.batch || mInstances.instances->empty()) return false;
 	
 	float u = mouseX / (float)getWindowWidth();
 	float v = mouseY / (float)getWindowHeight();
 	Ray ray = mCamera.generateRay(u, 1.0f - v, mCamera.getAspectRatio());
 
-	AxisAlignedBox worldBoundsApprox; // fast
-	int modelIndex; // modelIndex
-	int chosen = -1;
-	for (modelIndex = 0; modelIndex < mModelMatrices.size(); ++modelIndex)
-	{
-		//worldBoundsApprox = mTriMesh->calcBoundingBox(mModelMatrices[modelIndex]); // fast
-		
-		// Calc intersection localy
-		size_t polycount = mTriMesh->getNumTriangles();
-		float new_distance = 0.0f;
-		float current_distance = FLT_MAX;
-		for (size_t i = 0; i < polycount; ++i)
-		{
-			vec3 v0, v1, v2;
-			mTriMesh->getTriangleVertices(i, &v0, &v1, &v2);
-			v0 = vec3(mModelMatrices[modelIndex] * vec4(v0, 1.0));
-			v1 = vec3(mModelMatrices[modelIndex] * vec4(v1, 1.0));
-			v2 = vec3(mModelMatrices[modelIndex] * vec4(v2, 1.0));
-
-			if (ray.calcTriangleIntersection(v0, v1, v2, &new_distance))
-			{
-				if (new_distance < current_distance)
-				{
-					current_distance = new_distance;
-					chosen = modelIndex;
-				}
-			}
-		}
-		
-	}
+	// Atoms are drawn as spheres of their radius at their position, exactly what the bvh holds
+	int chosen = mPDB->getBvh().intersect(ray.getOrigin(), ray.getDirection());
 	if (chosen == -1 ) return false;
 
-	if (mPicked.find(chosen) == mPicked.end())
-		mPicked.insert(make_pair(chosen, true));
-	else
-		mPicked.find(chosen)->second = !mPicked.find(chosen)->second;
+	mPDB->select(chosen);
+	mSelectionStatus = toString(mPDB->getSelection().count()) + " atoms";
+	mHighlightDirty = true;
+
+	// Areas of the picked atom and its residue while coloring by SASA
+	const pdb::Sasa &sasa = mPDB->getSasa();
+	if (!sasa.empty())
+	{
+		const uint32_t residue = mPDB->getAtoms().getResidues()[chosen];
+		mSelectionStatus += ", SASA " + toString(sasa.getAtomArea(chosen)) + " / residue " + toString(sasa.getResidueArea(residue)) + " A^2";
+	}
 #ifdef DEBUG
-	for (auto const &ent1 : mPicked)
-		if (ent1.second) console() << ent1.first << endl;
+	console() << chosen << endl;
 #endif
 	return true;
 }
 
+size_t ProteinApp::selectMarquee(const Rectf &area)
+{
+	if (!mPDB || mPDB->getBvh().empty()) return 0;
+
+	// Rays through the corners span the sides of the frustum, the clip planes close it
+	const vec2 window((float)getWindowWidth(), (float)getWindowHeight());
+	const vec2 corners[4] = { area.getUpperLeft(), area.getUpperRight(), area.getLowerRight(), area.getLowerLeft() };
+	vec3 directions[4];
+	vec3 center(0.0f);
+	for (int i = 0; i < 4; ++i)
+	{
+		directions[i] = mCamera.generateRay(corners[i].x / window.x, 1.0f - corners[i].y / window.y, mCamera.getAspectRatio()).getDirection();
+		center += directions[i];
+	}
+
+	const vec3 eye = mCamera.getEyePoint();
+	const vec3 view = mCamera.getViewDirection();
+	vec4 planes[6];
+	for (int i = 0; i < 4; ++i)
+	{
+		vec3 normal = normalize(cross(directions[i], directions[(i + 1) % 4]));
+		if (dot(normal, center) < 0.0f) normal = -normal;
+		planes[i] = vec4(normal, -dot(normal, eye));
+	}
+	planes[4] = vec4(view, -dot(view, eye + view * mCamera.getNearClip()));
+	planes[5] = vec4(-view, dot(view, eye + view * mCamera.getFarClip()));
+
+	std::vector<uint32_t> atoms;
+	mPDB->getBvh().queryFrustum(planes, atoms);
+	mPDB->select(atoms);
+	mSelectionStatus = toString(mPDB->getSelection().count()) + " atoms";
+	mHighlightDirty = true;
+	return atoms.size();
+}
+
 void ProteinApp::loadMesh()
 {
 	ObjLoader loader(loadAsset("sphere_low_poly.obj"));
@@ -473,8 +792,6 @@ void ProteinApp::loadMesh()
 	{
 		TriMeshRef mesh = TriMesh::create(loader);
 		mObjectBounds = mesh->calcBoundingBox();
-		mVboMesh = gl::VboMesh::create(*mesh);
-		mPicked.clear();
 		mTriMesh = mesh;
 	}
 	catch (const std::exception &e)
@@ -483,13 +800,213 @@ void ProteinApp::loadMesh()
 	}
 }
 
-void ProteinApp::initializeBuffer()
+void ProteinApp::initializeInstanceBuffers()
 {
-	// Clear
-	mPicked.clear();
+	// A loading structure goes up into the staging set while the shown one keeps rendering
+	initializeInstanceSet(mInstances);
+	initializeInstanceSet(mStagedInstances);
 
-	// Move atoms to middle
-	mPDB->moveTo(vec3(0.0f));
+	// Selection highlight: a wire cube per selected atom
+	mHighlightBuffer = utils::InstanceBuffer::create(sizeof(vec4));
+	geom::BufferLayout instanceDataLayout;
+	instanceDataLayout.append(geom::Attrib::CUSTOM_0, 4, sizeof(vec4), 0, 1 /* per instance */);
+	gl::VboMeshRef mesh = gl::VboMesh::create(geom::WireCube());
+	mesh->appendVbo(instanceDataLayout, mHighlightBuffer->getVbo());
+	if (mHighlightShader) mHighlightBatch = gl::Batch::create(mesh, mHighlightShader, { { geom::CUSTOM_0, "iInstance" } });
+}
+
+void ProteinApp::initializeInstanceSet(InstanceSet &set)
+{
+	set.instances = utils::InstanceBuffer::create(sizeof(vec4));
+	set.colors = utils::InstanceBuffer::create(sizeof(uint32_t));
+
+	// Each instance needs 4 floats, center and radius, and a single integer color unpacked by the shader
+	geom::BufferLayout instanceDataLayout;
+	instanceDataLayout.append(geom::Attrib::CUSTOM_0, 4, sizeof(vec4), 0, 1 /* per instance */);
+	geom::BufferLayout instanceColorDataLayout;
+	instanceColorDataLayout.append(geom::Attrib::CUSTOM_1, geom::DataType::INTEGER, 1, sizeof(uint32_t), 0, 1);
+
+	// The buffer objects outlive every structure, so meshes and batches are built once; appendVbo changes the
+	// mesh, so each set has its own
+	if (mTriMesh)
+	{
+		gl::VboMeshRef sphereMesh = gl::VboMesh::create(*mTriMesh);
+		sphereMesh->appendVbo(instanceDataLayout, set.instances->getVbo());
+		sphereMesh->appendVbo(instanceColorDataLayout, set.colors->getVbo());
+		if (mShader) set.batch = gl::Batch::create(sphereMesh, mShader, { { geom::CUSTOM_1, "iColor" } ,{ geom::CUSTOM_0, "iInstance" } });
+		if (mPickShader) set.pickBatch = gl::Batch::create(sphereMesh, mPickShader, { { geom::CUSTOM_0, "iInstance" } });
+		// Light pass over the same instances, depth only
+		if (mDepthShader) set.depthBatch = gl::Batch::create(sphereMesh, mDepthShader, { { geom::CUSTOM_0, "iInstance" } });
+	}
+
+	// Impostors: a quad per atom instead of the sphere mesh
+	gl::VboMeshRef impostorMesh = gl::VboMesh::create(geom::Rect(Rectf(-1.0f, -1.0f, 1.0f, 1.0f)));
+	impostorMesh->appendVbo(instanceDataLayout, set.instances->getVbo());
+	impostorMesh->appendVbo(instanceColorDataLayout, set.colors->getVbo());
+	if (mImpostorShader) set.impostorBatch = gl::Batch::create(impostorMesh, mImpostorShader, { { geom::CUSTOM_1, "iColor" } ,{ geom::CUSTOM_0, "iInstance" } });
+	if (mDepthImpostorShader) set.depthImpostorBatch = gl::Batch::create(impostorMesh, mDepthImpostorShader, { { geom::CUSTOM_1, "iColor" } ,{ geom::CUSTOM_0, "iInstance" } });
+}
+
+void ProteinApp::uploadInstanceBuffers(size_t maxBytes)
+{
+	size_t remaining = maxBytes;
+	for (const utils::InstanceBufferRef &buffer : { mInstances.instances, mInstances.colors, mHighlightBuffer })
+		remaining -= buffer->upload(remaining);
+}
+
+bool ProteinApp::hasInstances() const
+{
+	return !mInstances.instances->empty() && !mInstances.instances->isDirty() && !mInstances.colors->isDirty();
+}
+
+void ProteinApp::startLoading(const fs::path &file)
+{
+	if (mLoadThread.joinable()) mLoadThread.join();
+
+	LoadJobRef job(new LoadJob());
+	job->file = file;
+	job->stage = LoadJob::PARSING;
+	job->progress = 0.0f;
+	job->staged = false;
+	job->uploadedBytes = 0;
+	mLoadJob = job;
+
+	const pdb::Protein::ColorScheme colorScheme = (pdb::Protein::ColorScheme)mColorScheme;
+	mLoadThread = std::thread([this, job, colorScheme]()
+	{
+		try
+		{
+			// ---------------------------------------------
+			// Stage 1: Parse
+			// ---------------------------------------------
+			job->protein = pdb::ProteinRef(new pdb::Protein());
+			job->protein->setColorScheme(colorScheme);
+			job->protein->loadProtein(loadFile(job->file),
+				[job](float progress) { job->progress = 0.7f * progress; });
+
+			// ---------------------------------------------
+			// Stage 2: Instance data
+			// ---------------------------------------------
+			job->stage = LoadJob::BUILDING;
+			buildInstanceData(*job);
+
+			// ---------------------------------------------
+			// Stage 3: Upload, continued on the main thread
+			// ---------------------------------------------
+			job->progress = 0.8f;
+			job->stage = LoadJob::UPLOADING;
+		}
+		catch (const std::exception &e)
+		{
+			job->error = e.what();
+			job->stage = LoadJob::FAILED;
+		}
+	});
+}
+
+void ProteinApp::buildInstanceData(LoadJob &job)
+{
+	// Number of Instances = number of atoms in pdb
+	const pdb::AtomTable &atoms = job.protein->getAtoms();
+	size_t numOfAtoms = atoms.size();
+	const float *x = atoms.getX();
+	const float *y = atoms.getY();
+	const float *z = atoms.getZ();
+	const float *radii = atoms.getRadii();
+
+	// Init trnasforms for every instance
+	job.instances.resize(numOfAtoms);
+	job.colors.resize(numOfAtoms);
+
+	// Center and radius, interleaved by the vectorized kernel
+	utils::simd::computeInstances(x, y, z, radii, 1.0f, numOfAtoms, job.instances.data());
+	for (size_t i = 0; i < numOfAtoms; i++)
+		job.colors[i] = atoms.getPackedColor(i);
+}
+
+bool ProteinApp::uploadInstanceData(LoadJob &job)
+{
+	// Bytes copied to the GPU per frame, small enough to keep the frame time flat
+	const size_t budget = 2 * 1024 * 1024;
+
+	const size_t instanceBytes = job.instances.size() * sizeof(vec4);
+	const size_t colorBytes = job.colors.size() * sizeof(uint32_t);
+
+	// The staging buffers hold the structure already (updateLoading); their dirty ranges go up in order
+	const size_t before = mStagedInstances.instances->getUploadedBytes() + mStagedInstances.colors->getUploadedBytes();
+	const size_t sent = mStagedInstances.instances->upload(budget);
+	mStagedInstances.colors->upload(budget - sent);
+	job.uploadedBytes += mStagedInstances.instances->getUploadedBytes() + mStagedInstances.colors->getUploadedBytes() - before;
+
+	size_t total = std::max<size_t>(instanceBytes + colorBytes, 1);
+	job.progress = 0.8f + 0.2f * std::min(1.0f, (float)job.uploadedBytes / (float)total);
+
+	return !mStagedInstances.instances->isDirty() && !mStagedInstances.colors->isDirty();
+}
+
+void ProteinApp::updateLoading()
+{
+	if (!mLoadJob)
+	{
+		mLoadProgress = 0.0f;
+		return;
+	}
+
+	LoadJob &job = *mLoadJob;
+	mLoadProgress = job.progress * 100.0f;
+
+	switch (job.stage)
+	{
+	case LoadJob::PARSING:
+		mLoadStatus = "parsing " + job.file.filename().string();
+		break;
+	case LoadJob::BUILDING:
+		mLoadStatus = "building instances";
+		break;
+	case LoadJob::UPLOADING:
+		mLoadStatus = "uploading";
+		// The instances are staged once and go up a slice per frame while mPDB keeps rendering
+		if (!job.staged)
+		{
+			if (mLoadThread.joinable()) mLoadThread.join();
+
+			// The staging set last held the structure shown before mPDB; its buffers only grow
+			mStagedInstances.instances->resize(job.instances.size());
+			mStagedInstances.instances->write(0, job.instances.size(), job.instances.data());
+			mStagedInstances.colors->resize(job.colors.size());
+			mStagedInstances.colors->write(0, job.colors.size(), job.colors.data());
+			job.staged = true;
+		}
+		if (uploadInstanceData(job))
+		{
+			initializeBuffer(job);
+			mLoadStatus = "loaded " + job.file.filename().string();
+			mLoadProgress = 100.0f;
+			mLoadJob.reset();
+		}
+		break;
+	case LoadJob::FAILED:
+		if (mLoadThread.joinable()) mLoadThread.join();
+		console() << job.error << std::endl;
+		mLoadStatus = "failed " + job.file.filename().string();
+		mLoadJob.reset();
+		break;
+	}
+}
+
+void ProteinApp::initializeBuffer(LoadJob &job)
+{
+	// Frames of a trajectory belong to the previous topology
+	stopTrajectory();
+
+	// Swap structure and instances together, so every draw sees one or the other
+	mPDB = job.protein;
+	std::swap(mInstances, mStagedInstances);
+	mDepthMapDirty = true;
+
+	// A new structure starts without selection
+	mHighlightDirty = true;
+	mSelectionStatus = "none";
 
 	// Set Camera
 	mSizeOfStructure = distance(vec4(mPDB->getBoundLower(), 1.0f), vec4(mPDB->getBoundUpper(),1.0f));
@@ -502,221 +1019,654 @@ void ProteinApp::initializeBuffer()
 						-orhtoSize, orhtoSize,
 						1.0f, mSizeOfStructure*1.5f + 20.0f);
 
-	// Number of Instances = number of atoms in pdb
-	unsigned int numOfAtoms = mPDB->getAtoms().size();
+	// Ensembles start at the first model
+	mModel = 0;
+	mParams->setOptions("Model", "max=" + toString(std::max<int>((int)mPDB->getNumModels() - 1, 0)));
 
-	// ---------------------------------------------
-	// Model Matrices
-	// ---------------------------------------------
+	// The scheme may have changed while the structure was loading
+	if (mPDB->getColorScheme() != mColorScheme) applyColorScheme();
 
-	// Init trnasforms for every instance
-	mModelMatrices.clear();
-	mModelMatrices.reserve(numOfAtoms);
+	// Mesh of the new structure, if shown; the vertices of the old one belong to the old atoms
+	resetSurfaceMesh();
+	updateSurface();
+	updateContactMap();
+}
 
-	for (size_t i = 0; i < numOfAtoms; i++)
+void ProteinApp::applyColorScheme()
+{
+	if (!mPDB || mInstances.colors->empty()) return;
+
+	mPDB->setColorScheme((pdb::Protein::ColorScheme)mColorScheme);
+	uploadColors();
+}
+
+void ProteinApp::uploadColors()
+{
+	if (!mPDB || mInstances.colors->empty()) return;
+
+	// Only atoms whose color changed are marked, so recoloring part of the structure sends little
+	const pdb::AtomTable &atoms = mPDB->getAtoms();
+	uint32_t *colors = mInstances.colors->getData<uint32_t>();
+	for (size_t i = 0; i < mInstances.colors->getCount(); ++i)
 	{
-		mat4 model = translate(mPDB->getAtoms()[i]->getPosition());
-		model = scale(model, vec3(mPDB->getAtoms()[i]->getVdWRadii()*2.0f));
-		mModelMatrices.push_back(model);
+		const uint32_t color = atoms.getPackedColor(i);
+		if (colors[i] == color) continue;
+		colors[i] = color;
+		mInstances.colors->markDirty(i, 1);
 	}
 
-	// Create an array Buffer to store all model matrices
-	mInstanceDataVbo = gl::Vbo::create(GL_ARRAY_BUFFER, mModelMatrices.size() * sizeof(mat4), mModelMatrices.data(), GL_STATIC_DRAW);
+	// Surface vertices take the color of their atom
+	if (mSurfaceColorVbo)
+	{
+		std::vector<uint32_t> vertexColors(mSurfaceVertexAtoms.size());
+		for (size_t i = 0; i < vertexColors.size(); ++i)
+			vertexColors[i] = colors[mSurfaceVertexAtoms[i]];
+		mSurfaceColorVbo->bufferSubData(0, vertexColors.size() * sizeof(uint32_t), vertexColors.data());
+	}
 
-	// Setup the buffer to contain space for all matrices. Each matrix needs 16 floats
-	geom::BufferLayout instanceDataLayout;
-	instanceDataLayout.append(geom::Attrib::CUSTOM_0, 16, sizeof(mat4), 0, 1 /* per instance */);
+	const pdb::Sasa &sasa = mPDB->getSasa();
+	mSasaStatus = sasa.empty() ? "-" : toString((int)sasa.getTotalArea()) + " A^2";
+}
 
-	// Add buffer to mesh 
-	mVboMesh->appendVbo(instanceDataLayout, mInstanceDataVbo);
+void ProteinApp::updateSasaColors()
+{
+	// A finished pass colors the atoms; its areas stay current unless the atoms moved on meanwhile
+	if (mSasaJob && mSasaJob->done)
+	{
+		SasaJobRef job = mSasaJob;
+		mSasaJob.reset();
+		if (!job->error.empty()) console() << "Could not compute SASA: " << job->error << std::endl;
+		else if (job->protein == mPDB)
+		{
+			mPDB->setSasa(std::move(job->sasa), job->atoms);
+			uploadColors();
+		}
+	}
 
-	// ---------------------------------------------
-	// Materials
-	// ---------------------------------------------
+	if (mSasaJob || !mPDB || mInstances.colors->empty() || mPDB->getColorScheme() != pdb::Protein::SASA_COLORS || !mPDB->getSasa().empty()) return;
 
-	std::vector< vec3 > matColors;
-	matColors.reserve(numOfAtoms);
+	// A pass costs about 150 ms on 2ex3; while frames or models play the atoms keep the colors of the last pass in between
+	const bool playing = (mTrajectory && mTrajectoryPlaying) || (mModelAnimated && mPDB->getNumModels() > 1);
+	if (playing && getElapsedSeconds() - mSasaTime < 1.0) return;
+	mSasaTime = getElapsedSeconds();
 
-	for (size_t i = 0; i < numOfAtoms; i++)
+	SasaJobRef job(new SasaJob());
+	job->protein = mPDB;
+	job->atoms = mPDB->getAtoms();
+	job->done = false;
+	mSasaJob = job;
+	utils::ThreadPool::get().submit([job]()
 	{
-		vec3 color = vec3(1.0f, 1.0f, 1.0f);
-		color = mPDB->getAtoms()[i]->getColor();
-		matColors.push_back(color);
+		try
+		{
+			pdb::SpatialGrid grid;
+			grid.build(job->atoms);
+			job->sasa.compute(job->atoms, grid, job->protein->getHierarchy());
+		}
+		catch (const std::exception &e)
+		{
+			job->error = e.what();
+		}
+		job->done = true;
+	});
+}
+
+void ProteinApp::updateSurface()
+{
+	if (!mPDB || !mShader || mRepresentation != SURFACE)
+	{
+		resetSurfaceMesh();
+		mSurfaceDirty = false;
+		mSurfaceStatus = "-";
+		return;
 	}
 
-	// Create and array Buffer to store all colors 
-	mInstanceColorVbo = gl::Vbo::create(GL_ARRAY_BUFFER, matColors.size() * sizeof(vec3), matColors.data(), GL_STATIC_DRAW);
+	// Picked up by the next job, see updateSurfaceJob
+	mSurfaceDirty = true;
+	if (!mSurfaceBatch) mSurfaceStatus = "building";
+}
 
-	// Setup the buffer to contain space for all vec. Each vec needs 3 floats
-	geom::BufferLayout instanceColorDataLayout;
-	instanceColorDataLayout.append(geom::Attrib::CUSTOM_1, 3, sizeof(vec3), 0, 1);
+void ProteinApp::updateSurfaceJob()
+{
+	// A finished mesh is swapped in while it still belongs to what is shown
+	if (mSurfaceJob && mSurfaceJob->done)
+	{
+		SurfaceJobRef job = mSurfaceJob;
+		mSurfaceJob.reset();
+		if (!job->error.empty())
+		{
+			console() << "Could not build the surface: " << job->error << std::endl;
+			mSurfaceStatus = "failed";
+		}
+		else if (job->protein == mPDB && mRepresentation == SURFACE && (job->changed || !mSurfaceBatch)) createSurfaceMesh(mPDB->getSurface());
+	}
 
-	// Add buffer to mesh and create batch
-	mVboMesh->appendVbo(instanceColorDataLayout, mInstanceColorVbo);
+	// One job at a time; positions that change meanwhile go into the next one
+	if (mSurfaceJob || !mSurfaceDirty) return;
+	mSurfaceDirty = false;
 
+	SurfaceJobRef job(new SurfaceJob());
+	job->protein = mPDB;
+	job->atoms = mPDB->getAtoms();
+	job->changed = false;
+	job->done = false;
+	mSurfaceJob = job;
+	utils::ThreadPool::get().submit([job]()
+	{
+		try
+		{
+			job->changed = job->protein->updateSurface(job->atoms);
+		}
+		catch (const std::exception &e)
+		{
+			job->error = e.what();
+		}
+		job->done = true;
+	});
+}
 
-	// ---------------------------------------------
-	// Create BATCH
-	// ---------------------------------------------
-	mBatch = gl::Batch::create(mVboMesh, mShader, { {geom::CUSTOM_1, "iColor"} , { geom::CUSTOM_0, "iModelMatrix" } });
-	mBatchTest = gl::Batch::create(mVboMesh, mShaderTest, { { geom::CUSTOM_1, "iColor" } ,{ geom::CUSTOM_0, "iModelMatrix" } });
+void ProteinApp::resetSurfaceMesh()
+{
+	// Representation or surface changed; the light pass follows
+	mDepthMapDirty = true;
+
+	mSurfaceBatch.reset();
+	mDepthSurfaceBatch.reset();
+	mSurfaceMesh.reset();
+	mSurfaceColorVbo.reset();
+	mSurfaceVertexAtoms.clear();
 }
 
-void ProteinApp::renderToFBO()
+void ProteinApp::createSurfaceMesh(const pdb::Surface &surface)
 {
-	mFboDepthMap->bindFramebuffer();
-	// clear out the FBO with blue
-	gl::clear(Color(0.0, 0.0f, 0.0f));
+	resetSurfaceMesh();
+	if (surface.empty())
+	{
+		mSurfaceStatus = "empty";
+		return;
+	}
+
+	// Positions and normals are rewritten on every update; the vertex count changes with them
+	const size_t numVertices = surface.getNumVertices();
+	gl::VboRef positionVbo = gl::Vbo::create(GL_ARRAY_BUFFER, numVertices * sizeof(vec3), surface.getPositions(), GL_DYNAMIC_DRAW);
+	gl::VboRef normalVbo = gl::Vbo::create(GL_ARRAY_BUFFER, numVertices * sizeof(vec3), surface.getNormals(), GL_DYNAMIC_DRAW);
+	gl::VboRef indexVbo = gl::Vbo::create(GL_ELEMENT_ARRAY_BUFFER, surface.getNumIndices() * sizeof(uint32_t), surface.getIndices(), GL_DYNAMIC_DRAW);
+	mSurfaceColorVbo = gl::Vbo::create(GL_ARRAY_BUFFER, numVertices * sizeof(uint32_t), nullptr, GL_DYNAMIC_DRAW);
+	// The sphere shader scales the mesh by the diameter: radius 0.5 at the origin
+	const vec4 identity(0.0f, 0.0f, 0.0f, 0.5f);
+	gl::VboRef instanceVbo = gl::Vbo::create(GL_ARRAY_BUFFER, sizeof(vec4), &identity, GL_STATIC_DRAW);
+
+	geom::BufferLayout positionLayout;
+	positionLayout.append(geom::Attrib::POSITION, 3, sizeof(vec3), 0);
+	geom::BufferLayout normalLayout;
+	normalLayout.append(geom::Attrib::NORMAL, 3, sizeof(vec3), 0);
+	geom::BufferLayout colorLayout;
+	colorLayout.append(geom::Attrib::CUSTOM_1, geom::DataType::INTEGER, 1, sizeof(uint32_t), 0, 0 /* per vertex */);
+	geom::BufferLayout instanceLayout;
+	instanceLayout.append(geom::Attrib::CUSTOM_0, 4, sizeof(vec4), 0, 1 /* per instance */);
+
+	mSurfaceMesh = gl::VboMesh::create((uint32_t)numVertices, GL_TRIANGLES,
+		{ { positionLayout, positionVbo }, { normalLayout, normalVbo }, { colorLayout, mSurfaceColorVbo }, { instanceLayout, instanceVbo } },
+		(uint32_t)surface.getNumIndices(), GL_UNSIGNED_INT, indexVbo);
+	mSurfaceBatch = gl::Batch::create(mSurfaceMesh, mShader, { { geom::CUSTOM_1, "iColor" } ,{ geom::CUSTOM_0, "iInstance" } });
+	if (mDepthShader) mDepthSurfaceBatch = gl::Batch::create(mSurfaceMesh, mDepthShader, { { geom::CUSTOM_0, "iInstance" } });
+	mSurfaceVertexAtoms.assign(surface.getVertexAtoms(), surface.getVertexAtoms() + numVertices);
+	uploadColors();
+
+	mSurfaceStatus = toString(surface.getNumIndices() / 3) + " triangles";
+}
+
+void ProteinApp::updateContactMap()
+{
+	mContactStatus = "-";
+	std::vector<uint32_t> rows;
+	if (mPDB && mShowContactMap) mPDB->getTraceAtoms(rows);
+	const size_t n = rows.size();
+	if (n == 0)
+	{
+		mContactTexture.reset();
+		mContactMap.clear();
+		if (mPDB && mShowContactMap) mContactStatus = "no atoms";
+		return;
+	}
 
-	// set viewport for this FBO
-	gl::ScopedViewport scpViewPort(ivec2(0.0f), mFboDepthMap->getSize());
+	// A texel per row up to the texture limit; larger maps bin several rows into a texel
+	GLint maxSize = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+	const size_t side = std::min(n, std::min((size_t)maxSize, kMaxContactMapSize));
+	std::vector<uint8_t> texels(side * side, 0);
+	size_t numContacts = 0;
+	if (n == side && n <= kMaxDenseContactRows)
+	{
+		// Contacts white, then gray fading out at four cutoffs
+		mContactMap.computeDistances(mPDB->getAtoms(), rows);
+		const float *distances = mContactMap.getDistances();
+		for (size_t i = 0; i < n * n; ++i)
+		{
+			const float distance = distances[i];
+			if (distance < mContactCutoff)
+			{
+				texels[i] = 255;
+				++numContacts;
+			}
+			else texels[i] = (uint8_t)(160.0f * std::max(0.0f, 1.0f - distance / (4.0f * mContactCutoff)));
+		}
+		// Pairs off the diagonal, each counted once
+		numContacts = (numContacts - n) / 2;
+	}
+	else
+	{
+		// Too many rows for the dense matrix; contacts only, from the spatial grid. A texel is white if any pair
+		// it covers is in contact.
+		mContactMap.computeContacts(mPDB->getAtoms(), rows, mContactCutoff, &mPDB->getGrid());
+		for (const pdb::ContactMap::Contact &contact : mContactMap.getContacts())
+		{
+			const size_t i = (size_t)contact.first * side / n, j = (size_t)contact.second * side / n;
+			texels[i * side + j] = texels[j * side + i] = 255;
+		}
+		for (size_t i = 0; i < side; ++i) texels[i * side + i] = 255;
+		numContacts = mContactMap.getContacts().size();
+	}
 
-	// Set our matrices to Cam
-	gl::setMatrices(mLight.cam);
+	// The texture is kept while its size stays, e.g. from frame to frame
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	if (mContactTexture && mContactTexture->getWidth() == (int)side)
+		mContactTexture->update(texels.data(), GL_RED, GL_UNSIGNED_BYTE, 0, (int)side, (int)side);
+	else
+	{
+		gl::Texture2d::Format format;
+		format.setInternalFormat(GL_R8);
+		format.setSwizzleMask(GL_RED, GL_RED, GL_RED, GL_ONE);
+		format.setMinFilter(GL_LINEAR);
+		format.setMagFilter(GL_NEAREST);
+		mContactTexture = gl::Texture2d::create(texels.data(), GL_RED, (int)side, (int)side, format);
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 
-	// Render our cube
-	// Draw Instances
-	gl::pushModelMatrix();
-	if (mVboMesh && mShader && mInstanceDataVbo)
+	mContactStatus = toString(numContacts) + " in " + toString(n) + " residues";
+}
+
+Rectf ProteinApp::getContactMapArea() const
+{
+	const float size = std::min(getWindowWidth(), getWindowHeight()) / 3.0f;
+	return Rectf(0.0f, getWindowHeight() - size, size, (float)getWindowHeight());
+}
+
+bool ProteinApp::pickContact(const vec2 &position)
+{
+	if (!mContactTexture || !mPDB) return false;
+
+	const Rectf area = getContactMapArea();
+	if (!area.contains(position)) return false;
+
+	// Texel (i, j) of row i, column j; the texture rows go up
+	const size_t n = mContactMap.getNumRows();
+	const size_t j = std::min(n - 1, (size_t)((position.x - area.x1) / area.getWidth() * n));
+	const size_t i = std::min(n - 1, (size_t)((area.y2 - position.y) / area.getHeight() * n));
+
+	// Both residues of the pair become the selection
+	const uint32_t *residues = mPDB->getAtoms().getResidues();
+	const uint32_t first = residues[mContactMap.getRows()[i]], second = residues[mContactMap.getRows()[j]];
+	mPDB->select("none");
+	mPDB->selectResidue(first);
+	if (second != first) mPDB->selectResidue(second);
+	const pdb::AtomTable &atoms = mPDB->getAtoms();
+	const float apart = distance(atoms[mContactMap.getRows()[i]].getPosition(), atoms[mContactMap.getRows()[j]].getPosition());
+	mSelectionStatus = toString(mPDB->getSelection().count()) + " atoms, " + toString(apart) + " A apart";
+	mHighlightDirty = true;
+	return true;
+}
+
+void ProteinApp::drawContactMap()
+{
+	if (!mContactTexture) return;
+
+	const Rectf area = toPixels(getContactMapArea());
+	gl::draw(mContactTexture, area);
+
+	// Selected residues as lines through their row and column
+	const pdb::Selection &selection = mPDB->getSelection();
+	const std::vector<uint32_t> &rows = mContactMap.getRows();
+	const float scale = area.getWidth() / rows.size();
+	gl::VertBatch lines(GL_LINES);
+	lines.color(1.0f, 0.85f, 0.2f, 0.5f);
+	for (size_t k = 0; k < rows.size(); ++k)
 	{
-		// Number of Instances = number of atoms in pdb
-		unsigned int numOfAtoms = mPDB->getAtoms().size();
-		gl::scale(vec3(1.05f));
-		gl::ScopedGlslProg shader(mShader);
-		mBatch->drawInstanced(numOfAtoms);
+		if (rows[k] >= selection.size() || !selection.test(rows[k])) continue;
+		const float offset = (k + 0.5f) * scale;
+		lines.vertex(area.x1 + offset, area.y1);
+		lines.vertex(area.x1 + offset, area.y2);
+		lines.vertex(area.x1, area.y2 - offset);
+		lines.vertex(area.x2, area.y2 - offset);
 	}
-	gl::popModelMatrix();
+	gl::ScopedBlendAlpha blend;
+	lines.draw();
+}
 
-	// Unbind FBO
-	mFboDepthMap->unbindFramebuffer();
-}
-
-void ProteinApp::renderToTestFbo()
+void ProteinApp::applySelection()
+{
+	try
+	{
+		if (mSelectionQuery.empty())	mPDB->select("none");
+		else				mPDB->select(mSelectionQuery);
+		mSelectionStatus = toString(mPDB->getSelection().count()) + " atoms";
+	}
+	catch (const std::exception &e)
+	{
+		mSelectionStatus = e.what();
+	}
+	mHighlightDirty = true;
+}
+
+void ProteinApp::updateHighlight()
+{
+	mHighlightDirty = false;
+	mHighlightBuffer->clear();
+	if (!mPDB || !mHighlightBatch) return;
+
+	// Gathering costs O(selected atoms); bits are visited word by word
+	const vec4 *instances = mInstances.instances->getData<vec4>();
+	const size_t numInstances = mInstances.instances->getCount();
+	mHighlightBuffer->resize(mPDB->getSelection().count());
+	vec4 *highlights = mHighlightBuffer->getData<vec4>();
+	size_t count = 0;
+	mPDB->getSelection().forEach([&](size_t row) { if (row < numInstances) highlights[count++] = instances[row]; });
+	mHighlightBuffer->resize(count);
+}
+
+void ProteinApp::updateModels()
 {
-	gl::ScopedFramebuffer scopedFbo(mFboTest);
-	gl::clear(Color::black());
+	if (!mPDB || mInstances.instances->empty() || mTrajectory) return;
 
-	// setup the viewport to match the dimensions of the FBO
-	gl::ScopedViewport scpVp(ivec2(0), mFboTest->getSize());
+	const int numModels = (int)mPDB->getNumModels();
+	if (numModels <= 1) return;
 
-	gl::setMatrices(mCamera);
+	if (mModelAnimated && getElapsedSeconds() - mModelTime >= 1.0 / mModelsPerSecond)
+	{
+		mModel = (mModel + 1) % numModels;
+		mModelTime = getElapsedSeconds();
+	}
 
-	// render the color cube
-	gl::pushModelMatrix();
-	if (mVboMesh && mShader && mInstanceDataVbo)
-	{
-		// Number of Instances = number of atoms in pdb
-		unsigned int numOfAtoms = mPDB->getAtoms().size();
-		gl::scale(vec3(1.05f));
-		gl::ScopedGlslProg shader(mShaderTest);
-		mBatchTest->drawInstanced(numOfAtoms);
-	}
-	gl::popModelMatrix();
+	mModel = glm::clamp(mModel, 0, numModels - 1);
+	if ((size_t)mModel != mPDB->getCurrentModel()) showModel(mModel);
 }
 
-bool ProteinApp::pickByColor(const ivec2 & position)
+void ProteinApp::alignModels()
 {
-	if (!mFboTest) return false;
-
-	// first, specify a small region around the current cursor position 
-	float scaleX = mFboTest->getWidth() / (float)getWindowWidth();
-	float scaleY = mFboTest->getHeight() / (float)getWindowHeight();
-	ivec2 pixel((int)(position.x * scaleX), (int)((getWindowHeight() - position.y) * scaleY));
-	Area area(pixel.x - 2, pixel.y - 2, pixel.x + 2, pixel.y + 2);
-
-	// next, we need to copy this region to a non-anti-aliased framebuffer
-	//  because sadly we can not sample colors from an anti-aliased one. However,
-	//  this also simplifies the glReadPixels statement, so no harm done.
-	//  Here, we create that non-AA buffer if it does not yet exist.
-	if (!mFboTestPicking) {
-		gl::Fbo::Format fmt;
+	if (!mPDB || mInstances.instances->empty() || mTrajectory || mPDB->getNumModels() <= 1) return;
 
-		// make sure the framebuffer is not anti-aliased
-		fmt.setSamples(0);
-		fmt.setCoverageSamples(0);
+	mPDB->alignModels(mPDB->getCurrentModel());
+	std::vector<float> rmsds;
+	mPDB->computeModelRmsds(rmsds);
 
-		mFboTestPicking = gl::Fbo::create(area.getWidth(), area.getHeight(), fmt.colorTexture());
+	const size_t numModels = mPDB->getNumModels();
+	double total = 0.0;
+	float largest = 0.0f;
+	for (size_t i = 0; i < numModels; ++i)
+	for (size_t j = i + 1; j < numModels; ++j)
+	{
+		total += rmsds[i * numModels + j];
+		largest = std::max(largest, rmsds[i * numModels + j]);
 	}
+	const double mean = total / (numModels * (numModels - 1) / 2);
+	mModelRmsdStatus = toString(std::round(mean * 100.0) / 100.0) + " / " + toString(std::round(largest * 100.0f) / 100.0f) + " A";
 
-	// (Cinder does not yet provide a way to handle multiple color targets in the blitTo function, 
-	//  so we have to make sure the correct target is selected before calling it)
-	glBindFramebufferEXT(GL_READ_FRAMEBUFFER_EXT, mFboTest->getId());
-	glBindFramebufferEXT(GL_DRAW_FRAMEBUFFER_EXT, mFboTestPicking->getId());
-	glReadBuffer(GL_COLOR_ATTACHMENT0_EXT);
-	glDrawBuffer(GL_COLOR_ATTACHMENT0_EXT);
-
-	mFboTest->blitTo(mFboTestPicking, area, mFboTestPicking->getBounds());
-
-	// bind the picking framebuffer, so we can read its pixels
-	mFboTestPicking->bindFramebuffer();
+	// The shown model moved too
+	showModel(mModel);
+}
 
-	// read pixel value(s) in the area
-	GLubyte buffer[400]; // make sure this is large enough to hold 4 bytes for every pixel!
+void ProteinApp::showModel(int model)
+{
+	if (!mPDB->setModel(model)) return;
 
-	glReadBuffer(GL_COLOR_ATTACHMENT0_EXT);
-	glReadPixels(0, 0, mFboTestPicking->getWidth(), mFboTestPicking->getHeight(), GL_RGBA, GL_UNSIGNED_BYTE, (void*)buffer);
+	// Topology, radii and colors are shared by all models; only centers change
+	const glm::vec3 *positions = mPDB->getModelPositions(model);
+	vec4 *instances = mInstances.instances->getData<vec4>();
+	for (size_t i = 0; i < mInstances.instances->getCount(); ++i)
+		instances[i] = vec4(positions[i], instances[i].w);
+	mInstances.instances->markAllDirty();
+	mHighlightDirty = true;
 
-	// unbind the picking framebuffer
-	mFboTestPicking->unbindFramebuffer();
+	// Surface areas depend on the positions; the SASA colors follow in updateSasaColors
+	if (mRepresentation == SURFACE) updateSurface();
+	if (mShowContactMap) updateContactMap();
+}
 
-	// calculate the total number of pixels
-	unsigned int total = (mFboTestPicking->getWidth() * mFboTestPicking->getHeight());
+void ProteinApp::startTrajectory(const fs::path &file)
+{
+	if (!mPDB || mInstances.instances->empty() || mLoadJob)
+	{
+		console() << "Load a structure before its trajectory " << file.filename() << std::endl;
+		return;
+	}
+
+	stopTrajectory();
+
+	try
+	{
+		pdb::TrajectoryReaderRef reader = pdb::TrajectoryReader::create(file);
+		if (reader->getNumAtoms() != mInstances.instances->getCount())
+		{
+			console() << file.filename() << " has " << reader->getNumAtoms() << " atoms, the structure has " << mInstances.instances->getCount() << std::endl;
+			return;
+		}
+
+		// Frames are centered the same way as the topology
+		mTrajectory = std::make_shared<pdb::TrajectoryPlayer>(reader, mPDB->getBoundingBoxMatrix());
+	}
+	catch (const std::exception &e)
+	{
+		console() << "Could not open trajectory " << file.filename() << ": " << e.what() << std::endl;
+		return;
+	}
+
+	mFrameTime = getElapsedSeconds();
+	mLoadStatus = "playing " + file.filename().string();
+}
+
+void ProteinApp::updateTrajectory()
+{
+	if (!mTrajectory) return;
+
+	mDecodeFps = mTrajectory->getDecodeFps();
+	if (mTrajectory->hasFailed()) mLoadStatus = "trajectory stopped, malformed frame";
+
+	if (!mTrajectoryPlaying || getElapsedSeconds() - mFrameTime < 1.0 / mFramesPerSecond) return;
+
+	// The decoder has not caught up; keep showing the current frame
+	const std::vector<vec3> *positions = mTrajectory->front();
+	if (!positions) return;
+	mFrameTime = getElapsedSeconds();
+
+	// Only centers change, all of them: the upload orphans the buffer rather than waiting for the previous frame
+	vec4 *instances = mInstances.instances->getData<vec4>();
+	for (size_t i = 0; i < mInstances.instances->getCount(); ++i)
+		instances[i] = vec4((*positions)[i], instances[i].w);
+	mInstances.instances->markAllDirty();
+	// The atoms and their spatial index follow the frame, so queries see what is drawn
+	mPDB->setPositions(positions->data());
+	if (mRepresentation == SURFACE) updateSurface();
+	if (mShowContactMap) updateContactMap();
+	mTrajectory->pop();
+	mTrajectoryFrame = (int)mTrajectory->getFrameIndex();
+	mHighlightDirty = true;
+}
+
+void ProteinApp::stopTrajectory()
+{
+	mTrajectory.reset();
+	mTrajectoryFrame = 0;
+	mDecodeFps = 0.0f;
+}
+
+void ProteinApp::createDepthMap()
+{
+	const GLsizei size_of_map = 512 << glm::clamp(mDepthMapResolution, 0, 3);
+	gl::Fbo::Format format;
+	format.disableColor();
+	mFboDepthMap = gl::Fbo::create(size_of_map, size_of_map, format.depthTexture());
+	//mFboDepthMap->getDepthTexture()->setCompareMode(GL_COMPARE_REF_TO_TEXTURE);
+	mDepthMapDirty = true;
+}
+
+void ProteinApp::renderToFBO()
+{
+	// The map stays valid while the light and the atoms stand still (a static light costs nothing)
+	const mat4 lightViewProjection = mLight.cam.getProjectionMatrix() * mLight.cam.getViewMatrix();
+	const size_t uploads = mInstances.instances->getUploadedBytes();
+	if (!mDepthMapDirty && lightViewProjection == mDepthMapViewProjection && uploads == mDepthMapUploads) return;
+	mDepthMapDirty = false;
+	mDepthMapViewProjection = lightViewProjection;
+	mDepthMapUploads = uploads;
+	++mDepthMapPasses;
+
+	gl::ScopedFramebuffer scopedFbo(mFboDepthMap);
+	gl::clear(GL_DEPTH_BUFFER_BIT);
+
+	// set viewport for this FBO
+	gl::ScopedViewport scpViewPort(ivec2(0.0f), mFboDepthMap->getSize());
+
+	// Set our matrices to Cam
+	gl::setMatrices(mLight.cam);
+
+	// Draw Instances, depth only
+	gl::pushModelMatrix();
+	if (mInstances.depthBatch && hasInstances())
+	{
+		// Number of Instances = number of atoms in pdb
+		unsigned int numOfAtoms = (unsigned int)mInstances.instances->getCount();
+		gl::scale(vec3(1.05f));
+		if (mSurfaceBatch)	{ if (mDepthSurfaceBatch) mDepthSurfaceBatch->drawInstanced(1); }
+		else if (mRepresentation == IMPOSTORS && mInstances.depthImpostorBatch)	mInstances.depthImpostorBatch->drawInstanced(numOfAtoms);
+		else				mInstances.depthBatch->drawInstanced(numOfAtoms);
+	}
+	gl::popModelMatrix();
+}
 
-	// now that we have the color information, count each occuring color
-	unsigned int color;
+void ProteinApp::requestPick(const Rectf &area, int tag)
+{
+	if (!mPickBuffer || !hasInstances()) return;
 
-	std::map<unsigned int, unsigned int> occurences;
-	for (size_t i = 0; i < total; ++i) {
-		color = utils::charToInt(buffer[(i * 4) + 0], buffer[(i * 4) + 1], buffer[(i * 4) + 2]); // Here is the problem
-		occurences[color]++;
-	}
+	// Buffer pixels have their origin in the lower left
+	const Rectf pixels = toPixels(area.canonicalized());
+	const int height = mPickBuffer->getSize().y;
+	mPickBuffer->request(Area((int)std::floor(pixels.x1), height - (int)std::ceil(pixels.y2), (int)std::ceil(pixels.x2), height - (int)std::floor(pixels.y1)), tag);
+}
 
-	// find the most occuring color by calling std::max_element using a custom comparator.
-	unsigned int max = 0;
+void ProteinApp::renderPickBuffer()
+{
+	if (!mPickBuffer || !mInstances.pickBatch || !mPickBuffer->hasRequests()) return;
 
-	auto itr = std::max_element(
-		occurences.begin(), occurences.end(),
-		[](const std::pair<unsigned int, unsigned int> &a, const std::pair<unsigned int, unsigned int> &b) {
-		return a.second < b.second;
+	// Every representation picks by the spheres of the atoms
+	mPickBuffer->render([this]()
+	{
+		gl::ScopedMatrices matrices;
+		gl::setMatrices(mCamera);
+		if (hasInstances()) mInstances.pickBatch->drawInstanced((GLsizei)mInstances.instances->getCount());
 	});
+}
 
-	if (itr != occurences.end()) {
-		color = itr->first;
-		max = itr->second;
-	}
+void ProteinApp::applyPicks()
+{
+	utils::PickBuffer::Result result;
+	while (mPickBuffer && mPickBuffer->poll(result))
+	{
+		// Ids are rows + 1; a structure swapped in since the request may have fewer atoms
+		const size_t numAtoms = mPDB ? mPDB->getAtoms().size() : 0;
+		const int width = result.area.getWidth(), height = result.area.getHeight();
+		const uint32_t center = result.ids[(height / 2) * width + width / 2];
+
+		switch (result.tag)
+		{
+		case PICK_HOVER:
+		{
+			mHoverAtom = (center > 0 && center <= numAtoms) ? (int)center - 1 : -1;
+			mHoverStatus = "-";
+			if (mHoverAtom >= 0)
+			{
+				const pdb::AtomTable &atoms = mPDB->getAtoms();
+				const pdb::Hierarchy &hierarchy = mPDB->getHierarchy();
+				const uint32_t residue = atoms.getResidues()[mHoverAtom];
+				mHoverStatus = pdb::unpackName(atoms.getNames()[mHoverAtom]) + " " + pdb::unpackName(hierarchy.getResidueName(residue)) + " "
+					+ toString(hierarchy.getResidueNumber(residue)) + " " + pdb::unpackName(hierarchy.getChainId(atoms.getChains()[mHoverAtom]));
+			}
+			break;
+		}
+		case PICK_CLICK:
+		{
+			// The atom under the cursor, else the one drawn closest to it
+			uint32_t id = center;
+			int nearest = width * width + height * height;
+			for (int y = 0; y < height && center == 0; ++y)
+				for (int x = 0; x < width; ++x)
+				{
+					const int distance = (x - width / 2) * (x - width / 2) + (y - height / 2) * (y - height / 2);
+					if (result.ids[y * width + x] != 0 && distance < nearest)
+					{
+						id = result.ids[y * width + x];
+						nearest = distance;
+					}
+				}
+			if (id == 0 || id > numAtoms) break;
 
-	if (max >= (total / 2)) {
-		int index = (color - 1);
-		if (mPDB->getAtoms()[index] != nullptr)
+			mPDB->select((int)id - 1);
+			mSelectionStatus = toString(mPDB->getSelection().count()) + " atoms";
+			mHighlightDirty = true;
+			break;
+		}
+		case PICK_AREA:
 		{
-			if (mPicked.find(index) == mPicked.end())
-				mPicked.insert(make_pair(index, true));
-			else
-				mPicked.find(index)->second = !mPicked.find(index)->second;
-			return true;
-		}		
+			std::vector<uint32_t> rows;
+			for (uint32_t id : result.ids)
+				if (id > 0 && id <= numAtoms) rows.push_back(id - 1);
+			std::sort(rows.begin(), rows.end());
+			rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+			mPDB->select(rows);
+			mSelectionStatus = toString(mPDB->getSelection().count()) + " atoms";
+			mHighlightDirty = true;
+			break;
+		}
+		}
 	}
 }
 
 void ProteinApp::mouseMove(MouseEvent event)
 {
+	requestPick(Rectf(vec2(event.getPos()), vec2(event.getPos()) + vec2(1.0f)), PICK_HOVER);
 }
 
 void ProteinApp::mouseDown(MouseEvent event)
 {
-	if (event.isShiftDown())
-		pickByColor(ivec2(event.getX(), event.getY()));
-	else
+	if (event.isShiftDown() || event.isAltDown())
+	{
+		mMarqueeActive = true;
+		mMarqueeVisible = !event.isShiftDown();
+		mMarqueeStart = mMarqueeEnd = vec2(event.getPos());
+	}
+	else if (!pickContact(vec2(event.getPos())))
 		mCameraUi.mouseDown(event);
 }
 
 void ProteinApp::mouseDrag(MouseEvent event)
 {
-	if(!event.isShiftDown()) mCameraUi.mouseDrag(event);
+	if (mMarqueeActive)		mMarqueeEnd = vec2(event.getPos());
+	else if (!event.isAltDown())	mCameraUi.mouseDrag(event);
 }
 
 void ProteinApp::mouseUp(MouseEvent event)
 {
+	if (!mMarqueeActive) return;
+	mMarqueeActive = false;
+
+	// A click picks the atom under the cursor, a drag selects everything inside the rectangle;
+	// with alt both come from the id buffer, so hidden atoms stay out
+	const bool click = glm::length(mMarqueeEnd - mMarqueeStart) < 4.0f;
+	if (mMarqueeVisible)
+		requestPick(click ? Rectf(mMarqueeEnd - vec2(2.0f), mMarqueeEnd + vec2(3.0f)) : Rectf(mMarqueeStart, mMarqueeEnd).canonicalized(), click ? PICK_CLICK : PICK_AREA);
+	else if (click)
+		performPicking(mMarqueeEnd.x, mMarqueeEnd.y);
+	else
+		selectMarquee(Rectf(mMarqueeStart, mMarqueeEnd).canonicalized());
 }
 
 void ProteinApp::keyDown(KeyEvent event)
@@ -0,0 +1,154 @@
+/*
+	Times covalent bond perception on a large structure: copies of a PDB file (4hhb by default) tiled on a
+	lattice up to about a million atoms, far enough apart that no bond crosses copies. Reports the spatial
+	grid build, BondTable::perceive and the merge into the adjacency it ends with, and checks that every copy
+	got the bonds of a single one. Not part of the app; build it on its own:
+
+		g++ -O2 -std=c++17 -pthread -I include -I include/Protein -I <cinder>/include include/Common/ThreadPool.cpp include/Common/Simd.cpp include/Protein/AtomTable.cpp include/Protein/Element.cpp include/Protein/PdbParser.cpp include/Protein/SpatialGrid.cpp include/Protein/BondTable.cpp tools/BondBenchmark.cpp
+
+	Usage: BondBenchmark [file] [atoms] (default proteins/4hhb.pdb, 1000000); prints milliseconds.
+*/
+
+#include "Protein/PdbParser.h"
+#include "Protein/AtomTable.h"
+#include "Protein/SpatialGrid.h"
+#include "Protein/BondTable.h"
+#include "Common/ThreadPool.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <string>
+#include <vector>
+
+using namespace pdb;
+
+// ---------------------------------------------------------------------
+
+// Milliseconds per call of fn, the best of a few rounds
+template<typename Fn>
+static double measure(Fn fn)
+{
+	const int kRounds = 3;
+	double best = std::numeric_limits<double>::max();
+	for (int round = 0; round < kRounds; ++round)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		fn();
+		const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+		best = std::min(best, elapsed.count());
+	}
+	return best;
+}
+
+// Opens the merge step perceive ends with
+class MergeTable : public BondTable
+{
+public:
+	using BondTable::merge;
+};
+
+// Positions and elements of the first model of a PDB file
+static bool loadRecords(const char *path, std::vector<parser::AtomRecord> &records)
+{
+	std::ifstream stream(path, std::ios::binary);
+	const std::string data((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+
+	parser::LineReader reader(data);
+	std::string_view line;
+	parser::AtomRecord record;
+	while (reader.next(line))
+	{
+		if (parser::startsWith(line, "ENDMDL")) break;
+		if (parser::parseAtomRecord(line, record)) records.push_back(record);
+	}
+	return !records.empty();
+}
+
+// ---------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+	const char *path = argc > 1 ? argv[1] : "proteins/4hhb.pdb";
+	const size_t target = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000000;
+
+	std::vector<parser::AtomRecord> records;
+	if (!loadRecords(path, records) || target == 0)
+	{
+		std::printf("could not read %s\n", path);
+		return 1;
+	}
+
+	// Copies on a cubic lattice, 10 A apart
+	glm::vec3 lower(std::numeric_limits<float>::max()), upper(std::numeric_limits<float>::lowest());
+	for (const parser::AtomRecord &record : records)
+	{
+		lower = glm::min(lower, record.position);
+		upper = glm::max(upper, record.position);
+	}
+	const glm::vec3 step = upper - lower + glm::vec3(10.0f);
+	const size_t numCopies = (target + records.size() - 1) / records.size();
+	const size_t side = (size_t)std::ceil(std::cbrt((double)numCopies));
+
+	AtomTable atoms;
+	atoms.resize(numCopies * records.size());
+	for (size_t copy = 0; copy < numCopies; ++copy)
+	{
+		const glm::vec3 offset = step * glm::vec3(float(copy % side), float(copy / side % side), float(copy / side / side));
+		for (size_t i = 0; i < records.size(); ++i)
+		{
+			const size_t row = copy * records.size() + i;
+			atoms.setPosition(row, records[i].position + offset);
+			atoms.setElement(row, records[i].element);
+		}
+	}
+
+	// A single copy for the reference count
+	AtomTable single;
+	single.resize(records.size());
+	for (size_t i = 0; i < records.size(); ++i)
+	{
+		single.setPosition(i, records[i].position);
+		single.setElement(i, records[i].element);
+	}
+	SpatialGrid singleGrid;
+	singleGrid.build(single);
+	BondTable singleBonds;
+	singleBonds.perceive(single, singleGrid);
+
+	std::printf("%s x %zu = %zu atoms, %zu threads\n", path, numCopies, atoms.size(), utils::ThreadPool::get().getNumThreads());
+
+	SpatialGrid grid;
+	const double gridMs = measure([&]() { grid.build(atoms); });
+
+	BondTable bonds;
+	const double perceiveMs = measure([&]() { bonds = BondTable(); bonds.perceive(atoms, grid); });
+
+	// The pairs perceive hands to merge, merged on their own
+	std::vector<Bond> pairs;
+	pairs.reserve(bonds.getNumBonds());
+	bonds.forEachBond([&](uint32_t first, uint32_t second) { pairs.emplace_back(first, second); });
+	const double mergeMs = measure([&]()
+	{
+		std::vector<Bond> copy(pairs);
+		MergeTable table;
+		table.merge(atoms.size(), copy);
+	});
+
+	std::printf("%-12s %10s\n", "", "ms");
+	std::printf("%-12s %10.1f\n", "grid build", gridMs);
+	std::printf("%-12s %10.1f\n", "perceive", perceiveMs);
+	std::printf("%-12s %10.1f  (part of perceive)\n", "merge", mergeMs);
+	std::printf("%zu bonds, %zu per copy\n", bonds.getNumBonds(), singleBonds.getNumBonds());
+
+	if (bonds.getNumBonds() != numCopies * singleBonds.getNumBonds())
+	{
+		std::printf("copies differ from a single one\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,146 @@
+/*
+	Times the PDB record parser (parser::parseAtomRecord over a LineReader) next to the split / substr /
+	lexical_cast loop it replaced, on whole files, and counts the records the loop read differently. Not part
+	of the app; build it on its own:
+
+		g++ -O2 -std=c++17 -I include -I include/Protein -I <cinder>/include -I <boost> include/Protein/PdbParser.cpp include/Protein/Element.cpp tools/ParserBenchmark.cpp
+
+	Usage: ParserBenchmark [files] (default: the .pdb files in proteins); prints MB/s, single threaded.
+*/
+
+#include "Protein/PdbParser.h"
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <string>
+#include <vector>
+
+using namespace pdb;
+
+// ---------------------------------------------------------------------
+
+// Milliseconds per call of fn, the best of a few rounds
+template<typename Fn>
+static double measure(Fn fn)
+{
+	const int kRounds = 5, kCalls = 5;
+	double best = std::numeric_limits<double>::max();
+	for (int round = 0; round < kRounds; ++round)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		for (int call = 0; call < kCalls; ++call) fn();
+		const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+		best = std::min(best, elapsed.count() / kCalls);
+	}
+	return best;
+}
+
+// Keeps the compiler from dropping fields the loop reads but does not store
+static volatile size_t sink = 0;
+
+/*
+	Reference loop, as Protein::loadProtein had it before the parser: ci::split (boost::split with compressed
+	separators) into line copies, then substr, trim_copy and lexical_cast per field. It read 7 of the 8
+	characters of every coordinate: positions lose the last decimal, and in files with shifted columns (2ex3)
+	a second one or the sign. Lines it can not read are skipped here rather than failing the whole file.
+*/
+
+static size_t parseLoop(const std::string &data, std::vector<glm::vec3> &positions)
+{
+	positions.clear();
+	std::vector<std::string> lines;
+	boost::split(lines, data, boost::is_any_of("\n\r"), boost::token_compress_on);
+
+	size_t failed = 0;
+	for (size_t i = 0; i < lines.size(); ++i)
+	{
+		if (lines[i].substr(0, 4) != "ATOM") continue;
+		try
+		{
+			const int id = boost::lexical_cast<int>(boost::trim_copy(lines[i].substr(6, 5)));
+			glm::vec3 position;
+			position.x = boost::lexical_cast<float>(boost::trim_copy(lines[i].substr(30, 7)));
+			position.y = boost::lexical_cast<float>(boost::trim_copy(lines[i].substr(38, 7)));
+			position.z = boost::lexical_cast<float>(boost::trim_copy(lines[i].substr(46, 7)));
+			const std::string name = lines[i].substr(77, 1);
+			positions.push_back(position);
+			sink = id + name.size();
+		}
+		catch (const std::exception&)
+		{
+			++failed;
+			positions.push_back(glm::vec3(std::numeric_limits<float>::quiet_NaN()));
+		}
+	}
+	return failed;
+}
+
+// The parser on the same text; ATOM records only, like the loop
+static void parseRecords(const std::string &data, std::vector<glm::vec3> &positions)
+{
+	positions.clear();
+	parser::LineReader reader(data);
+	std::string_view line;
+	parser::AtomRecord record;
+	while (reader.next(line))
+	{
+		if (!parser::startsWith(line, "ATOM ") && !parser::startsWith(line, "ATOM\t")) continue;
+		if (parser::parseAtomRecord(line, record)) positions.push_back(record.position);
+	}
+}
+
+// ---------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+	std::vector<std::filesystem::path> files;
+	for (int i = 1; i < argc; ++i) files.emplace_back(argv[i]);
+	if (files.empty() && std::filesystem::is_directory("proteins"))
+	{
+		for (const std::filesystem::directory_entry &entry : std::filesystem::directory_iterator("proteins"))
+			if (entry.path().extension() == ".pdb") files.push_back(entry.path());
+		std::sort(files.begin(), files.end());
+	}
+	if (files.empty()) return 1;
+
+	std::printf("%-20s %8s %8s %10s %10s %8s\n", "", "MB", "atoms", "loop MB/s", "parser MB/s", "speedup");
+
+	double totalBytes = 0.0, totalLoopMs = 0.0, totalParserMs = 0.0;
+	for (const std::filesystem::path &file : files)
+	{
+		std::ifstream stream(file, std::ios::binary);
+		const std::string data((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+		if (data.empty()) continue;
+
+		std::vector<glm::vec3> loopPositions, parserPositions;
+		size_t failed = 0;
+		const double loopMs = measure([&]() { failed = parseLoop(data, loopPositions); });
+		const double parserMs = measure([&]() { parseRecords(data, parserPositions); });
+
+		// Beyond the dropped last decimal; records the loop could not read are counted apart
+		size_t misread = 0;
+		for (size_t i = 0; i < loopPositions.size() && i < parserPositions.size(); ++i)
+			if (!std::isnan(loopPositions[i].x) && glm::length(loopPositions[i] - parserPositions[i]) >= 0.018f) ++misread;
+
+		const double megabytes = data.size() / (1024.0 * 1024.0);
+		std::printf("%-20s %8.2f %8zu %10.1f %10.1f %7.1fx", file.filename().string().c_str(), megabytes, parserPositions.size(),
+			megabytes / (loopMs / 1000.0), megabytes / (parserMs / 1000.0), loopMs / parserMs);
+		if (failed > 0) std::printf("  loop failed on %zu", failed);
+		if (misread > 0) std::printf("  loop misread %zu", misread);
+		std::printf("\n");
+		totalBytes += data.size();
+		totalLoopMs += loopMs;
+		totalParserMs += parserMs;
+	}
+
+	const double megabytes = totalBytes / (1024.0 * 1024.0);
+	std::printf("%-20s %8.2f %8s %10.1f %10.1f %7.1fx\n", "total", megabytes, "", megabytes / (totalLoopMs / 1000.0), megabytes / (totalParserMs / 1000.0), totalLoopMs / totalParserMs);
+	return 0;
+}
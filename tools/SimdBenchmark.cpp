@@ -0,0 +1,153 @@
+/*
+	Times the coordinate kernels of Common/Simd at every level the processor supports, next to the plain
+	loops they replaced, and checks the results against those loops. Not part of the app; build it on its own:
+
+		g++ -O2 -std=c++17 -I include -I <cinder>/include include/Common/Simd.cpp tools/SimdBenchmark.cpp
+
+	Usage: SimdBenchmark [atoms] (default 1000000); prints milliseconds per call.
+*/
+
+#include "Common/Simd.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <vector>
+
+using namespace utils;
+
+// ---------------------------------------------------------------------
+
+// Milliseconds per call of fn, the best of a few rounds
+template<typename Fn>
+static double measure(Fn fn)
+{
+	const int kRounds = 5, kCalls = 10;
+	double best = std::numeric_limits<double>::max();
+	for (int round = 0; round < kRounds; ++round)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		for (int call = 0; call < kCalls; ++call) fn();
+		const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+		best = std::min(best, elapsed.count() / kCalls);
+	}
+	return best;
+}
+
+/*
+	Reference loops, as the callers had them before the kernels
+*/
+
+static void transformLoop(const glm::mat4 &m, float *x, float *y, float *z, size_t count)
+{
+	for (size_t i = 0; i < count; ++i)
+	{
+		const float px = x[i], py = y[i], pz = z[i];
+		x[i] = m[0][0] * px + m[1][0] * py + m[2][0] * pz + m[3][0];
+		y[i] = m[0][1] * px + m[1][1] * py + m[2][1] * pz + m[3][1];
+		z[i] = m[0][2] * px + m[1][2] * py + m[2][2] * pz + m[3][2];
+	}
+}
+
+static void boundsLoop(const float *x, const float *y, const float *z, size_t count, glm::vec3 &lower, glm::vec3 &upper)
+{
+	lower = glm::vec3(std::numeric_limits<float>::max());
+	upper = glm::vec3(std::numeric_limits<float>::lowest());
+	for (size_t i = 0; i < count; ++i)
+	{
+		lower.x = std::min(lower.x, x[i]);
+		upper.x = std::max(upper.x, x[i]);
+		lower.y = std::min(lower.y, y[i]);
+		upper.y = std::max(upper.y, y[i]);
+		lower.z = std::min(lower.z, z[i]);
+		upper.z = std::max(upper.z, z[i]);
+	}
+}
+
+static glm::dvec3 centroidLoop(const float *x, const float *y, const float *z, size_t count)
+{
+	glm::dvec3 sum(0.0);
+	for (size_t i = 0; i < count; ++i) sum += glm::dvec3(x[i], y[i], z[i]);
+	return sum / double(count);
+}
+
+// ---------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+	const size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+	if (count == 0) return 1;
+
+	std::mt19937 random(3);
+	std::uniform_real_distribution<float> coordinate(-200.0f, 200.0f), radius(1.0f, 2.0f);
+	std::vector<float> x(count), y(count), z(count), radii(count);
+	std::vector<glm::vec3> points(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		x[i] = coordinate(random);
+		y[i] = coordinate(random);
+		z[i] = coordinate(random);
+		radii[i] = radius(random);
+		points[i] = glm::vec3(x[i], y[i], z[i]);
+	}
+	// A rotation and a translation
+	const glm::mat4 matrix(glm::vec4(0.8f, 0.36f, -0.48f, 0.0f), glm::vec4(-0.36f, 0.928f, 0.096f, 0.0f), glm::vec4(0.48f, 0.096f, 0.872f, 0.0f), glm::vec4(1.5f, -2.0f, 3.0f, 1.0f));
+
+	// Results of the reference loops
+	std::vector<float> tx = x, ty = y, tz = z;
+	transformLoop(matrix, tx.data(), ty.data(), tz.data(), count);
+	glm::vec3 lower, upper;
+	boundsLoop(x.data(), y.data(), z.data(), count, lower, upper);
+	const glm::dvec3 centroid = centroidLoop(x.data(), y.data(), z.data(), count);
+
+	std::vector<float> cx, cy, cz;
+	std::vector<glm::vec3> cp;
+	std::vector<glm::vec4> instances(count);
+	// Keeps the compiler from dropping calls whose result is otherwise unused
+	volatile double sink = 0.0;
+	std::printf("%zu atoms, supported level %s\n", count, simd::getLevelName(simd::getSupportedLevel()));
+	std::printf("%-8s %10s %10s %10s %10s %10s\n", "", "transform", "vec3[]", "bounds", "instances", "centroid");
+
+	// Inputs are copied outside the timed calls; transforming the same data over and over is fine for timing
+	cx = x; cy = y; cz = z; cp = points;
+	std::printf("%-8s %10.3f %10.3f %10.3f %10.3f %10.3f\n", "loop",
+		measure([&]() { transformLoop(matrix, cx.data(), cy.data(), cz.data(), count); }),
+		measure([&]() { for (glm::vec3 &p : cp) p = glm::vec3(matrix * glm::vec4(p, 1.0f)); }),
+		measure([&]() { boundsLoop(x.data(), y.data(), z.data(), count, lower, upper); }),
+		measure([&]() { for (size_t i = 0; i < count; ++i) instances[i] = glm::vec4(x[i], y[i], z[i], radii[i] * 2.0f); }),
+		measure([&]() { sink = centroidLoop(x.data(), y.data(), z.data(), count).x; }));
+
+	bool matches = true;
+	for (int level = simd::SCALAR; level <= simd::getSupportedLevel(); ++level)
+	{
+		simd::setLevel(simd::Level(level));
+
+		cx = x; cy = y; cz = z; cp = points;
+		const double transformMs = measure([&]() { simd::transform(matrix, cx.data(), cy.data(), cz.data(), count); });
+		const double pointsMs = measure([&]() { simd::transform(matrix, cp.data(), count); });
+		glm::vec3 kernelLower, kernelUpper;
+		const double boundsMs = measure([&]() { simd::computeBounds(x.data(), y.data(), z.data(), count, kernelLower, kernelUpper); });
+		const double instancesMs = measure([&]() { simd::computeInstances(x.data(), y.data(), z.data(), radii.data(), 2.0f, count, instances.data()); });
+		glm::vec3 kernelCentroid;
+		const double centroidMs = measure([&]() { kernelCentroid = simd::computeCentroid(x.data(), y.data(), z.data(), count); });
+		std::printf("%-8s %10.3f %10.3f %10.3f %10.3f %10.3f\n", simd::getLevelName(simd::Level(level)), transformMs, pointsMs, boundsMs, instancesMs, centroidMs);
+
+		// One pass from the original data must match the reference bit for bit; the centroid to float precision
+		cx = x; cy = y; cz = z; cp = points;
+		simd::transform(matrix, cx.data(), cy.data(), cz.data(), count);
+		simd::transform(matrix, cp.data(), count);
+		bool same = cx == tx && cy == ty && cz == tz && kernelLower == lower && kernelUpper == upper;
+		for (size_t i = 0; i < count && same; ++i)
+			same = cp[i] == glm::vec3(tx[i], ty[i], tz[i]) && instances[i] == glm::vec4(x[i], y[i], z[i], radii[i] * 2.0f);
+		const double error = glm::length(glm::dvec3(kernelCentroid) - centroid) / std::max(glm::length(centroid), 1.0);
+		if (!same || error > 1e-6)
+		{
+			std::printf("%-8s differs from the loops (centroid error %.2g)\n", simd::getLevelName(simd::Level(level)), error);
+			matches = false;
+		}
+	}
+	return matches ? 0 : 1;
+}